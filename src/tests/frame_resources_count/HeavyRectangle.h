@@ -80,13 +80,13 @@ class HeavyRectangle final : public vulkan::shaderbuilder::VertexShaderInputSet<
   }
 
   // Returns the number of vertices that a single call to create_entry produce.
-  int next_batch() override
+  int entries_per_create_entry() const override
   {
     return batch_size;
   }
 
   // Fill the next batch_size VertexData objects.
-  void create_entry(VertexData* input_entry_ptr) override
+  void create_square(VertexData* input_entry_ptr)
   {
     for (int vertex = 0; vertex < batch_size; ++vertex)
     {
@@ -97,4 +97,16 @@ class HeavyRectangle final : public vulkan::shaderbuilder::VertexShaderInputSet<
     // Advance to the next square.
     if (++xy.x() == iside) { xy.x() = 0; ++xy.y(); }
   }
+
+  void create_entry(VertexData* input_entry_ptr) override
+  {
+    create_square(input_entry_ptr);
+  }
+
+  // Fill VertexData objects [begin, end> without a virtual call per square.
+  void create_entries(VertexData* input_entry_ptr, int begin, int end) override
+  {
+    for (int entry = begin; entry < end; entry += batch_size, input_entry_ptr += batch_size)
+      create_square(input_entry_ptr);
+  }
 };
@@ -11,7 +11,8 @@ LAYOUT_DECLARATION(PushConstant, push_constant_std430)
     MEMBER(Float, pc2),
     MEMBER(Float, aspect_scale),
     MEMBER(Float, pc4),
-    MEMBER(Float, pc5)
+    MEMBER(Float, pc5),
+    MEMBER(Uint, benchmark_texture_index)
   );
 };
 
@@ -23,6 +24,7 @@ struct PushConstant
   glsl::Float aspect_scale;
   glsl::Float pc4;
   glsl::Float pc5;
+  glsl::Uint benchmark_texture_index;           // The slot of the benchmark texture in the bindless texture table (if used).
 };
 
 static_assert(offsetof(PushConstant, aspect_scale) == std::tuple_element_t<2, decltype(vulkan::shaderbuilder::ShaderVariableLayouts<PushConstant>::struct_layout)::members_tuple>::offset,
@@ -4,6 +4,7 @@
 #include "SampleParameters.h"
 #include "vulkan/shaderbuilder/VertexShaderInputSet.h"
 #include <random>
+#include <cstdint>
 
 // Generate SampleParameters::s_max_object_count InstanceData objects.
 //
@@ -14,15 +15,41 @@
 class RandomPositions final : public vulkan::shaderbuilder::VertexShaderInputSet<InstanceData>
 {
   std::random_device m_random_device;
-  std::mt19937 m_generator;
-  std::uniform_real_distribution<float> m_distribution_xy;
-  std::uniform_real_distribution<float> m_distribution_z;
+  uint64_t const m_seed;
+  int m_next_index{};                   // The index of the InstanceData that create_entry fills next.
 
  public:
-  // Constructor. Initialize the random number generator and distributions.
-  RandomPositions() : m_generator(m_random_device()), m_distribution_xy(-1.0f, 1.0f), m_distribution_z(0.0f, 1.0f) { }
+  // Constructor. Initialize the seed of the random number generator.
+  RandomPositions() : m_seed(m_random_device()) { }
 
  private:
+  // Counter-based random number generator: the position of each InstanceData only depends on
+  // the seed and its index, so it doesn't matter how the objects are divided over threads.
+  // This is the finalizer of splitmix64, applied to the seed plus a counter.
+  static uint64_t random(uint64_t seed, uint64_t counter)
+  {
+    uint64_t z = seed + (counter + 1) * 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  // Returns a float in the range [0, 1> from the 24 most significant bits of a random number.
+  static float uniform(uint64_t bits)
+  {
+    return static_cast<float>(bits >> 40) * 0x1p-24f;
+  }
+
+  // Fill the InstanceData with index i.
+  void fill(InstanceData* input_entry_ptr, int i) const
+  {
+    uint64_t const counter = 3 * static_cast<uint64_t>(i);
+    input_entry_ptr->m_position[1] << 2.0f * uniform(random(m_seed, counter)) - 1.0f,
+                                   2.0f * uniform(random(m_seed, counter + 1)) - 1.0f,
+                                   uniform(random(m_seed, counter + 2)),
+                                   0.0f;                                // Homogeneous coordinates. This is used as an offset (a vector).
+  }
+
   // Returns the number of instances.
   int chunk_count() const override
   {
@@ -32,9 +59,19 @@ class RandomPositions final : public vulkan::shaderbuilder::VertexShaderInputSet
   // Fill the next batch_size InstanceData objects.
   void create_entry(InstanceData* input_entry_ptr) override
   {
-    input_entry_ptr->m_position[1] << m_distribution_xy(m_generator),
-                                   m_distribution_xy(m_generator),
-                                   m_distribution_z(m_generator),
-                                   0.0f;                                // Homogeneous coordinates. This is used as an offset (a vector).
+    fill(input_entry_ptr, m_next_index++);
+  }
+
+  // Allow CopyDataToGPU to generate the positions in parallel.
+  bool is_range_addressable() const override
+  {
+    return true;
+  }
+
+  // Fill InstanceData objects [begin, end>. This is called concurrently; each object only depends on its index.
+  void create_entries(InstanceData* input_entry_ptr, int begin, int end) override
+  {
+    for (int i = begin; i < end; ++i, ++input_entry_ptr)
+      fill(input_entry_ptr, i);
   }
 };
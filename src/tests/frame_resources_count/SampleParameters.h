@@ -4,24 +4,35 @@ struct SampleParameters
 {
   static constexpr int s_max_object_count = 3000;
   static constexpr int s_quad_tessellation = 300;
+  static constexpr int s_draw_lists = 16;                       // The number of parts that the objects are split into when recording with secondary command buffers.
+  static constexpr int s_scaling_benchmark_frames = 300;        // The number of frames measured per thread count by the scaling benchmark.
 
   int ObjectCount;
   int PreSubmitCpuWorkTime;
   int PostSubmitCpuWorkTime;
   int SwapchainCount;
   int FrameResourcesCount;
+  int RecordingThreads;                 // 0: record everything into the primary command buffer, otherwise the number of threads that record secondary command buffers.
   float m_frame_generation_time;
   float m_total_frame_time;
+  float m_recording_time;
   bool m_show_fps = true;
 
+  // Scaling benchmark.
+  int m_scaling_benchmark_threads = 0;  // The number of recording threads that are being measured, or 0 if the benchmark isn't running.
+  int m_scaling_benchmark_frame = 0;    // The number of frames measured with m_scaling_benchmark_threads so far.
+  float m_scaling_benchmark_time = 0;   // The sum of the recording times of those frames.
+
   SampleParameters() :
     ObjectCount(889),
     PreSubmitCpuWorkTime(4),
     PostSubmitCpuWorkTime(4),
     SwapchainCount(3),
     FrameResourcesCount(2),
+    RecordingThreads(0),
     m_frame_generation_time(0),
-    m_total_frame_time(0)
+    m_total_frame_time(0),
+    m_recording_time(0)
   {
   }
 };
@@ -6,12 +6,23 @@
 #include "SampleParameters.h"
 #include "FrameResourcesCount.h"
 #include "queues/CopyDataToBuffer.h"
+#include "queues/CopyDataToBufferRegions.h"
 #include "queues/CopyDataToImage.h"
+#include "queues/Defragment.h"
+#include "memory/BufferRelocator.h"
+#include "memory/ImageRelocator.h"
+#include "memory/DirtyRanges.h"
+#include "memory/GatherFeeder.h"
+#include "descriptor/BindlessTextures.h"
 #include "vulkan/SynchronousWindow.h"
 #include "vulkan/Pipeline.h"
 #include "vulkan/shaderbuilder/ShaderIndex.h"
-#include "vk_utils/ImageData.h"
+#include "vk_utils/ImageDecoder.h"
 #include <imgui.h>
+#include <iostream>
+#include <array>
+#include <random>
+#include <atomic>
 #include "debug.h"
 #include "tracy/CwTracy.h"
 #ifdef TRACY_ENABLE
@@ -28,6 +39,14 @@ class Window : public task::SynchronousWindow
  public:
   using task::SynchronousWindow::SynchronousWindow;
 
+ protected:
+  ~Window() override
+  {
+    // No frame uses the texture anymore; let its slot be reused.
+    if (m_use_bindless_textures && m_benchmark_texture.m_image_view)
+      logical_device()->bindless_textures().erase(m_benchmark_texture_index);
+  }
+
  private:
   // Additional image (view) kind.
 //  static vulkan::ImageKind const s_vector_image_kind;
@@ -47,12 +66,30 @@ class Window : public task::SynchronousWindow
   using vertex_buffers_container_type = std::vector<vulkan::memory::Buffer>;
   using vertex_buffers_type = aithreadsafe::Wrapper<vertex_buffers_container_type, aithreadsafe::policy::ReadWrite<AIReadWriteSpinLock>>;
   vertex_buffers_type m_vertex_buffers;
+  // Allow task::Defragment to move the vertex buffers (created the first time that defragmentation is requested).
+  std::vector<std::unique_ptr<vulkan::memory::BufferRelocator>> m_vertex_buffer_relocators;
+  bool m_defragmenting = false;
+  // Moving objects: partial updates of the instance buffer (see scatter_objects).
+  size_t m_instance_buffer_index{};                             // The index of the instance buffer in m_vertex_buffers.
+  std::vector<InstanceData> m_moved_instances;                  // Host copy of the instance buffer; only the instances that were moved are valid.
+  vulkan::DirtyRanges m_dirty_instances;                        // The parts of the instance buffer that must be uploaded.
+  std::mt19937 m_scatter_generator{std::random_device{}()};
+  std::atomic<bool> m_scattering = false;                       // Set while uploading m_dirty_instances.
 
  public: //FIXME: make this private again once 'FrameResourcesCountPipelineCharacteristic::initialize()' doesn't need it anymore.
   vulkan::Texture m_background_texture;
   vulkan::Texture m_benchmark_texture;
   vk::DescriptorSet m_vh_descriptor_set;        // The lifetime of this resource is entirely controlled by its pool: LogicalDevice::m_descriptor_pool.
+  // If the device supports it, the fragment shader samples m_benchmark_texture through the bindless texture table.
+  bool m_use_bindless_textures = false;
+  uint32_t m_benchmark_texture_index{};         // The slot of m_benchmark_texture in LogicalDevice::bindless_textures(), if m_use_bindless_textures.
  private:
+  // Allow task::Defragment to move m_benchmark_texture (only when it is accessed through the bindless texture table).
+  vk::ImageCreateInfo m_benchmark_image_create_info;
+  vulkan::ImageViewKind const* m_benchmark_image_view_kind{};
+  vk::UniqueImageView m_old_benchmark_image_view;               // The view of m_benchmark_texture before it was moved, while frames in flight might use it.
+  std::unique_ptr<vulkan::memory::ImageRelocator> m_benchmark_texture_relocator;
+
   vulkan::Pipeline m_graphics_pipeline;
 
   imgui::StatsWindow m_imgui_stats_window;
@@ -107,9 +144,15 @@ class Window : public task::SynchronousWindow
   {
     DoutEntering(dc::vulkan, "Window::create_textures() [" << this << "]");
 
+    // Decode both images in parallel, in the background; the background is needed first.
+    std::shared_ptr<vk_utils::stbi::DecodedImage> background_data =
+      m_application->image_decoder().decode(m_application->path_of(Directory::resources) / "textures/background.png", 4, 1);
+    std::shared_ptr<vk_utils::stbi::DecodedImage> sample_data =
+      m_application->image_decoder().decode(m_application->path_of(Directory::resources) / "textures/frame_resources.png", 4, 0);
+
     // Background texture.
     {
-      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/background.png", 4);
+      std::shared_ptr<vk_utils::stbi::DecodedImage> texture_data = std::move(background_data);
       // Create descriptor resources.
       {
         static vulkan::ImageKind const background_image_kind({
@@ -121,53 +164,60 @@ class Window : public task::SynchronousWindow
 
         m_background_texture =
           vulkan::Texture(m_logical_device,
-              texture_data.extent(), background_image_view_kind,
+              texture_data->extent(), background_image_view_kind,
               { .mipmapMode = vk::SamplerMipmapMode::eNearest,
                 .anisotropyEnable = VK_FALSE },
               graphics_settings(),
               { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
               COMMA_CWDEBUG_ONLY(debug_name_prefix("m_background_texture")));
 
-        auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, texture_data.size(),
-            m_background_texture.m_vh_image, texture_data.extent(), vk_defaults::ImageSubresourceRange{},
+        auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, texture_data->size(),
+            m_background_texture.m_vh_image, texture_data->extent(), vk_defaults::ImageSubresourceRange{},
             vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
             vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
             COMMA_CWDEBUG_ONLY(true));
 
         copy_data_to_image->set_resource_owner(this);   // Wait for this task to finish before destroying this window, because this window owns the texture (m_background_texture).
-        copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(texture_data)));
+        copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::stbi::DecodedImageFeeder>(std::move(texture_data)));
         copy_data_to_image->run(vulkan::Application::instance().low_priority_queue());
       }
     }
 
     // Sample texture.
     {
-      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/frame_resources.png", 4);
+      std::shared_ptr<vk_utils::stbi::DecodedImage> texture_data = std::move(sample_data);
       // Create descriptor resources.
       {
+        // Also a transfer source, so that task::Defragment can move it.
         static vulkan::ImageKind const sample_image_kind({
           .format = vk::Format::eR8G8B8A8Unorm,
-          .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+          .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
         });
 
         static vulkan::ImageViewKind const sample_image_view_kind(sample_image_kind, {});
 
         m_benchmark_texture = vulkan::Texture(m_logical_device,
-            texture_data.extent(), sample_image_view_kind,
+            texture_data->extent(), sample_image_view_kind,
             { .mipmapMode = vk::SamplerMipmapMode::eNearest,
               .anisotropyEnable = VK_FALSE },
             graphics_settings(),
             { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
             COMMA_CWDEBUG_ONLY(debug_name_prefix("m_benchmark_texture")));
+        m_benchmark_image_create_info = sample_image_kind(texture_data->extent());
+        m_benchmark_image_view_kind = &sample_image_view_kind;
 
-        auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, texture_data.size(),
-            m_benchmark_texture.m_vh_image, texture_data.extent(), vk_defaults::ImageSubresourceRange{},
+        // Sample the texture through the bindless texture table (see intel_bindless_frag_glsl).
+        if (m_use_bindless_textures)
+          m_benchmark_texture_index = logical_device()->bindless_textures().insert(*m_benchmark_texture.m_image_view, *m_benchmark_texture.m_sampler);
+
+        auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, texture_data->size(),
+            m_benchmark_texture.m_vh_image, texture_data->extent(), vk_defaults::ImageSubresourceRange{},
             vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
             vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
             COMMA_CWDEBUG_ONLY(true));
 
         copy_data_to_image->set_resource_owner(this);   // Wait for this task to finish before destroying this window, because this window owns the texture (m_benchmark_texture).
-        copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(texture_data)));
+        copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::stbi::DecodedImageFeeder>(std::move(texture_data)));
         copy_data_to_image->run(vulkan::Application::instance().low_priority_queue());
       }
     }
@@ -215,6 +265,26 @@ void main()
   vec4 benchmark_image = texture(u_Texture_benchmark, v_Texcoord);
   o_Color = v_Distance * mix(background_image, benchmark_image, benchmark_image.a);
 }
+)glsl";
+
+  // The same as intel_frag_glsl, but accessing the benchmark texture through the bindless texture table.
+  static constexpr std::string_view intel_bindless_frag_glsl = R"glsl(
+#extension GL_EXT_nonuniform_qualifier : require
+//FIXME: this should be generated.
+layout(set=0, binding=0) uniform sampler2D u_Texture_background;
+layout(set=1, binding=0) uniform sampler2D bindless_textures[];
+
+layout(location = 0) in vec2 v_Texcoord;
+layout(location = 1) in float v_Distance;
+
+layout(location = 0) out vec4 o_Color;
+
+void main()
+{
+  vec4 background_image = texture(u_Texture_background, v_Texcoord);
+  vec4 benchmark_image = texture(bindless_textures[PushConstant::benchmark_texture_index], v_Texcoord);
+  o_Color = v_Distance * mix(background_image, benchmark_image, benchmark_image.a);
+}
 )glsl";
 
   void register_shader_templates() override
@@ -223,12 +293,14 @@ void main()
 
     using namespace vulkan::shaderbuilder;
 
+    m_use_bindless_textures = logical_device()->supports_bindless_textures();
+
     std::vector<ShaderInfo> shader_info = {
       { vk::ShaderStageFlagBits::eVertex,   "intel.vert.glsl" },
-      { vk::ShaderStageFlagBits::eFragment, "intel.frag.glsl" }
+      { vk::ShaderStageFlagBits::eFragment, m_use_bindless_textures ? "intel_bindless.frag.glsl" : "intel.frag.glsl" }
     };
     shader_info[0].load(intel_vert_glsl);
-    shader_info[1].load(intel_frag_glsl);
+    shader_info[1].load(m_use_bindless_textures ? intel_bindless_frag_glsl : intel_frag_glsl);
     auto indices = application().register_shaders(std::move(shader_info));
     m_shader_vert = indices[0];
     m_shader_frag = indices[1];
@@ -319,6 +391,8 @@ void main()
 
       // Define pipeline layout.
       m_descriptor_set_layouts.push_back(descriptor_set_layout);
+      if (window->m_use_bindless_textures)
+        m_descriptor_set_layouts.push_back(owning_window->logical_device()->bindless_textures().set_layout());
 
       m_vertex_input_binding_descriptions = m_shader_input_data.vertex_binding_descriptions();
       m_vertex_input_attribute_descriptions = m_shader_input_data.vertex_input_attribute_descriptions();
@@ -382,6 +456,10 @@ void main()
     pipeline_factory.generate(this);
   }
 
+  // The vertex buffers are also a source and destination of transfers when they are moved by task::Defragment.
+  static constexpr vk::BufferUsageFlags s_vertex_buffer_usage =
+    vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer;
+
   void create_vertex_buffers(vulkan::pipeline::CharacteristicRange const* pipeline_owner)
   {
     DoutEntering(dc::vulkan, "Window::create_vertex_buffers(" << pipeline_owner << ") [" << this << "]");
@@ -393,16 +471,22 @@ void main()
       size_t buffer_size = count * entry_size;
 
       vk::Buffer new_buffer;
+      VmaAllocation new_allocation;
       {
         vertex_buffers_type::wat vertex_buffers_w(m_vertex_buffers);
 
         // Seems a compiler bug that I have to specify `vulkan::memory::Buffer` even when using emplace_back.
         vertex_buffers_w->push_back(vulkan::memory::Buffer(logical_device(), buffer_size,
-            { .usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-              .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+            { .usage = s_vertex_buffer_usage,
+              .properties = vk::MemoryPropertyFlagBits::eDeviceLocal,
+              // Prefer memory that is both device local and host visible (if any), so that CopyDataToBuffer can write to it directly.
+              .vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT }
             COMMA_CWDEBUG_ONLY(debug_name_prefix("m_vertex_buffers[" + std::to_string(vertex_buffers_w->size()) + "]"))));
 
         new_buffer = vertex_buffers_w->back().m_vh_buffer;
+        new_allocation = vertex_buffers_w->back().m_vh_allocation;
+        if (vertex_shader_input_set->input_rate() == vk::VertexInputRate::eInstance)
+          m_instance_buffer_index = vertex_buffers_w->size() - 1;
       }
 
       auto copy_data_to_buffer = statefultask::create<task::CopyDataToBuffer>(logical_device(), buffer_size, new_buffer, 0, vk::AccessFlags(0),
@@ -410,6 +494,7 @@ void main()
           COMMA_CWDEBUG_ONLY(true));
 
       copy_data_to_buffer->set_resource_owner(this);    // Wait for this task to finish before destroying this window, because this window owns the buffer (m_vertex_buffers.back()).
+      copy_data_to_buffer->set_target_allocation(new_allocation);
       copy_data_to_buffer->set_data_feeder(std::make_unique<vulkan::shaderbuilder::VertexShaderInputSetFeeder>(vertex_shader_input_set, pipeline_owner));
       copy_data_to_buffer->run(vulkan::Application::instance().low_priority_queue());
     }
@@ -544,59 +629,87 @@ void main()
     m_logical_device->reset_fences({ *frame_resources->m_command_buffers_completed });
     auto command_buffer = frame_resources->m_command_buffer;
 
+    // Tell the residency manager that this frame uses these resources.
+    m_background_texture.touch();
+    m_benchmark_texture.touch();
+    {
+      vertex_buffers_type::rat vertex_buffers_r(m_vertex_buffers);
+      for (vulkan::memory::Buffer const& vertex_buffer : *vertex_buffers_r)
+        vertex_buffer.touch();
+    }
+
     Dout(dc::vkframe, "Start recording command buffer.");
     command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    auto recording_begin_time = std::chrono::high_resolution_clock::now();
+    if (m_sample_parameters.RecordingThreads > 0)
     {
+      record_in_parallel(command_buffer, create_parallel_recording(viewport, scissor, scaling_factor), m_sample_parameters.RecordingThreads);
+      TracyVkCollect(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer));
+    }
+    else
+    {
+      {
 #if 0
-      CwTracyVkZone(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(),
-          tracy::IndexPair(max_number_of_frame_resources(), vulkan::SwapchainIndex{0}, max_number_of_swapchain_images()),
-          tracy::IndexPair(m_current_frame.m_resource_index, swapchain_index, max_number_of_swapchain_images()));
+        CwTracyVkZone(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(),
+            tracy::IndexPair(max_number_of_frame_resources(), vulkan::SwapchainIndex{0}, max_number_of_swapchain_images()),
+            tracy::IndexPair(m_current_frame.m_resource_index, swapchain_index, max_number_of_swapchain_images()));
 #endif
-      CwTracyVkNamedZone(presentation_surface().tracy_context(), __main_pass1, static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(), true,
-          max_number_of_frame_resources(), m_current_frame.m_resource_index);
-      CwTracyVkNamedZone(presentation_surface().tracy_context(), __main_pass2, static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(), true,
-          max_number_of_swapchain_images(), swapchain_index);
+        CwTracyVkNamedZone(presentation_surface().tracy_context(), __main_pass1, static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(), true,
+            max_number_of_frame_resources(), m_current_frame.m_resource_index);
+        CwTracyVkNamedZone(presentation_surface().tracy_context(), __main_pass2, static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(), true,
+            max_number_of_swapchain_images(), swapchain_index);
 
-      command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
+        command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
 // FIXME: this is a hack - what we really need is a vector with RenderProxy objects.
 if (!m_graphics_pipeline.handle())
   Dout(dc::warning, "Pipeline not available");
 else
 {
-      command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_graphics_pipeline(m_graphics_pipeline.handle()));
+        command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_graphics_pipeline(m_graphics_pipeline.handle()));
 //FIXME: m_vh_descriptor_set should not exist; this is just a hack... need still to design where/how to store descriptor sets...
-      command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipeline.layout(), 0, { m_vh_descriptor_set }, {});
-      {
-        vertex_buffers_type::rat vertex_buffers_r(m_vertex_buffers);
-        vertex_buffers_container_type const& vertex_buffers(*vertex_buffers_r);
-        command_buffer->bindVertexBuffers(0, { vertex_buffers[0].m_vh_buffer, vertex_buffers[1].m_vh_buffer }, { 0, 0 });
-      }
-      command_buffer->setViewport(0, { viewport });
-      //FIXME: this should become something like: update_push_constant(scaling_factor, command_buffer);
-      command_buffer->pushConstants(m_graphics_pipeline.layout(), vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, offsetof(PushConstant, aspect_scale), sizeof(float), &scaling_factor);
-      command_buffer->setScissor(0, { scissor });
-      command_buffer->draw(6 * SampleParameters::s_quad_tessellation * SampleParameters::s_quad_tessellation, m_sample_parameters.ObjectCount, 0, 0);
+        command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipeline.layout(), 0, { m_vh_descriptor_set }, {});
+        if (m_use_bindless_textures)
+        {
+          logical_device()->bindless_textures().bind(*command_buffer.operator->(), vk::PipelineBindPoint::eGraphics, m_graphics_pipeline.layout(), 1);
+          command_buffer->pushConstants(m_graphics_pipeline.layout(), vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment,
+              offsetof(PushConstant, benchmark_texture_index), sizeof(uint32_t), &m_benchmark_texture_index);
+        }
+        {
+          vertex_buffers_type::rat vertex_buffers_r(m_vertex_buffers);
+          vertex_buffers_container_type const& vertex_buffers(*vertex_buffers_r);
+          command_buffer->bindVertexBuffers(0, { vertex_buffers[0].m_vh_buffer, vertex_buffers[1].m_vh_buffer }, { 0, 0 });
+        }
+        command_buffer->setViewport(0, { viewport });
+        //FIXME: this should become something like: update_push_constant(scaling_factor, command_buffer);
+        command_buffer->pushConstants(m_graphics_pipeline.layout(), vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, offsetof(PushConstant, aspect_scale), sizeof(float), &scaling_factor);
+        command_buffer->setScissor(0, { scissor });
+        command_buffer->draw(6 * SampleParameters::s_quad_tessellation * SampleParameters::s_quad_tessellation, m_sample_parameters.ObjectCount, 0, 0);
 }
-      command_buffer->endRenderPass();
-      TracyVkCollect(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer));
-    }
+        command_buffer->endRenderPass();
+        TracyVkCollect(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer));
+      }
 #if ENABLE_IMGUI
-    {
+      {
 #if 0
-      CwTracyVkZone(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer), imgui_pass.name(),
-          tracy::IndexPair(max_number_of_frame_resources(), vulkan::SwapchainIndex{0}, max_number_of_swapchain_images()),
-          tracy::IndexPair(m_current_frame.m_resource_index, swapchain_index, max_number_of_swapchain_images()));
+        CwTracyVkZone(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer), imgui_pass.name(),
+            tracy::IndexPair(max_number_of_frame_resources(), vulkan::SwapchainIndex{0}, max_number_of_swapchain_images()),
+            tracy::IndexPair(m_current_frame.m_resource_index, swapchain_index, max_number_of_swapchain_images()));
 #endif
-      CwTracyVkNamedZone(presentation_surface().tracy_context(), __imgui_pass1, static_cast<vk::CommandBuffer>(command_buffer), imgui_pass.name(), true,
-          max_number_of_frame_resources(), m_current_frame.m_resource_index);
-      CwTracyVkNamedZone(presentation_surface().tracy_context(), __imgui_pass2, static_cast<vk::CommandBuffer>(command_buffer), imgui_pass.name(), true,
-          max_number_of_swapchain_images(), swapchain_index);
-      command_buffer->beginRenderPass(imgui_pass.begin_info(), vk::SubpassContents::eInline);
-      m_imgui.render_frame(command_buffer, m_current_frame.m_resource_index COMMA_CWDEBUG_ONLY(debug_name_prefix("m_imgui")));
-      command_buffer->endRenderPass();
-      TracyVkCollect(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer));
-    }
+        CwTracyVkNamedZone(presentation_surface().tracy_context(), __imgui_pass1, static_cast<vk::CommandBuffer>(command_buffer), imgui_pass.name(), true,
+            max_number_of_frame_resources(), m_current_frame.m_resource_index);
+        CwTracyVkNamedZone(presentation_surface().tracy_context(), __imgui_pass2, static_cast<vk::CommandBuffer>(command_buffer), imgui_pass.name(), true,
+            max_number_of_swapchain_images(), swapchain_index);
+        command_buffer->beginRenderPass(imgui_pass.begin_info(), vk::SubpassContents::eInline);
+        m_imgui.render_frame(command_buffer, m_current_frame.m_resource_index COMMA_CWDEBUG_ONLY(debug_name_prefix("m_imgui")));
+        command_buffer->endRenderPass();
+        TracyVkCollect(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer));
+      }
 #endif
+    }
+    float const recording_time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recording_begin_time).count();
+    m_sample_parameters.m_recording_time = m_sample_parameters.m_recording_time * 0.99f + recording_time * 0.01f;
+    if (m_sample_parameters.m_scaling_benchmark_threads > 0)
+      scaling_benchmark_step(recording_time);
     command_buffer->end();
     Dout(dc::vkframe, "End recording command buffer.");
 
@@ -605,6 +718,155 @@ else
     Dout(dc::vkframe, "Leaving Window::draw_frame.");
   }
 
+  // Split the objects over SampleParameters::s_draw_lists jobs that are recorded into secondary command buffers,
+  // drawing each object with its own draw call (to have something worth splitting), plus a job for imgui.
+  std::shared_ptr<vulkan::ParallelRecording> create_parallel_recording(vk::Viewport const& viewport, vk::Rect2D const& scissor, float scaling_factor)
+  {
+    auto recording = std::make_shared<vulkan::ParallelRecording>();
+// FIXME: this is a hack - what we really need is a vector with RenderProxy objects.
+if (!m_graphics_pipeline.handle())
+  Dout(dc::warning, "Pipeline not available");
+else
+{
+    // Look these up here, so that the jobs only use values that they own.
+    vk::Pipeline const vh_pipeline = vh_graphics_pipeline(m_graphics_pipeline.handle());
+    vk::PipelineLayout const vh_pipeline_layout = m_graphics_pipeline.layout();
+    std::array<vk::Buffer, 2> vh_vertex_buffers;
+    {
+      vertex_buffers_type::rat vertex_buffers_r(m_vertex_buffers);
+      vertex_buffers_container_type const& vertex_buffers(*vertex_buffers_r);
+      vh_vertex_buffers = { vertex_buffers[0].m_vh_buffer, vertex_buffers[1].m_vh_buffer };
+    }
+    vulkan::descriptor::BindlessTextures const* bindless_textures = m_use_bindless_textures ? &logical_device()->bindless_textures() : nullptr;
+    uint32_t const benchmark_texture_index = m_benchmark_texture_index;
+    int const object_count = m_sample_parameters.ObjectCount;
+    for (int draw_list = 0; draw_list < SampleParameters::s_draw_lists; ++draw_list)
+    {
+      uint32_t const first_object = object_count * draw_list / SampleParameters::s_draw_lists;
+      uint32_t const end_object = object_count * (draw_list + 1) / SampleParameters::s_draw_lists;
+      if (first_object == end_object)
+        continue;
+      recording->add(main_pass, [=, vh_descriptor_set = m_vh_descriptor_set](vulkan::handle::CommandBuffer command_buffer){
+        command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_pipeline);
+        command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, vh_pipeline_layout, 0, { vh_descriptor_set }, {});
+        if (bindless_textures)
+        {
+          bindless_textures->bind(*command_buffer.operator->(), vk::PipelineBindPoint::eGraphics, vh_pipeline_layout, 1);
+          command_buffer->pushConstants(vh_pipeline_layout, vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment,
+              offsetof(PushConstant, benchmark_texture_index), sizeof(uint32_t), &benchmark_texture_index);
+        }
+        command_buffer->bindVertexBuffers(0, vh_vertex_buffers, { 0, 0 });
+        command_buffer->setViewport(0, { viewport });
+        command_buffer->pushConstants(vh_pipeline_layout, vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, offsetof(PushConstant, aspect_scale), sizeof(float), &scaling_factor);
+        command_buffer->setScissor(0, { scissor });
+        for (uint32_t object = first_object; object < end_object; ++object)
+          command_buffer->draw(6 * SampleParameters::s_quad_tessellation * SampleParameters::s_quad_tessellation, 1, 0, object);
+      });
+    }
+}
+#if ENABLE_IMGUI
+    recording->add(imgui_pass, [this](vulkan::handle::CommandBuffer command_buffer){
+      m_imgui.render_frame(command_buffer, m_current_frame.m_resource_index COMMA_CWDEBUG_ONLY(debug_name_prefix("m_imgui")));
+    });
+#endif
+    return recording;
+  }
+
+  int max_recording_threads() const
+  {
+    // All thread pool threads plus the render loop thread.
+    return application().number_of_worker_threads() + 1;
+  }
+
+  // Called every frame while the scaling benchmark is running.
+  void scaling_benchmark_step(float recording_time)
+  {
+    m_sample_parameters.m_scaling_benchmark_time += recording_time;
+    if (++m_sample_parameters.m_scaling_benchmark_frame < SampleParameters::s_scaling_benchmark_frames)
+      return;
+    std::cout << "Recording " << SampleParameters::s_draw_lists << " draw lists with " << m_sample_parameters.m_scaling_benchmark_threads <<
+      " thread(s): " << (m_sample_parameters.m_scaling_benchmark_time / m_sample_parameters.m_scaling_benchmark_frame) << " ms per frame." << std::endl;
+    m_sample_parameters.m_scaling_benchmark_frame = 0;
+    m_sample_parameters.m_scaling_benchmark_time = 0;
+    // Continue with one more thread, or stop after measuring max_recording_threads() threads.
+    if (++m_sample_parameters.m_scaling_benchmark_threads > max_recording_threads())
+      m_sample_parameters.m_scaling_benchmark_threads = 0;
+    else
+      m_sample_parameters.RecordingThreads = m_sample_parameters.m_scaling_benchmark_threads;
+  }
+
+  // Give a random tenth of the visible objects a new position, and upload only the positions that changed.
+  void scatter_objects()
+  {
+    DoutEntering(dc::vulkan, "Window::scatter_objects() [" << this << "]");
+    m_moved_instances.resize(SampleParameters::s_max_object_count);
+    std::uniform_int_distribution<int> distribution_index(0, m_sample_parameters.ObjectCount - 1);
+    std::uniform_real_distribution<float> distribution_xy(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> distribution_z(0.0f, 1.0f);
+    for (int n = 0; n < m_sample_parameters.ObjectCount / 10 + 1; ++n)
+    {
+      int const index = distribution_index(m_scatter_generator);
+      // The shader only uses m_position[1] (see intel_vert_glsl).
+      m_moved_instances[index].m_position[1] << distribution_xy(m_scatter_generator),
+                                             distribution_xy(m_scatter_generator),
+                                             distribution_z(m_scatter_generator),
+                                             0.0f;
+      m_dirty_instances.add(index * sizeof(InstanceData) + offsetof(InstanceData, m_position) + sizeof(glsl::vec4), sizeof(glsl::vec4));
+    }
+
+    vk::Buffer vh_instance_buffer;
+    {
+      vertex_buffers_type::rat vertex_buffers_r(m_vertex_buffers);
+      vh_instance_buffer = (*vertex_buffers_r)[m_instance_buffer_index].m_vh_buffer;
+    }
+    // The positions of the instances that didn't move are not in m_moved_instances; so don't merge ranges (the default merge_gap is zero).
+    std::vector<vulkan::DirtyRanges::Range> ranges = m_dirty_instances.take();
+    auto copy_data_to_buffer_regions = statefultask::create<task::CopyDataToBufferRegions>(logical_device(), vh_instance_buffer, ranges,
+        vk::AccessFlagBits::eVertexAttributeRead, vk::PipelineStageFlagBits::eVertexInput,
+        vk::AccessFlagBits::eVertexAttributeRead, vk::PipelineStageFlagBits::eVertexInput
+        COMMA_CWDEBUG_ONLY(true));
+    copy_data_to_buffer_regions->set_resource_owner(this);     // Wait for this task to finish before destroying this window, because this window owns the buffer.
+    copy_data_to_buffer_regions->set_data_feeder(std::make_unique<vulkan::GatherFeeder>(m_moved_instances.data(), std::move(ranges)));
+    // m_moved_instances must not change until the upload finished.
+    m_scattering = true;
+    copy_data_to_buffer_regions->run(vulkan::Application::instance().low_priority_queue(), [this](bool){ m_scattering = false; });
+  }
+
+  // Move the vertex buffers to reduce fragmentation of device memory.
+  void defragment()
+  {
+    DoutEntering(dc::vulkan, "Window::defragment() [" << this << "]");
+    {
+      // The vertex buffers are no longer added to (nor moved in) m_vertex_buffers once we're rendering.
+      vertex_buffers_type::wat vertex_buffers_w(m_vertex_buffers);
+      for (size_t i = m_vertex_buffer_relocators.size(); i < vertex_buffers_w->size(); ++i)
+        m_vertex_buffer_relocators.push_back(std::make_unique<vulkan::memory::BufferRelocator>(this, &(*vertex_buffers_w)[i], s_vertex_buffer_usage));
+    }
+    // The descriptor in the bindless texture table isn't used by frames in flight while it is replaced: a new slot is used instead.
+    if (m_use_bindless_textures && !m_benchmark_texture_relocator)
+      m_benchmark_texture_relocator = std::make_unique<vulkan::memory::ImageRelocator>(this, &m_benchmark_texture, m_benchmark_image_create_info,
+          vk::ImageLayout::eShaderReadOnlyOptimal,
+          [this](vk::Image vh_new_image){
+            vulkan::descriptor::BindlessTextures& bindless_textures = logical_device()->bindless_textures();
+            m_old_benchmark_image_view = std::move(m_benchmark_texture.m_image_view);
+            m_benchmark_texture.m_image_view = logical_device()->create_image_view(vh_new_image, *m_benchmark_image_view_kind
+                COMMA_CWDEBUG_ONLY(debug_name_prefix("m_benchmark_texture.m_image_view")));
+            uint32_t const old_index = m_benchmark_texture_index;
+            m_benchmark_texture_index = bindless_textures.insert(*m_benchmark_texture.m_image_view, *m_benchmark_texture.m_sampler);
+            bindless_textures.erase(old_index);
+          },
+          [this](){ m_old_benchmark_image_view.reset(); });
+    m_defragmenting = true;
+    auto defragment = statefultask::create<task::Defragment>(this COMMA_CWDEBUG_ONLY(true));
+    task::Defragment const* defragment_ptr = defragment.get();  // The task is still alive while calling its callback.
+    defragment->run([this, defragment_ptr](bool success){
+      if (success)
+        std::cout << "Defragmentation moved " << defragment_ptr->defragmentation_stats().allocationsMoved << " allocations (" <<
+          defragment_ptr->defragmentation_stats().bytesMoved << " bytes)." << std::endl;
+      m_defragmenting = false;
+    });
+  }
+
   //===========================================================================
   //
   // ImGui
@@ -627,7 +889,7 @@ else
     //  bool show_demo_window = true;
     //  ShowDemoWindow(&show_demo_window);
     ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 120.0f, 20.0f));
-    m_imgui_stats_window.draw(io, m_timer);
+    m_imgui_stats_window.draw(io, m_timer, m_logical_device);
 
     ImGui::SetNextWindowPos(ImVec2(20.0f, 20.0f));
     ImGui::Begin(reinterpret_cast<char const*>(application().application_name().c_str()), nullptr, ImGuiWindowFlags_AlwaysAutoResize);
@@ -639,8 +901,21 @@ else
     ImGui::SliderInt("Frame resources count", &m_sample_parameters.FrameResourcesCount, 1, max_number_of_frame_resources().get_value());
     ImGui::SliderInt("Pre-submit CPU work time [ms]", &m_sample_parameters.PreSubmitCpuWorkTime, 0, 20);
     ImGui::SliderInt("Post-submit CPU work time [ms]", &m_sample_parameters.PostSubmitCpuWorkTime, 0, 20);
+    ImGui::SliderInt("Recording threads (0: primary only)", &m_sample_parameters.RecordingThreads, 0, max_recording_threads());
+    if (m_sample_parameters.m_scaling_benchmark_threads == 0 && ImGui::Button("Run scaling benchmark"))
+    {
+      // Measure the recording time with 1 up till max_recording_threads() threads; the result is written to std::cout.
+      m_sample_parameters.m_scaling_benchmark_threads = 1;
+      m_sample_parameters.RecordingThreads = 1;
+    }
+    // Don't move the instance buffer while it is being updated, and vice versa.
+    if (!m_defragmenting && !m_scattering && ImGui::Button("Scatter objects"))
+      scatter_objects();
+    if (!m_defragmenting && !m_scattering && ImGui::Button("Defragment"))
+      defragment();
     ImGui::Text("Frame generation time: %5.2f ms", m_sample_parameters.m_frame_generation_time);
     ImGui::Text("Total frame time: %5.2f ms", m_sample_parameters.m_total_frame_time);
+    ImGui::Text("Recording time: %5.3f ms", m_sample_parameters.m_recording_time);
     ImGui::End();
 
     if (current_SwapchainCount != m_sample_parameters.SwapchainCount)
@@ -5,12 +5,13 @@
 #include "TopPosition.h"
 #include "LeftPosition.h"
 #include "BottomPosition.h"
-#include "memory/UniformBuffer.h"
+#include "FrameResourcesData.h"
 #include "queues/CopyDataToImage.h"
 #include "vulkan/Pipeline.h"
 #include "vulkan/shaderbuilder/ShaderIndex.h"
-#include "vk_utils/ImageData.h"
+#include "vk_utils/KTX2Data.h"
 #include <imgui.h>
+#include <atomic>
 #include "debug.h"
 #include "tracy/CwTracy.h"
 #ifdef TRACY_ENABLE
@@ -35,7 +36,8 @@ class Window : public task::SynchronousWindow
   RenderPass  main_pass{this, "main_pass"};
   Attachment      depth{this, "depth", s_depth_image_view_kind};
 
-  vulkan::Texture m_sample_texture;
+  vulkan::Texture m_sample_texture;                             // Evictable: uploaded again when touch() returns false.
+  std::atomic<bool> m_sample_texture_ready{false};              // Set when uploading m_sample_texture finished; it isn't sampled before that.
 
   enum class LocalShaderIndex {
     vertex1,
@@ -47,9 +49,6 @@ class Window : public task::SynchronousWindow
 
   vulkan::Pipeline m_graphics_pipeline1;
   vulkan::Pipeline m_graphics_pipeline2;
-  utils::Vector<vulkan::memory::UniformBuffer, vulkan::FrameResourceIndex> m_top_buffer;
-  utils::Vector<vulkan::memory::UniformBuffer, vulkan::FrameResourceIndex> m_left_buffer;
-  utils::Vector<vulkan::memory::UniformBuffer, vulkan::FrameResourceIndex> m_bottom_buffer;
 
   imgui::StatsWindow m_imgui_stats_window;
   int m_frame_count = 0;
@@ -83,6 +82,12 @@ class Window : public task::SynchronousWindow
     return vulkan::SwapchainIndex{4};
   }
 
+  // The uniform data of all objects of one frame is allocated from the UniformArena of that frame.
+  vk::DeviceSize uniform_arena_size() const override
+  {
+    return 64 * 1024;
+  }
+
   //FIXME: this doesn't belong here
   vk::DescriptorSet m_vh_top_descriptor_set;
   vk::DescriptorSet m_vh_left_descriptor_set;
@@ -92,37 +97,40 @@ class Window : public task::SynchronousWindow
   {
     DoutEntering(dc::vulkan, "Window::create_textures() [" << this << "]");
 
-    // Sample texture.
-    {
-      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/vort3_128x128.png", 4);
-      // Create descriptor resources.
+    // The descriptor set is updated in create_uniform_buffers.
+    upload_sample_texture();
+  }
+
+  // (Re)create m_sample_texture. Called from create_textures and after m_sample_texture was evicted.
+  void upload_sample_texture()
+  {
+    DoutEntering(dc::vulkan, "Window::upload_sample_texture() [" << this << "]");
+
+    // A BC1 compressed version of vort3_128x128.png with all mip levels; decoded on the CPU if the device can't sample BC1.
+    vk_utils::ktx2::KTX2Data texture_data(m_application->path_of(Directory::resources) / "textures/vort3_128x128.ktx2");
+    vulkan::SamplerKind const sample_sampler_kind(m_logical_device, {
+      .mipmapMode = vk::SamplerMipmapMode::eNearest,
+      .anisotropyEnable = VK_FALSE
+    });
+    m_sample_texture_ready.store(false, std::memory_order::relaxed);
+    m_sample_texture = upload_texture(std::move(texture_data), 1, sample_sampler_kind, {},
+        [this](bool success){ m_sample_texture_ready.store(success, std::memory_order::release); }
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_sample_texture")));
+    // Allow the residency manager to free the texture when its heap runs out of budget; it can always be uploaded again.
+    m_sample_texture.make_evictable();
+  }
+
+  // Point binding 1 of the 'top' descriptor set at m_sample_texture.
+  void update_sample_texture_descriptor()
+  {
+    std::vector<vk::DescriptorImageInfo> image_infos = {
       {
-        static vulkan::ImageKind const sample_image_kind({
-          .format = vk::Format::eR8G8B8A8Unorm,
-          .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
-        });
-
-        static vulkan::ImageViewKind const sample_image_view_kind(sample_image_kind, {});
-
-        m_sample_texture = vulkan::Texture(m_logical_device,
-            texture_data.extent(), sample_image_view_kind,
-            { .mipmapMode = vk::SamplerMipmapMode::eNearest,
-              .anisotropyEnable = VK_FALSE },
-            graphics_settings(),
-            { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
-            COMMA_CWDEBUG_ONLY(debug_name_prefix("m_sample_texture")));
-
-        auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, texture_data.size(),
-            m_sample_texture.m_vh_image, texture_data.extent(), vk_defaults::ImageSubresourceRange{},
-            vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
-            vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
-            COMMA_CWDEBUG_ONLY(true));
-
-        copy_data_to_image->set_resource_owner(this);   // Wait for this task to finish before destroying this window, because this window owns the texture (m_sample_texture).
-        copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(texture_data)));
-        copy_data_to_image->run(vulkan::Application::instance().low_priority_queue());
+        .sampler = *m_sample_texture.m_sampler,
+        .imageView = *m_sample_texture.m_image_view,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
       }
-    }
+    };
+    m_logical_device->update_descriptor_set(m_vh_top_descriptor_set, vk::DescriptorType::eCombinedImageSampler, 1, 0, image_infos);
   }
 
  public:
@@ -144,65 +152,19 @@ class Window : public task::SynchronousWindow
     m_vh_left_descriptor_set = descriptor_sets[1];
     m_vh_bottom_descriptor_set = descriptor_sets[2];
 
-    for (vulkan::FrameResourceIndex i{0}; i != max_number_of_frame_resources(); ++i)
-      m_top_buffer.emplace_back(logical_device(), top_position_array_size * sizeof(TopPosition)
-        COMMA_CWDEBUG_ONLY(debug_name_prefix("Window::m_top_buffer[" + to_string(i) + "]")));
-
-    for (vulkan::FrameResourceIndex i{0}; i != max_number_of_frame_resources(); ++i)
-      m_left_buffer.emplace_back(logical_device(), sizeof(LeftPosition)
-        COMMA_CWDEBUG_ONLY(debug_name_prefix("Window::m_left_buffer[" + to_string(i) + "]")));
-
-    for (vulkan::FrameResourceIndex i{0}; i != max_number_of_frame_resources(); ++i)
-      m_bottom_buffer.emplace_back(logical_device(), sizeof(BottomPosition)
-        COMMA_CWDEBUG_ONLY(debug_name_prefix("Window::m_bottom_buffer[" + to_string(i) + "]")));
-
-    // Information about the buffer we want to point at in the descriptor.
-    std::vector<vk::DescriptorBufferInfo> top_buffer_infos = {
-      {
-        .buffer = m_top_buffer.begin()->m_vh_buffer,
-        .offset = 0,
-        .range = top_position_array_size * sizeof(TopPosition)
-      }
-    };
-    std::vector<vk::DescriptorBufferInfo> left_buffer_infos = {
-      {
-        .buffer = m_left_buffer.begin()->m_vh_buffer,
-        .offset = 0,
-        .range = sizeof(LeftPosition)
-      }
-    };
-    std::vector<vk::DescriptorBufferInfo> bottom_buffer_infos = {
-      {
-        .buffer = m_bottom_buffer.begin()->m_vh_buffer,
-        .offset = 0,
-        .range = sizeof(BottomPosition)
-      }
-    };
-
-    //vkUpdateDescriptorSets(_device, 1, &setWrite, 0, nullptr);
+    // Point the dynamic uniform buffer descriptors at the uniform arena. Because this window only
+    // has a single FrameResourcesData, all frames use the same arena (and thus descriptor sets).
+    vulkan::memory::UniformArena const& uniform_arena = m_frame_resources_list[vulkan::FrameResourceIndex{0}]->m_uniform_arena;
     uint32_t binding = 0;
-    logical_device()->update_descriptor_set(m_vh_top_descriptor_set, vk::DescriptorType::eUniformBuffer, binding, 0, {}, top_buffer_infos);
-    logical_device()->update_descriptor_set(m_vh_left_descriptor_set, vk::DescriptorType::eUniformBuffer, binding, 0, {}, left_buffer_infos);
-    logical_device()->update_descriptor_set(m_vh_bottom_descriptor_set, vk::DescriptorType::eUniformBuffer, binding, 0, {}, bottom_buffer_infos);
-
-    // Fill the buffer...
-    for (int i = 0; i < top_position_array_size; ++i)
-      ((TopPosition*)(m_top_buffer.begin()->m_pointer))[i].x = 0.8;
-    ((LeftPosition*)(m_left_buffer.begin()->m_pointer))->y = 0.5;
-    ((BottomPosition*)(m_bottom_buffer.begin()->m_pointer))->x = 0.5;
-
-    // Update descriptor set of m_sample_texture.
-    {
-      std::vector<vk::DescriptorImageInfo> image_infos = {
-        {
-          .sampler = *m_sample_texture.m_sampler,
-          .imageView = *m_sample_texture.m_image_view,
-          .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
-        }
-      };
-      // The 'top' descriptor set also contains the texture.
-      m_logical_device->update_descriptor_set(m_vh_top_descriptor_set, vk::DescriptorType::eCombinedImageSampler, 1, 0, image_infos);
-    }
+    logical_device()->update_descriptor_set(m_vh_top_descriptor_set, vk::DescriptorType::eUniformBufferDynamic, binding, 0, {},
+        { uniform_arena.descriptor_buffer_info(top_position_array_size * sizeof(TopPosition)) });
+    logical_device()->update_descriptor_set(m_vh_left_descriptor_set, vk::DescriptorType::eUniformBufferDynamic, binding, 0, {},
+        { uniform_arena.descriptor_buffer_info(sizeof(LeftPosition)) });
+    logical_device()->update_descriptor_set(m_vh_bottom_descriptor_set, vk::DescriptorType::eUniformBufferDynamic, binding, 0, {},
+        { uniform_arena.descriptor_buffer_info(sizeof(BottomPosition)) });
+
+    // The 'top' descriptor set also contains the texture.
+    update_sample_texture_descriptor();
   }
 
  private:
@@ -415,7 +377,7 @@ void main()
         std::vector<vk::DescriptorSetLayoutBinding> top_layout_bindings = {
           {
             .binding = 0,
-            .descriptorType = vk::DescriptorType::eUniformBuffer,
+            .descriptorType = vk::DescriptorType::eUniformBufferDynamic,
             .descriptorCount = 1,
             .stageFlags = vk::ShaderStageFlagBits::eVertex,
           },
@@ -429,7 +391,7 @@ void main()
         std::vector<vk::DescriptorSetLayoutBinding> left_layout_bindings = {
           {
             .binding = 0,
-            .descriptorType = vk::DescriptorType::eUniformBuffer,
+            .descriptorType = vk::DescriptorType::eUniformBufferDynamic,
             .descriptorCount = 1,
             .stageFlags = vk::ShaderStageFlagBits::eVertex,
           }
@@ -437,7 +399,7 @@ void main()
         std::vector<vk::DescriptorSetLayoutBinding> bottom_layout_bindings = {
           {
             .binding = 0,
-            .descriptorType = vk::DescriptorType::eUniformBuffer,
+            .descriptorType = vk::DescriptorType::eUniformBufferDynamic,
             .descriptorCount = 1,
             .stageFlags = vk::ShaderStageFlagBits::eVertex,
           }
@@ -604,6 +566,31 @@ void main()
     wait_command_buffer_completed();
     m_logical_device->reset_fences({ *frame_resources->m_command_buffers_completed });
 
+    // Tell the residency manager that this frame uses the texture. If it was evicted, upload it again.
+    if (!m_sample_texture.touch())
+    {
+      upload_sample_texture();
+      // This window has a single frame resource and we just waited for its command buffer: the descriptor set isn't in use.
+      if (m_vh_top_descriptor_set)
+        update_sample_texture_descriptor();
+    }
+    bool const sample_texture_ready = m_sample_texture_ready.load(std::memory_order::acquire);
+
+    // Write the uniform data of this frame (this must be done after waiting for the previous use of frame_resources to complete).
+    uint32_t top_offset;
+    uint32_t left_offset;
+    uint32_t bottom_offset;
+    {
+      vulkan::memory::UniformArena& uniform_arena = frame_resources->m_uniform_arena;
+      TopPosition* top_positions = static_cast<TopPosition*>(uniform_arena.allocate(top_position_array_size * sizeof(TopPosition), top_offset));
+      for (int i = 0; i < top_position_array_size; ++i)
+        top_positions[i].x = 0.8;
+      top_positions[0].x = m_top_position;
+      top_positions[1].x = m_top_position + 0.1;
+      uniform_arena.allocate<LeftPosition>(left_offset)->y = m_left_position;
+      uniform_arena.allocate<BottomPosition>(bottom_offset)->x = m_bottom_position;
+    }
+
     auto command_buffer = frame_resources->m_command_buffer;
     Dout(dc::vkframe, "Start recording command buffer.");
     command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
@@ -617,6 +604,8 @@ void main()
 // FIXME: this is a hack - what we really need is a vector with RenderProxy objects.
 if (!m_graphics_pipeline1.handle() || !m_graphics_pipeline2.handle())
   Dout(dc::warning, "Pipeline not available");
+else if (!sample_texture_ready)
+  Dout(dc::vkframe, "Sample texture not uploaded yet");
 else
 {
       command_buffer->setViewport(0, { viewport });
@@ -624,13 +613,13 @@ else
 
       command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_graphics_pipeline(m_graphics_pipeline1.handle()));
       command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipeline1.layout(), 0,
-          { m_vh_top_descriptor_set, m_vh_left_descriptor_set, m_vh_bottom_descriptor_set }, {});
+          { m_vh_top_descriptor_set, m_vh_left_descriptor_set, m_vh_bottom_descriptor_set }, { top_offset, left_offset, bottom_offset });
 
       command_buffer->draw(3, 1, 0, 0);
 
       command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_graphics_pipeline(m_graphics_pipeline2.handle()));
       command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipeline2.layout(), 0,
-          { m_vh_left_descriptor_set, m_vh_top_descriptor_set, m_vh_bottom_descriptor_set }, {});
+          { m_vh_left_descriptor_set, m_vh_top_descriptor_set, m_vh_bottom_descriptor_set }, { left_offset, top_offset, bottom_offset });
 
       command_buffer->draw(3, 1, 0, 0);
 }
@@ -680,7 +669,7 @@ else
     ImGuiIO& io = ImGui::GetIO();
 
     ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 120.0f, 20.0f));
-    m_imgui_stats_window.draw(io, m_timer);
+    m_imgui_stats_window.draw(io, m_timer, m_logical_device);
 
     //ImGui::SetNextWindowPos(ImVec2(20.0f, 20.0f));
     ImGui::Begin(reinterpret_cast<char const*>(application().application_name().c_str()), nullptr, ImGuiWindowFlags_None);
@@ -688,9 +677,5 @@ else
     ImGui::SliderFloat("Left position", &m_left_position, -1.0, 1.0);
     ImGui::SliderFloat("Bottom position", &m_bottom_position, 0.0, 1.0);
     ImGui::End();
-    ((TopPosition*)(m_top_buffer.begin()->m_pointer))[0].x = m_top_position;
-    ((TopPosition*)(m_top_buffer.begin()->m_pointer))[1].x = m_top_position + 0.1;
-    ((LeftPosition*)(m_left_buffer.begin()->m_pointer))->y = m_left_position;
-    ((BottomPosition*)(m_bottom_buffer.begin()->m_pointer))->x = m_bottom_position;
   }
 };
@@ -101,7 +101,8 @@ void Application::initialize(int argc, char** argv)
     m_directories.initialize(application_name(), argv[0]);
 
     // Initialize the thread pool.
-    m_thread_pool.change_number_of_threads_to(thread_pool_number_of_worker_threads());
+    m_number_of_worker_threads = thread_pool_number_of_worker_threads();
+    m_thread_pool.change_number_of_threads_to(m_number_of_worker_threads);
     Debug(m_thread_pool.set_color_functions([](int color){
       static std::array<std::string, 32> color_on_escape_codes = {
         "\e[38;5;1m",
@@ -17,6 +17,7 @@
 #include "utils/threading/Gate.h"
 #include "utils/DequeMemoryResource.h"
 #include "utils/Vector.h"
+#include "vk_utils/ImageDecoder.h"
 #include <boost/intrusive_ptr.hpp>
 #include <filesystem>
 #include <deque>
@@ -82,8 +83,12 @@ class Application
   // Once it doesn't, the program will assert in utils/NodeMemoryResource.h with: Assertion `block_size <= stored_block_size' failed.
   utils::NodeMemoryResource m_deque512_nmr{m_mpp.instance(), 512};  // _GLIBCXX_DEQUE_BUF_SIZE
 
+  // Decodes images in the background (must be created before thread_pool, because its tasks use it).
+  vk_utils::stbi::ImageDecoder m_image_decoder;
+
   // Create the thread pool.
   AIThreadPool m_thread_pool;
+  int m_number_of_worker_threads{};             // The number of threads of m_thread_pool, as returned by thread_pool_number_of_worker_threads().
 
   // And the thread pool queues.
   AIQueueHandle m_high_priority_queue;
@@ -219,6 +224,12 @@ class Application
   AIQueueHandle medium_priority_queue() const { return m_medium_priority_queue; }
   AIQueueHandle low_priority_queue() const { return m_low_priority_queue; }
 
+  // The number of threads in the thread pool.
+  int number_of_worker_threads() const { return m_number_of_worker_threads; }
+
+  // Accessor for the background image decoder.
+  vk_utils::stbi::ImageDecoder& image_decoder() { return m_image_decoder; }
+
   std::filesystem::path path_of(Directory directory) const
   {
     return m_directories.path_of(directory);
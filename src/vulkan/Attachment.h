@@ -1,6 +1,7 @@
 #pragma once
 
 #include "memory/Image.h"
+#include "memory/AliasedMemory.h"
 
 namespace vulkan {
 
@@ -28,6 +29,33 @@ struct Attachment : public memory::Image
   {
   }
 
+  Attachment(
+      LogicalDevice const* logical_device,
+      vk::ImageCreateInfo const& image_create_info,
+      vulkan::ImageViewKind const& image_view_kind,
+      MemoryCreateInfo memory_create_info
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+    memory::Image(logical_device, image_create_info, memory_create_info
+        COMMA_CWDEBUG_ONLY(ambifix)),
+    m_image_view(logical_device->create_image_view(m_vh_image, image_view_kind
+        COMMA_CWDEBUG_ONLY(ambifix(".m_image_view"))))
+  {
+  }
+
+  // Create an attachment that shares aliased_memory with other attachments (see rendergraph::RenderGraph::alias_groups).
+  Attachment(
+      LogicalDevice const* logical_device,
+      vk::ImageCreateInfo const& image_create_info,
+      vulkan::ImageViewKind const& image_view_kind,
+      memory::AliasedMemory const& aliased_memory
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+    memory::Image(logical_device, image_create_info, aliased_memory
+        COMMA_CWDEBUG_ONLY(ambifix)),
+    m_image_view(logical_device->create_image_view(m_vh_image, image_view_kind
+        COMMA_CWDEBUG_ONLY(ambifix(".m_image_view"))))
+  {
+  }
+
   // Class is move-only.
   Attachment(Attachment&& rhs) = default;
   Attachment& operator=(Attachment&& rhs) = default;
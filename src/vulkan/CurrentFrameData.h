@@ -11,6 +11,7 @@ struct CurrentFrameData
   FrameResourcesData* m_frame_resources;
   FrameResourceIndex m_resource_count;
   FrameResourceIndex m_resource_index;
+  uint64_t m_frame_serial;                      // The number of this frame, as returned by ResidencyManager::new_frame.
 };
 
 } // namespace vulkan
@@ -3,13 +3,17 @@
 #include "Attachment.h"
 #include "CommandPool.h"
 #include "CommandBuffer.h"
+#include "memory/UniformArena.h"
+#include "memory/AliasedMemory.h"
 #include "utils/Vector.h"
 #include <memory>
+#include <vector>
 
 namespace vulkan {
 
 struct FrameResourcesData
 {
+  std::vector<memory::AliasedMemory> m_aliased_attachment_memory;      // The memory shared by the attachments of each alias group (must be destroyed after m_attachments).
   utils::Vector<Attachment, rendergraph::AttachmentIndex> m_attachments;
 
   // Too specialized?
@@ -17,11 +21,29 @@ struct FrameResourcesData
   using command_pool_type = CommandPool<pool_type>;
   command_pool_type       m_command_pool;
 
-  // Command buffers (currently only one).
+  // Command buffers.
   handle::CommandBuffer   m_command_buffer;                     // Freed when the command pool is destructed.
+  handle::CommandBuffer   m_ownership_acquire_command_buffer;   // Used to acquire ownership of resources that were uploaded on a different queue family.
+
+  // A secondary command buffer with its own command pool; command pools may only be used by one thread at a time.
+  struct SecondaryCommandBuffer
+  {
+    command_pool_type     m_command_pool;
+    handle::CommandBuffer m_command_buffer;                     // Freed when m_command_pool is destructed.
+
+    SecondaryCommandBuffer(LogicalDevice const* logical_device, QueueFamilyPropertiesIndex queue_family
+        COMMA_CWDEBUG_ONLY(AmbifixOwner const& debug_name)) :
+      m_command_pool(logical_device, queue_family COMMA_CWDEBUG_ONLY(debug_name("->m_command_pool"))),
+      m_command_buffer(m_command_pool.allocate_secondary_buffer(CWDEBUG_ONLY(debug_name("->m_command_buffer")))) { }
+  };
+  std::vector<std::unique_ptr<SecondaryCommandBuffer>> m_secondary_command_buffers;   // One per job of SynchronousWindow::record_in_parallel (grown on demand).
 
   // Fence that signals when all (aka, the last) command buffers have finished.
   vk::UniqueFence         m_command_buffers_completed;          // This fence should be signaled when the last command buffer used for this frame completed.
+  uint64_t                m_frame_serial{};                     // The number of the last frame that was submitted with these resources (see ResidencyManager::new_frame), or 0 if that completed.
+
+  // Linear allocator for per-frame uniform data; only valid if SynchronousWindow::uniform_arena_size() returns non-zero.
+  memory::UniformArena    m_uniform_arena;                      // Reset at the start of each frame.
 
   // Overlapping descriptor set handles.
   vk::UniqueDescriptorSet m_overlapping_descriptor_set;         // Used for resources that need to changed during rendering (e.g. uniform buffers).
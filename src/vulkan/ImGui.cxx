@@ -468,6 +468,8 @@ void ImGui::init(task::SynchronousWindow* owning_window, vk::SampleCountFlagBits
   m_font_texture = owning_window->upload_texture(std::make_unique<TexPixelsRGBA32Feeder>(std::move(io.Fonts)),
       extent, 0, imgui_font_image_view_kind, imgui_font_sampler_kind, m_descriptor_set, imgui_font_texture_ready
       COMMA_CWDEBUG_ONLY(ambifix(".m_font_texture")));
+  // Count the font atlas as imgui memory, rather than as a texture.
+  logical_device()->residency_manager().set_category(m_font_texture.m_vh_allocation, memory::AllocationCategory::imgui);
 
   // Create imgui pipeline.
   create_graphics_pipeline(MSAASamples COMMA_CWDEBUG_ONLY(ambifix));
@@ -931,6 +933,7 @@ void ImGui::render_frame(handle::CommandBuffer command_buffer, FrameResourceInde
   ImDrawData* draw_data = GetDrawData();
   ImGui_FrameResourcesData& frame_resources = m_frame_resources_list[index];
   LogicalDevice const* device = logical_device();
+  m_font_texture.touch();
 
   size_t vertex_size = draw_data->TotalVtxCount * sizeof(ImDrawVert);
   size_t index_size = draw_data->TotalIdxCount * sizeof(ImDrawIdx);
@@ -953,7 +956,8 @@ void ImGui::render_frame(handle::CommandBuffer command_buffer, FrameResourceInde
             .properties = vk::MemoryPropertyFlagBits::eHostVisible,
             .vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
             .vma_memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .allocation_info_out = &allocation_info }
+            .allocation_info_out = &allocation_info,
+            .category = memory::AllocationCategory::imgui }
           COMMA_CWDEBUG_ONLY(ambifix(".m_frame_resources_list[" + std::to_string(index.get_value()) + "].m_vertex_buffer")));
       frame_resources.m_mapped_vertex_buffer = static_cast<imgui::ImDrawVert*>(allocation_info.pMappedData);
     }
@@ -968,7 +972,8 @@ void ImGui::render_frame(handle::CommandBuffer command_buffer, FrameResourceInde
             .properties = vk::MemoryPropertyFlagBits::eHostVisible,
             .vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
             .vma_memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .allocation_info_out = &allocation_info }
+            .allocation_info_out = &allocation_info,
+            .category = memory::AllocationCategory::imgui }
           COMMA_CWDEBUG_ONLY(ambifix(".m_frame_resources_list[" + std::to_string(index.get_value()) + "].m_index_buffer")));
       frame_resources.m_mapped_index_buffer = static_cast<ImDrawIdx*>(allocation_info.pMappedData);
     }
@@ -1093,7 +1098,7 @@ ImGui::~ImGui()
 
 namespace imgui {
 
-void StatsWindow::draw(ImGuiIO& io, vk_utils::TimerData const& timer)
+void StatsWindow::draw(ImGuiIO& io, vk_utils::TimerData const& timer, vulkan::LogicalDevice const* logical_device)
 {
   ImGui::SetNextWindowSize(ImVec2(100.0f, 100.0));
   ImGui::Begin("Stats", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoScrollbar);
@@ -1126,6 +1131,36 @@ void StatsWindow::draw(ImGuiIO& io, vk_utils::TimerData const& timer)
   }
 
   ImGui::End();
+
+  if (logical_device)
+    draw_memory_statistics(logical_device->residency_manager().statistics());
+}
+
+void StatsWindow::draw_memory_statistics(vulkan::memory::ResidencyManager::Statistics const& statistics)
+{
+  using namespace vulkan::memory;
+  constexpr float MiB = 1024.0f * 1024.0f;
+
+  ImGui::Begin("GPU memory", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+  ImGui::Text("%-10s %6s %10s", "category", "allocs", "MiB");
+  for (size_t category = 0; category < number_of_allocation_categories; ++category)
+  {
+    ResidencyManager::CategoryStatistics const& category_statistics = statistics.m_categories[category];
+    ImGui::Text("%-10s %6u %10.2f", to_string(static_cast<AllocationCategory>(category)),
+        category_statistics.m_allocation_count, category_statistics.m_bytes / MiB);
+  }
+
+  ImGui::Separator();
+  ImGui::Text("%-4s %6s %6s %10s %10s", "heap", "blocks", "allocs", "MiB used", "MiB budget");
+  for (size_t heap = 0; heap < statistics.m_heaps.size(); ++heap)
+  {
+    ResidencyManager::HeapBudget const& heap_budget = statistics.m_heaps[heap];
+    ImGui::Text("%-4zu %6u %6u %10.2f %10.2f", heap, heap_budget.m_block_count, heap_budget.m_allocation_count,
+        heap_budget.m_allocation_bytes / MiB, heap_budget.m_budget / MiB);
+  }
+
+  ImGui::End();
 }
 
 } // namespace imgui
@@ -3,6 +3,7 @@
 #include "CurrentFrameData.h"
 #include "Texture.h"
 #include "memory/Buffer.h"
+#include "memory/ResidencyManager.h"
 #include "shaderbuilder/ShaderIndex.h"
 #include "shaderbuilder/VertexAttribute.h"
 #include "shaderbuilder/VertexShaderInputSet.h"
@@ -154,7 +155,11 @@ class StatsWindow
   bool m_show_fps = true;       // To show FPS or ms.
 
  public:
-  void draw(ImGuiIO& io, vk_utils::TimerData const& timer);
+  // If logical_device is non-null then also draw a window with the memory usage per allocation category and per heap.
+  void draw(ImGuiIO& io, vk_utils::TimerData const& timer, vulkan::LogicalDevice const* logical_device = nullptr);
+
+ private:
+  void draw_memory_statistics(vulkan::memory::ResidencyManager::Statistics const& statistics);
 };
 
 } // namespace imgui
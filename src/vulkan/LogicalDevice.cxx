@@ -8,6 +8,7 @@
 #include "SynchronousWindow.h"
 #include "queues/QueueFamilyProperties.h"
 #include "queues/QueueReply.h"
+#include "memory/StagingBufferRing.h"
 #include "infos/DeviceCreateInfo.h"
 #include "vk_utils/find_missing_names.h"
 #include "vk_utils/get_binary_file_contents.h"
@@ -15,6 +16,7 @@
 #include "utils/is_power_of_two.h"
 #include "utils/MultiLoop.h"
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 #include "debug.h"
 
 namespace vulkan {
@@ -329,6 +331,19 @@ QueueFamilies::QueueFamilies(vk::PhysicalDevice vh_physical_device, vk::SurfaceK
   }
 }
 
+bool LogicalDevice::supports_linear_blit(vk::Format format) const
+{
+  vk::FormatFeatureFlags const required_features =
+    vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+  return (m_vh_physical_device.getFormatProperties(format).optimalTilingFeatures & required_features) == required_features;
+}
+
+bool LogicalDevice::supports_sampled_image_format(vk::Format format) const
+{
+  vk::FormatFeatureFlags const required_features = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eTransferDst;
+  return (m_vh_physical_device.getFormatProperties(format).optimalTilingFeatures & required_features) == required_features;
+}
+
 bool LogicalDevice::verify_presentation_support(vulkan::PresentationSurface const& surface) const
 {
   DoutEntering(dc::vulkan, "LogicalDevice::verify_presentation_support(" << surface << ")");
@@ -365,27 +380,28 @@ void LogicalDevice::prepare(
         .shaderUniformTexelBufferArrayDynamicIndexing       = false,
         .shaderStorageTexelBufferArrayDynamicIndexing       = false,
         .shaderUniformBufferArrayNonUniformIndexing         = false,
-        .shaderSampledImageArrayNonUniformIndexing          = false,
+        .shaderSampledImageArrayNonUniformIndexing          = true,     // Optional; used by BindlessTextures.
         .shaderStorageBufferArrayNonUniformIndexing         = false,
         .shaderStorageImageArrayNonUniformIndexing          = false,
         .shaderInputAttachmentArrayNonUniformIndexing       = false,
         .shaderUniformTexelBufferArrayNonUniformIndexing    = false,
         .shaderStorageTexelBufferArrayNonUniformIndexing    = false,
         .descriptorBindingUniformBufferUpdateAfterBind      = false,
-        .descriptorBindingSampledImageUpdateAfterBind       = false,
+        .descriptorBindingSampledImageUpdateAfterBind       = true,     // Optional; used by BindlessTextures.
         .descriptorBindingStorageImageUpdateAfterBind       = false,
         .descriptorBindingStorageBufferUpdateAfterBind      = false,
         .descriptorBindingUniformTexelBufferUpdateAfterBind = false,
         .descriptorBindingStorageTexelBufferUpdateAfterBind = false,
-        .descriptorBindingUpdateUnusedWhilePending          = false,
-        .descriptorBindingPartiallyBound                    = false,
+        .descriptorBindingUpdateUnusedWhilePending          = true,     // Optional; used by BindlessTextures.
+        .descriptorBindingPartiallyBound                    = true,     // Optional; used by BindlessTextures.
         .descriptorBindingVariableDescriptorCount           = false,
-        .runtimeDescriptorArray                             = false,
+        .runtimeDescriptorArray                             = true,     // Optional; used by BindlessTextures.
 
         .imagelessFramebuffer = true,           // Mandatory feature.
         .separateDepthStencilLayouts = true },  // Optional feature.
       // 1.3 features.
-      { .pipelineCreationCacheControl = true }  // Optional feature.
+      { .pipelineCreationCacheControl = true,   // Optional feature.
+        .maintenance4 = true }                  // Optional feature.
   );
 
   // Get the required physical device features from the user, using the virtual function prepare_physical_device_features.
@@ -483,8 +499,9 @@ void LogicalDevice::prepare(
 #ifdef CWDEBUG
     debug::Mark mark;
 #endif
-    vk::StructureChain<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceInlineUniformBlockProperties> properties_chain;
+    vk::StructureChain<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceInlineUniformBlockProperties, vk::PhysicalDeviceDescriptorIndexingProperties> properties_chain;
     auto& properties2                     = properties_chain.get<vk::PhysicalDeviceProperties2>();
+    auto& descriptor_indexing_properties  = properties_chain.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
     m_vh_physical_device.getProperties2(&properties2);
     vk::PhysicalDeviceProperties& properties = properties2.properties;
     // Exposition only currently (not yet used).
@@ -492,8 +509,14 @@ void LogicalDevice::prepare(
 
     Dout(dc::vulkan, properties);
     m_non_coherent_atom_size    = properties.limits.nonCoherentAtomSize;
+    m_min_uniform_buffer_offset_alignment = properties.limits.minUniformBufferOffsetAlignment;
     m_max_sampler_anisotropy    = properties.limits.maxSamplerAnisotropy;
     m_max_bound_descriptor_sets = properties.limits.maxBoundDescriptorSets;
+    m_max_bindless_textures = std::min({ descriptor_indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+        descriptor_indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+        descriptor_indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        descriptor_indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+        descriptor::BindlessTextures::s_max_textures });
     m_set_limits = {
       .maxPerStageDescriptorSamplers = properties.limits.maxPerStageDescriptorSamplers,
       .maxPerStageDescriptorUniformBuffers = properties.limits.maxPerStageDescriptorUniformBuffers,
@@ -513,8 +536,10 @@ void LogicalDevice::prepare(
     };
 
     Dout(dc::vulkan, "m_non_coherent_atom_size = " << m_non_coherent_atom_size);
+    Dout(dc::vulkan, "m_min_uniform_buffer_offset_alignment = " << m_min_uniform_buffer_offset_alignment);
     Dout(dc::vulkan, "m_max_sampler_anisotropy = " << m_max_sampler_anisotropy);
     Dout(dc::vulkan, "m_max_bound_descriptor_sets = " << m_max_bound_descriptor_sets);
+    Dout(dc::vulkan, "m_max_bindless_textures = " << m_max_bindless_textures);
     Dout(dc::vulkan, "m_set_limits = " << m_set_limits);
   }
   Dout(dc::vulkan, "Physical Device Memory Properties:");
@@ -526,6 +551,11 @@ void LogicalDevice::prepare(
     Dout(dc::vulkan, memory_properties);
     m_memory_type_count = memory_properties.memoryTypeCount;
     m_memory_heap_count = memory_properties.memoryHeapCount;
+    m_supports_lazily_allocated_memory = false;
+    for (uint32_t i = 0; i < m_memory_type_count; ++i)
+      if ((memory_properties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated))
+        m_supports_lazily_allocated_memory = true;
+    Dout(dc::vulkan, "m_supports_lazily_allocated_memory = " << std::boolalpha << m_supports_lazily_allocated_memory);
   }
   Dout(dc::vulkan, "Physical Device Features:");
   {
@@ -536,6 +566,10 @@ void LogicalDevice::prepare(
     m_supports_sampler_anisotropy = features10.samplerAnisotropy;
     m_supports_separate_depth_stencil_layouts = features12.separateDepthStencilLayouts;
     m_supports_cache_control = features13.pipelineCreationCacheControl;
+    m_supports_maintenance4 = features13.maintenance4;
+    m_supports_bindless_textures = features12.shaderSampledImageArrayNonUniformIndexing &&
+      features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingUpdateUnusedWhilePending &&
+      features12.descriptorBindingPartiallyBound && features12.runtimeDescriptorArray;
     Dout(dc::vulkan, features2);
   }
 #ifdef CWDEBUG
@@ -596,6 +630,9 @@ void LogicalDevice::prepare(
   m_device->setDebugUtilsObjectNameEXT(name_info);
 #endif
 
+  // Start the thread that waits for timeline semaphores (this requires m_device).
+  m_semaphore_watcher->start_waiter(this);
+
   // Initialize the VMA allocator.
   VmaVulkanFunctions vma_vulkan_functions{
     .vkGetInstanceProcAddr = vkGetInstanceProcAddr,
@@ -610,6 +647,10 @@ void LogicalDevice::prepare(
   };
   m_vh_allocator.create(vma_allocator_create_info);
 
+  // Create the staging buffer ring that is used by CopyDataToGPU.
+  m_staging_buffer_ring = std::make_unique<memory::StagingBufferRing>(this, staging_buffer_ring_size()
+      COMMA_CWDEBUG_ONLY(debug_name_prefix("m_staging_buffer_ring")));
+
   {
     std::vector<vk::DescriptorPoolSize> pool_sizes = {
       {
@@ -665,6 +706,13 @@ void LogicalDevice::prepare(
     descriptor_pool_t::wat descriptor_pool_w(m_descriptor_pool);
     *descriptor_pool_w = create_descriptor_pool(pool_sizes, 2200 COMMA_DEBUG_ONLY({".m_descriptor_pool"}));
   }
+
+  // Create the bindless texture table.
+  if (m_supports_bindless_textures)
+    m_bindless_textures = std::make_unique<descriptor::BindlessTextures>(this, m_max_bindless_textures
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_bindless_textures")));
+  else
+    Dout(dc::warning, "The physical device does not support the descriptor indexing features required for bindless textures.");
 }
 
 Queue LogicalDevice::acquire_queue(QueueRequestKey queue_request_key) const
@@ -787,6 +835,23 @@ vk::UniqueRenderPass LogicalDevice::create_render_pass(
 #endif
   };
 
+  // If this render pass begins using memory that a preceding render pass used for a different attachment (see
+  // RenderGraph::compute_memory_aliasing), then all accesses to that memory by the preceding render passes must
+  // have finished before the layout transition of the new attachment (write-after-write and write-after-read).
+  if (render_graph_pass.reuses_aliased_memory())
+    dependencies.push_back({
+      .srcSubpass = VK_SUBPASS_EXTERNAL,
+      .dstSubpass = 0,
+      .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                      vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eFragmentShader,
+      .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                      vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eFragmentShader,
+      .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+      .dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite |
+                       vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+                       vk::AccessFlagBits::eInputAttachmentRead
+    });
+
   vk::RenderPassCreateInfo render_pass_create_info{
     .attachmentCount = static_cast<uint32_t>(attachment_descriptions.size()),
     .pAttachments = attachment_descriptions.data(),
@@ -893,12 +958,13 @@ vk::UniqueFramebuffer LogicalDevice::create_imageless_framebuffer(
 }
 
 vk::UniqueDescriptorPool LogicalDevice::create_descriptor_pool(
+    vk::DescriptorPoolCreateFlags flags,
     std::vector<vk::DescriptorPoolSize> const& pool_sizes,
     uint32_t max_sets
     COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const
 {
   vk::DescriptorPoolCreateInfo descriptor_pool_create_info{
-//    .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+    .flags = flags,
     .maxSets = max_sets,
     .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
     .pPoolSizes = pool_sizes.data()
@@ -921,6 +987,30 @@ vk::UniqueDescriptorSetLayout LogicalDevice::create_descriptor_set_layout(
   return set_layout;
 }
 
+vk::UniqueDescriptorSetLayout LogicalDevice::create_descriptor_set_layout(
+    vk::DescriptorSetLayoutCreateFlags flags,
+    std::vector<vk::DescriptorSetLayoutBinding> const& layout_bindings,
+    std::vector<vk::DescriptorBindingFlags> const& binding_flags
+    COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const
+{
+  // There must be one vk::DescriptorBindingFlags per binding.
+  ASSERT(binding_flags.size() == layout_bindings.size());
+  vk::StructureChain<vk::DescriptorSetLayoutCreateInfo, vk::DescriptorSetLayoutBindingFlagsCreateInfo> descriptor_set_layout_create_info_chain(
+    {
+      .flags = flags,
+      .bindingCount = static_cast<uint32_t>(layout_bindings.size()),
+      .pBindings = layout_bindings.data()
+    },
+    {
+      .bindingCount = static_cast<uint32_t>(binding_flags.size()),
+      .pBindingFlags = binding_flags.data()
+    }
+  );
+  vk::UniqueDescriptorSetLayout set_layout = m_device->createDescriptorSetLayoutUnique(descriptor_set_layout_create_info_chain.get<vk::DescriptorSetLayoutCreateInfo>());
+  DebugSetName(set_layout, debug_name, this);
+  return set_layout;
+}
+
 std::vector<vk::DescriptorSet> LogicalDevice::allocate_descriptor_sets(
     std::vector<vk::DescriptorSetLayout> const& vhv_descriptor_set_layout,
     vk::DescriptorPool vh_descriptor_pool
@@ -1254,6 +1344,8 @@ LogicalDevice::LogicalDevice() : m_semaphore_watcher(statefultask::create<task::
 
 LogicalDevice::~LogicalDevice()
 {
+  // The waiter thread must be stopped before m_device is destroyed.
+  m_semaphore_watcher->stop_waiter();
 }
 
 #ifdef TRACY_ENABLE
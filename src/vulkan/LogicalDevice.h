@@ -12,9 +12,12 @@
 #include "queues/QueueRequestKey.h"
 #include "queues/QueueReply.h"
 #include "memory/Allocator.h"
+#include "memory/ResidencyManager.h"
+#include "memory/BufferPools.h"
 #include "descriptor/SetLimits.h"
 #include "descriptor/LayoutBindingCompare.h"
 #include "descriptor/SetLayout.h"
+#include "descriptor/BindlessTextures.h"
 #include "pipeline/PushConstantRangeCompare.h"
 #include "vk_utils/print_list.h"
 #include "statefultask/AIStatefulTask.h"
@@ -40,6 +43,7 @@
 namespace task {
 class SynchronousWindow;
 class AsyncSemaphoreWatcher;
+class Defragment;
 } // namespace task
 
 namespace vulkan {
@@ -62,6 +66,10 @@ class RenderPass;
 namespace memory {
 class Buffer;
 class Image;
+class StagingBufferRing;
+class BufferRelocator;
+class ImageRelocator;
+class AliasedMemory;
 } // namespace memory
 
 // The collection of queue family properties for a given physical device.
@@ -103,8 +111,10 @@ class LogicalDevice
 
   // Physical device properties.
   vk::DeviceSize m_non_coherent_atom_size;              // Allocated non-coherent memory must be a multiple of this value in size.
+  vk::DeviceSize m_min_uniform_buffer_offset_alignment; // Offsets into uniform buffers (including dynamic offsets) must be a multiple of this value.
   float m_max_sampler_anisotropy;                       // GraphicsSettingsPOD::maxAnisotropy must be less than or equal this value.
   uint32_t m_max_bound_descriptor_sets;                 // Each pipeline object can use up to m_max_bound_descriptor_sets descriptor sets.
+  uint32_t m_max_bindless_textures;                     // The size of the array of m_bindless_textures.
   descriptor::SetLimits m_set_limits;
 
   uint32_t m_memory_type_count;                         // The number of memory types of this GPU.
@@ -112,12 +122,19 @@ class LogicalDevice
   bool m_supports_separate_depth_stencil_layouts;       // Set if the physical device supports vk::PhysicalDeviceSeparateDepthStencilLayoutsFeatures.
   bool m_supports_sampler_anisotropy = {};
   bool m_supports_cache_control = {};
+  bool m_supports_bindless_textures = {};               // Set if the physical device supports the descriptor indexing features required by BindlessTextures.
+  bool m_supports_lazily_allocated_memory = {};         // Set if the physical device has a memory type with vk::MemoryPropertyFlagBits::eLazilyAllocated (tile-based GPUs).
+  bool m_supports_maintenance4 = {};                    // Set if the memory requirements of an image can be queried without creating it (vkGetDeviceImageMemoryRequirements).
   memory::Allocator m_vh_allocator;                     // Handle to VMA allocator object.
+  mutable memory::ResidencyManager m_residency_manager{&m_vh_allocator};  // Tracks all buffer and image allocations; thread-safe.
+  memory::BufferPools m_buffer_pools{&m_vh_allocator};  // Custom pools for small vertex, uniform and imgui buffers; thread-safe.
+  std::unique_ptr<memory::StagingBufferRing> m_staging_buffer_ring;     // Persistently mapped staging buffer, shared by all uploads (must be destroyed before m_vh_allocator).
   QueueRequestKey::request_cookie_type m_transfer_request_cookie = {};  // The cookie that was used to request eTransfer queues (set in LogicalDevice::prepare).
   boost::intrusive_ptr<task::AsyncSemaphoreWatcher> m_semaphore_watcher;// Asynchronous task that polls timeline semaphores.
 
   using descriptor_pool_t = aithreadsafe::Wrapper<vk::UniqueDescriptorPool, aithreadsafe::policy::Primitive<std::mutex>>;
   descriptor_pool_t m_descriptor_pool;
+  std::unique_ptr<descriptor::BindlessTextures> m_bindless_textures;    // Only created if m_supports_bindless_textures.
 
   using descriptor_set_layouts_container_t = std::map<std::vector<vk::DescriptorSetLayoutBinding>, vk::UniqueDescriptorSetLayout, utils::VectorCompare<descriptor::LayoutBindingCompare>>;
   using descriptor_set_layouts_t = aithreadsafe::Wrapper<descriptor_set_layouts_container_t, aithreadsafe::policy::ReadWrite<AIReadWriteMutex>>;
@@ -149,11 +166,28 @@ class LogicalDevice
   bool supports_separate_depth_stencil_layouts() const { return m_supports_separate_depth_stencil_layouts; }
   bool supports_sampler_anisotropy() const { return m_supports_sampler_anisotropy; }
   bool supports_cache_control() const { return m_supports_cache_control; }
+  bool supports_bindless_textures() const { return m_supports_bindless_textures; }
+  bool supports_lazily_allocated_memory() const { return m_supports_lazily_allocated_memory; }
+  bool supports_maintenance4() const { return m_supports_maintenance4; }
   vk::DeviceSize non_coherent_atom_size() const { return m_non_coherent_atom_size; }
+  vk::DeviceSize min_uniform_buffer_offset_alignment() const { return m_min_uniform_buffer_offset_alignment; }
   float max_sampler_anisotropy() const { return m_max_sampler_anisotropy; }
   uint32_t max_bound_descriptor_sets() const { return m_max_bound_descriptor_sets; }
   bool has_explicit_transfer_support() const { return m_queue_families.has_explicit_transfer_support(); }
+  QueueFlags queue_family_flags(QueueFamilyPropertiesIndex queue_family) const { return m_queue_families[queue_family].get_queue_flags(); }
+  // Returns true if optimal tiling images of this format can be the source and destination of vkCmdBlitImage with a linear filter.
+  bool supports_linear_blit(vk::Format format) const;
+  // Returns true if optimal tiling images of this format can be sampled and be the destination of transfer commands.
+  bool supports_sampled_image_format(vk::Format format) const;
   QueueRequestKey::request_cookie_type transfer_request_cookie() const { return m_transfer_request_cookie; }
+  // The returned ring is thread-safe.
+  memory::StagingBufferRing& staging_buffer_ring() const { return *m_staging_buffer_ring; }
+  // The returned residency manager is thread-safe.
+  memory::ResidencyManager& residency_manager() const { return m_residency_manager; }
+  // The returned pools are thread-safe.
+  memory::BufferPools const& buffer_pools() const { return m_buffer_pools; }
+  // The per-device bindless texture table; only call this if supports_bindless_textures() returns true. Thread-safe.
+  descriptor::BindlessTextures& bindless_textures() const { return *m_bindless_textures; }
 
   void print_on(std::ostream& os) const { char const* prefix = ""; os << '{'; print_members(os, prefix); os << '}'; }
   void print_members(std::ostream& os, char const* prefix) const;
@@ -218,6 +252,10 @@ class LogicalDevice
     DoutEntering(dc::vkframe, "LogicalDevice::wait_for_fences(" << fences << ", " << wait_all << ", " << timeout << ")");
     return m_device->waitForFences(fences, wait_all, timeout);
   }
+  vk::Result get_fence_status(vk::Fence fence) const
+  {
+    return m_device->getFenceStatus(fence);
+  }
   void reset_fences(vk::ArrayProxy<vk::Fence const> const& fences) const
   {
     DoutEntering(dc::vkframe, "LogicalDevice::reset_fences(" << fences << ")");
@@ -252,10 +290,16 @@ class LogicalDevice
       COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
   vk::UniqueFramebuffer create_imageless_framebuffer(RenderPass const& render_graph_pass, vk::Extent2D extent, uint32_t layers
       COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) const;
-  vk::UniqueDescriptorPool create_descriptor_pool(std::vector<vk::DescriptorPoolSize> const& pool_sizes, uint32_t max_sets
+  vk::UniqueDescriptorPool create_descriptor_pool(vk::DescriptorPoolCreateFlags flags, std::vector<vk::DescriptorPoolSize> const& pool_sizes, uint32_t max_sets
       COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
+  vk::UniqueDescriptorPool create_descriptor_pool(std::vector<vk::DescriptorPoolSize> const& pool_sizes, uint32_t max_sets
+      COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const { return create_descriptor_pool({}, pool_sizes, max_sets COMMA_CWDEBUG_ONLY(debug_name)); }
   vk::UniqueDescriptorSetLayout create_descriptor_set_layout(std::vector<vk::DescriptorSetLayoutBinding> const& layout_bindings
       COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
+  // Create a descriptor set layout with per-binding flags (binding_flags must have the same size as layout_bindings).
+  vk::UniqueDescriptorSetLayout create_descriptor_set_layout(vk::DescriptorSetLayoutCreateFlags flags,
+      std::vector<vk::DescriptorSetLayoutBinding> const& layout_bindings, std::vector<vk::DescriptorBindingFlags> const& binding_flags
+      COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
   std::vector<vk::DescriptorSet> allocate_descriptor_sets(std::vector<vk::DescriptorSetLayout> const& vhv_descriptor_set_layout, vk::DescriptorPool vh_descriptor_pool
       COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
   std::vector<vk::UniqueDescriptorSet> allocate_descriptor_sets_unique(std::vector<vk::DescriptorSetLayout> const& vhv_descriptor_set_layout, vk::DescriptorPool vh_descriptor_pool
@@ -288,18 +332,29 @@ class LogicalDevice
 
   // Called by memory::Buffer::Buffer.
   vk::Buffer create_buffer(utils::Badge<memory::Buffer>, vk::BufferCreateInfo const& buffer_create_info,
-      VmaAllocationCreateInfo const& vma_allocation_create_info, VmaAllocation* vh_allocation, VmaAllocationInfo* allocation_info
+      VmaAllocationCreateInfo const& vma_allocation_create_info, VmaAllocation* vh_allocation, VmaAllocationInfo* allocation_info,
+      memory::AllocationCategory category
       COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
   {
-    DoutEntering(dc::vulkan, "LogicalDevice::create_buffer(" << buffer_create_info << ", " << debug::set_device(this) << vma_allocation_create_info << ", " << (void*)vh_allocation << ")");
-    return m_vh_allocator.create_buffer(buffer_create_info, vma_allocation_create_info, vh_allocation, allocation_info
+    DoutEntering(dc::vulkan, "LogicalDevice::create_buffer(" << buffer_create_info << ", " << debug::set_device(this) << vma_allocation_create_info << ", " << (void*)vh_allocation << ", " << to_string(category) << ")");
+    // Evict least recently used resources if this allocation would not fit in the budget.
+    if (AI_UNLIKELY(m_residency_manager.under_pressure(buffer_create_info.size)))
+      m_residency_manager.make_room(m_vh_allocator.find_memory_type_index(buffer_create_info, vma_allocation_create_info), buffer_create_info.size);
+    // Allocate small buffers from the custom pool of their category.
+    VmaAllocationCreateInfo pooled_allocation_create_info = vma_allocation_create_info;
+    if (!pooled_allocation_create_info.pool)
+      pooled_allocation_create_info.pool = m_buffer_pools.pool_for(buffer_create_info, vma_allocation_create_info, category);
+    vk::Buffer vh_buffer = m_vh_allocator.create_buffer(buffer_create_info, pooled_allocation_create_info, vh_allocation, allocation_info
         COMMA_CWDEBUG_ONLY(allocation_name));
+    m_residency_manager.track(*vh_allocation, category);
+    return vh_buffer;
   }
 
   // Called by memory::Buffer::destroy().
   void destroy_buffer(utils::Badge<memory::Buffer>, vk::Buffer vh_buffer, VmaAllocation vh_allocation) const
   {
     DoutEntering(dc::vulkan, "LogicalDevice::destroy_buffer(" << vh_buffer << ", " << vh_allocation << ")");
+    m_residency_manager.untrack(vh_allocation);
     m_vh_allocator.destroy_buffer(vh_buffer, vh_allocation);
   }
 
@@ -344,21 +399,95 @@ class LogicalDevice
 
   // Called by memory::Image::Image.
   vk::Image create_image(utils::Badge<memory::Image>, vk::ImageCreateInfo const& image_create_info,
-      VmaAllocationCreateInfo const& vma_allocation_create_info, VmaAllocation* vh_allocation, VmaAllocationInfo* allocation_info
+      VmaAllocationCreateInfo const& vma_allocation_create_info, VmaAllocation* vh_allocation, VmaAllocationInfo* allocation_info,
+      memory::AllocationCategory category
       COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
   {
-    DoutEntering(dc::vulkan, "LogicalDevice::create_image(" << image_create_info << ", " << debug::set_device(this) << vma_allocation_create_info << ", " << (void*)vh_allocation << ")");
-    return m_vh_allocator.create_image(image_create_info, vma_allocation_create_info, vh_allocation, allocation_info
+    DoutEntering(dc::vulkan, "LogicalDevice::create_image(" << image_create_info << ", " << debug::set_device(this) << vma_allocation_create_info << ", " << (void*)vh_allocation << ", " << to_string(category) << ")");
+    // Evict least recently used resources if this allocation would not fit in the budget.
+    // The size of the image is only known before creating it with maintenance4, and it is only needed if anything can be evicted.
+    if (m_supports_maintenance4 && m_residency_manager.has_evictables())
+    {
+      vk::DeviceSize const size = m_device->getImageMemoryRequirements(vk::DeviceImageMemoryRequirements{ .pCreateInfo = &image_create_info }).memoryRequirements.size;
+      if (AI_UNLIKELY(m_residency_manager.under_pressure(size)))
+        m_residency_manager.make_room(m_vh_allocator.find_memory_type_index(image_create_info, vma_allocation_create_info), size);
+    }
+    vk::Image vh_image = m_vh_allocator.create_image(image_create_info, vma_allocation_create_info, vh_allocation, allocation_info
         COMMA_CWDEBUG_ONLY(allocation_name));
+    m_residency_manager.track(*vh_allocation, category);
+    return vh_image;
+  }
+
+  // Called by memory::Image::Image for an image that is bound to (a part of) a memory::AliasedMemory.
+  vk::Image create_aliasing_image(utils::Badge<memory::Image>, VmaAllocation vh_allocation, vk::ImageCreateInfo const& image_create_info) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::create_aliasing_image(" << vh_allocation << ", " << image_create_info << ")");
+    return m_vh_allocator.create_aliasing_image(vh_allocation, image_create_info);
   }
 
-  // Called by memory::Image::destroy().
+  // Called by memory::Image::destroy(). vh_allocation is null for an aliasing image; in that case only the image is destroyed.
   void destroy_image(utils::Badge<memory::Image>, vk::Image vh_image, VmaAllocation vh_allocation) const
   {
     DoutEntering(dc::vulkan, "LogicalDevice::destroy_image(" << vh_image << ", " << vh_allocation << ")");
+    if (vh_allocation)
+      m_residency_manager.untrack(vh_allocation);
     m_vh_allocator.destroy_image(vh_image, vh_allocation);
   }
 
+  // Called by memory::AliasedMemory::AliasedMemory.
+  VmaAllocation allocate_memory(utils::Badge<memory::AliasedMemory>, vk::MemoryRequirements const& memory_requirements,
+      VmaAllocationCreateInfo const& vma_allocation_create_info, memory::AllocationCategory category
+      COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::allocate_memory(" << memory_requirements << ", " << debug::set_device(this) << vma_allocation_create_info << ", " << to_string(category) << ")");
+    // Evict least recently used resources if this allocation would not fit in the budget.
+    if (AI_UNLIKELY(m_residency_manager.under_pressure(memory_requirements.size)))
+      m_residency_manager.make_room(m_vh_allocator.find_memory_type_index(memory_requirements.memoryTypeBits, vma_allocation_create_info), memory_requirements.size);
+    VmaAllocation vh_allocation = m_vh_allocator.allocate_memory(memory_requirements, vma_allocation_create_info, nullptr
+        COMMA_CWDEBUG_ONLY(allocation_name));
+    m_residency_manager.track(vh_allocation, category);
+    return vh_allocation;
+  }
+
+  // Called by memory::AliasedMemory::destroy().
+  void free_memory(utils::Badge<memory::AliasedMemory>, VmaAllocation vh_allocation) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::free_memory(" << vh_allocation << ")");
+    m_residency_manager.untrack(vh_allocation);
+    m_vh_allocator.free_memory(vh_allocation);
+  }
+
+  // Called by memory::BufferRelocator::create_relocated.
+  vk::Buffer create_aliasing_buffer(utils::Badge<memory::BufferRelocator>, VmaAllocation vh_allocation, vk::BufferCreateInfo const& buffer_create_info) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::create_aliasing_buffer(" << vh_allocation << ", " << buffer_create_info << ")");
+    return m_vh_allocator.create_aliasing_buffer(vh_allocation, buffer_create_info);
+  }
+
+  // Called by memory::BufferRelocator::destroy_old. This destroys the buffer, but not its allocation.
+  void destroy_buffer_keep_allocation(utils::Badge<memory::BufferRelocator>, vk::Buffer vh_buffer) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::destroy_buffer_keep_allocation(" << vh_buffer << ")");
+    m_device->destroyBuffer(vh_buffer);
+  }
+
+  // Called by memory::ImageRelocator::create_relocated.
+  vk::Image create_aliasing_image(utils::Badge<memory::ImageRelocator>, VmaAllocation vh_allocation, vk::ImageCreateInfo const& image_create_info) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::create_aliasing_image(" << vh_allocation << ", " << image_create_info << ")");
+    return m_vh_allocator.create_aliasing_image(vh_allocation, image_create_info);
+  }
+
+  // Called by memory::ImageRelocator::destroy_old. This destroys the image, but not its allocation.
+  void destroy_image_keep_allocation(utils::Badge<memory::ImageRelocator>, vk::Image vh_image) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::destroy_image_keep_allocation(" << vh_image << ")");
+    m_device->destroyImage(vh_image);
+  }
+
+  // Used by task::Defragment.
+  memory::Allocator const& allocator(utils::Badge<task::Defragment>) const { return m_vh_allocator; }
+
   // End of API for access to m_vh_allocator.
   //---------------------------------------------------------------------------
 
@@ -392,6 +521,14 @@ class LogicalDevice
     DoutEntering(dc::vulkan, "LogicalDevice::get_image_memory_requirements(" << vh_image << ")");
     return m_device->getImageMemoryRequirements(vh_image);
   }
+  // Returns the memory requirements of an image that would be created with image_create_info, without creating it.
+  // Requires supports_maintenance4().
+  vk::MemoryRequirements get_image_memory_requirements(vk::ImageCreateInfo const& image_create_info) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::get_image_memory_requirements(" << image_create_info << ")");
+    ASSERT(m_supports_maintenance4);
+    return m_device->getImageMemoryRequirements(vk::DeviceImageMemoryRequirements{ .pCreateInfo = &image_create_info }).memoryRequirements;
+  }
   vk::DescriptorPool get_vh_descriptor_pool() const
   {
     descriptor_pool_t::crat descriptor_pool_r(m_descriptor_pool);
@@ -412,6 +549,9 @@ class LogicalDevice
 
   // Override this function to add QueueRequest objects. The default will create a graphics and presentation queue.
   virtual void prepare_logical_device(DeviceCreateInfo& device_create_info) const { }
+
+  // Override this function to change the size of the staging buffer ring (in bytes).
+  virtual vk::DeviceSize staging_buffer_ring_size() const { return 64 * 1024 * 1024; }
 };
 
 } // namespace vulkan
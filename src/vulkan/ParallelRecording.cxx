@@ -0,0 +1,70 @@
+#include "sys.h"
+#include "ParallelRecording.h"
+#include "RenderPass.h"
+#include <Tracy.hpp>
+
+namespace vulkan {
+
+void ParallelRecording::add(RenderPass const& render_pass, record_function_type record_function)
+{
+  m_jobs.push_back({ &render_pass, std::move(record_function), {} });
+  m_unfinished_jobs.fetch_add(1, std::memory_order::relaxed);
+}
+
+void ParallelRecording::record(Job const& job)
+{
+  ZoneScopedN("ParallelRecording::record");
+  handle::CommandBuffer command_buffer = job.m_command_buffer;
+  vk::CommandBufferInheritanceInfo command_buffer_inheritance_info{
+    .renderPass = job.m_render_pass->vh_render_pass(),
+    .subpass = 0,
+    .framebuffer = job.m_render_pass->vh_framebuffer()
+  };
+  command_buffer->begin({
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+    .pInheritanceInfo = &command_buffer_inheritance_info
+  });
+  job.m_record_function(command_buffer);
+  command_buffer->end();
+}
+
+void ParallelRecording::record_jobs()
+{
+  int const end = number_of_jobs();
+  for (;;)
+  {
+    int const job = m_next_job.fetch_add(1, std::memory_order::relaxed);
+    if (job >= end)
+      break;
+    record(m_jobs[job]);
+    // The last one to finish wakes up wait().
+    if (m_unfinished_jobs.fetch_sub(1, std::memory_order::acq_rel) == 1)
+      m_unfinished_jobs.notify_all();
+  }
+}
+
+void ParallelRecording::wait()
+{
+  ZoneScopedN("ParallelRecording::wait");
+  int unfinished_jobs;
+  while ((unfinished_jobs = m_unfinished_jobs.load(std::memory_order::acquire)) > 0)
+    m_unfinished_jobs.wait(unfinished_jobs, std::memory_order::acquire);
+}
+
+void ParallelRecording::execute(handle::CommandBuffer command_buffer) const
+{
+  std::vector<vk::CommandBuffer> vh_secondary_command_buffers;
+  for (auto job = m_jobs.begin(); job != m_jobs.end();)
+  {
+    RenderPass const* render_pass = job->m_render_pass;
+    vh_secondary_command_buffers.clear();
+    do
+      vh_secondary_command_buffers.push_back(job->m_command_buffer);
+    while (++job != m_jobs.end() && job->m_render_pass == render_pass);
+    command_buffer->beginRenderPass(render_pass->begin_info(), vk::SubpassContents::eSecondaryCommandBuffers);
+    command_buffer->executeCommands(vh_secondary_command_buffers);
+    command_buffer->endRenderPass();
+  }
+}
+
+} // namespace vulkan
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CommandBuffer.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "debug.h"
+
+namespace vulkan {
+
+class RenderPass;
+
+// A list of jobs that each record part of a frame into their own secondary command buffer.
+//
+// Usage (from draw_frame):
+//
+//   auto recording = std::make_shared<vulkan::ParallelRecording>();
+//   for (int part = 0; part < number_of_parts; ++part)
+//     recording->add(main_pass, [this, part](vulkan::handle::CommandBuffer command_buffer){
+//       // Record the draw calls of `part` into command_buffer.
+//     });
+//   recording->add(imgui_pass, [this](vulkan::handle::CommandBuffer command_buffer){
+//     m_imgui.render_frame(command_buffer, ...);
+//   });
+//   record_in_parallel(command_buffer, recording);
+//
+// record_in_parallel records the jobs on the thread pool (and on the calling thread), then
+// records into command_buffer, for each consecutive run of jobs with the same render pass,
+// a beginRenderPass, the execution of their secondary command buffers (in the order in which
+// they were added) and an endRenderPass.
+//
+// The record functions are called concurrently and may not record a beginRenderPass / endRenderPass.
+class ParallelRecording
+{
+ public:
+  using record_function_type = std::function<void(handle::CommandBuffer)>;
+
+ private:
+  struct Job
+  {
+    RenderPass const* m_render_pass;                    // The render pass that the commands are recorded for.
+    record_function_type m_record_function;             // The function that records the commands.
+    handle::CommandBuffer m_command_buffer;             // The secondary command buffer to record into.
+  };
+
+  std::vector<Job> m_jobs;
+  std::atomic<int> m_next_job{0};                       // The index of the next job to record.
+  std::atomic<int> m_unfinished_jobs{0};                // The number of jobs that weren't recorded yet.
+
+ public:
+  // Add a job that records (part of) the commands of render_pass.
+  void add(RenderPass const& render_pass, record_function_type record_function);
+
+  int number_of_jobs() const { return static_cast<int>(m_jobs.size()); }
+
+  // Used by SynchronousWindow::record_in_parallel.
+  void set_command_buffer(int job, handle::CommandBuffer command_buffer) { m_jobs[job].m_command_buffer = command_buffer; }
+  // Record jobs until there are no jobs left to start. Called from one or more threads at the same time.
+  void record_jobs();
+  // Wait until all jobs are recorded.
+  void wait();
+  // Record the execution of all secondary command buffers into the primary command_buffer.
+  void execute(handle::CommandBuffer command_buffer) const;
+
+ private:
+  void record(Job const& job);
+};
+
+} // namespace vulkan
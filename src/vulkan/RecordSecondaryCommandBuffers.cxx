@@ -0,0 +1,45 @@
+#include "sys.h"
+#include "RecordSecondaryCommandBuffers.h"
+#include <Tracy.hpp>
+
+namespace task {
+
+RecordSecondaryCommandBuffers::~RecordSecondaryCommandBuffers()
+{
+  DoutEntering(dc::statefultask(mSMDebug), "RecordSecondaryCommandBuffers::~RecordSecondaryCommandBuffers() [" << this << "]");
+}
+
+char const* RecordSecondaryCommandBuffers::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(RecordSecondaryCommandBuffers_record);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* RecordSecondaryCommandBuffers::task_name_impl() const
+{
+  return "RecordSecondaryCommandBuffers";
+}
+
+void RecordSecondaryCommandBuffers::initialize_impl()
+{
+  set_state(RecordSecondaryCommandBuffers_record);
+}
+
+void RecordSecondaryCommandBuffers::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case RecordSecondaryCommandBuffers_record:
+    {
+      ZoneScopedN("RecordSecondaryCommandBuffers_record");
+      m_recording->record_jobs();
+      finish();
+      break;
+    }
+  }
+}
+
+} // namespace task
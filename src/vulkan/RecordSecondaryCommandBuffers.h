@@ -0,0 +1,43 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "ParallelRecording.h"
+#include <memory>
+#include "debug.h"
+
+namespace task {
+
+// Helper task of SynchronousWindow::record_in_parallel: records jobs of a ParallelRecording
+// until there are none left to start.
+class RecordSecondaryCommandBuffers final : public vulkan::AsyncTask
+{
+ private:
+  std::shared_ptr<vulkan::ParallelRecording> m_recording;       // Shared, so that it outlives this task even if the window isn't waiting anymore.
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of this task.
+  enum RecordSecondaryCommandBuffers_state_type {
+    RecordSecondaryCommandBuffers_record = direct_base_type::state_end
+  };
+
+ public:
+  static constexpr state_type state_end = RecordSecondaryCommandBuffers_record + 1;
+
+  RecordSecondaryCommandBuffers(std::shared_ptr<vulkan::ParallelRecording> recording COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    direct_base_type(CWDEBUG_ONLY(debug)), m_recording(std::move(recording))
+  {
+    DoutEntering(dc::statefultask(mSMDebug), "RecordSecondaryCommandBuffers(" << m_recording.get() << ") [" << this << "]");
+  }
+
+ protected:
+  ~RecordSecondaryCommandBuffers() override;
+
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+};
+
+} // namespace task
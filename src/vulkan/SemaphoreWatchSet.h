@@ -0,0 +1,247 @@
+#pragma once
+
+#include "statefultask/AIStatefulTask.h"
+#include "utils/Vector.h"
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include "debug.h"
+
+namespace task {
+
+struct SemaphoreWatcherValueTaskConditionTriplet
+{
+  uint64_t m_signal_value;                                      // The counter value that we must reach before we can signal m_task.
+  AIStatefulTask* m_task;                                       // The task to wake up when the associated timeline semaphore reaches m_signal_value.
+  AIStatefulTask::condition_type m_condition;                   // The condition to use.
+
+  SemaphoreWatcherValueTaskConditionTriplet(uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition) :
+    m_signal_value(signal_value), m_task(task), m_condition(condition) { }
+
+  // Heap order: the triplet with the smallest m_signal_value is on top.
+  static bool heap_compare(SemaphoreWatcherValueTaskConditionTriplet const& lhs, SemaphoreWatcherValueTaskConditionTriplet const& rhs)
+  {
+    return lhs.m_signal_value > rhs.m_signal_value;
+  }
+};
+
+struct SemaphoreWatcherNotifyData
+{
+  std::vector<SemaphoreWatcherValueTaskConditionTriplet> m_value_task_condition_triplets;      // Min-heap of value / task / condition triplets (smallest signal value on top).
+
+  // Used for the first entry.
+  SemaphoreWatcherNotifyData(SemaphoreWatcherValueTaskConditionTriplet const& value_task_condition_triplet)
+  {
+    m_value_task_condition_triplets.push_back(value_task_condition_triplet);
+  }
+
+  void push(SemaphoreWatcherValueTaskConditionTriplet const& value_task_condition_triplet)
+  {
+    m_value_task_condition_triplets.push_back(value_task_condition_triplet);
+    std::push_heap(m_value_task_condition_triplets.begin(), m_value_task_condition_triplets.end(), &SemaphoreWatcherValueTaskConditionTriplet::heap_compare);
+  }
+
+  SemaphoreWatcherValueTaskConditionTriplet const& top() const
+  {
+    return m_value_task_condition_triplets.front();
+  }
+
+  void pop()
+  {
+    std::pop_heap(m_value_task_condition_triplets.begin(), m_value_task_condition_triplets.end(), &SemaphoreWatcherValueTaskConditionTriplet::heap_compare);
+    m_value_task_condition_triplets.pop_back();
+  }
+
+  bool empty() const
+  {
+    return m_value_task_condition_triplets.empty();
+  }
+};
+
+using SemaphoreWatcherIndex = utils::VectorIndex<SemaphoreWatcherNotifyData>;
+
+template<typename SEMAPHORE>
+struct SemaphoreWatcherWatchData
+{
+  SEMAPHORE const* m_timeline_semaphore;                        // The timeline semaphore to watch.
+  uint64_t m_signal_value;                                      // The smallest counter value that it must reach before we can call signal on a task.
+
+  // Clang requires a constructor.
+  SemaphoreWatcherWatchData(SEMAPHORE const* timeline_semaphore, uint64_t signal_value) :
+    m_timeline_semaphore(timeline_semaphore), m_signal_value(signal_value) { }
+};
+
+// A single call to SemaphoreWatcher::add, on its way to the SemaphoreWatchSet.
+template<typename SEMAPHORE>
+struct SemaphoreWatcherRegistration
+{
+  SemaphoreWatcherRegistration* m_next;                         // The registration that was pushed before this one.
+  SEMAPHORE const* m_timeline_semaphore;                        // The timeline semaphore to watch.
+  SemaphoreWatcherValueTaskConditionTriplet m_value_task_condition_triplet;
+
+  SemaphoreWatcherRegistration(SEMAPHORE const* timeline_semaphore, uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition) :
+    m_next(nullptr), m_timeline_semaphore(timeline_semaphore), m_value_task_condition_triplet(signal_value, task, condition) { }
+};
+
+// Multi-producer / single-consumer lock-free list of registrations.
+//
+// Producers push a registration with a CAS on m_head. The consumer takes the whole list at once
+// with an exchange; because nodes are never popped one by one there is no ABA problem.
+// The list returned by take_all is in LIFO order.
+template<typename SEMAPHORE>
+class SemaphoreWatcherRegistrationList
+{
+ public:
+  using registration_type = SemaphoreWatcherRegistration<SEMAPHORE>;
+
+ private:
+  std::atomic<registration_type*> m_head{nullptr};
+
+ public:
+  ~SemaphoreWatcherRegistrationList()
+  {
+    registration_type* registration = take_all();
+    while (registration)
+    {
+      registration_type* next = registration->m_next;
+      delete registration;
+      registration = next;
+    }
+  }
+
+  // Takes ownership of registration. Returns true if the list was empty.
+  bool push(registration_type* registration)
+  {
+    registration_type* head = m_head.load(std::memory_order::relaxed);
+    do
+      registration->m_next = head;
+    while (!m_head.compare_exchange_weak(head, registration, std::memory_order::release, std::memory_order::relaxed));
+    return head == nullptr;
+  }
+
+  // Returns all registrations that were pushed so far (the caller takes ownership).
+  registration_type* take_all()
+  {
+    // Fast path: don't write to the cache line when there is nothing to take.
+    if (m_head.load(std::memory_order::relaxed) == nullptr)
+      return nullptr;
+    return m_head.exchange(nullptr, std::memory_order::acquire);
+  }
+};
+
+// The timeline semaphores that are being watched, each with a min-heap of the tasks that wait for it.
+//
+// SEMAPHORE must have a member function `uint64_t get_counter_value() const`.
+// This class is not thread-safe; see SemaphoreWatcher.
+template<typename SEMAPHORE>
+class SemaphoreWatchSet
+{
+ public:
+  using registration_type = SemaphoreWatcherRegistration<SEMAPHORE>;
+
+ private:
+  utils::Vector<SemaphoreWatcherWatchData<SEMAPHORE>, SemaphoreWatcherIndex> m_watch_data;   // List with semaphores and the smallest counter value that we are waiting for.
+  utils::Vector<SemaphoreWatcherNotifyData, SemaphoreWatcherIndex> m_notify_data;           // List with associated notify data.
+  std::unordered_map<SEMAPHORE const*, SemaphoreWatcherIndex> m_index;                      // Maps each watched semaphore to its index in the above lists.
+
+  void erase(SemaphoreWatcherIndex wsi)
+  {
+    SemaphoreWatcherIndex const wsi_last{m_watch_data.size() - 1};
+    m_index.erase(m_watch_data[wsi].m_timeline_semaphore);
+    if (wsi != wsi_last)
+    {
+      m_watch_data[wsi] = m_watch_data[wsi_last];
+      m_notify_data[wsi] = std::move(m_notify_data[wsi_last]);
+      m_index[m_watch_data[wsi].m_timeline_semaphore] = wsi;
+    }
+    m_watch_data.pop_back();
+    m_notify_data.pop_back();
+  }
+
+ public:
+  // Add the registrations of the list returned by SemaphoreWatcherRegistrationList::take_all, and delete them.
+  void insert(registration_type* registration)
+  {
+    while (registration)
+    {
+      SemaphoreWatcherValueTaskConditionTriplet const& triplet = registration->m_value_task_condition_triplet;
+      auto [iter, inserted] = m_index.try_emplace(registration->m_timeline_semaphore, SemaphoreWatcherIndex{m_watch_data.size()});
+      if (inserted)
+      {
+        // New semaphore.
+        m_watch_data.emplace_back(registration->m_timeline_semaphore, triplet.m_signal_value);
+        m_notify_data.emplace_back(triplet);
+      }
+      else
+      {
+        m_notify_data[iter->second].push(triplet);
+        m_watch_data[iter->second].m_signal_value = m_notify_data[iter->second].top().m_signal_value;
+      }
+      registration_type* next = registration->m_next;
+      delete registration;
+      registration = next;
+    }
+  }
+
+  // Stop watching timeline_semaphore. Returns false if it wasn't being watched.
+  bool erase(SEMAPHORE const* timeline_semaphore)
+  {
+    auto iter = m_index.find(timeline_semaphore);
+    if (iter == m_index.end())
+      return false;
+    erase(iter->second);
+    return true;
+  }
+
+  // Append the triplets whose signal value was reached to ready, and forget about them.
+  void collect(std::vector<SemaphoreWatcherValueTaskConditionTriplet>& ready)
+  {
+    SemaphoreWatcherIndex wsi_end{m_watch_data.size()};
+    for (SemaphoreWatcherIndex wsi{0}; wsi != wsi_end;)
+    {
+      uint64_t const counter_value = m_watch_data[wsi].m_timeline_semaphore->get_counter_value();
+      if (counter_value < m_watch_data[wsi].m_signal_value)
+      {
+        ++wsi;
+        continue;
+      }
+      SemaphoreWatcherNotifyData& notify_data = m_notify_data[wsi];
+      do
+      {
+        ready.push_back(notify_data.top());
+        notify_data.pop();
+      }
+      while (!notify_data.empty() && notify_data.top().m_signal_value <= counter_value);
+      // It is not likely that we're waiting on multiple values of the same semaphore.
+      if (AI_UNLIKELY(!notify_data.empty()))
+      {
+        m_watch_data[wsi].m_signal_value = notify_data.top().m_signal_value;
+        ++wsi;
+        continue;
+      }
+      erase(wsi);       // This moves the last element to wsi.
+      --wsi_end;
+    }
+  }
+
+  // Call f(timeline_semaphore, signal_value) for each watched semaphore.
+  template<typename F>
+  void for_each(F&& f) const
+  {
+    for (SemaphoreWatcherWatchData<SEMAPHORE> const& watch_data : m_watch_data)
+      f(watch_data.m_timeline_semaphore, watch_data.m_signal_value);
+  }
+
+  bool empty() const
+  {
+    return m_watch_data.empty();
+  }
+
+  size_t size() const
+  {
+    return m_watch_data.size();
+  }
+};
+
+} // namespace task
@@ -1,15 +1,134 @@
 #include "sys.h"
 #include "SemaphoreWatcher.h"
+#include "LogicalDevice.h"
+#include <limits>
 
 namespace task {
 
-char const* AsyncSemaphoreWatcher::condition_str_impl(condition_type condition) const
+void AsyncSemaphoreWatcher::start_waiter(vulkan::LogicalDevice const* logical_device)
 {
-  switch (condition)
+  DoutEntering(dc::vulkan, "AsyncSemaphoreWatcher::start_waiter(" << logical_device << ") [" << this << "]");
+  // Only call start_waiter once.
+  ASSERT(!m_waiter.joinable());
+  m_logical_device = logical_device;
+  m_wake_up_semaphore = logical_device->create_timeline_semaphore(0
+      COMMA_CWDEBUG_ONLY(logical_device->debug_name_prefix("m_semaphore_watcher->m_wake_up_semaphore")));
+  m_waiter = std::thread([this](){ wait_loop(); });
+  m_waiter_started.store(true, std::memory_order::release);
+}
+
+void AsyncSemaphoreWatcher::stop_waiter()
+{
+  DoutEntering(dc::vulkan, "AsyncSemaphoreWatcher::stop_waiter() [" << this << "]");
+  if (!m_waiter.joinable())
+    return;
   {
-    AI_CASE_RETURN(poll_timer);
+    std::lock_guard<std::mutex> lock(m_waiter_mutex);
+    // If m_terminate is already set then m_waiter stopped by itself.
+    if (!m_terminate)
+    {
+      m_terminate = true;
+      wake_up();
+    }
   }
-  return SemaphoreWatcher<vulkan::AsyncTask>::condition_str_impl(condition);
+  m_waiter.join();
+  m_wake_up_semaphore.reset();
+}
+
+void AsyncSemaphoreWatcher::wake_up()
+{
+  // The values that a timeline semaphore is signaled with must be strictly increasing,
+  // hence this is done while m_waiter_mutex is locked.
+  vk::SemaphoreSignalInfo semaphore_signal_info{
+    .semaphore = *m_wake_up_semaphore,
+    .value = ++m_wake_up_value
+  };
+  m_logical_device->signal_timeline_semaphore(semaphore_signal_info);
+}
+
+void AsyncSemaphoreWatcher::add(vulkan::TimelineSemaphore const* timeline_semaphore, uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition)
+{
+  SemaphoreWatcher<vulkan::AsyncTask>::add(timeline_semaphore, signal_value, task, condition);
+  if (!m_waiter_started.load(std::memory_order::acquire))
+    return;
+  // Let m_waiter wait for the new semaphore too.
+  std::lock_guard<std::mutex> lock(m_waiter_mutex);
+  if (!m_terminate)
+    wake_up();
+}
+
+void AsyncSemaphoreWatcher::remove(vulkan::TimelineSemaphore const* timeline_semaphore)
+{
+  SemaphoreWatcher<vulkan::AsyncTask>::remove(timeline_semaphore);
+  // If this is called from m_waiter itself (from a task that was signaled by poll() and runs immediately) then
+  // m_waiter isn't waiting for anything; otherwise wait until it took a new wait set that no longer contains timeline_semaphore.
+  if (!m_waiter_started.load(std::memory_order::acquire) || std::this_thread::get_id() == m_waiter.get_id())
+    return;
+  std::unique_lock<std::mutex> lock(m_waiter_mutex);
+  if (m_terminate)
+    return;
+  uint64_t const generation = ++m_generation;
+  wake_up();
+  m_acknowledged.wait(lock, [&](){ return m_acknowledged_generation >= generation || m_terminate; });
+}
+
+void AsyncSemaphoreWatcher::wait_loop()
+{
+  Debug(NAMESPACE_DEBUG::init_thread("SemaphoreWaiter"));
+  DoutEntering(dc::vulkan, "AsyncSemaphoreWatcher::wait_loop() [" << this << "]");
+
+  std::vector<vk::Semaphore> vh_semaphores;
+  std::vector<uint64_t> values;
+  for (;;)
+  {
+    // Read the wake up value and the generation before taking the wait set: any change of the set after this
+    // point will signal m_wake_up_semaphore with a larger value, and a remove() after this point is not
+    // acknowledged by this wait set.
+    uint64_t wake_up_value;
+    uint64_t generation;
+    {
+      std::lock_guard<std::mutex> lock(m_waiter_mutex);
+      if (m_terminate)
+        break;
+      wake_up_value = m_wake_up_value;
+      generation = m_generation;
+    }
+
+    // Signal the tasks of all semaphores that reached their value and remove those semaphores.
+    poll();
+    get_wait_set(vh_semaphores, values);
+
+    {
+      std::lock_guard<std::mutex> lock(m_waiter_mutex);
+      m_acknowledged_generation = generation;
+    }
+    m_acknowledged.notify_all();
+
+    vh_semaphores.push_back(*m_wake_up_semaphore);
+    values.push_back(wake_up_value + 1);
+    vk::SemaphoreWaitInfo semaphore_wait_info{
+      .flags = vk::SemaphoreWaitFlagBits::eAny,
+      .semaphoreCount = static_cast<uint32_t>(vh_semaphores.size()),
+      .pSemaphores = vh_semaphores.data(),
+      .pValues = values.data()
+    };
+    // Block until one of the watched semaphores reaches its value, or until we're woken up.
+    try
+    {
+      m_logical_device->wait_semaphores(semaphore_wait_info, std::numeric_limits<uint64_t>::max());
+    }
+    catch (vk::SystemError const& error)
+    {
+      // For example vk::DeviceLostError. Stop waiting, and don't let remove() wait for us anymore.
+      Dout(dc::warning, "AsyncSemaphoreWatcher: waiting for semaphores failed: " << error.what());
+      std::lock_guard<std::mutex> lock(m_waiter_mutex);
+      m_terminate = true;
+      break;
+    }
+  }
+
+  // Wake up any remove() that is still waiting.
+  m_acknowledged.notify_all();
 }
 
 void AsyncSemaphoreWatcher::multiplex_impl(state_type run_state)
@@ -17,26 +136,10 @@ void AsyncSemaphoreWatcher::multiplex_impl(state_type run_state)
   switch (run_state)
   {
     case SemaphoreWatcher_poll:
-      m_poll_rate_limiter.start(m_poll_rate_interval);
-      if (poll())
-      {
-        yield();
-        wait(poll_timer);
-      }
-      else
-      {
-        if (!m_poll_rate_limiter.stop())
-        {
-          // We could not stop the timer from firing. Perhaps because it already
-          // fired, or because it is already calling expire(). Wait until it
-          // returned from expire().
-          m_poll_rate_limiter.wait_for_possible_expire_to_finish();
-          // Now we are sure that signal(poll_timer) was already called.
-          // To nullify that, call wait(poll_timer) here.
-          wait(poll_timer);
-        }
-        wait(have_semaphores);
-      }
+      // All polling is done by m_waiter. Only if that was never started poll here (at the rate that new semaphores are added).
+      if (!m_waiter_started.load(std::memory_order::acquire))
+        poll();
+      wait(have_semaphores);
       break;
     case SemaphoreWatcher_done:
       finish();
@@ -3,7 +3,11 @@
 
 #include "AsyncTask.h"
 #include "SynchronousTask.h"
-#include "utils/Vector.h"
+#include "SemaphoreWatchSet.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <type_traits>
 
 namespace vulkan {
@@ -12,45 +16,6 @@ class TimelineSemaphore;
 
 namespace task {
 
-struct SemaphoreWatcherWatchData
-{
-  vulkan::TimelineSemaphore const* m_timeline_semaphore;        // The timeline semaphore to watch.
-  uint64_t m_signal_value;                                      // The counter value that it must reach before we can call signal on a task.
-
-  // Clang requires a constructor.
-  SemaphoreWatcherWatchData(vulkan::TimelineSemaphore const* timeline_semaphore, uint64_t signal_value) :
-    m_timeline_semaphore(timeline_semaphore), m_signal_value(signal_value) { }
-};
-
-struct SemaphoreWatcherValueTaskConditionTriplet
-{
-  uint64_t m_signal_value;                                      // The counter value that we must reach before we can signal m_task.
-  AIStatefulTask* m_task;                                       // The task to wake up when the associated timeline semaphore reaches m_signal_value.
-  AIStatefulTask::condition_type m_condition;                   // The condition to use.
-
-  SemaphoreWatcherValueTaskConditionTriplet(uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition) :
-    m_signal_value(signal_value), m_task(task), m_condition(condition) { }
-};
-
-struct SemaphoreWatcherNotifyData
-{
-  std::vector<SemaphoreWatcherValueTaskConditionTriplet> m_value_task_condition_triplets;                // Sorted list of value / task / condition triplets (increasing signal values).
-
-  // Used for the first entry.
-  SemaphoreWatcherNotifyData(uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition)
-  {
-    m_value_task_condition_triplets.emplace_back(signal_value, task, condition);
-  }
-};
-
-using SemaphoreWatcherIndex = utils::VectorIndex<SemaphoreWatcherWatchData>;
-
-struct SemaphoreWatcherWatchSet
-{
-  utils::Vector<SemaphoreWatcherWatchData> m_watch_data;                                // List with semaphores and counter values that we are waiting for.
-  utils::Vector<SemaphoreWatcherNotifyData, SemaphoreWatcherIndex> m_notify_data;       // List with associated notify data.
-};
-
 template<TaskType BASE>
 class SemaphoreWatcher : public BASE
 {
@@ -58,20 +23,9 @@ class SemaphoreWatcher : public BASE
   static constexpr AIStatefulTask::condition_type have_semaphores = 1;
 
  private:
-  using watch_set_type = aithreadsafe::Wrapper<SemaphoreWatcherWatchSet, aithreadsafe::policy::Primitive<std::mutex>>;
-  watch_set_type m_watch_set;
-
-  void remove(watch_set_type::wat const& watch_set_w, SemaphoreWatcherIndex wsi, SemaphoreWatcherIndex wsi_last)
-  {
-    Dout(dc::notice, "SemaphoreWatcher::remove() removing timeline semaphore " << watch_set_w->m_watch_data[wsi].m_timeline_semaphore);
-    if (wsi != wsi_last)
-    {
-      watch_set_w->m_watch_data[wsi] = watch_set_w->m_watch_data[wsi_last];
-      watch_set_w->m_notify_data[wsi] = std::move(watch_set_w->m_notify_data[wsi_last]);
-    }
-    watch_set_w->m_watch_data.pop_back();
-    watch_set_w->m_notify_data.pop_back();
-  }
+  using watch_set_type = aithreadsafe::Wrapper<SemaphoreWatchSet<vulkan::TimelineSemaphore>, aithreadsafe::policy::Primitive<std::mutex>>;
+  SemaphoreWatcherRegistrationList<vulkan::TimelineSemaphore> m_registrations;  // New registrations; add() pushes them here without taking a lock.
+  watch_set_type m_watch_set;                                                   // Only locked by poll(), get_wait_set() and remove().
 
  protected:
   enum semaphore_watcher_state_type {
@@ -97,6 +51,9 @@ class SemaphoreWatcher : public BASE
  protected:
   ~SemaphoreWatcher() override = default;
 
+  // Replace the contents of vh_semaphores and values with the semaphores that are currently watched and the (lowest) values they must reach.
+  void get_wait_set(std::vector<vk::Semaphore>& vh_semaphores, std::vector<uint64_t>& values);
+
   // Implementation of virtual functions of AIStatefulTask.
   char const* condition_str_impl(condition_type condition) const override;
   char const* state_str_impl(state_type run_state) const override;
@@ -105,20 +62,48 @@ class SemaphoreWatcher : public BASE
   void initialize_impl() override;
 };
 
+// The SemaphoreWatcher of the LogicalDevice.
+//
+// Instead of polling, a dedicated thread (m_waiter) blocks in vkWaitSemaphores (with eAny) on all watched
+// timeline semaphores, plus m_wake_up_semaphore that is signaled from the host whenever the set of watched
+// semaphores changes. As soon as one of the semaphores reaches its value the waiting tasks are signaled
+// from that thread.
+//
+// The task itself does nothing but exist; it is kept for its life time management and the SemaphoreWatcher interface.
 class AsyncSemaphoreWatcher : public SemaphoreWatcher<vulkan::AsyncTask>
 {
- public:
-  static constexpr AIStatefulTask::condition_type poll_timer = 2;
-
  private:
-  threadpool::Timer::Interval m_poll_rate_interval{threadpool::Interval<4, std::chrono::milliseconds>{}};      // The minimum time between two polls.
-  threadpool::Timer m_poll_rate_limiter{[this](){ signal(poll_timer); }};
+  vulkan::LogicalDevice const* m_logical_device{};      // Set by start_waiter.
+  vk::UniqueSemaphore m_wake_up_semaphore;              // Timeline semaphore that is signaled from the host to wake up m_waiter.
+  std::thread m_waiter;                                 // The thread that runs wait_loop().
+  std::atomic<bool> m_waiter_started = false;           // Set by start_waiter after m_waiter was assigned.
+
+  // A plain mutex is used (instead of an aithreadsafe::Wrapper) because remove() needs to wait on m_acknowledged.
+  std::mutex m_waiter_mutex;                            // Protects the members below.
+  uint64_t m_wake_up_value = 0;                         // The last value that m_wake_up_semaphore was signaled with.
+  uint64_t m_generation = 0;                            // Incremented by remove().
+  uint64_t m_acknowledged_generation = 0;               // The generation of the last wait set used by m_waiter.
+  bool m_terminate = false;                             // Set by stop_waiter(), or by m_waiter when waiting failed (device lost).
+  std::condition_variable m_acknowledged;               // Notified whenever m_acknowledged_generation is updated.
 
  public:
   using SemaphoreWatcher<vulkan::AsyncTask>::SemaphoreWatcher;
 
+  // Start m_waiter. Must be called after the logical device was created, before the first call to add().
+  void start_waiter(vulkan::LogicalDevice const* logical_device);
+  // Stop and join m_waiter. Must be called before the logical device is destroyed.
+  void stop_waiter();
+
+  // These hide the functions of the base class: they also wake up m_waiter.
+  void add(vulkan::TimelineSemaphore const* timeline_semaphore, uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition);
+  // Does not return until m_waiter no longer waits for timeline_semaphore, so that it may be destroyed afterwards.
+  void remove(vulkan::TimelineSemaphore const* timeline_semaphore);
+
+ private:
+  void wake_up();                                       // Must be called with m_waiter_mutex locked.
+  void wait_loop();
+
  protected:
-  char const* condition_str_impl(condition_type condition) const override;
   void multiplex_impl(state_type run_state) override;
 };
 
@@ -139,22 +124,10 @@ template<TaskType BASE>
 void SemaphoreWatcher<BASE>::add(vulkan::TimelineSemaphore const* timeline_semaphore, uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition)
 {
   DoutEntering(dc::notice, "SemaphoreWatcher::add(" << timeline_semaphore << ", " << signal_value << ", " << task << ", " << task->print_conditions(condition) << ")");
-  watch_set_type::wat watch_set_w(m_watch_set);
-  SemaphoreWatcherIndex const wsi_end{watch_set_w->m_watch_data.size()};
-  for (SemaphoreWatcherIndex wsi{0}; wsi != wsi_end; ++wsi)
-    if (watch_set_w->m_watch_data[wsi].m_timeline_semaphore == timeline_semaphore)
-    {
-      // Each subsequent signal_value must be greater or equal the last m_signal_value.
-      ASSERT(!watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.empty() &&
-          signal_value >= watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.back().m_signal_value);
-      // Append to SemaphoreWatcherWatchSet::m_notify_data[wsi].m_value_task_condition_triplets a SemaphoreWatcherValueTaskConditionTriplet,
-      watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.emplace_back(signal_value, task, condition);
-      return;
-    }
-  // New semaphore.
-  watch_set_w->m_watch_data.emplace_back(timeline_semaphore, signal_value);
-  watch_set_w->m_notify_data.emplace_back(signal_value, task, condition);
-  signal(have_semaphores);
+  // The registration is moved into m_watch_set by the next poll(). Only the first registration
+  // after the list was emptied needs to wake up the task; the others will be seen by the same poll().
+  if (m_registrations.push(new SemaphoreWatcherRegistration<vulkan::TimelineSemaphore>(timeline_semaphore, signal_value, task, condition)))
+    signal(have_semaphores);
 }
 
 template<TaskType BASE>
@@ -162,54 +135,43 @@ void SemaphoreWatcher<BASE>::remove(vulkan::TimelineSemaphore const* timeline_se
 {
   DoutEntering(dc::notice, "SemaphoreWatcher::remove(" << timeline_semaphore << ")");
   watch_set_type::wat watch_set_w(m_watch_set);
-  SemaphoreWatcherIndex const wsi_end{watch_set_w->m_watch_data.size()};
-  for (SemaphoreWatcherIndex wsi{0}; wsi != wsi_end; ++wsi)
-    if (watch_set_w->m_watch_data[wsi].m_timeline_semaphore == timeline_semaphore)
-    {
-      remove(watch_set_w, wsi, wsi_end - 1);
-      return;
-    }
-  // Could not find the semaphore; assume this means it was signaled, polled and removed before
-  // we managed to get the lock, and do nothing.
+  // The semaphore might still be in m_registrations.
+  watch_set_w->insert(m_registrations.take_all());
+  if (watch_set_w->erase(timeline_semaphore))
+    Dout(dc::notice, "Removed timeline semaphore " << timeline_semaphore);
+  // Otherwise we could not find the semaphore; assume this means it was signaled, polled and removed
+  // before we managed to get the lock, and do nothing.
 }
 
 template<TaskType BASE>
 bool SemaphoreWatcher<BASE>::poll()
 {
   DoutEntering(dc::notice, "SemaphoreWatcher::poll()");
-  watch_set_type::wat watch_set_w(m_watch_set);
-  SemaphoreWatcherIndex wsi_end{watch_set_w->m_watch_data.size()};
-  for (SemaphoreWatcherIndex wsi{0}; wsi != wsi_end;)
+  std::vector<SemaphoreWatcherValueTaskConditionTriplet> ready;
+  bool have_semaphores;
   {
-    uint64_t const signal_value = watch_set_w->m_watch_data[wsi].m_signal_value;
-    uint64_t const counter_value = watch_set_w->m_watch_data[wsi].m_timeline_semaphore->get_counter_value();
-    Dout(dc::notice, "Timeline semaphore " << watch_set_w->m_watch_data[wsi].m_timeline_semaphore << " has value " << counter_value << '.');
-    if (counter_value >= signal_value)
-    {
-      auto value_task_condition_triplet = watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.begin();
-      while (value_task_condition_triplet != watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.end())
-      {
-        if (counter_value < value_task_condition_triplet->m_signal_value)
-          break;
-        value_task_condition_triplet->m_task->signal(value_task_condition_triplet->m_condition);
-        ++value_task_condition_triplet;
-      }
-      // It is not likely that we're waiting on multiple values of the same semaphore.
-      if (AI_UNLIKELY(value_task_condition_triplet != watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.end()))
-      {
-        watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.erase(watch_set_w->m_notify_data[wsi].m_value_task_condition_triplets.begin(), value_task_condition_triplet);
-        watch_set_w->m_watch_data[wsi].m_signal_value = value_task_condition_triplet->m_signal_value;
-        ++wsi;
-        continue;
-      }
-      remove(watch_set_w, wsi, --wsi_end);      // This removes a single element: that at index wsi.
-      // Paranoia check.
-      ASSERT(wsi_end == SemaphoreWatcherIndex{watch_set_w->m_watch_data.size()});
-      continue;
-    }
-    ++wsi;
+    watch_set_type::wat watch_set_w(m_watch_set);
+    watch_set_w->insert(m_registrations.take_all());
+    watch_set_w->collect(ready);
+    have_semaphores = !watch_set_w->empty();
   }
-  return !watch_set_w->m_watch_data.empty();
+  // Signal the tasks without holding the lock on m_watch_set.
+  for (SemaphoreWatcherValueTaskConditionTriplet const& value_task_condition_triplet : ready)
+    value_task_condition_triplet.m_task->signal(value_task_condition_triplet.m_condition);
+  return have_semaphores;
+}
+
+template<TaskType BASE>
+void SemaphoreWatcher<BASE>::get_wait_set(std::vector<vk::Semaphore>& vh_semaphores, std::vector<uint64_t>& values)
+{
+  watch_set_type::wat watch_set_w(m_watch_set);
+  watch_set_w->insert(m_registrations.take_all());
+  vh_semaphores.clear();
+  values.clear();
+  watch_set_w->for_each([&](vulkan::TimelineSemaphore const* timeline_semaphore, uint64_t signal_value){
+    vh_semaphores.push_back(*timeline_semaphore->vh_semaphore_ptr());
+    values.push_back(signal_value);
+  });
 }
 
 template<TaskType BASE>
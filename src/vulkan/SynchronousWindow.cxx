@@ -6,9 +6,13 @@
 #include "FrameResourcesData.h"
 #include "Exceptions.h"
 #include "SynchronousTask.h"
+#include "RecordSecondaryCommandBuffers.h"
 #include "pipeline/Handle.h"
 #include "pipeline/PipelineCache.h"
 #include "queues/CopyDataToImage.h"
+#include "memory/MipmapFeeder.h"
+#include "vk_utils/KTX2Data.h"
+#include "vk_utils/BCnDecoder.h"
 #include "descriptor/LayoutBindingCompare.h"
 #include "vk_utils/print_flags.h"
 #include "xcb-task/ConnectionBrokerKey.h"
@@ -27,6 +31,7 @@
 #include "tracy/CwTracy.h"
 #include <vulkan/vk_format_utils.h>
 #include <algorithm>
+#include <array>
 #include "debug.h"
 
 #if defined(CWDEBUG) && !defined(DOXYGEN)
@@ -768,18 +773,110 @@ vulkan::Texture SynchronousWindow::upload_texture(std::unique_ptr<vulkan::DataFe
       { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
       COMMA_CWDEBUG_ONLY(ambifix));
 
-  size_t const data_size = extent.width * extent.height * vk_utils::format_component_count(image_view_kind.image_kind()->format);
+  vulkan::ImageKind const& image_kind = image_view_kind.image_kind();
+  uint32_t const texel_size = vk_utils::format_component_count(image_kind->format);
+  // The number of mip levels is taken from the image kind; texture_data_feeder only provides the first level.
+  uint32_t const mip_levels = image_kind->mip_levels;
+  // Generate the mip chain on the GPU if possible, otherwise on the CPU.
+  bool const generate_mipmaps_on_gpu = mip_levels > 1 && m_logical_device->supports_linear_blit(image_kind->format);
+  // The blits read from the image.
+  ASSERT(!generate_mipmaps_on_gpu || (image_kind->usage & vk::ImageUsageFlagBits::eTransferSrc));
+  if (mip_levels > 1 && !generate_mipmaps_on_gpu)
+    texture_data_feeder = std::make_unique<vulkan::MipmapFeeder>(std::move(texture_data_feeder), extent, mip_levels, texel_size);
+  size_t const data_size = vulkan::MipmapFeeder::mip_chain_size(extent, generate_mipmaps_on_gpu ? 1 : mip_levels, texel_size);
 
   auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, data_size,
-            texture.m_vh_image, extent, vk_defaults::ImageSubresourceRange{},
+            texture.m_vh_image, extent, vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, mip_levels},
             vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
             vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
             COMMA_CWDEBUG_ONLY(true));
 
+  copy_data_to_image->set_generate_mipmaps(generate_mipmaps_on_gpu);
+  copy_data_to_image->set_resource_owner(this);
   copy_data_to_image->set_data_feeder(std::move(texture_data_feeder));
   copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), this, texture_ready, signal_parent);
 
-  // Update descriptor set.
+  // Update descriptor set (unless the texture is only accessed through the bindless texture table).
+  if (vh_descriptor_set)
+  {
+    std::vector<vk::DescriptorImageInfo> image_infos = {
+      {
+        .sampler = *texture.m_sampler,
+        .imageView = *texture.m_image_view,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+      }
+    };
+    m_logical_device->update_descriptor_set(vh_descriptor_set, vk::DescriptorType::eCombinedImageSampler, binding, 0, image_infos);
+  }
+
+  return texture;
+}
+
+vulkan::Texture SynchronousWindow::upload_texture(std::shared_ptr<vk_utils::stbi::DecodedImage> decoded_image,
+    int binding, vulkan::ImageViewKind const& image_view_kind, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
+    AIStatefulTask::condition_type texture_ready
+    COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& ambifix))
+{
+  // The extent is known before the image is decoded; the CopyDataToImage task waits for the data.
+  vk::Extent2D const extent = decoded_image->extent();
+  return upload_texture(std::make_unique<vk_utils::stbi::DecodedImageFeeder>(std::move(decoded_image)), extent,
+      binding, image_view_kind, sampler_kind, vh_descriptor_set, texture_ready COMMA_CWDEBUG_ONLY(ambifix));
+}
+
+vulkan::Texture SynchronousWindow::upload_texture(vk_utils::ktx2::KTX2Data&& texture_data,
+    int binding, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
+    AIStatefulTask::condition_type texture_ready
+    COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& ambifix))
+{
+  return upload_texture(std::move(texture_data), binding, sampler_kind, vh_descriptor_set,
+      [this, texture_ready](bool){ signal(texture_ready); } COMMA_CWDEBUG_ONLY(ambifix));
+}
+
+vulkan::Texture SynchronousWindow::upload_texture(vk_utils::ktx2::KTX2Data&& texture_data,
+    int binding, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
+    std::function<void(bool)> texture_ready
+    COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& ambifix))
+{
+  DoutEntering(dc::vulkan, "SynchronousWindow::upload_texture(" << texture_data.format() << " " << texture_data.extent() << ", " <<
+      binding << ", " << sampler_kind << ", " << vh_descriptor_set << ", texture_ready)");
+
+  // Decode the blocks on the CPU if the device can't sample this format (for example, lavapipe).
+  bool const decode = !m_logical_device->supports_sampled_image_format(texture_data.format());
+  vk::Format const format = decode ? vk_utils::bcn::decoded_format(texture_data.format()) : texture_data.format();
+  if (decode)
+    Dout(dc::warning, "Device does not support sampling " << texture_data.format() << "; decoding on the CPU.");
+  uint32_t const mip_levels = texture_data.mip_levels();
+  vk::Extent2D const extent = texture_data.extent();
+
+  vulkan::ImageKind const image_kind({
+    .format = format,
+    .mip_levels = mip_levels,
+    .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+  });
+  vulkan::ImageViewKind const image_view_kind(image_kind, {
+    .subresource_range = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, mip_levels}
+  });
+
+  // Create texture parameters.
+  vulkan::Texture texture(m_logical_device, extent,
+      image_view_kind, sampler_kind, m_graphics_settings,
+      { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+      COMMA_CWDEBUG_ONLY(ambifix));
+
+  auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, texture_data.size(decode),
+            texture.m_vh_image, extent, vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, mip_levels},
+            vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
+            COMMA_CWDEBUG_ONLY(true));
+
+  if (!decode)
+    copy_data_to_image->set_texel_block({4, 4}, vk_utils::bcn::block_size(format));
+  copy_data_to_image->set_resource_owner(this);
+  copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::ktx2::KTX2DataFeeder>(std::move(texture_data), decode));
+  copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), std::move(texture_ready));
+
+  // Update descriptor set (unless the texture is only accessed through the bindless texture table).
+  if (vh_descriptor_set)
   {
     std::vector<vk::DescriptorImageInfo> image_infos = {
       {
@@ -808,6 +905,26 @@ void SynchronousWindow::start_frame()
 
   m_current_frame.m_resource_index = (m_current_frame.m_resource_index + 1) % m_current_frame.m_resource_count;
   m_current_frame.m_frame_resources = m_frame_resources_list[m_current_frame.m_resource_index].get();
+  m_current_frame.m_frame_resources->m_uniform_arena.reset();
+
+  // Tell the residency manager which frames of this window might still be in flight: the new frame, and
+  // every frame whose fence isn't signaled yet (we didn't wait for the fence of the frame resources that we're about to reuse).
+  vulkan::memory::ResidencyManager& residency_manager = m_logical_device->residency_manager();
+  m_current_frame.m_frame_serial = residency_manager.new_frame();
+  uint64_t oldest_frame_in_flight = m_current_frame.m_frame_serial;
+  for (auto const& frame_resources : m_frame_resources_list)
+  {
+    if (frame_resources->m_frame_serial == 0 || frame_resources->m_frame_serial >= oldest_frame_in_flight)
+      continue;
+    if (m_logical_device->get_fence_status(*frame_resources->m_command_buffers_completed) == vk::Result::eSuccess)
+      frame_resources->m_frame_serial = 0;
+    else
+      oldest_frame_in_flight = frame_resources->m_frame_serial;
+  }
+  residency_manager.set_oldest_frame_in_flight(this, oldest_frame_in_flight);
+#ifdef TRACY_ENABLE
+  m_logical_device->residency_manager().plot_statistics();
+#endif
 
   if (m_use_imgui)
   {
@@ -959,6 +1076,10 @@ void SynchronousWindow::finish_impl()
 
   // Wait for (certain) tasks to be finished.
   m_task_counter_gate.wait();
+
+  // Our frames no longer hold back eviction, defragmentation and the reuse of bindless texture slots.
+  if (m_logical_device)
+    m_logical_device->residency_manager().remove_window(this);
 }
 
 //virtual
@@ -993,26 +1114,92 @@ void SynchronousWindow::on_window_size_changed_post()
   };
 #endif
 
+  // Attachments that are never loaded or stored are transient: they get lazily allocated memory if the device has it
+  // (on tile-based GPUs such memory is never actually backed). Attachments in the same alias group of the render graph
+  // have lifetimes that do not overlap and share one block of memory.
+  bool const use_lazily_allocated_memory = m_logical_device->supports_lazily_allocated_memory();
+  auto attachment_image_create_info = [this](Attachment const* attachment)
+  {
+    vk::ImageCreateInfo image_create_info = attachment->image_kind()(swapchain().extent());
+    if (attachment->is_transient())
+      image_create_info.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+    return image_create_info;
+  };
+  auto const& alias_groups = m_render_graph.alias_groups();
+  // The memory requirements of the attachments of an alias group can only be queried before creating them with maintenance4.
+  bool const can_alias = m_logical_device->supports_maintenance4();
+
 #ifdef CWDEBUG
   vulkan::FrameResourceIndex frame_resource_index{0};
 #endif
   // Run over all frame resources.
   for (std::unique_ptr<vulkan::FrameResourcesData> const& frame_resources_data : m_frame_resources_list)
   {
+    // Destroy the attachments that are bound to aliased memory before freeing that memory.
+    for (Attachment const* attachment : m_attachments)
+      if (!attachment->index().undefined() && attachment->alias_group() != -1)
+        frame_resources_data->m_attachments[*attachment] = {};
+    frame_resources_data->m_aliased_attachment_memory.clear();
+
+    // Allocate the memory of each alias group: large enough and suitable for each of its attachments.
+    for (int alias_group_index = 0; alias_group_index < static_cast<int>(alias_groups.size()); ++alias_group_index)
+    {
+      if (!can_alias)
+      {
+        // Each attachment of this group will get its own memory.
+        frame_resources_data->m_aliased_attachment_memory.emplace_back();
+        continue;
+      }
+      vk::MemoryRequirements group_memory_requirements{ .memoryTypeBits = ~uint32_t{0} };
+      for (Attachment const* attachment : alias_groups[alias_group_index])
+      {
+        vk::MemoryRequirements const memory_requirements = m_logical_device->get_image_memory_requirements(attachment_image_create_info(attachment));
+        group_memory_requirements.size = std::max(group_memory_requirements.size, memory_requirements.size);
+        group_memory_requirements.alignment = std::max(group_memory_requirements.alignment, memory_requirements.alignment);
+        group_memory_requirements.memoryTypeBits &= memory_requirements.memoryTypeBits;
+      }
+      if (group_memory_requirements.memoryTypeBits == 0)
+      {
+        // Each attachment of this group will get its own memory.
+        Dout(dc::warning, "The attachments of alias group " << alias_group_index << " have no memory type in common.");
+        frame_resources_data->m_aliased_attachment_memory.emplace_back();
+        continue;
+      }
+      frame_resources_data->m_aliased_attachment_memory.emplace_back(m_logical_device, group_memory_requirements, vk::MemoryPropertyFlagBits::eDeviceLocal
+          COMMA_CWDEBUG_ONLY(debug_name_prefix("m_frame_resources_list[" + to_string(frame_resource_index) +
+              "]->m_aliased_attachment_memory[" + std::to_string(alias_group_index) + "]")));
+    }
+
     // Run over all attachments.
     for (Attachment const* attachment : m_attachments)
     {
       if (attachment->index().undefined())      // Skip swapchain attachment.
         continue;
       Dout(dc::vulkan, "Creating attachment \"" << attachment->name() << "\".");
+#ifdef CWDEBUG
+      vulkan::AmbifixOwner const ambifix = debug_name_prefix("m_frame_resources_list[" + to_string(frame_resource_index) +
+          "]->m_attachments[" + to_string(attachment->index()) + "]");
+#endif
+      if (attachment->alias_group() != -1 && frame_resources_data->m_aliased_attachment_memory[attachment->alias_group()].vh_allocation())
+      {
+        frame_resources_data->m_attachments[*attachment] = vulkan::Attachment(
+            m_logical_device,
+            attachment_image_create_info(attachment),
+            attachment->image_view_kind(),
+            frame_resources_data->m_aliased_attachment_memory[attachment->alias_group()]
+            COMMA_CWDEBUG_ONLY(ambifix));
+        continue;
+      }
+      bool const lazily_allocated = attachment->is_transient() && use_lazily_allocated_memory;
       frame_resources_data->m_attachments[*attachment] = vulkan::Attachment(
           m_logical_device,
-          swapchain().extent(),
+          attachment_image_create_info(attachment),
           attachment->image_view_kind(),
-          0,
-          vk::MemoryPropertyFlagBits::eDeviceLocal
-          COMMA_CWDEBUG_ONLY(debug_name_prefix("m_frame_resources_list[" + to_string(frame_resource_index) +
-              "]->m_attachments[" + to_string(attachment->index()) + "]")));
+          {
+            .properties = lazily_allocated ? vk::MemoryPropertyFlagBits::eLazilyAllocated : vk::MemoryPropertyFlagBits::eDeviceLocal,
+            .vma_memory_usage = lazily_allocated ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : VMA_MEMORY_USAGE_AUTO
+          }
+          COMMA_CWDEBUG_ONLY(ambifix));
     }
 #ifdef CWDEBUG
     ++frame_resource_index;
@@ -1090,6 +1277,13 @@ void SynchronousWindow::create_frame_resources()
     // Create the command buffer.
     frame_resources->m_command_buffer = frame_resources->m_command_pool.allocate_buffer(
         CWDEBUG_ONLY(ambifix("->m_command_buffer")));
+    frame_resources->m_ownership_acquire_command_buffer = frame_resources->m_command_pool.allocate_buffer(
+        CWDEBUG_ONLY(ambifix("->m_ownership_acquire_command_buffer")));
+
+    // Create the uniform arena, if any.
+    if (vk::DeviceSize const arena_size = uniform_arena_size(); arena_size > 0)
+      frame_resources->m_uniform_arena = vulkan::memory::UniformArena(m_logical_device, arena_size
+          COMMA_CWDEBUG_ONLY(ambifix("->m_uniform_arena")));
 
 #if 0 // FIXME: See FIXME above.
     // Move the overlapping descriptor set into m_frame_resources_list.
@@ -1112,6 +1306,44 @@ void SynchronousWindow::create_frame_resources()
   on_window_size_changed_post();
 }
 
+void SynchronousWindow::record_in_parallel(vulkan::handle::CommandBuffer command_buffer, std::shared_ptr<vulkan::ParallelRecording> const& recording, int max_threads)
+{
+  DoutEntering(dc::vkframe, "SynchronousWindow::record_in_parallel(" << command_buffer << ", <" << recording->number_of_jobs() << " jobs>, " << max_threads << ")");
+  ZoneScopedN("record_in_parallel");
+
+  int const number_of_jobs = recording->number_of_jobs();
+  if (number_of_jobs == 0)
+    return;
+
+  // Give each job its own secondary command buffer (and command pool).
+  vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+  auto& secondary_command_buffers = frame_resources->m_secondary_command_buffers;
+  while (static_cast<int>(secondary_command_buffers.size()) < number_of_jobs)
+  {
+    secondary_command_buffers.push_back(std::make_unique<vulkan::FrameResourcesData::SecondaryCommandBuffer>(
+        m_logical_device, m_presentation_surface.graphics_queue().queue_family()
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_frame_resources_list[" + to_string(m_current_frame.m_resource_index) +
+            "]->m_secondary_command_buffers[" + std::to_string(secondary_command_buffers.size()) + "]"))));
+  }
+  for (int job = 0; job < number_of_jobs; ++job)
+    recording->set_command_buffer(job, secondary_command_buffers[job]->m_command_buffer);
+
+  // The calling thread records too.
+  int number_of_threads = std::min(number_of_jobs, m_application->number_of_worker_threads() + 1);
+  if (max_threads > 0)
+    number_of_threads = std::min(number_of_threads, max_threads);
+  for (int helper = 1; helper < number_of_threads; ++helper)
+  {
+    auto record_task = statefultask::create<task::RecordSecondaryCommandBuffers>(recording COMMA_CWDEBUG_ONLY(false));
+    record_task->run(m_application->medium_priority_queue());
+  }
+  recording->record_jobs();
+  // Helper tasks that didn't start yet won't find any jobs left; we only have to wait for the ones that are recording.
+  recording->wait();
+
+  recording->execute(command_buffer);
+}
+
 void SynchronousWindow::submit(vulkan::handle::CommandBuffer command_buffer)
 {
 #ifdef TRACY_ENABLE
@@ -1136,6 +1368,70 @@ void SynchronousWindow::submit(vulkan::handle::CommandBuffer command_buffer)
     .pSignalSemaphores = swapchain().vhp_current_rendering_finished_semaphore()
   };
 
+  // Make the uniform data of this frame available to the device.
+  m_current_frame.m_frame_resources->m_uniform_arena.flush();
+
+  // Take over the acquire barriers of resources that were uploaded on a different queue family (if any).
+  PendingOwnershipAcquires acquires;
+  {
+    pending_ownership_acquires_t::wat pending_ownership_acquires_w(m_pending_ownership_acquires);
+    if (AI_UNLIKELY(!pending_ownership_acquires_w->empty()))
+      std::swap(acquires, *pending_ownership_acquires_w);
+  }
+  // These must live until after the call to submit.
+  std::array<vk::CommandBuffer, 2> command_buffers;
+  std::vector<vk::Semaphore> wait_semaphores;
+  std::vector<vk::PipelineStageFlags> wait_dst_stage_masks;
+  std::vector<uint64_t> wait_values;
+  vk::TimelineSemaphoreSubmitInfo timeline_semaphore_submit_info;
+  if (AI_UNLIKELY(!acquires.empty()))
+  {
+    Dout(dc::vulkan, "Acquiring ownership of " << acquires.m_buffer_barriers.size() << " buffers and " << acquires.m_image_barriers.size() << " images; " <<
+        acquires.m_relocations.size() << " relocations.");
+    vulkan::handle::CommandBuffer acquire_command_buffer = m_current_frame.m_frame_resources->m_ownership_acquire_command_buffer;
+    acquire_command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    // The semaphore waits below use m_consuming_stages as destination stages; using the same stages as source stages here
+    // chains the acquire barriers (including their layout transitions) after the waits, and therefore after the transfers.
+    if (!acquires.m_buffer_barriers.empty() || !acquires.m_image_barriers.empty())
+      acquire_command_buffer->pipelineBarrier(acquires.m_consuming_stages, acquires.m_consuming_stages, vk::DependencyFlags(0),
+          {}, acquires.m_buffer_barriers, acquires.m_image_barriers);
+    // Generate the mip chains that couldn't be generated on the transfer queue.
+    if (!acquires.m_mipmap_generations.empty())
+    {
+      for (vulkan::MipmapGeneration const& mipmap_generation : acquires.m_mipmap_generations)
+        mipmap_generation.record(*acquire_command_buffer.operator->());
+      acquire_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, acquires.m_post_generation_stages, vk::DependencyFlags(0),
+          {}, {}, acquires.m_post_generation_barriers);
+    }
+    // Copy the resources that were moved to a different allocation.
+    for (auto const& record : acquires.m_relocations)
+      record(*acquire_command_buffer.operator->(), m_current_frame.m_frame_serial);
+    acquire_command_buffer->end();
+
+    // Execute the acquire barriers before the command buffer of this frame.
+    command_buffers = { acquire_command_buffer, command_buffer };
+    submit_info.commandBufferCount = command_buffers.size();
+    submit_info.pCommandBuffers = command_buffers.data();
+
+    // Wait for the image available semaphore (a binary semaphore; its wait value is ignored) and the timeline semaphores of the transfers.
+    wait_semaphores.push_back(*swapchain().vhp_current_image_available_semaphore());
+    wait_dst_stage_masks.push_back(wait_dst_stage_mask);
+    wait_values.push_back(0);
+    for (size_t i = 0; i < acquires.m_vh_wait_semaphores.size(); ++i)
+    {
+      wait_semaphores.push_back(acquires.m_vh_wait_semaphores[i]);
+      wait_dst_stage_masks.push_back(acquires.m_consuming_stages);
+      wait_values.push_back(acquires.m_wait_values[i]);
+    }
+    timeline_semaphore_submit_info.waitSemaphoreValueCount = wait_values.size();
+    timeline_semaphore_submit_info.pWaitSemaphoreValues = wait_values.data();
+    submit_info.pNext = &timeline_semaphore_submit_info;
+    submit_info.waitSemaphoreCount = wait_semaphores.size();
+    submit_info.pWaitSemaphores = wait_semaphores.data();
+    submit_info.pWaitDstStageMask = wait_dst_stage_masks.data();
+  }
+
+  m_current_frame.m_frame_resources->m_frame_serial = m_current_frame.m_frame_serial;
   Dout(dc::vkframe, "Submitting command buffer: submit({" << submit_info << "}, " << *m_current_frame.m_frame_resources->m_command_buffers_completed << ")");
   presentation_surface().vh_graphics_queue().submit({ submit_info }, *m_current_frame.m_frame_resources->m_command_buffers_completed);
 
@@ -1146,6 +1442,71 @@ void SynchronousWindow::submit(vulkan::handle::CommandBuffer command_buffer)
 #endif
 }
 
+void SynchronousWindow::PendingOwnershipAcquires::wait_for(vk::Semaphore vh_timeline_semaphore, uint64_t value)
+{
+  // Timeline semaphore values only increase, so we only need to wait for the largest value.
+  auto semaphore = std::find(m_vh_wait_semaphores.begin(), m_vh_wait_semaphores.end(), vh_timeline_semaphore);
+  if (semaphore == m_vh_wait_semaphores.end())
+  {
+    m_vh_wait_semaphores.push_back(vh_timeline_semaphore);
+    m_wait_values.push_back(value);
+  }
+  else
+  {
+    uint64_t& wait_value = m_wait_values[semaphore - m_vh_wait_semaphores.begin()];
+    wait_value = std::max(wait_value, value);
+  }
+}
+
+void SynchronousWindow::add_acquire_barrier(vk::PipelineStageFlags consuming_stages, vk::BufferMemoryBarrier const& barrier, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value)
+{
+  DoutEntering(dc::vulkan, "SynchronousWindow::add_acquire_barrier(" << consuming_stages << ", {buffer:" << barrier.buffer << "}, " << vh_timeline_semaphore << ", " << signal_value << ") [" << this << "]");
+  // This must be the acquire half of an ownership transfer to our graphics queue family.
+  ASSERT(barrier.dstQueueFamilyIndex == static_cast<uint32_t>(m_presentation_surface.graphics_queue().queue_family().get_value()));
+  pending_ownership_acquires_t::wat pending_ownership_acquires_w(m_pending_ownership_acquires);
+  pending_ownership_acquires_w->m_buffer_barriers.push_back(barrier);
+  pending_ownership_acquires_w->m_consuming_stages |= consuming_stages;
+  pending_ownership_acquires_w->wait_for(vh_timeline_semaphore, signal_value);
+}
+
+void SynchronousWindow::add_acquire_barrier(vk::PipelineStageFlags consuming_stages, vk::ImageMemoryBarrier const& barrier, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value)
+{
+  DoutEntering(dc::vulkan, "SynchronousWindow::add_acquire_barrier(" << consuming_stages << ", {image:" << barrier.image << "}, " << vh_timeline_semaphore << ", " << signal_value << ") [" << this << "]");
+  // This must be the acquire half of an ownership transfer to our graphics queue family.
+  ASSERT(barrier.dstQueueFamilyIndex == static_cast<uint32_t>(m_presentation_surface.graphics_queue().queue_family().get_value()));
+  pending_ownership_acquires_t::wat pending_ownership_acquires_w(m_pending_ownership_acquires);
+  pending_ownership_acquires_w->m_image_barriers.push_back(barrier);
+  pending_ownership_acquires_w->m_consuming_stages |= consuming_stages;
+  pending_ownership_acquires_w->wait_for(vh_timeline_semaphore, signal_value);
+}
+
+void SynchronousWindow::add_acquire_barrier_and_mipmap_generation(vk::ImageMemoryBarrier const& barrier, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value,
+    vulkan::MipmapGeneration const& mipmap_generation, vk::PipelineStageFlags consuming_stages, vk::AccessFlags new_access, vk::ImageLayout new_layout)
+{
+  DoutEntering(dc::vulkan, "SynchronousWindow::add_acquire_barrier_and_mipmap_generation({image:" << barrier.image << "}, " << vh_timeline_semaphore << ", " <<
+      signal_value << ", " << consuming_stages << ", " << new_access << ", " << new_layout << ") [" << this << "]");
+  // This must be the acquire half of an ownership transfer to our graphics queue family, that leaves the image ready for the blits.
+  ASSERT(barrier.dstQueueFamilyIndex == static_cast<uint32_t>(m_presentation_surface.graphics_queue().queue_family().get_value()));
+  ASSERT(barrier.newLayout == vk::ImageLayout::eTransferDstOptimal && barrier.image == mipmap_generation.m_vh_image);
+  std::array<vk::ImageMemoryBarrier, 2> const final_barriers = mipmap_generation.final_barriers(
+      vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite, new_access, new_layout);
+  pending_ownership_acquires_t::wat pending_ownership_acquires_w(m_pending_ownership_acquires);
+  pending_ownership_acquires_w->m_image_barriers.push_back(barrier);
+  pending_ownership_acquires_w->m_consuming_stages |= vk::PipelineStageFlagBits::eTransfer;
+  pending_ownership_acquires_w->wait_for(vh_timeline_semaphore, signal_value);
+  pending_ownership_acquires_w->m_mipmap_generations.push_back(mipmap_generation);
+  pending_ownership_acquires_w->m_post_generation_barriers.insert(pending_ownership_acquires_w->m_post_generation_barriers.end(),
+      final_barriers.begin(), final_barriers.end());
+  pending_ownership_acquires_w->m_post_generation_stages |= consuming_stages;
+}
+
+void SynchronousWindow::add_relocations(std::function<void(vk::CommandBuffer, uint64_t)> record)
+{
+  DoutEntering(dc::vulkan, "SynchronousWindow::add_relocations(...) [" << this << "]");
+  pending_ownership_acquires_t::wat pending_ownership_acquires_w(m_pending_ownership_acquires);
+  pending_ownership_acquires_w->m_relocations.push_back(std::move(record));
+}
+
 void SynchronousWindow::copy_graphics_settings()
 {
   DoutEntering(dc::vulkan, "SynchronousWindow::copy_graphics_settings() [" << this << "]");
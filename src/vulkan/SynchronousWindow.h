@@ -13,10 +13,12 @@
 #include "ImageKind.h"
 #include "SamplerKind.h"
 #include "RenderPass.h"
+#include "ParallelRecording.h"
 #include "InputEvent.h"
 #include "GraphicsSettings.h"
 #include "Pipeline.h"
 #include "queues/QueueReply.h"
+#include "queues/MipmapGeneration.h"
 #include "pipeline/Handle.h"
 #include "rendergraph/RenderGraph.h"
 #include "rendergraph/Attachment.h"
@@ -47,6 +49,14 @@ namespace xcb {
 class ConnectionBrokerKey;
 } // namespace xcb
 
+namespace vk_utils::ktx2 {
+class KTX2Data;
+} // namespace vk_utils::ktx2
+
+namespace vk_utils::stbi {
+class DecodedImage;
+} // namespace vk_utils::stbi
+
 namespace task {
 class LogicalDevice;
 class SynchronousTask;
@@ -188,6 +198,25 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
 
   vulkan::GraphicsSettingsPOD m_graphics_settings;                        // Cached copy of global graphics settings; should be synchronized at the start of the render loop.
 
+  // The acquire half of queue family ownership transfers of resources that were uploaded on a different queue family.
+  struct PendingOwnershipAcquires
+  {
+    std::vector<vk::BufferMemoryBarrier> m_buffer_barriers;
+    std::vector<vk::ImageMemoryBarrier> m_image_barriers;
+    vk::PipelineStageFlags m_consuming_stages;                            // The union of the destination stages of all barriers.
+    std::vector<vk::Semaphore> m_vh_wait_semaphores;                      // Timeline semaphores that must be waited on before the barriers may execute.
+    std::vector<uint64_t> m_wait_values;                                  // The corresponding values to wait for.
+    std::vector<vulkan::MipmapGeneration> m_mipmap_generations;           // Mip chains of acquired images that are generated after the acquire barriers.
+    std::vector<vk::ImageMemoryBarrier> m_post_generation_barriers;       // Barriers that transition the generated images to their final layout.
+    vk::PipelineStageFlags m_post_generation_stages;                      // The union of the destination stages of m_post_generation_barriers.
+    std::vector<std::function<void(vk::CommandBuffer, uint64_t)>> m_relocations;       // Record the copies of resources that were moved by task::Defragment.
+
+    void wait_for(vk::Semaphore vh_timeline_semaphore, uint64_t value);
+    bool empty() const { return m_buffer_barriers.empty() && m_image_barriers.empty() && m_relocations.empty(); }
+  };
+  using pending_ownership_acquires_t = aithreadsafe::Wrapper<PendingOwnershipAcquires, aithreadsafe::policy::Primitive<std::mutex>>;
+  pending_ownership_acquires_t m_pending_ownership_acquires;              // Recorded into the next frame, see submit().
+
 #ifdef CWDEBUG
   bool const mVWDebug;                                                    // A copy of mSMDebug.
 #endif
@@ -423,11 +452,52 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
     vk::Image vh_image,
     vk::ImageSubresourceRange const& image_subresource_range) const;
 
+  // Called (by CopyDataToBuffer and CopyDataToImage) after submitting the release half of a queue family ownership
+  // transfer to the graphics queue family of this window (see TransferBatch::after_submit). The acquire barrier is
+  // executed at the start of the next submitted frame, after vh_timeline_semaphore reached signal_value.
+  void add_acquire_barrier(vk::PipelineStageFlags consuming_stages, vk::BufferMemoryBarrier const& barrier, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value);
+  void add_acquire_barrier(vk::PipelineStageFlags consuming_stages, vk::ImageMemoryBarrier const& barrier, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value);
+
+  // Called by CopyDataToImage instead of add_acquire_barrier when the mip chain of the image can't be generated on the (transfer)
+  // queue that it was uploaded with. The acquire barrier must keep all levels in layout eTransferDstOptimal. After acquiring
+  // the image, its mip chain is generated and all levels are transitioned to new_layout.
+  void add_acquire_barrier_and_mipmap_generation(vk::ImageMemoryBarrier const& barrier, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value,
+      vulkan::MipmapGeneration const& mipmap_generation, vk::PipelineStageFlags consuming_stages, vk::AccessFlags new_access, vk::ImageLayout new_layout);
+
+  // Called by task::Defragment, between two frames, after switching resources over to their new memory.
+  // record is called with the command buffer that is executed on the graphics queue at the start of the next
+  // submitted frame, before the commands of that frame, and the serial number of that frame (see ResidencyManager::new_frame).
+  void add_relocations(std::function<void(vk::CommandBuffer, uint64_t)> record);
+
+  // Upload the first level of a texture from texture_data_feeder. If the image kind of image_view_kind has more than one
+  // mip level, the other levels are generated: with blits if the format supports that, otherwise on the CPU (see MipmapFeeder).
+  // The subresource range of image_view_kind determines which of the levels are visible through the image view.
+  // All upload_texture functions write the texture to binding of vh_descriptor_set, unless vh_descriptor_set is null
+  // (for example, because the texture will be added to LogicalDevice::bindless_textures()).
   vulkan::Texture upload_texture(std::unique_ptr<vulkan::DataFeeder> texture_data_feeder, vk::Extent2D extent,
       int binding, vulkan::ImageViewKind const& image_view_kind, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
       AIStatefulTask::condition_type texture_ready
       COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& debug_name));
 
+  // Upload an image that is being decoded by Application::image_decoder(); the upload starts once decoding finished.
+  vulkan::Texture upload_texture(std::shared_ptr<vk_utils::stbi::DecodedImage> decoded_image,
+      int binding, vulkan::ImageViewKind const& image_view_kind, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
+      AIStatefulTask::condition_type texture_ready
+      COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& debug_name));
+
+  // Upload a block compressed KTX2 texture with all of its mip levels. The blocks are uploaded as-is if the device
+  // can sample the format of the texture, otherwise they are decoded to RGBA8 on the CPU first.
+  vulkan::Texture upload_texture(vk_utils::ktx2::KTX2Data&& texture_data,
+      int binding, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
+      AIStatefulTask::condition_type texture_ready
+      COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& debug_name));
+
+  // Same, but call texture_ready (with true on success) once the upload finished, instead of signaling this window.
+  vulkan::Texture upload_texture(vk_utils::ktx2::KTX2Data&& texture_data,
+      int binding, vulkan::SamplerKind const& sampler_kind, vk::DescriptorSet vh_descriptor_set,
+      std::function<void(bool)> texture_ready
+      COMMA_CWDEBUG_ONLY(vulkan::Ambifix const& debug_name));
+
   void detect_if_imgui_is_used();
 
  public:
@@ -495,6 +565,9 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
   // Called by create_frame_resources() (and PresentationSurface::set_queues when TRACY_ENABLE).
   virtual vulkan::FrameResourceIndex max_number_of_frame_resources() const;
 
+  // Called by create_frame_resources(). Override to give each FrameResourcesData a UniformArena of this size (in bytes).
+  virtual vk::DeviceSize uniform_arena_size() const { return 0; }
+
   // Called by ... when TRACY_ENABLE.
   virtual vulkan::SwapchainIndex max_number_of_swapchain_images() const;
 
@@ -506,6 +579,11 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
   void start_frame();
   void wait_command_buffer_completed();
   void submit(vulkan::handle::CommandBuffer command_buffer);
+  // Record the jobs of recording into secondary command buffers of the current frame resources, on up to
+  // max_threads threads (0 means: all thread pool threads plus the calling thread), and record their
+  // execution into command_buffer (which must be in the recording state, outside of a render pass).
+  // Returns after all jobs were recorded. See ParallelRecording.
+  void record_in_parallel(vulkan::handle::CommandBuffer command_buffer, std::shared_ptr<vulkan::ParallelRecording> const& recording, int max_threads = 0);
   void finish_frame();
   void acquire_image();
 
@@ -0,0 +1,50 @@
+#include "sys.h"
+#include "Texture.h"
+
+namespace vulkan {
+
+Texture& Texture::operator=(Texture&& rhs)
+{
+  // Stop both from being evicted while moving; this also waits for an eviction that is in progress.
+  make_unevictable();
+  bool const rhs_was_evictable = rhs.m_evictable_allocation;
+  rhs.make_unevictable();
+  memory::Image::operator=(std::move(rhs));
+  m_image_view = std::move(rhs.m_image_view);
+  m_sampler = std::move(rhs.m_sampler);
+  // Register the new address, unless rhs was evicted.
+  if (rhs_was_evictable && m_vh_image)
+    make_evictable();
+  return *this;
+}
+
+void Texture::make_evictable()
+{
+  // Only textures with their own allocation can be evicted.
+  ASSERT(m_vh_image && m_vh_allocation && !m_evictable_allocation);
+  m_evictable_allocation = m_vh_allocation;
+  m_logical_device->residency_manager().set_evictable(m_evictable_allocation, this);
+}
+
+void Texture::make_unevictable()
+{
+  if (!m_evictable_allocation)
+    return;
+  m_logical_device->residency_manager().remove_evictable(m_evictable_allocation, this);
+  m_evictable_allocation = VK_NULL_HANDLE;
+}
+
+vk::DeviceSize Texture::evict(VmaAllocation vh_allocation)
+{
+  DoutEntering(dc::vulkan, "Texture::evict(" << vh_allocation << ") [" << this << "]");
+  // Called by ResidencyManager::make_room while no frame in flight uses this texture, and the owner
+  // no longer uses it either (touch() returns false). m_evictable_allocation is left alone; it is
+  // read by touch() and reset by make_unevictable().
+  ASSERT(vh_allocation == m_evictable_allocation);
+  vk::DeviceSize const size = m_logical_device->get_allocation_info(vh_allocation).size;
+  m_image_view.reset();
+  destroy();
+  return size;
+}
+
+} // namespace vulkan
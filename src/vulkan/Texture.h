@@ -1,15 +1,24 @@
 #pragma once
 
 #include "memory/Image.h"
+#include "memory/ResidencyManager.h"
 
 namespace vulkan {
 
 // Data collection used for textures.
-struct Texture : public memory::Image
+//
+// A texture can be made evictable (see make_evictable): when the heap that it was allocated from runs out
+// of budget then the image (and its view) are destroyed, provided that no frame in flight is using it.
+// The owner of an evictable texture must call touch() every frame before using it; if that returns false
+// then the texture was evicted and must be recreated (for example with fewer mip levels) before it can be used again.
+struct Texture : public memory::Image, public memory::Evictable
 {
   vk::UniqueImageView   m_image_view;
   vk::UniqueSampler     m_sampler;
 
+ private:
+  VmaAllocation m_evictable_allocation{};               // The allocation that this texture is registered as Evictable for, or null.
+
  public:
   // Used to move-assign later.
   Texture() = default;
@@ -63,8 +72,30 @@ struct Texture : public memory::Image
   }
 
   // Class is move-only.
-  Texture(Texture&& rhs) = default;
-  Texture& operator=(Texture&& rhs) = default;
+  Texture(Texture&& rhs) { *this = std::move(rhs); }
+  Texture& operator=(Texture&& rhs);
+
+  ~Texture() { make_unevictable(); }
+
+  // Allow the residency manager of the logical device to evict this texture.
+  void make_evictable();
+
+  // Stop this texture from being evicted. If it is being evicted at this moment then this waits until that finished.
+  void make_unevictable();
+
+  // Mark this texture as used by the current frame. Returns false if the texture was evicted.
+  bool touch()
+  {
+    if (m_evictable_allocation)
+      return m_logical_device->residency_manager().touch(m_evictable_allocation, this);
+    if (m_vh_allocation)
+      m_logical_device->residency_manager().touch(m_vh_allocation);
+    return true;
+  }
+
+ private:
+  // Implementation of memory::Evictable.
+  vk::DeviceSize evict(VmaAllocation vh_allocation) override;
 };
 
 } // namespace vulkan
@@ -0,0 +1,98 @@
+#include "sys.h"
+#include "BindlessTextures.h"
+#include "LogicalDevice.h"
+#include "debug/DebugSetName.h"
+#include "utils/AIAlert.h"
+
+namespace vulkan::descriptor {
+
+namespace {
+
+std::vector<vk::DescriptorSetLayoutBinding> bindless_layout_bindings(uint32_t capacity)
+{
+  return {
+    {
+      .binding = BindlessTextures::s_binding,
+      .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+      .descriptorCount = capacity,
+      .stageFlags = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute
+    }
+  };
+}
+
+} // namespace
+
+BindlessTextures::BindlessTextures(LogicalDevice const* logical_device, uint32_t capacity
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) : m_logical_device(logical_device), m_capacity(capacity)
+{
+  DoutEntering(dc::vulkan, "BindlessTextures::BindlessTextures(" << logical_device << ", " << capacity << ") [" << this << "]");
+
+  std::vector<vk::DescriptorSetLayoutBinding> layout_bindings = bindless_layout_bindings(capacity);
+  // Slots may be empty, and may be written while the set is bound in a pending command buffer (as long as that slot isn't used by it).
+  std::vector<vk::DescriptorBindingFlags> binding_flags = {
+    vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending
+  };
+  m_descriptor_set_layout = logical_device->create_descriptor_set_layout(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+      layout_bindings, binding_flags COMMA_CWDEBUG_ONLY(ambifix(".m_descriptor_set_layout")));
+  m_set_layout = SetLayout(std::move(layout_bindings), *m_descriptor_set_layout);
+
+  m_descriptor_pool = logical_device->create_descriptor_pool(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+      { { .type = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = capacity } }, 1
+      COMMA_CWDEBUG_ONLY(ambifix(".m_descriptor_pool")));
+  m_vh_descriptor_set = logical_device->allocate_descriptor_sets({ *m_descriptor_set_layout }, *m_descriptor_pool
+      COMMA_CWDEBUG_ONLY(ambifix(".m_vh_descriptor_set")))[0];
+}
+
+void BindlessTextures::write(uint32_t slot, vk::ImageView vh_image_view, vk::Sampler vh_sampler) const
+{
+  m_logical_device->update_descriptor_set(m_vh_descriptor_set, vk::DescriptorType::eCombinedImageSampler, s_binding, slot,
+      { { .sampler = vh_sampler, .imageView = vh_image_view, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal } });
+}
+
+uint32_t BindlessTextures::insert(vk::ImageView vh_image_view, vk::Sampler vh_sampler)
+{
+  DoutEntering(dc::vulkan, "BindlessTextures::insert(" << vh_image_view << ", " << vh_sampler << ") [" << this << "]");
+  memory::ResidencyManager const& residency_manager = m_logical_device->residency_manager();
+  slots_t::wat slots_w(m_slots);
+  // Recycle the slots that were erased before the oldest frame that is still in flight (of any window) was started.
+  while (!slots_w->m_released.empty() && residency_manager.is_completed(slots_w->m_released.front().m_frame))
+  {
+    slots_w->m_free.push_back(slots_w->m_released.front().m_slot);
+    slots_w->m_released.pop_front();
+  }
+  uint32_t slot;
+  if (!slots_w->m_free.empty())
+  {
+    slot = slots_w->m_free.back();
+    slots_w->m_free.pop_back();
+  }
+  else if (slots_w->m_next_unused < m_capacity)
+    slot = slots_w->m_next_unused++;
+  else
+    THROW_ALERT("BindlessTextures is full ([CAPACITY] textures)", AIArgs("[CAPACITY]", m_capacity));
+  write(slot, vh_image_view, vh_sampler);
+  Dout(dc::vulkan, "Using slot " << slot << ".");
+  return slot;
+}
+
+void BindlessTextures::update(uint32_t slot, vk::ImageView vh_image_view, vk::Sampler vh_sampler)
+{
+  DoutEntering(dc::vulkan, "BindlessTextures::update(" << slot << ", " << vh_image_view << ", " << vh_sampler << ") [" << this << "]");
+  // slot must have been returned by insert.
+  ASSERT(slot < m_capacity);
+  slots_t::wat slots_w(m_slots);
+  write(slot, vh_image_view, vh_sampler);
+}
+
+void BindlessTextures::erase(uint32_t slot)
+{
+  DoutEntering(dc::vulkan, "BindlessTextures::erase(" << slot << ") [" << this << "]");
+  // slot must have been returned by insert.
+  ASSERT(slot < m_capacity);
+  // The descriptor is left as-is (it is partially bound and no longer used by any shader invocation).
+  uint64_t const frame = m_logical_device->residency_manager().frame();
+  slots_t::wat slots_w(m_slots);
+  slots_w->m_released.push_back({ slot, frame });
+}
+
+} // namespace vulkan::descriptor
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "SetLayout.h"
+#include "threadsafe/aithreadsafe.h"
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "debug.h"
+
+namespace vulkan {
+
+class LogicalDevice;
+#ifdef CWDEBUG
+class Ambifix;
+#endif
+
+namespace descriptor {
+
+// A per-device table of textures, addressed by index.
+//
+// The table is a single descriptor set with one large, partially bound, update-after-bind array of
+// combined image samplers. Textures are added to and removed from the table at any time (also while
+// the set is bound by command buffers that are pending) and are referred to by their slot index,
+// typically passed as push constant. Hence, drawing many objects with different textures requires
+// binding this set only once per command buffer.
+//
+// Usage:
+//
+//   // Include set_layout() in the pipeline layout, for example as set 1:
+//   vk::PipelineLayout vh_pipeline_layout = logical_device->try_emplace_pipeline_layout(
+//       { other_set_layout, logical_device->bindless_textures().set_layout() }, push_constant_ranges);
+//
+//   // In the shader (requires #extension GL_EXT_nonuniform_qualifier : require):
+//   layout(set = 1, binding = 0) uniform sampler2D bindless_textures[];
+//   layout(push_constant) uniform PushConstant { uint texture_index; } push_constant;
+//   ... texture(bindless_textures[nonuniformEXT(push_constant.texture_index)], uv) ...
+//
+//   // After uploading a texture (upload_texture may be passed a null descriptor set):
+//   m_texture_index = logical_device->bindless_textures().insert(*m_texture.m_image_view, *m_texture.m_sampler);
+//
+//   // While recording:
+//   logical_device->bindless_textures().bind(command_buffer, vk::PipelineBindPoint::eGraphics, vh_pipeline_layout, 1);
+//   command_buffer.pushConstants(vh_pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(uint32_t), &m_texture_index);
+//
+//   // Before destroying the texture:
+//   logical_device->bindless_textures().erase(m_texture_index);
+//
+class BindlessTextures
+{
+ public:
+  static constexpr uint32_t s_binding = 0;              // The binding of the array.
+  static constexpr uint32_t s_max_textures = 16384;     // The maximum size of the array (it is further limited by the device).
+
+ private:
+  struct ReleasedSlot
+  {
+    uint32_t m_slot;
+    uint64_t m_frame;                                   // The value of ResidencyManager::frame() when the slot was erased (the last frame that might use it).
+  };
+
+  struct Slots
+  {
+    uint32_t m_next_unused{};                           // Slots [m_next_unused, m_capacity) were never used.
+    std::vector<uint32_t> m_free;                       // Slots that can be reused.
+    std::deque<ReleasedSlot> m_released;                // Erased slots that might still be accessed by the GPU, in the order in which they were erased.
+  };
+  using slots_t = aithreadsafe::Wrapper<Slots, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  LogicalDevice const* m_logical_device;
+  uint32_t m_capacity;                                  // The size of the array.
+  vk::UniqueDescriptorPool m_descriptor_pool;           // A pool with eUpdateAfterBind, only used for m_vh_descriptor_set.
+  vk::UniqueDescriptorSetLayout m_descriptor_set_layout;
+  SetLayout m_set_layout;                               // The same layout, with its bindings.
+  vk::DescriptorSet m_vh_descriptor_set;                // Freed together with m_descriptor_pool.
+  mutable slots_t m_slots;                              // Also protects writing to m_vh_descriptor_set.
+
+ public:
+  BindlessTextures(LogicalDevice const* logical_device, uint32_t capacity
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Add a texture to the table and return its slot. Throws if the table is full.
+  // The image must be in the layout eShaderReadOnlyOptimal when it is accessed.
+  uint32_t insert(vk::ImageView vh_image_view, vk::Sampler vh_sampler);
+
+  // Replace the texture in slot (for example, after the image was recreated).
+  void update(uint32_t slot, vk::ImageView vh_image_view, vk::Sampler vh_sampler);
+
+  // Remove the texture in slot from the table. The slot is not reused until the GPU can't be accessing it anymore.
+  void erase(uint32_t slot);
+
+  // Bind the table as set set_index of vh_pipeline_layout.
+  void bind(vk::CommandBuffer vh_command_buffer, vk::PipelineBindPoint pipeline_bind_point, vk::PipelineLayout vh_pipeline_layout, uint32_t set_index) const
+  {
+    vh_command_buffer.bindDescriptorSets(pipeline_bind_point, vh_pipeline_layout, set_index, { m_vh_descriptor_set }, {});
+  }
+
+  // Accessors.
+  // Note: the pipeline layout cache compares set layouts by their bindings only; don't use a layout with the same bindings but without the update-after-bind flags.
+  SetLayout const& set_layout() const { return m_set_layout; }
+  vk::DescriptorSet vh_descriptor_set() const { return m_vh_descriptor_set; }
+  uint32_t capacity() const { return m_capacity; }
+
+ private:
+  void write(uint32_t slot, vk::ImageView vh_image_view, vk::Sampler vh_sampler) const;
+};
+
+} // namespace descriptor
+} // namespace vulkan
@@ -0,0 +1,35 @@
+#include "sys.h"
+#include "AliasedMemory.h"
+#include "LogicalDevice.h"
+
+namespace vulkan::memory {
+
+AliasedMemory::AliasedMemory(LogicalDevice const* logical_device, vk::MemoryRequirements const& memory_requirements, vk::MemoryPropertyFlags properties
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) : m_logical_device(logical_device), m_size(memory_requirements.size)
+{
+  DoutEntering(dc::vulkan, "AliasedMemory::AliasedMemory(" << logical_device << ", " << memory_requirements << ", " << properties << ") [" << this << "]");
+  VmaAllocationCreateInfo vma_allocation_create_info{
+    .usage = VMA_MEMORY_USAGE_UNKNOWN,
+    .requiredFlags = static_cast<VkMemoryPropertyFlags>(properties)
+  };
+  m_vh_allocation = logical_device->allocate_memory({}, memory_requirements, vma_allocation_create_info, AllocationCategory::attachment
+      COMMA_CWDEBUG_ONLY(ambifix(".m_vh_allocation")));
+}
+
+void AliasedMemory::destroy()
+{
+  if (m_vh_allocation)
+    m_logical_device->free_memory({}, m_vh_allocation);
+  m_vh_allocation = VK_NULL_HANDLE;
+}
+
+#ifdef CWDEBUG
+void AliasedMemory::print_on(std::ostream& os) const
+{
+  os << "{logical_device:" << m_logical_device <<
+      ", vh_allocation:" << m_vh_allocation <<
+      ", size:" << m_size << '}';
+}
+#endif
+
+} // namespace vulkan::memory
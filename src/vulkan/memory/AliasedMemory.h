@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Allocator.h"
+#include "AllocationCategory.h"
+#include "debug.h"
+
+namespace vulkan {
+class LogicalDevice;
+
+namespace memory {
+
+// A block of device memory that is not bound to any resource of its own.
+//
+// Used to let several images (e.g. attachments of the render graph whose lifetimes do not overlap)
+// share the same memory; see the memory::Image constructor that takes an AliasedMemory.
+// The AliasedMemory must outlive all images that are bound to it.
+class AliasedMemory
+{
+ private:
+  LogicalDevice const* m_logical_device{};              // The associated logical device; only valid when m_vh_allocation is non-null.
+  VmaAllocation m_vh_allocation{};                      // The memory allocation, or VK_NULL_HANDLE when no memory is represented.
+  vk::DeviceSize m_size{};                              // The size of the allocation in bytes.
+
+ public:
+  AliasedMemory() = default;
+
+  // Allocate memory that satisfies memory_requirements, in memory with (at least) properties.
+  AliasedMemory(LogicalDevice const* logical_device, vk::MemoryRequirements const& memory_requirements, vk::MemoryPropertyFlags properties
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Move-only.
+  AliasedMemory(AliasedMemory&& rhs) : m_logical_device(rhs.m_logical_device), m_vh_allocation(rhs.m_vh_allocation), m_size(rhs.m_size)
+  {
+    rhs.m_vh_allocation = VK_NULL_HANDLE;
+  }
+
+  AliasedMemory& operator=(AliasedMemory&& rhs)
+  {
+    destroy();
+    m_logical_device = rhs.m_logical_device;
+    m_vh_allocation = rhs.m_vh_allocation;
+    m_size = rhs.m_size;
+    rhs.m_vh_allocation = VK_NULL_HANDLE;
+    return *this;
+  }
+
+  ~AliasedMemory()
+  {
+    destroy();
+  }
+
+  VmaAllocation vh_allocation() const { return m_vh_allocation; }
+  vk::DeviceSize size() const { return m_size; }
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+
+ private:
+  void destroy();
+};
+
+} // namespace memory
+} // namespace vulkan
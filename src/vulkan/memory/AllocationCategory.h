@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <magic_enum.hpp>
+#include <array>
+#include <cstdint>
+
+namespace vulkan::memory {
+
+// What an allocation is used for; used for memory statistics only (see ResidencyManager::statistics).
+enum class AllocationCategory
+{
+  staging,
+  vertex,                       // Vertex and index buffers.
+  uniform,
+  texture,
+  attachment,
+  imgui,
+  other,
+  automatic                     // Deduce the category from the usage flags (only valid in a MemoryCreateInfo).
+};
+
+static constexpr size_t number_of_allocation_categories = static_cast<size_t>(AllocationCategory::automatic);
+
+inline AllocationCategory deduce_category(vk::BufferUsageFlags usage)
+{
+  if (usage & (vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer))
+    return AllocationCategory::vertex;
+  if (usage & vk::BufferUsageFlagBits::eUniformBuffer)
+    return AllocationCategory::uniform;
+  if (usage == vk::BufferUsageFlagBits::eTransferSrc)
+    return AllocationCategory::staging;
+  return AllocationCategory::other;
+}
+
+inline AllocationCategory deduce_category(vk::ImageUsageFlags usage)
+{
+  if (usage & (vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment |
+               vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eInputAttachment))
+    return AllocationCategory::attachment;
+  if (usage & vk::ImageUsageFlagBits::eSampled)
+    return AllocationCategory::texture;
+  return AllocationCategory::other;
+}
+
+inline char const* to_string(AllocationCategory category)
+{
+  return magic_enum::enum_name(category).data();
+}
+
+} // namespace vulkan::memory
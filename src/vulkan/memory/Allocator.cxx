@@ -14,6 +14,15 @@ void Allocator::create(VmaAllocatorCreateInfo const& vma_allocator_create_info)
     THROW_ALERTC(res, "vmaCreateAllocator");
 }
 
+VmaPool Allocator::create_pool(VmaPoolCreateInfo const& pool_create_info) const
+{
+  VmaPool vh_pool;
+  vk::Result res = static_cast<vk::Result>(vmaCreatePool(m_handle, &pool_create_info, &vh_pool));
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaCreatePool");
+  return vh_pool;
+}
+
 vk::Buffer Allocator::create_buffer(
     vk::BufferCreateInfo const& buffer_create_info,
     VmaAllocationCreateInfo const& vma_allocation_create_info,
@@ -48,4 +57,42 @@ vk::Image Allocator::create_image(
   return vh_image;
 }
 
+vk::Buffer Allocator::create_aliasing_buffer(VmaAllocation vh_allocation, vk::BufferCreateInfo const& buffer_create_info) const
+{
+  VkBuffer vh_buffer;
+  vk::Result res = static_cast<vk::Result>(
+      vmaCreateAliasingBuffer(m_handle, vh_allocation, &static_cast<VkBufferCreateInfo const&>(buffer_create_info), &vh_buffer)
+      );
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaCreateAliasingBuffer");
+  return vh_buffer;
+}
+
+vk::Image Allocator::create_aliasing_image(VmaAllocation vh_allocation, vk::ImageCreateInfo const& image_create_info) const
+{
+  VkImage vh_image;
+  vk::Result res = static_cast<vk::Result>(
+      vmaCreateAliasingImage(m_handle, vh_allocation, &static_cast<VkImageCreateInfo const&>(image_create_info), &vh_image)
+      );
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaCreateAliasingImage");
+  return vh_image;
+}
+
+VmaAllocation Allocator::allocate_memory(
+    vk::MemoryRequirements const& memory_requirements,
+    VmaAllocationCreateInfo const& vma_allocation_create_info,
+    VmaAllocationInfo* allocation_info
+    COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
+{
+  VmaAllocation vh_allocation;
+  vk::Result res = static_cast<vk::Result>(
+      vmaAllocateMemory(m_handle, &static_cast<VkMemoryRequirements const&>(memory_requirements), &vma_allocation_create_info, &vh_allocation, allocation_info)
+      );
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaAllocateMemory");
+  Debug(vmaSetAllocationName(m_handle, vh_allocation, allocation_name.object_name().c_str()));
+  return vh_allocation;
+}
+
 } // namespace vulkan::memory
@@ -94,6 +94,122 @@ class Allocator
     vmaGetAllocationMemoryProperties(m_handle, vh_allocation, &memory_property_flags);
     memory_property_flags_out = vk::MemoryPropertyFlags{memory_property_flags};
   }
+
+  //---------------------------------------------------------------------------
+  // Custom pools (used by BufferPools).
+
+  VmaPool create_pool(VmaPoolCreateInfo const& pool_create_info) const;
+
+  void destroy_pool(VmaPool vh_pool) const
+  {
+    vmaDestroyPool(m_handle, vh_pool);
+  }
+
+#ifdef CWDEBUG
+  void set_pool_name(VmaPool vh_pool, char const* name) const
+  {
+    vmaSetPoolName(m_handle, vh_pool, name);
+  }
+#endif
+
+  VmaDetailedStatistics calculate_pool_statistics(VmaPool vh_pool) const
+  {
+    VmaDetailedStatistics pool_statistics;
+    vmaCalculatePoolStatistics(m_handle, vh_pool, &pool_statistics);
+    return pool_statistics;
+  }
+
+  //---------------------------------------------------------------------------
+
+  // Create a buffer that is bound to the memory of an existing allocation. Destroy it with vkDestroyBuffer (not destroy_buffer).
+  vk::Buffer create_aliasing_buffer(VmaAllocation vh_allocation, vk::BufferCreateInfo const& buffer_create_info) const;
+
+  // Create an image that is bound to the memory of an existing allocation. Destroy it with vkDestroyImage (not destroy_image).
+  vk::Image create_aliasing_image(VmaAllocation vh_allocation, vk::ImageCreateInfo const& image_create_info) const;
+
+  //---------------------------------------------------------------------------
+  // Raw memory (used by memory::AliasedMemory).
+
+  VmaAllocation allocate_memory(vk::MemoryRequirements const& memory_requirements,
+      VmaAllocationCreateInfo const& vma_allocation_create_info, VmaAllocationInfo* allocation_info
+      COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const;
+
+  void free_memory(VmaAllocation vh_allocation) const
+  {
+    vmaFreeMemory(m_handle, vh_allocation);
+  }
+
+  //---------------------------------------------------------------------------
+  // Defragmentation (used by task::Defragment).
+
+  vk::Result begin_defragmentation(VmaDefragmentationInfo const& defragmentation_info, VmaDefragmentationContext* context_out) const
+  {
+    return static_cast<vk::Result>(vmaBeginDefragmentation(m_handle, &defragmentation_info, context_out));
+  }
+
+  // Returns eSuccess if there is nothing (left) to move, or eIncomplete if pass_info_out contains moves.
+  vk::Result begin_defragmentation_pass(VmaDefragmentationContext context, VmaDefragmentationPassMoveInfo* pass_info_out) const
+  {
+    return static_cast<vk::Result>(vmaBeginDefragmentationPass(m_handle, context, pass_info_out));
+  }
+
+  // Returns eSuccess if defragmentation is complete, or eIncomplete if another pass is needed.
+  vk::Result end_defragmentation_pass(VmaDefragmentationContext context, VmaDefragmentationPassMoveInfo* pass_info) const
+  {
+    return static_cast<vk::Result>(vmaEndDefragmentationPass(m_handle, context, pass_info));
+  }
+
+  void end_defragmentation(VmaDefragmentationContext context, VmaDefragmentationStats* stats_out) const
+  {
+    vmaEndDefragmentation(m_handle, context, stats_out);
+  }
+
+  VmaTotalStatistics calculate_statistics() const
+  {
+    VmaTotalStatistics total_statistics;
+    vmaCalculateStatistics(m_handle, &total_statistics);
+    return total_statistics;
+  }
+
+  //---------------------------------------------------------------------------
+
+  VkPhysicalDeviceMemoryProperties const* get_memory_properties() const
+  {
+    VkPhysicalDeviceMemoryProperties const* memory_properties;
+    vmaGetMemoryProperties(m_handle, &memory_properties);
+    return memory_properties;
+  }
+
+  // budgets must point to an array of at least get_memory_properties()->memoryHeapCount elements.
+  void get_heap_budgets(VmaBudget* budgets) const
+  {
+    vmaGetHeapBudgets(m_handle, budgets);
+  }
+
+  // Return the memory type that VMA would use for a buffer or image with the given create info, or UINT32_MAX if there is none.
+  uint32_t find_memory_type_index(vk::BufferCreateInfo const& buffer_create_info, VmaAllocationCreateInfo const& vma_allocation_create_info) const
+  {
+    uint32_t memory_type_index;
+    if (vmaFindMemoryTypeIndexForBufferInfo(m_handle, &static_cast<VkBufferCreateInfo const&>(buffer_create_info), &vma_allocation_create_info, &memory_type_index) != VK_SUCCESS)
+      return UINT32_MAX;
+    return memory_type_index;
+  }
+
+  uint32_t find_memory_type_index(vk::ImageCreateInfo const& image_create_info, VmaAllocationCreateInfo const& vma_allocation_create_info) const
+  {
+    uint32_t memory_type_index;
+    if (vmaFindMemoryTypeIndexForImageInfo(m_handle, &static_cast<VkImageCreateInfo const&>(image_create_info), &vma_allocation_create_info, &memory_type_index) != VK_SUCCESS)
+      return UINT32_MAX;
+    return memory_type_index;
+  }
+
+  uint32_t find_memory_type_index(uint32_t memory_type_bits, VmaAllocationCreateInfo const& vma_allocation_create_info) const
+  {
+    uint32_t memory_type_index;
+    if (vmaFindMemoryTypeIndex(m_handle, memory_type_bits, &vma_allocation_create_info, &memory_type_index) != VK_SUCCESS)
+      return UINT32_MAX;
+    return memory_type_index;
+  }
 };
 
 } // namespace memory
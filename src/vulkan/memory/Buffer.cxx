@@ -34,7 +34,8 @@ Buffer::Buffer(
     .usage = memory_create_info.vma_memory_usage
   };
 
-  m_vh_buffer = logical_device->create_buffer({}, buffer_create_info, vma_allocation_create_info, &m_vh_allocation, memory_create_info.allocation_info_out
+  m_vh_buffer = logical_device->create_buffer({}, buffer_create_info, vma_allocation_create_info, &m_vh_allocation, memory_create_info.allocation_info_out,
+      memory_create_info.category == AllocationCategory::automatic ? deduce_category(memory_create_info.usage) : memory_create_info.category
       COMMA_CWDEBUG_ONLY(ambifix(".m_vh_allocation")));
   DebugSetName(m_vh_buffer, ambifix(".m_vh_buffer"), logical_device);
 
@@ -2,6 +2,7 @@
 #define VULKAN_MEMORY_BUFFER_H
 
 #include "Allocator.h"
+#include "AllocationCategory.h"
 
 namespace vulkan {
 class LogicalDevice;
@@ -16,6 +17,7 @@ struct BufferMemoryCreateInfoDefaults
   VmaAllocationCreateFlags    vma_allocation_create_flags{};
   VmaMemoryUsage              vma_memory_usage                  = VMA_MEMORY_USAGE_AUTO;
   VmaAllocationInfo*          allocation_info_out{};
+  AllocationCategory          category                          = AllocationCategory::automatic;
 };
 
 // Vulkan Buffer's parameters container class.
@@ -62,6 +64,9 @@ struct Buffer
   [[gnu::always_inline]] inline void* map_memory();
   [[gnu::always_inline]] inline void unmap_memory();
 
+  // Mark the buffer as used by the current frame (see ResidencyManager::touch).
+  [[gnu::always_inline]] inline void touch() const;
+
  private:
   inline void destroy();
 };
@@ -92,6 +97,12 @@ void Buffer::unmap_memory()
   m_logical_device->unmap_memory(m_vh_allocation);
 }
 
+//inline
+void Buffer::touch() const
+{
+  m_logical_device->residency_manager().touch(m_vh_allocation);
+}
+
 //inline
 void Buffer::destroy()
 {
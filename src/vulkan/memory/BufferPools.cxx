@@ -0,0 +1,84 @@
+#include "sys.h"
+#include "BufferPools.h"
+#include <algorithm>
+#include <limits>
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#include <string>
+#endif
+
+namespace vulkan::memory {
+
+BufferPools::~BufferPools()
+{
+  pools_t::wat pools_w(m_pools);
+  for (auto const& key_pool : *pools_w)
+    m_allocator->destroy_pool(key_pool.second);
+}
+
+VmaPool BufferPools::pool_for(vk::BufferCreateInfo const& buffer_create_info, VmaAllocationCreateInfo const& vma_allocation_create_info,
+    AllocationCategory category) const
+{
+  vk::DeviceSize const pool_block_size = block_size(category);
+  if (pool_block_size == 0 || buffer_create_info.size > max_pooled_size(category) ||
+      (vma_allocation_create_info.flags & VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT))
+    return VK_NULL_HANDLE;
+
+  // The memory type that VMA would pick from the default pools.
+  uint32_t const memory_type_index = m_allocator->find_memory_type_index(buffer_create_info, vma_allocation_create_info);
+  if (memory_type_index == UINT32_MAX)
+    return VK_NULL_HANDLE;      // Let vmaCreateBuffer report the error.
+
+  pools_t::wat pools_w(m_pools);
+  auto iter = pools_w->find({ category, memory_type_index });
+  if (AI_LIKELY(iter != pools_w->end()))
+    return iter->second;
+
+  DoutEntering(dc::vulkan, "BufferPools::pool_for(" << buffer_create_info << ", " << vma_allocation_create_info << ", " << to_string(category) << ")");
+  VmaPoolCreateInfo pool_create_info{
+    .memoryTypeIndex = memory_type_index,
+    .blockSize = pool_block_size
+  };
+  VmaPool vh_pool = m_allocator->create_pool(pool_create_info);
+#ifdef CWDEBUG
+  std::string pool_name = std::string("BufferPools:") + to_string(category) + ":" + std::to_string(memory_type_index);
+  m_allocator->set_pool_name(vh_pool, pool_name.c_str());
+  Dout(dc::vulkan, "Created pool " << pool_name << " with block size " << pool_block_size << ".");
+#endif
+  pools_w->emplace(key_type{ category, memory_type_index }, vh_pool);
+  return vh_pool;
+}
+
+std::vector<VmaPool> BufferPools::pools() const
+{
+  std::vector<VmaPool> result;
+  pools_t::wat pools_w(m_pools);
+  for (auto const& key_pool : *pools_w)
+    result.push_back(key_pool.second);
+  return result;
+}
+
+VmaDetailedStatistics BufferPools::statistics(AllocationCategory category) const
+{
+  VmaDetailedStatistics result{};
+  result.allocationSizeMin = result.unusedRangeSizeMin = std::numeric_limits<VkDeviceSize>::max();
+  pools_t::wat pools_w(m_pools);
+  for (auto const& key_pool : *pools_w)
+  {
+    if (key_pool.first.first != category)
+      continue;
+    VmaDetailedStatistics pool_statistics = m_allocator->calculate_pool_statistics(key_pool.second);
+    result.statistics.blockCount += pool_statistics.statistics.blockCount;
+    result.statistics.allocationCount += pool_statistics.statistics.allocationCount;
+    result.statistics.blockBytes += pool_statistics.statistics.blockBytes;
+    result.statistics.allocationBytes += pool_statistics.statistics.allocationBytes;
+    result.unusedRangeCount += pool_statistics.unusedRangeCount;
+    result.allocationSizeMin = std::min(result.allocationSizeMin, pool_statistics.allocationSizeMin);
+    result.allocationSizeMax = std::max(result.allocationSizeMax, pool_statistics.allocationSizeMax);
+    result.unusedRangeSizeMin = std::min(result.unusedRangeSizeMin, pool_statistics.unusedRangeSizeMin);
+    result.unusedRangeSizeMax = std::max(result.unusedRangeSizeMax, pool_statistics.unusedRangeSizeMax);
+  }
+  return result;
+}
+
+} // namespace vulkan::memory
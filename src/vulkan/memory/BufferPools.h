@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Allocator.h"
+#include "AllocationCategory.h"
+#include "threadsafe/aithreadsafe.h"
+#include <map>
+#include <utility>
+#include <vector>
+#include <mutex>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+// Custom VMA pools for small buffers, one per (category, memory type).
+//
+// Small vertex/index, uniform and imgui buffers are allocated from their own pool with a block size
+// that is tuned for that category, instead of from the default pools where they would be interleaved
+// with (and fragment the blocks of) textures, attachments and large buffers.
+//
+// Used by LogicalDevice::create_buffer; a buffer is pooled when its category has a pool (see block_size),
+// it is not larger than max_pooled_size of its category and it doesn't ask for dedicated memory.
+// The pools are created the first time they are needed.
+//
+// Note that each pooled buffer still has its own VkBuffer; use a SlicedBuffer to share one VkBuffer
+// between many small objects. task::Defragment defragments each of the pools (see pools()) after the default pools.
+class BufferPools
+{
+ public:
+  // The block size of the pools of category, or zero if buffers of that category use the default pools.
+  static constexpr vk::DeviceSize block_size(AllocationCategory category)
+  {
+    switch (category)
+    {
+      case AllocationCategory::vertex:
+        return 16 * 1024 * 1024;
+      case AllocationCategory::uniform:
+        return 4 * 1024 * 1024;
+      case AllocationCategory::imgui:
+        return 1024 * 1024;
+      default:
+        return 0;
+    }
+  }
+
+  // Larger buffers are allocated from the default pools.
+  static constexpr vk::DeviceSize max_pooled_size(AllocationCategory category) { return block_size(category) / 16; }
+
+ private:
+  using key_type = std::pair<AllocationCategory, uint32_t>;     // The category and memory type index of a pool.
+  using pools_container_t = std::map<key_type, VmaPool>;
+  using pools_t = aithreadsafe::Wrapper<pools_container_t, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  Allocator const* m_allocator;
+  mutable pools_t m_pools;
+
+ public:
+  BufferPools(Allocator const* allocator) : m_allocator(allocator) { }
+  // Must be destroyed before the allocator, after all buffers that were allocated from the pools were destroyed.
+  ~BufferPools();
+
+  // Return the pool that a buffer with these create infos should be allocated from, or VK_NULL_HANDLE for the default pools.
+  // This function is thread-safe.
+  VmaPool pool_for(vk::BufferCreateInfo const& buffer_create_info, VmaAllocationCreateInfo const& vma_allocation_create_info,
+      AllocationCategory category) const;
+
+  // Return all pools that were created so far.
+  std::vector<VmaPool> pools() const;
+
+  // Return the sum of the statistics of all pools of category.
+  VmaDetailedStatistics statistics(AllocationCategory category) const;
+};
+
+} // namespace vulkan::memory
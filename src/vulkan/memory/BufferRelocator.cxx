@@ -0,0 +1,95 @@
+#include "sys.h"
+#include "BufferRelocator.h"
+#include "LogicalDevice.h"
+#include <array>
+
+namespace vulkan::memory {
+
+BufferRelocator::BufferRelocator(task::SynchronousWindow const* owning_window, Buffer* buffer, vk::BufferUsageFlags usage, std::function<void(vk::Buffer)> rebind) :
+  Relocatable(owning_window), m_buffer(buffer), m_usage(usage), m_rebind(std::move(rebind))
+{
+  DoutEntering(dc::vulkan, "BufferRelocator::BufferRelocator(" << owning_window << ", " << buffer << ", " << usage << ", ...) [" << this << "]");
+  // The contents are moved with vkCmdCopyBuffer.
+  ASSERT((usage & (vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst)) ==
+      (vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst));
+  m_buffer->m_logical_device->residency_manager().set_relocatable(m_buffer->m_vh_allocation, this);
+}
+
+BufferRelocator::~BufferRelocator()
+{
+  // Don't destroy a BufferRelocator while it is being relocated.
+  ASSERT(!m_vh_new_buffer && !m_vh_old_buffer);
+  m_buffer->m_logical_device->residency_manager().set_relocatable(m_buffer->m_vh_allocation, nullptr);
+}
+
+bool BufferRelocator::create_relocated(VmaAllocation vh_allocation, VmaAllocation vh_dst_allocation)
+{
+  DoutEntering(dc::vulkan, "BufferRelocator::create_relocated(" << vh_allocation << ", " << vh_dst_allocation << ") [" << this << "]");
+  ASSERT(vh_allocation == m_buffer->m_vh_allocation);
+  vk::BufferCreateInfo const buffer_create_info{
+    .size = m_buffer->m_size,
+    .usage = m_usage,
+    .sharingMode = vk::SharingMode::eExclusive
+  };
+  m_vh_new_buffer = m_buffer->m_logical_device->create_aliasing_buffer({}, vh_dst_allocation, buffer_create_info);
+  return true;
+}
+
+void BufferRelocator::switch_to_relocated()
+{
+  DoutEntering(dc::vulkan, "BufferRelocator::switch_to_relocated() [" << this << "]");
+  if (m_rebind)
+    m_rebind(m_vh_new_buffer);
+  m_vh_old_buffer = m_buffer->m_vh_buffer;
+  m_buffer->m_vh_buffer = m_vh_new_buffer;
+  m_vh_new_buffer = VK_NULL_HANDLE;
+}
+
+void BufferRelocator::record_relocation(vk::CommandBuffer vh_command_buffer)
+{
+  // Wait for previous frames that wrote to the old buffer; the new memory might have been used by a resource that was destroyed.
+  std::array<vk::BufferMemoryBarrier, 2> const pre_copy_barriers{{
+    {
+      .srcAccessMask = vk::AccessFlagBits::eMemoryWrite,
+      .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = m_vh_old_buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+    },
+    {
+      .srcAccessMask = vk::AccessFlags(0),
+      .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = m_buffer->m_vh_buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+    }
+  }};
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0),
+      {}, pre_copy_barriers, {});
+  vh_command_buffer.copyBuffer(m_vh_old_buffer, m_buffer->m_vh_buffer, { vk::BufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = m_buffer->m_size } });
+  // Make the copy available to the commands of the frame.
+  vk::BufferMemoryBarrier const post_copy_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = m_buffer->m_vh_buffer,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE
+  };
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(0),
+      {}, { post_copy_barrier }, {});
+}
+
+void BufferRelocator::destroy_old()
+{
+  DoutEntering(dc::vulkan, "BufferRelocator::destroy_old() [" << this << "]");
+  m_buffer->m_logical_device->destroy_buffer_keep_allocation({}, m_vh_old_buffer);
+  m_vh_old_buffer = VK_NULL_HANDLE;
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Buffer.h"
+#include "ResidencyManager.h"
+#include <functional>
+
+namespace vulkan::memory {
+
+// A Relocatable for a memory::Buffer, allowing task::Defragment to move it.
+//
+// The buffer must have been created with (at least) eTransferSrc and eTransferDst usage.
+// Construct the BufferRelocator after the contents of the buffer were uploaded, and destroy it before the buffer is destroyed or moved
+// (and not while a Defragment task of owning_window is running).
+// If anything refers to the buffer handle (other than the command buffers recorded by owning_window, which are recorded
+// every frame) then pass a rebind function that updates it with the new buffer handle. Note that a descriptor set that
+// is in use by a frame in flight may not be updated; use a new descriptor set instead.
+//
+class BufferRelocator final : public Relocatable
+{
+ private:
+  Buffer* m_buffer;                                     // The buffer that can be moved.
+  vk::BufferUsageFlags m_usage;                         // The usage flags that m_buffer was created with.
+  std::function<void(vk::Buffer)> m_rebind;             // Called with the new buffer handle, from switch_to_relocated.
+  vk::Buffer m_vh_new_buffer;                           // The buffer that is bound to the destination allocation, until switch_to_relocated.
+  vk::Buffer m_vh_old_buffer;                           // The buffer that is bound to the source allocation, after switch_to_relocated.
+
+ public:
+  BufferRelocator(task::SynchronousWindow const* owning_window, Buffer* buffer, vk::BufferUsageFlags usage, std::function<void(vk::Buffer)> rebind = {});
+  ~BufferRelocator();
+
+  bool create_relocated(VmaAllocation vh_allocation, VmaAllocation vh_dst_allocation) override;
+  void switch_to_relocated() override;
+  void record_relocation(vk::CommandBuffer vh_command_buffer) override;
+  void destroy_old() override;
+};
+
+} // namespace vulkan::memory
@@ -0,0 +1,106 @@
+#include "sys.h"
+#include "BufferSlice.h"
+#include "LogicalDevice.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+
+namespace vulkan::memory {
+
+void BufferSlice::release()
+{
+  if (m_owner)
+    m_owner->free({}, m_vh_virtual_allocation);
+  m_owner = nullptr;
+}
+
+void BufferSlice::flush() const
+{
+  m_owner->flush({}, m_offset, m_size);
+}
+
+#ifdef CWDEBUG
+void BufferSlice::print_on(std::ostream& os) const
+{
+  os << "{owner:" << m_owner <<
+      ", offset:" << m_offset <<
+      ", size:" << m_size << '}';
+}
+#endif
+
+SlicedBuffer::SlicedBuffer(LogicalDevice const* logical_device, vk::DeviceSize size, Buffer::MemoryCreateInfo memory_create_info, vk::DeviceSize alignment
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) : m_alignment(alignment)
+{
+  DoutEntering(dc::vulkan, "SlicedBuffer::SlicedBuffer(" << logical_device << ", " << size << ", ..., " << alignment << ") [" << this << "]");
+  // The alignment must be a power of two.
+  ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  if (memory_create_info.usage & vk::BufferUsageFlagBits::eUniformBuffer)
+    m_alignment = std::max(m_alignment, logical_device->min_uniform_buffer_offset_alignment());
+
+  // We need the allocation info to find out if the buffer is persistently mapped.
+  VmaAllocationInfo allocation_info;
+  if (!memory_create_info.allocation_info_out)
+    memory_create_info.allocation_info_out = &allocation_info;
+  m_buffer = Buffer(logical_device, size, memory_create_info COMMA_CWDEBUG_ONLY(ambifix(".m_buffer")));
+  m_vh_buffer = m_buffer.m_vh_buffer;
+  m_capacity = m_buffer.m_size;
+  if ((memory_create_info.vma_allocation_create_flags & VMA_ALLOCATION_CREATE_MAPPED_BIT))
+    m_pointer = memory_create_info.allocation_info_out->pMappedData;
+
+  create_virtual_block();
+}
+
+SlicedBuffer::SlicedBuffer(vk::Buffer vh_buffer, vk::DeviceSize size, vk::DeviceSize alignment, void* pointer) :
+  m_vh_buffer(vh_buffer), m_capacity(size), m_pointer(pointer), m_alignment(alignment)
+{
+  DoutEntering(dc::vulkan, "SlicedBuffer::SlicedBuffer(" << vh_buffer << ", " << size << ", " << alignment << ", " << pointer << ") [" << this << "]");
+  // The alignment must be a power of two.
+  ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  create_virtual_block();
+}
+
+void SlicedBuffer::create_virtual_block()
+{
+  VmaVirtualBlockCreateInfo virtual_block_create_info{
+    .size = m_capacity
+  };
+  virtual_block_t::wat virtual_block_w(m_virtual_block);
+  vk::Result res = static_cast<vk::Result>(vmaCreateVirtualBlock(&virtual_block_create_info, &*virtual_block_w));
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaCreateVirtualBlock");
+}
+
+SlicedBuffer::~SlicedBuffer()
+{
+  DoutEntering(dc::vulkan, "SlicedBuffer::~SlicedBuffer() [" << this << "]");
+  virtual_block_t::wat virtual_block_w(m_virtual_block);
+  // All slices must be destroyed before the SlicedBuffer.
+  ASSERT(vmaIsVirtualBlockEmpty(*virtual_block_w));
+  vmaDestroyVirtualBlock(*virtual_block_w);
+}
+
+BufferSlice SlicedBuffer::allocate(vk::DeviceSize size)
+{
+  VmaVirtualAllocationCreateInfo virtual_allocation_create_info{
+    .size = size,
+    .alignment = m_alignment
+  };
+  VmaVirtualAllocation vh_virtual_allocation;
+  vk::DeviceSize offset;
+  VkResult res;
+  {
+    virtual_block_t::wat virtual_block_w(m_virtual_block);
+    res = vmaVirtualAllocate(*virtual_block_w, &virtual_allocation_create_info, &vh_virtual_allocation, &offset);
+  }
+  if (AI_UNLIKELY(res != VK_SUCCESS))
+    THROW_ALERT("SlicedBuffer of [CAPACITY] bytes has no free range of [SIZE] bytes",
+        AIArgs("[CAPACITY]", m_capacity)("[SIZE]", size));
+  return { {}, this, vh_virtual_allocation, offset, size };
+}
+
+void SlicedBuffer::free(utils::Badge<BufferSlice>, VmaVirtualAllocation vh_virtual_allocation)
+{
+  virtual_block_t::wat virtual_block_w(m_virtual_block);
+  vmaVirtualFree(*virtual_block_w, vh_virtual_allocation);
+}
+
+} // namespace vulkan::memory
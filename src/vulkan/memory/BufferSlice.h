@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Buffer.h"
+#include "threadsafe/aithreadsafe.h"
+#include "utils/Badge.h"
+#include <mutex>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+class SlicedBuffer;
+
+// A range of a SlicedBuffer, for example the vertices of one object or a per-object uniform block.
+//
+// Many BufferSlice's share the same VkBuffer; bind them with their offset(), or use descriptor_buffer_info().
+// The range is given back to the SlicedBuffer when the BufferSlice is destroyed.
+class BufferSlice
+{
+ private:
+  SlicedBuffer* m_owner{};                              // The SlicedBuffer that this slice was allocated from, or nullptr if this slice is empty.
+  VmaVirtualAllocation m_vh_virtual_allocation{};       // The range in m_owner's virtual block.
+  vk::DeviceSize m_offset{};                            // The offset of this slice into m_owner->vh_buffer().
+  vk::DeviceSize m_size{};                              // The size of this slice in bytes.
+
+ public:
+  BufferSlice() = default;
+  BufferSlice(utils::Badge<SlicedBuffer>, SlicedBuffer* owner, VmaVirtualAllocation vh_virtual_allocation, vk::DeviceSize offset, vk::DeviceSize size) :
+    m_owner(owner), m_vh_virtual_allocation(vh_virtual_allocation), m_offset(offset), m_size(size) { }
+
+  // Move-only.
+  BufferSlice(BufferSlice&& rhs) : m_owner(rhs.m_owner), m_vh_virtual_allocation(rhs.m_vh_virtual_allocation), m_offset(rhs.m_offset), m_size(rhs.m_size)
+  {
+    rhs.m_owner = nullptr;
+  }
+
+  BufferSlice& operator=(BufferSlice&& rhs)
+  {
+    release();
+    m_owner = rhs.m_owner;
+    m_vh_virtual_allocation = rhs.m_vh_virtual_allocation;
+    m_offset = rhs.m_offset;
+    m_size = rhs.m_size;
+    rhs.m_owner = nullptr;
+    return *this;
+  }
+
+  ~BufferSlice() { release(); }
+
+  // Accessors.
+  inline vk::Buffer vh_buffer() const;
+  vk::DeviceSize offset() const { return m_offset; }
+  vk::DeviceSize size() const { return m_size; }
+  // Returns a pointer to the start of this slice if the SlicedBuffer is persistently mapped, otherwise nullptr.
+  inline void* pointer() const;
+  explicit operator bool() const { return m_owner; }
+
+  vk::DescriptorBufferInfo descriptor_buffer_info() const { return { .buffer = vh_buffer(), .offset = m_offset, .range = m_size }; }
+
+  // Make the data written to pointer() available to the device (a no-op for host coherent memory).
+  void flush() const;
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+
+ private:
+  void release();
+};
+
+// A single buffer that many small objects share through BufferSlice's.
+//
+// Creating a separate Buffer for every small object costs a VkBuffer (and VMA allocation) per object.
+// A SlicedBuffer creates one Buffer and sub-allocates ranges of it with a VMA virtual block.
+//
+// All slices must be destroyed before the SlicedBuffer is destroyed.
+//
+// Usage:
+//
+//   vulkan::memory::SlicedBuffer m_vertex_buffers(logical_device, 4 * 1024 * 1024,
+//       { .usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst }, 16
+//       COMMA_CWDEBUG_ONLY(debug_name_prefix("m_vertex_buffers")));
+//
+//   vulkan::memory::BufferSlice m_vertices = m_vertex_buffers.allocate(vertex_count * sizeof(Vertex));
+//   // Upload to m_vertices.vh_buffer() at m_vertices.offset(), and
+//   command_buffer.bindVertexBuffers(0, { m_vertices.vh_buffer() }, { m_vertices.offset() });
+//
+class SlicedBuffer
+{
+ private:
+  using virtual_block_t = aithreadsafe::Wrapper<VmaVirtualBlock, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  Buffer m_buffer;                                      // The underlying buffer, if owned by this SlicedBuffer.
+  vk::Buffer m_vh_buffer;                               // The buffer that is sliced (m_buffer.m_vh_buffer, or a buffer owned by the user).
+  vk::DeviceSize m_capacity;                            // The size of m_vh_buffer in bytes.
+  void* m_pointer{};                                    // Non-null if m_vh_buffer is persistently mapped (VMA_ALLOCATION_CREATE_MAPPED_BIT).
+  vk::DeviceSize m_alignment;                           // The alignment of the offset of every slice.
+  mutable virtual_block_t m_virtual_block;              // Keeps track of which ranges of m_buffer are in use.
+
+ public:
+  // Every slice will start at a multiple of alignment, which must be a power of two.
+  // If usage contains eUniformBuffer then the alignment is increased to at least minUniformBufferOffsetAlignment.
+  SlicedBuffer(LogicalDevice const* logical_device, vk::DeviceSize size, Buffer::MemoryCreateInfo memory_create_info, vk::DeviceSize alignment
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+  // Slice vh_buffer of size bytes, which is owned by the user and must outlive this SlicedBuffer.
+  // Pass its mapped address as pointer if it is persistently mapped. The slices of such a SlicedBuffer can not be flushed.
+  SlicedBuffer(vk::Buffer vh_buffer, vk::DeviceSize size, vk::DeviceSize alignment, void* pointer = nullptr);
+  ~SlicedBuffer();
+
+  // BufferSlice's point to this object.
+  SlicedBuffer(SlicedBuffer const&) = delete;
+  SlicedBuffer& operator=(SlicedBuffer const&) = delete;
+
+  // Allocate a slice of size bytes. Throws if there is no free range large enough.
+  // This function is thread-safe.
+  BufferSlice allocate(vk::DeviceSize size);
+
+  // Called by BufferSlice::release. This function is thread-safe.
+  void free(utils::Badge<BufferSlice>, VmaVirtualAllocation vh_virtual_allocation);
+
+  // Called by BufferSlice::flush.
+  void flush(utils::Badge<BufferSlice>, vk::DeviceSize offset, vk::DeviceSize size) const
+  {
+    // Only a SlicedBuffer that owns its buffer knows the allocation.
+    ASSERT(m_buffer.m_vh_buffer);
+    m_buffer.m_logical_device->flush_mapped_allocation(m_buffer.m_vh_allocation, offset, size);
+  }
+
+  // Accessors.
+  vk::Buffer vh_buffer() const { return m_vh_buffer; }
+  vk::DeviceSize capacity() const { return m_capacity; }
+  void* pointer() const { return m_pointer; }
+  vk::DeviceSize alignment() const { return m_alignment; }
+
+ private:
+  void create_virtual_block();
+};
+
+//inline
+vk::Buffer BufferSlice::vh_buffer() const
+{
+  return m_owner->vh_buffer();
+}
+
+//inline
+void* BufferSlice::pointer() const
+{
+  void* base = m_owner->pointer();
+  return base ? static_cast<unsigned char*>(base) + m_offset : nullptr;
+}
+
+} // namespace vulkan::memory
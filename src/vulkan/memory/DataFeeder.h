@@ -1,6 +1,8 @@
 #pragma once
 
+#include "statefultask/AIStatefulTask.h"
 #include <cstdint>
+#include "debug.h"
 
 namespace vulkan {
 
@@ -11,6 +13,7 @@ namespace vulkan {
 //
 // uint32_t size = df.chunk_size();
 // int chunk_count = df.chunk_count();
+// df.set_max_batch_size(max_chunks);                   // Optional.
 // int next_batch;
 // for (int chunks = 0; chunks < chunk_count; chunks += next_batch)
 // {
@@ -20,6 +23,17 @@ namespace vulkan {
 //   df.get_chunks(ptr);
 // }
 //
+// Alternatively, if is_range_addressable() returns true, then any range
+// of chunks can be requested with fill_chunks, possibly concurrently from
+// different threads (for disjoint ranges). For example,
+//
+// df.fill_chunks(ptr + begin * size, begin, end);      // Write chunks [begin, end>.
+//
+// Feeders whose data is produced asynchronously (for example, an image that is
+// still being decoded) override is_ready; the consumer must not call next_batch,
+// get_chunks or fill_chunks before is_ready returned true. chunk_size and
+// chunk_count must be known immediately however.
+//
 class DataFeeder
 {
  public:
@@ -31,6 +45,17 @@ class DataFeeder
   // The total number of chunks.
   virtual int chunk_count() const = 0;
 
+  // Return true if the data can be read. Otherwise return false and signal task with condition once it can.
+  virtual bool is_ready(AIStatefulTask* UNUSED_ARG(task), AIStatefulTask::condition_type UNUSED_ARG(condition)) { return true; }
+
+  // Called when task is finished (or aborted) so that it won't be signaled anymore.
+  virtual void remove_waiter(AIStatefulTask* UNUSED_ARG(task)) { }
+
+  // Called by the consumer, before the first call to next_batch(), with the maximum number of chunks
+  // that it can accept in a single batch. Feeders that can produce more than one chunk per call to
+  // get_chunks should return as many chunks as possible, up to this value, from next_batch().
+  virtual void set_max_batch_size(int UNUSED_ARG(max_chunks)) { }
+
   // The value returned is the number of chunks that will be initialized by the next call to get_chunks.
   // Once the sum of all returned values reaches chunk_count(), no more calls to next_batch or get_chunks
   // must be made.
@@ -38,6 +63,13 @@ class DataFeeder
 
   // Fills in N chunks, where N is the value that was returned by the last call to next_batch().
   virtual void get_chunks(unsigned char* chunk_ptr) = 0;
+
+  // Return true if fill_chunks is implemented and thread-safe.
+  virtual bool is_range_addressable() const { return false; }
+
+  // Fill in chunks [begin, end>, where chunk_ptr points to where chunk `begin` must be written.
+  // Only called when is_range_addressable() returns true.
+  virtual void fill_chunks(unsigned char* UNUSED_ARG(chunk_ptr), int UNUSED_ARG(begin), int UNUSED_ARG(end)) { ASSERT(false); }
 };
 
 } // namespace vulkan
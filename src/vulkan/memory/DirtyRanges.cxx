@@ -0,0 +1,38 @@
+#include "sys.h"
+#include "DirtyRanges.h"
+#include <algorithm>
+
+namespace vulkan {
+
+void DirtyRanges::add(vk::DeviceSize offset, vk::DeviceSize size)
+{
+  if (size == 0)
+    return;
+  vk::DeviceSize end = offset + size;
+  // Find the first range that ends at or after offset - m_merge_gap; that is the first range that must be merged (if any).
+  auto first = std::lower_bound(m_ranges.begin(), m_ranges.end(), offset,
+      [this](Range const& range, vk::DeviceSize offset){ return range.end() + m_merge_gap < offset; });
+  // Find the first range that starts after end + m_merge_gap; that is one past the last range that must be merged.
+  auto last = std::upper_bound(first, m_ranges.end(), end,
+      [this](vk::DeviceSize end, Range const& range){ return end + m_merge_gap < range.m_offset; });
+  if (first == last)
+  {
+    // Nothing to merge with.
+    m_ranges.insert(first, { offset, size });
+    return;
+  }
+  offset = std::min(offset, first->m_offset);
+  end = std::max(end, std::prev(last)->end());
+  *first = { offset, end - offset };
+  m_ranges.erase(std::next(first), last);
+}
+
+vk::DeviceSize DirtyRanges::total_size() const
+{
+  vk::DeviceSize total_size = 0;
+  for (Range const& range : m_ranges)
+    total_size += range.m_size;
+  return total_size;
+}
+
+} // namespace vulkan
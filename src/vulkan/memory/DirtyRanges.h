@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include "debug.h"
+
+namespace vulkan {
+
+// Keeps track of which parts of a buffer were changed since the last upload.
+//
+// Added ranges are kept sorted and coalesced: overlapping and adjacent ranges, and ranges
+// that are separated by at most merge_gap bytes, are merged into a single range. Uploading
+// a few unchanged bytes in between is usually cheaper than an extra BufferCopy region.
+//
+// Usage:
+//
+//   vulkan::DirtyRanges dirty_ranges(256);
+//   dirty_ranges.add(instance_index * sizeof(InstanceData), sizeof(InstanceData));    // For every changed instance.
+//   ...
+//   if (!dirty_ranges.empty())
+//   {
+//     auto ranges = dirty_ranges.take();
+//     // Create a CopyDataToBufferRegions task for ranges, with a GatherFeeder that reads them from the CPU copy of the buffer.
+//   }
+//
+class DirtyRanges
+{
+ public:
+  struct Range
+  {
+    vk::DeviceSize m_offset;
+    vk::DeviceSize m_size;
+
+    vk::DeviceSize end() const { return m_offset + m_size; }
+  };
+
+ private:
+  std::vector<Range> m_ranges;          // Sorted and disjoint; the gap between two consecutive ranges is larger than m_merge_gap.
+  vk::DeviceSize m_merge_gap;           // Merge ranges that are separated by this many bytes or less.
+
+ public:
+  DirtyRanges(vk::DeviceSize merge_gap = 0) : m_merge_gap(merge_gap) { }
+
+  // Mark [offset, offset + size> as dirty.
+  void add(vk::DeviceSize offset, vk::DeviceSize size);
+
+  // Return the sum of the sizes of all ranges.
+  vk::DeviceSize total_size() const;
+
+  // Return the current ranges and start over.
+  std::vector<Range> take()
+  {
+    std::vector<Range> ranges;
+    ranges.swap(m_ranges);
+    return ranges;
+  }
+
+  // Accessors.
+  std::vector<Range> const& ranges() const { return m_ranges; }
+  bool empty() const { return m_ranges.empty(); }
+  void clear() { m_ranges.clear(); }
+};
+
+} // namespace vulkan
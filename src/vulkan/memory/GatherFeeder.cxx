@@ -0,0 +1,56 @@
+#include "sys.h"
+#include "GatherFeeder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace vulkan {
+
+GatherFeeder::GatherFeeder(void const* source, std::vector<DirtyRanges::Range> ranges, uint32_t chunk_size) :
+  m_source(static_cast<std::byte const*>(source)), m_ranges(std::move(ranges)), m_chunk_size(chunk_size)
+{
+  DoutEntering(dc::vulkan, "GatherFeeder::GatherFeeder(" << source << ", <" << m_ranges.size() << " ranges>, " << chunk_size << ") [" << this << "]");
+  m_packed_offsets.reserve(m_ranges.size());
+  vk::DeviceSize packed_size = 0;
+  for (DirtyRanges::Range const& range : m_ranges)
+  {
+    // Ranges must be non-empty and consist of whole chunks.
+    ASSERT(range.m_size > 0 && range.m_offset % chunk_size == 0 && range.m_size % chunk_size == 0);
+    m_packed_offsets.push_back(packed_size);
+    packed_size += range.m_size;
+  }
+  // chunk_count() must fit in an int.
+  ASSERT(packed_size / chunk_size <= static_cast<vk::DeviceSize>(std::numeric_limits<int>::max()));
+  m_chunk_count = static_cast<int>(packed_size / chunk_size);
+}
+
+int GatherFeeder::next_batch()
+{
+  m_batch_size = std::min(m_max_batch_size, m_chunk_count - m_next_chunk);
+  return m_batch_size;
+}
+
+void GatherFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  fill_chunks(chunk_ptr, m_next_chunk, m_next_chunk + m_batch_size);
+  m_next_chunk += m_batch_size;
+}
+
+void GatherFeeder::fill_chunks(unsigned char* chunk_ptr, int begin, int end)
+{
+  vk::DeviceSize packed_begin = static_cast<vk::DeviceSize>(begin) * m_chunk_size;
+  vk::DeviceSize const packed_end = static_cast<vk::DeviceSize>(end) * m_chunk_size;
+  // Find the range that contains packed_begin.
+  size_t index = std::upper_bound(m_packed_offsets.begin(), m_packed_offsets.end(), packed_begin) - m_packed_offsets.begin() - 1;
+  while (packed_begin < packed_end)
+  {
+    DirtyRanges::Range const& range = m_ranges[index];
+    vk::DeviceSize const skip = packed_begin - m_packed_offsets[index];
+    vk::DeviceSize const size = std::min(range.m_size - skip, packed_end - packed_begin);
+    std::memcpy(chunk_ptr, m_source + range.m_offset + skip, size);
+    chunk_ptr += size;
+    packed_begin += size;
+    ++index;
+  }
+}
+
+} // namespace vulkan
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "DataFeeder.h"
+#include "DirtyRanges.h"
+#include <vector>
+#include <limits>
+#include <cstddef>
+
+namespace vulkan {
+
+// A DataFeeder that packs a list of ranges of a host copy of a buffer contiguously, as expected by CopyDataToBufferRegions.
+//
+// The source memory must stay valid (and the ranges unchanged) until the upload finished.
+// The offset and size of every range must be a multiple of chunk_size.
+class GatherFeeder final : public DataFeeder
+{
+ private:
+  std::byte const* m_source;                    // The host copy of the buffer.
+  std::vector<DirtyRanges::Range> m_ranges;     // The ranges to copy, relative to m_source.
+  std::vector<vk::DeviceSize> m_packed_offsets; // The offset of each range in the packed data.
+  uint32_t m_chunk_size;
+  int m_chunk_count;
+  int m_max_batch_size{std::numeric_limits<int>::max()};
+  int m_next_chunk{};                           // The first chunk of the next batch.
+  int m_batch_size{};                           // The number of chunks of the current batch.
+
+ public:
+  GatherFeeder(void const* source, std::vector<DirtyRanges::Range> ranges, uint32_t chunk_size = 1);
+
+  uint32_t chunk_size() const override { return m_chunk_size; }
+  int chunk_count() const override { return m_chunk_count; }
+  void set_max_batch_size(int max_chunks) override { m_max_batch_size = max_chunks; }
+  int next_batch() override;
+  void get_chunks(unsigned char* chunk_ptr) override;
+  bool is_range_addressable() const override { return true; }
+  void fill_chunks(unsigned char* chunk_ptr, int begin, int end) override;
+};
+
+} // namespace vulkan
@@ -1,5 +1,6 @@
 #include "sys.h"
 #include "Image.h"
+#include "AliasedMemory.h"
 #include "ImageKind.h"
 #include "LogicalDevice.h"
 
@@ -10,6 +11,15 @@ Image::Image(
     vk::Extent2D extent,
     ImageViewKind const& image_view_kind,
     MemoryCreateInfo memory_create_info
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+  Image(logical_device, image_view_kind.image_kind()(extent), memory_create_info COMMA_CWDEBUG_ONLY(ambifix))
+{
+}
+
+Image::Image(
+    LogicalDevice const* logical_device,
+    vk::ImageCreateInfo const& image_create_info,
+    MemoryCreateInfo memory_create_info
     COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) : m_logical_device(logical_device)
 {
   VmaAllocationCreateInfo vma_allocation_create_info{
@@ -17,7 +27,8 @@ Image::Image(
     .usage = memory_create_info.vma_memory_usage
   };
 
-  m_vh_image = logical_device->create_image({}, image_view_kind.image_kind()(extent), vma_allocation_create_info, &m_vh_allocation, memory_create_info.allocation_info_out
+  m_vh_image = logical_device->create_image({}, image_create_info, vma_allocation_create_info, &m_vh_allocation, memory_create_info.allocation_info_out,
+      memory_create_info.category == AllocationCategory::automatic ? deduce_category(image_create_info.usage) : memory_create_info.category
       COMMA_CWDEBUG_ONLY(ambifix(".m_vh_allocation")));
   DebugSetName(m_vh_image, ".m_vh_image" + ambifix, logical_device);
 
@@ -29,6 +40,18 @@ Image::Image(
 #endif
 }
 
+Image::Image(
+    LogicalDevice const* logical_device,
+    vk::ImageCreateInfo const& image_create_info,
+    AliasedMemory const& aliased_memory
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) : m_logical_device(logical_device)
+{
+  m_vh_image = logical_device->create_aliasing_image({}, aliased_memory.vh_allocation(), image_create_info);
+  DebugSetName(m_vh_image, ".m_vh_image" + ambifix, logical_device);
+  // The aliased memory must be large enough for this image (see SynchronousWindow::on_window_size_changed_post).
+  ASSERT(logical_device->get_image_memory_requirements(m_vh_image).size <= aliased_memory.size());
+}
+
 #ifdef CWDEBUG
 void Image::print_on(std::ostream& os) const
 {
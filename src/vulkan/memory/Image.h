@@ -2,12 +2,14 @@
 #define VULKAN_MEMORY_IMAGE_H
 
 #include "Allocator.h"
+#include "AllocationCategory.h"
 
 namespace vulkan {
 class LogicalDevice;
 class ImageViewKind;
 
 namespace memory {
+class AliasedMemory;
 
 struct ImageMemoryCreateInfoDefaults
 {
@@ -15,6 +17,7 @@ struct ImageMemoryCreateInfoDefaults
   VmaAllocationCreateFlags    vma_allocation_create_flags{};
   VmaMemoryUsage              vma_memory_usage{VMA_MEMORY_USAGE_AUTO};
   VmaAllocationInfo*          allocation_info_out{};
+  AllocationCategory          category{AllocationCategory::automatic};
 };
 
 // Vulkan Image's parameters container class.
@@ -23,6 +26,7 @@ struct Image
   LogicalDevice const* m_logical_device{};              // The associated logical device; only valid when m_vh_image is non-null.
   vk::Image m_vh_image;                                 // Vulkan handle to the underlying image, or VK_NULL_HANDLE when no image is represented.
   VmaAllocation m_vh_allocation{};                      // The memory allocation used for the image; only valid when m_vh_image is non-null.
+                                                        // Null if the image is bound to an AliasedMemory (which then owns the memory).
 
   using MemoryCreateInfo = ImageMemoryCreateInfoDefaults;
 
@@ -35,6 +39,19 @@ struct Image
     MemoryCreateInfo memory_create_info
     COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
 
+  Image(
+    LogicalDevice const* logical_device,
+    vk::ImageCreateInfo const& image_create_info,
+    MemoryCreateInfo memory_create_info
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Create an image that is bound to the start of aliased_memory, which must outlive the image.
+  Image(
+    LogicalDevice const* logical_device,
+    vk::ImageCreateInfo const& image_create_info,
+    AliasedMemory const& aliased_memory
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
   Image(Image&& rhs) : m_logical_device(rhs.m_logical_device), m_vh_image(rhs.m_vh_image), m_vh_allocation(rhs.m_vh_allocation)
   {
     rhs.m_vh_image = VK_NULL_HANDLE;
@@ -62,7 +79,8 @@ struct Image
   [[gnu::always_inline]] inline void* map_memory();
   [[gnu::always_inline]] inline void unmap_memory();
 
- private:
+ protected:
+  // Destroy the image and free its memory (if any).
   inline void destroy();
 };
 
@@ -0,0 +1,131 @@
+#include "sys.h"
+#include "ImageRelocator.h"
+#include "LogicalDevice.h"
+#include <array>
+#include <vector>
+#include <algorithm>
+
+namespace vulkan::memory {
+
+ImageRelocator::ImageRelocator(task::SynchronousWindow const* owning_window, Image* image, vk::ImageCreateInfo const& image_create_info, vk::ImageLayout layout,
+    std::function<void(vk::Image)> rebind, std::function<void()> release_old) :
+  Relocatable(owning_window), m_image(image), m_image_create_info(image_create_info), m_layout(layout),
+  m_rebind(std::move(rebind)), m_release_old(std::move(release_old))
+{
+  DoutEntering(dc::vulkan, "ImageRelocator::ImageRelocator(" << owning_window << ", " << image << ", " << image_create_info << ", " << layout << ", ...) [" << this << "]");
+  // The contents are moved with vkCmdCopyImage.
+  ASSERT((image_create_info.usage & (vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst)) ==
+      (vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst));
+  // Only images that own their allocation can be moved (not the ones that are bound to an AliasedMemory).
+  ASSERT(m_image->m_vh_allocation);
+  ASSERT(m_rebind && m_release_old);
+  m_image->m_logical_device->residency_manager().set_relocatable(m_image->m_vh_allocation, this);
+}
+
+ImageRelocator::~ImageRelocator()
+{
+  // Don't destroy an ImageRelocator while it is being relocated.
+  ASSERT(!m_vh_new_image && !m_vh_old_image);
+  m_image->m_logical_device->residency_manager().set_relocatable(m_image->m_vh_allocation, nullptr);
+}
+
+bool ImageRelocator::create_relocated(VmaAllocation vh_allocation, VmaAllocation vh_dst_allocation)
+{
+  DoutEntering(dc::vulkan, "ImageRelocator::create_relocated(" << vh_allocation << ", " << vh_dst_allocation << ") [" << this << "]");
+  ASSERT(vh_allocation == m_image->m_vh_allocation);
+  vk::ImageCreateInfo image_create_info = m_image_create_info;
+  image_create_info.initialLayout = vk::ImageLayout::eUndefined;
+  m_vh_new_image = m_image->m_logical_device->create_aliasing_image({}, vh_dst_allocation, image_create_info);
+  return true;
+}
+
+void ImageRelocator::switch_to_relocated()
+{
+  DoutEntering(dc::vulkan, "ImageRelocator::switch_to_relocated() [" << this << "]");
+  m_rebind(m_vh_new_image);
+  m_vh_old_image = m_image->m_vh_image;
+  m_image->m_vh_image = m_vh_new_image;
+  m_vh_new_image = VK_NULL_HANDLE;
+}
+
+void ImageRelocator::record_relocation(vk::CommandBuffer vh_command_buffer)
+{
+  vk::ImageSubresourceRange const subresource_range{
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .baseMipLevel = 0,
+    .levelCount = m_image_create_info.mipLevels,
+    .baseArrayLayer = 0,
+    .layerCount = m_image_create_info.arrayLayers
+  };
+  // Wait for previous frames that used the old image and transition both images for the copy.
+  std::array<vk::ImageMemoryBarrier, 2> const pre_copy_barriers{{
+    {
+      .srcAccessMask = vk::AccessFlagBits::eMemoryWrite,
+      .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+      .oldLayout = m_layout,
+      .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_vh_old_image,
+      .subresourceRange = subresource_range
+    },
+    {
+      .srcAccessMask = vk::AccessFlags(0),
+      .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .oldLayout = vk::ImageLayout::eUndefined,
+      .newLayout = vk::ImageLayout::eTransferDstOptimal,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_image->m_vh_image,
+      .subresourceRange = subresource_range
+    }
+  }};
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0),
+      {}, {}, pre_copy_barriers);
+
+  std::vector<vk::ImageCopy> regions;
+  regions.reserve(m_image_create_info.mipLevels);
+  for (uint32_t level = 0; level < m_image_create_info.mipLevels; ++level)
+  {
+    vk::ImageSubresourceLayers const subresource{
+      .aspectMask = vk::ImageAspectFlagBits::eColor,
+      .mipLevel = level,
+      .baseArrayLayer = 0,
+      .layerCount = m_image_create_info.arrayLayers
+    };
+    regions.push_back({
+      .srcSubresource = subresource,
+      .dstSubresource = subresource,
+      .extent = {
+        std::max(m_image_create_info.extent.width >> level, 1U),
+        std::max(m_image_create_info.extent.height >> level, 1U),
+        std::max(m_image_create_info.extent.depth >> level, 1U)
+      }
+    });
+  }
+  vh_command_buffer.copyImage(m_vh_old_image, vk::ImageLayout::eTransferSrcOptimal, m_image->m_vh_image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+  // Transition the new image to the layout that the frame expects.
+  vk::ImageMemoryBarrier const post_copy_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = m_layout,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = m_image->m_vh_image,
+    .subresourceRange = subresource_range
+  };
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(0),
+      {}, {}, { post_copy_barrier });
+}
+
+void ImageRelocator::destroy_old()
+{
+  DoutEntering(dc::vulkan, "ImageRelocator::destroy_old() [" << this << "]");
+  m_release_old();
+  m_image->m_logical_device->destroy_image_keep_allocation({}, m_vh_old_image);
+  m_vh_old_image = VK_NULL_HANDLE;
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Image.h"
+#include "ResidencyManager.h"
+#include <functional>
+
+namespace vulkan::memory {
+
+// A Relocatable for a (color) memory::Image, allowing task::Defragment to move it.
+//
+// The image must have been created with image_create_info, which must include eTransferSrc and eTransferDst usage,
+// and must be in layout between frames. All mip levels and array layers are copied.
+// Construct the ImageRelocator after the contents of the image were uploaded, and destroy it before the image is destroyed or moved
+// (and not while a Defragment task of owning_window is running).
+//
+// Image views can't be moved to a different image, so a rebind function is required: it must create new image
+// views for the new image and make everything that refers to the old views use the new views. The old views must be
+// kept alive until release_old is called (frames in flight might still be using them). Note that a descriptor
+// that is in use by a frame in flight may not be updated; for example, insert the new view into
+// LogicalDevice::bindless_textures() and erase the old slot instead of updating it.
+//
+class ImageRelocator final : public Relocatable
+{
+ private:
+  Image* m_image;                                       // The image that can be moved.
+  vk::ImageCreateInfo m_image_create_info;              // The create info that m_image was created with.
+  vk::ImageLayout m_layout;                             // The layout of m_image between frames.
+  std::function<void(vk::Image)> m_rebind;              // Called with the new image handle, from switch_to_relocated.
+  std::function<void()> m_release_old;                  // Called just before the old image is destroyed.
+  vk::Image m_vh_new_image;                             // The image that is bound to the destination allocation, until switch_to_relocated.
+  vk::Image m_vh_old_image;                             // The image that is bound to the source allocation, after switch_to_relocated.
+
+ public:
+  ImageRelocator(task::SynchronousWindow const* owning_window, Image* image, vk::ImageCreateInfo const& image_create_info, vk::ImageLayout layout,
+      std::function<void(vk::Image)> rebind, std::function<void()> release_old);
+  ~ImageRelocator();
+
+  bool create_relocated(VmaAllocation vh_allocation, VmaAllocation vh_dst_allocation) override;
+  void switch_to_relocated() override;
+  void record_relocation(vk::CommandBuffer vh_command_buffer) override;
+  void destroy_old() override;
+};
+
+} // namespace vulkan::memory
@@ -0,0 +1,108 @@
+#include "sys.h"
+#include "MappedFileFeeder.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <Tracy.hpp>
+
+namespace vulkan {
+
+MappedFileFeeder::MappedFileFeeder(std::filesystem::path const& filename, uint32_t chunk_size, size_t offset, size_t size) :
+  m_chunk_size(chunk_size), m_max_batch_size(std::numeric_limits<int>::max())
+{
+  DoutEntering(dc::vulkan, "MappedFileFeeder::MappedFileFeeder(" << filename << ", " << chunk_size << ", " << offset << ", " << size << ") [" << this << "]");
+  // A chunk size of zero makes no sense.
+  ASSERT(chunk_size > 0);
+
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    THROW_ALERTE("Could not open [FILENAME]", AIArgs("[FILENAME]", filename));
+
+  struct stat st;
+  if (::fstat(fd, &st) == -1)
+  {
+    ::close(fd);
+    THROW_ALERTE("fstat([FILENAME])", AIArgs("[FILENAME]", filename));
+  }
+  size_t const file_size = static_cast<size_t>(st.st_size);
+  if (size == 0 && offset <= file_size)
+    size = file_size - offset;
+  // Don't calculate offset + size: that could overflow.
+  if (offset > file_size || size > file_size - offset || size == 0 || size % chunk_size != 0 ||
+      size / chunk_size > static_cast<size_t>(std::numeric_limits<int>::max()))
+  {
+    ::close(fd);
+    THROW_ALERT("Can not feed [SIZE] bytes at offset [OFFSET] in chunks of [CHUNK_SIZE] from [FILENAME] (file size [FILE_SIZE])",
+        AIArgs("[SIZE]", size)("[OFFSET]", offset)("[CHUNK_SIZE]", chunk_size)("[FILENAME]", filename)("[FILE_SIZE]", file_size));
+  }
+  m_chunk_count = static_cast<int>(size / chunk_size);
+
+  // mmap requires the offset to be page aligned.
+  size_t const page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t const mapping_offset = offset / page_size * page_size;
+  m_mapping_size = offset + size - mapping_offset;
+  m_mapping = ::mmap(nullptr, m_mapping_size, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(mapping_offset));
+  // The mapping keeps its own reference to the file.
+  ::close(fd);
+  if (m_mapping == MAP_FAILED)
+    THROW_ALERTE("Could not map [FILENAME]", AIArgs("[FILENAME]", filename));
+  m_data = static_cast<std::byte const*>(m_mapping) + (offset - mapping_offset);
+
+  // The data is read once, front to back: start reading ahead now and allow the kernel to drop pages behind us.
+  advise(0, size, MADV_SEQUENTIAL);
+  advise(0, size, MADV_WILLNEED);
+}
+
+MappedFileFeeder::~MappedFileFeeder()
+{
+  ::munmap(m_mapping, m_mapping_size);
+}
+
+void MappedFileFeeder::advise(size_t begin, size_t end, int advice) const
+{
+  size_t const page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  std::byte const* const mapping = static_cast<std::byte const*>(m_mapping);
+  size_t const mapping_begin = static_cast<size_t>(m_data - mapping) + begin;
+  size_t const mapping_end = static_cast<size_t>(m_data - mapping) + end;
+  size_t const page_begin = mapping_begin / page_size * page_size;
+  if (mapping_end <= page_begin)
+    return;
+  if (::madvise(const_cast<std::byte*>(mapping) + page_begin, mapping_end - page_begin, advice) == -1)
+    Dout(dc::warning, "madvise(" << advice << "): " << std::strerror(errno));
+}
+
+int MappedFileFeeder::next_batch()
+{
+  m_batch_size = std::min(m_max_batch_size, m_chunk_count - m_next_chunk);
+  return m_batch_size;
+}
+
+void MappedFileFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  ZoneScopedN("MappedFileFeeder::get_chunks");
+  size_t const begin = static_cast<size_t>(m_next_chunk) * m_chunk_size;
+  size_t const size = static_cast<size_t>(m_batch_size) * m_chunk_size;
+  std::memcpy(chunk_ptr, m_data + begin, size);
+  m_next_chunk += m_batch_size;
+  // These pages won't be read again; for a read-only private mapping this only drops them from our address space (not from the page cache).
+  // Only whole pages are dropped, so the partial page at the end is kept for the next batch.
+  size_t const page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t const mapping_end = static_cast<size_t>(m_data - static_cast<std::byte const*>(m_mapping)) + begin + size;
+  size_t const dropped_end = mapping_end / page_size * page_size;
+  if (dropped_end > 0)
+    ::madvise(m_mapping, dropped_end, MADV_DONTNEED);
+}
+
+void MappedFileFeeder::fill_chunks(unsigned char* chunk_ptr, int begin, int end)
+{
+  ZoneScopedN("MappedFileFeeder::fill_chunks");
+  std::memcpy(chunk_ptr, m_data + static_cast<size_t>(begin) * m_chunk_size, static_cast<size_t>(end - begin) * m_chunk_size);
+}
+
+} // namespace vulkan
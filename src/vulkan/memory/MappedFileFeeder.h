@@ -0,0 +1,58 @@
+#pragma once
+
+#include "DataFeeder.h"
+#include <filesystem>
+#include <cstddef>
+#include <cstdint>
+#include "debug.h"
+
+namespace vulkan {
+
+// A DataFeeder that reads a range of a pre-baked binary file (raw vertex data, decoded or block compressed texels)
+// through a read-only memory mapping of that file.
+//
+// The data is copied directly from the page cache into the staging buffer, without intermediate allocation.
+// The mapped range is advised MADV_SEQUENTIAL and MADV_WILLNEED upon construction, so that the kernel starts
+// reading ahead immediately; pages that were handed out by get_chunks are dropped from the mapping again.
+//
+// Usage:
+//
+//   auto feeder = std::make_unique<vulkan::MappedFileFeeder>(path, sizeof(Vertex));
+//   auto copy_data_to_buffer = statefultask::create<task::CopyDataToBuffer>(logical_device, feeder->chunk_size() * feeder->chunk_count(), ...);
+//   copy_data_to_buffer->set_data_feeder(std::move(feeder));
+//
+class MappedFileFeeder final : public DataFeeder
+{
+ private:
+  void* m_mapping;                      // The start of the mapping (page aligned).
+  size_t m_mapping_size;                // The size of the mapping.
+  std::byte const* m_data;              // The start of the data (inside the mapping).
+  uint32_t m_chunk_size;                // The size of one chunk.
+  int m_chunk_count;                    // The number of chunks in the range.
+  int m_max_batch_size;                 // The maximum number of chunks to return per batch.
+  int m_next_chunk{};                   // The first chunk of the next batch.
+  int m_batch_size{};                   // The number of chunks of the current batch.
+
+ public:
+  // Map the range [offset, offset + size> of filename; size zero means: up till the end of the file.
+  // The size of the range must be a multiple of chunk_size. Throws if the file can't be mapped.
+  MappedFileFeeder(std::filesystem::path const& filename, uint32_t chunk_size, size_t offset = 0, size_t size = 0);
+  ~MappedFileFeeder() override;
+
+  MappedFileFeeder(MappedFileFeeder const&) = delete;
+  MappedFileFeeder& operator=(MappedFileFeeder const&) = delete;
+
+  uint32_t chunk_size() const override { return m_chunk_size; }
+  int chunk_count() const override { return m_chunk_count; }
+  void set_max_batch_size(int max_chunks) override { m_max_batch_size = max_chunks; }
+  int next_batch() override;
+  void get_chunks(unsigned char* chunk_ptr) override;
+  bool is_range_addressable() const override { return true; }
+  void fill_chunks(unsigned char* chunk_ptr, int begin, int end) override;
+
+ private:
+  // Call madvise(advice) on the pages that contain [begin, end>, relative to m_data.
+  void advise(size_t begin, size_t end, int advice) const;
+};
+
+} // namespace vulkan
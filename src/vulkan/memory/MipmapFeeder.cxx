@@ -0,0 +1,143 @@
+#include "sys.h"
+#include "MipmapFeeder.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <Tracy.hpp>
+
+namespace vulkan {
+
+namespace {
+
+// Average 2x2 blocks of components of two source rows into one destination row.
+// When src_step is zero the source is one texel wide and the same texel is used twice.
+//
+// The texel size is a template parameter for the common sizes, which allows the compiler
+// to turn the inner loops into SIMD code (strided loads and a packed average).
+template<uint32_t texel_size>
+void downsample_row(unsigned char const* __restrict__ row0, unsigned char const* __restrict__ row1,
+    unsigned char* __restrict__ dst, uint32_t dst_width, uint32_t src_step)
+{
+  for (uint32_t x = 0; x < dst_width; ++x)
+  {
+    unsigned char const* p0 = row0 + 2 * x * texel_size;
+    unsigned char const* p1 = row1 + 2 * x * texel_size;
+    for (uint32_t c = 0; c < texel_size; ++c)
+      dst[x * texel_size + c] = static_cast<unsigned char>((p0[c] + p0[c + src_step] + p1[c] + p1[c + src_step] + 2) >> 2);
+  }
+}
+
+void downsample_row(unsigned char const* row0, unsigned char const* row1,
+    unsigned char* dst, uint32_t dst_width, uint32_t src_step, uint32_t texel_size)
+{
+  for (uint32_t x = 0; x < dst_width; ++x)
+  {
+    unsigned char const* p0 = row0 + 2 * x * texel_size;
+    unsigned char const* p1 = row1 + 2 * x * texel_size;
+    for (uint32_t c = 0; c < texel_size; ++c)
+      dst[x * texel_size + c] = static_cast<unsigned char>((p0[c] + p0[c + src_step] + p1[c] + p1[c + src_step] + 2) >> 2);
+  }
+}
+
+} // namespace
+
+MipmapFeeder::MipmapFeeder(std::unique_ptr<DataFeeder> base_level_feeder, vk::Extent2D extent, uint32_t mip_levels, uint32_t texel_size) :
+  m_base_level_feeder(std::move(base_level_feeder)), m_extent(extent), m_mip_levels(mip_levels), m_texel_size(texel_size),
+  m_max_batch_size(std::numeric_limits<int>::max())
+{
+  DoutEntering(dc::vulkan, "MipmapFeeder::MipmapFeeder(" << m_base_level_feeder.get() << ", " << extent << ", " << mip_levels << ", " << texel_size << ") [" << this << "]");
+  // The base level feeder must produce exactly one level.
+  ASSERT(vk::DeviceSize{m_base_level_feeder->chunk_size()} * m_base_level_feeder->chunk_count() == mip_chain_size(extent, 1, texel_size));
+  // chunk_count() must fit in an int.
+  ASSERT(mip_chain_size(extent, mip_levels, 1) <= static_cast<vk::DeviceSize>(std::numeric_limits<int>::max()));
+}
+
+//static
+vk::DeviceSize MipmapFeeder::mip_chain_size(vk::Extent2D extent, uint32_t mip_levels, uint32_t texel_size)
+{
+  vk::DeviceSize size = 0;
+  for (uint32_t level = 0; level < mip_levels; ++level)
+    size += vk::DeviceSize{std::max(extent.width >> level, 1u)} * std::max(extent.height >> level, 1u) * texel_size;
+  return size;
+}
+
+//static
+void MipmapFeeder::downsample(unsigned char const* src, vk::Extent2D src_extent, unsigned char* dst, uint32_t texel_size)
+{
+  uint32_t const dst_width = std::max(src_extent.width / 2, 1u);
+  uint32_t const dst_height = std::max(src_extent.height / 2, 1u);
+  size_t const src_row_size = size_t{src_extent.width} * texel_size;
+  size_t const dst_row_size = size_t{dst_width} * texel_size;
+  // For odd extents the last row/column is dropped; for an extent of one, the single row/column is used twice.
+  uint32_t const src_step = src_extent.width > 1 ? texel_size : 0;
+  size_t const src_row_step = src_extent.height > 1 ? src_row_size : 0;
+  for (uint32_t y = 0; y < dst_height; ++y)
+  {
+    unsigned char const* row0 = src + 2 * y * src_row_step;
+    unsigned char const* row1 = row0 + src_row_step;
+    unsigned char* dst_row = dst + y * dst_row_size;
+    switch (texel_size)
+    {
+      case 1:
+        downsample_row<1>(row0, row1, dst_row, dst_width, src_step);
+        break;
+      case 2:
+        downsample_row<2>(row0, row1, dst_row, dst_width, src_step);
+        break;
+      case 4:
+        downsample_row<4>(row0, row1, dst_row, dst_width, src_step);
+        break;
+      default:
+        downsample_row(row0, row1, dst_row, dst_width, src_step, texel_size);
+        break;
+    }
+  }
+}
+
+void MipmapFeeder::generate_mip_chain()
+{
+  ZoneScopedN("MipmapFeeder::generate_mip_chain");
+  m_mip_chain.resize(mip_chain_size(m_extent, m_mip_levels, m_texel_size));
+
+  // Read the first level.
+  unsigned char* ptr = m_mip_chain.data();
+  uint32_t const base_chunk_size = m_base_level_feeder->chunk_size();
+  int const base_chunk_count = m_base_level_feeder->chunk_count();
+  int next_batch;
+  for (int chunks = 0; chunks < base_chunk_count; chunks += next_batch)
+  {
+    next_batch = m_base_level_feeder->next_batch();
+    m_base_level_feeder->get_chunks(ptr);
+    ptr += next_batch * base_chunk_size;
+  }
+
+  // Generate the other levels.
+  unsigned char* src = m_mip_chain.data();
+  vk::Extent2D src_extent = m_extent;
+  for (uint32_t level = 1; level < m_mip_levels; ++level)
+  {
+    unsigned char* dst = src + size_t{src_extent.width} * src_extent.height * m_texel_size;
+    downsample(src, src_extent, dst, m_texel_size);
+    src = dst;
+    src_extent = vk::Extent2D{ std::max(src_extent.width / 2, 1u), std::max(src_extent.height / 2, 1u) };
+  }
+}
+
+int MipmapFeeder::next_batch()
+{
+  if (m_mip_chain.empty())
+    generate_mip_chain();
+  m_batch_size = std::min(m_max_batch_size, chunk_count() - m_next_texel);
+  return m_batch_size;
+}
+
+void MipmapFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  std::memcpy(chunk_ptr, m_mip_chain.data() + static_cast<size_t>(m_next_texel) * m_texel_size, static_cast<size_t>(m_batch_size) * m_texel_size);
+  m_next_texel += m_batch_size;
+  // Free the memory as soon as everything was handed out.
+  if (m_next_texel == chunk_count())
+    std::vector<unsigned char>().swap(m_mip_chain);
+}
+
+} // namespace vulkan
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "DataFeeder.h"
+#include <vulkan/vulkan.hpp>
+#include <memory>
+#include <vector>
+
+namespace vulkan {
+
+// A DataFeeder that produces a full mip chain from a feeder that produces only the first level.
+//
+// This is the fallback for formats that don't support linear blits (see LogicalDevice::supports_linear_blit),
+// where CopyDataToImage can't generate the mip levels on the GPU. Each level is computed from the previous
+// one with a 2x2 box filter per 8-bit component, so this is only correct for formats with 8-bit unorm
+// (or uint) components; for sRGB formats the average is taken in gamma space.
+//
+// The whole chain is computed on the first call to next_batch() and then handed out in batches of
+// (at most) the size that was passed to set_max_batch_size. The chunk size is the size of one texel.
+//
+class MipmapFeeder final : public DataFeeder
+{
+ private:
+  std::unique_ptr<DataFeeder> m_base_level_feeder;      // Produces the first level.
+  vk::Extent2D m_extent;                                // The extent of the first level.
+  uint32_t m_mip_levels;                                // The number of levels to produce.
+  uint32_t m_texel_size;                                // The size of one texel in bytes.
+  std::vector<unsigned char> m_mip_chain;               // All levels, one after another; filled by the first call to next_batch.
+  int m_max_batch_size;                                 // The maximum number of texels to return per batch.
+  int m_next_texel{};                                   // The first texel of the next batch.
+  int m_batch_size{};                                   // The number of texels of the current batch.
+
+ public:
+  MipmapFeeder(std::unique_ptr<DataFeeder> base_level_feeder, vk::Extent2D extent, uint32_t mip_levels, uint32_t texel_size);
+
+  // Return the size in bytes of a mip chain with mip_levels levels.
+  static vk::DeviceSize mip_chain_size(vk::Extent2D extent, uint32_t mip_levels, uint32_t texel_size);
+
+  // Write the level that follows src (with extent src_extent) to dst.
+  static void downsample(unsigned char const* src, vk::Extent2D src_extent, unsigned char* dst, uint32_t texel_size);
+
+  uint32_t chunk_size() const override { return m_texel_size; }
+  int chunk_count() const override { return static_cast<int>(mip_chain_size(m_extent, m_mip_levels, 1)); }
+  bool is_ready(AIStatefulTask* task, AIStatefulTask::condition_type condition) override { return m_base_level_feeder->is_ready(task, condition); }
+  void remove_waiter(AIStatefulTask* task) override { m_base_level_feeder->remove_waiter(task); }
+  void set_max_batch_size(int max_chunks) override { m_max_batch_size = max_chunks; }
+  int next_batch() override;
+  void get_chunks(unsigned char* chunk_ptr) override;
+
+ private:
+  void generate_mip_chain();
+};
+
+} // namespace vulkan
@@ -0,0 +1,321 @@
+#include "sys.h"
+#include "ResidencyManager.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#ifdef TRACY_ENABLE
+#include <Tracy.hpp>
+#endif
+
+namespace vulkan::memory {
+
+void ResidencyManager::track(VmaAllocation vh_allocation, AllocationCategory category)
+{
+  // The category must be known at this point.
+  ASSERT(category != AllocationCategory::automatic);
+  VmaAllocationInfo const allocation_info = m_allocator->get_allocation_info(vh_allocation);
+  uint32_t const heap = heap_index(allocation_info.memoryType);
+  uint64_t const frame = m_frame.load(std::memory_order::relaxed);
+  state_type::wat state_w(m_state);
+  if (AI_UNLIKELY(state_w->m_tracked_bytes.empty()))
+  {
+    uint32_t const memory_heap_count = m_allocator->get_memory_properties()->memoryHeapCount;
+    state_w->m_tracked_bytes.resize(memory_heap_count);
+    state_w->m_evictable_bytes.resize(memory_heap_count);
+  }
+  [[maybe_unused]] bool inserted = state_w->m_entries.try_emplace(vh_allocation, heap, category, allocation_info.size, frame, nullptr, nullptr, false).second;
+  // Tracking the same allocation twice?
+  ASSERT(inserted);
+  state_w->m_tracked_bytes[heap] += allocation_info.size;
+  CategoryStatistics& category_statistics = state_w->m_categories[static_cast<size_t>(category)];
+  ++category_statistics.m_allocation_count;
+  category_statistics.m_bytes += allocation_info.size;
+}
+
+void ResidencyManager::untrack(VmaAllocation vh_allocation)
+{
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  // Untracking an allocation that wasn't tracked?
+  ASSERT(entry != state_w->m_entries.end());
+  state_w->m_tracked_bytes[entry->second.m_heap_index] -= entry->second.m_size;
+  if (entry->second.m_evictable)
+  {
+    state_w->m_evictable_bytes[entry->second.m_heap_index] -= entry->second.m_size;
+    m_evictable_count.fetch_sub(1, std::memory_order::relaxed);
+  }
+  CategoryStatistics& category_statistics = state_w->m_categories[static_cast<size_t>(entry->second.m_category)];
+  --category_statistics.m_allocation_count;
+  category_statistics.m_bytes -= entry->second.m_size;
+  state_w->m_entries.erase(entry);
+}
+
+void ResidencyManager::set_category(VmaAllocation vh_allocation, AllocationCategory category)
+{
+  ASSERT(category != AllocationCategory::automatic);
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  ASSERT(entry != state_w->m_entries.end());
+  CategoryStatistics& old_category_statistics = state_w->m_categories[static_cast<size_t>(entry->second.m_category)];
+  --old_category_statistics.m_allocation_count;
+  old_category_statistics.m_bytes -= entry->second.m_size;
+  entry->second.m_category = category;
+  CategoryStatistics& new_category_statistics = state_w->m_categories[static_cast<size_t>(category)];
+  ++new_category_statistics.m_allocation_count;
+  new_category_statistics.m_bytes += entry->second.m_size;
+}
+
+void ResidencyManager::set_evictable(VmaAllocation vh_allocation, Evictable* evictable)
+{
+  ASSERT(evictable);
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  ASSERT(entry != state_w->m_entries.end());
+  if (!entry->second.m_evictable)
+  {
+    state_w->m_evictable_bytes[entry->second.m_heap_index] += entry->second.m_size;
+    m_evictable_count.fetch_add(1, std::memory_order::relaxed);
+  }
+  entry->second.m_evictable = evictable;
+  entry->second.m_evicted = false;
+}
+
+void ResidencyManager::remove_evictable(VmaAllocation vh_allocation, Evictable* evictable)
+{
+  // Wait until evictable is no longer being evicted.
+  std::lock_guard<std::mutex> lock(m_evict_mutex);
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  // If the allocation was evicted then the entry was removed, or vh_allocation is reused by a different resource.
+  if (entry == state_w->m_entries.end() || entry->second.m_evictable != evictable)
+    return;
+  state_w->m_evictable_bytes[entry->second.m_heap_index] -= entry->second.m_size;
+  m_evictable_count.fetch_sub(1, std::memory_order::relaxed);
+  entry->second.m_evictable = nullptr;
+}
+
+void ResidencyManager::set_relocatable(VmaAllocation vh_allocation, Relocatable* relocatable)
+{
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  if (entry == state_w->m_entries.end())
+  {
+    // Only unregistering is allowed after the allocation was destroyed.
+    ASSERT(!relocatable);
+    return;
+  }
+  entry->second.m_relocatable = relocatable;
+}
+
+Relocatable* ResidencyManager::relocatable(VmaAllocation vh_allocation) const
+{
+  state_type::crat state_r(m_state);
+  auto entry = state_r->m_entries.find(vh_allocation);
+  // Resources don't have to be idle: the frames that use them are ordered with the copy (see task::Defragment).
+  if (entry == state_r->m_entries.end() || entry->second.m_evictable)
+    return nullptr;
+  return entry->second.m_relocatable;
+}
+
+void ResidencyManager::moved(VmaAllocation vh_allocation)
+{
+  uint32_t const heap = heap_index(m_allocator->get_allocation_info(vh_allocation).memoryType);
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  ASSERT(entry != state_w->m_entries.end());
+  Entry& moved_entry = entry->second;
+  if (moved_entry.m_heap_index == heap)
+    return;
+  state_w->m_tracked_bytes[moved_entry.m_heap_index] -= moved_entry.m_size;
+  state_w->m_tracked_bytes[heap] += moved_entry.m_size;
+  if (moved_entry.m_evictable)
+  {
+    state_w->m_evictable_bytes[moved_entry.m_heap_index] -= moved_entry.m_size;
+    state_w->m_evictable_bytes[heap] += moved_entry.m_size;
+  }
+  moved_entry.m_heap_index = heap;
+}
+
+bool ResidencyManager::touch(VmaAllocation vh_allocation, Evictable const* evictable)
+{
+  uint64_t const frame = m_frame.load(std::memory_order::relaxed);
+  state_type::wat state_w(m_state);
+  auto entry = state_w->m_entries.find(vh_allocation);
+  if (evictable)
+  {
+    // Once evicted, the entry is removed (and vh_allocation might even be reused for another allocation).
+    if (entry == state_w->m_entries.end() || entry->second.m_evictable != evictable || entry->second.m_evicted)
+      return false;
+  }
+  else
+  {
+    // Touching an allocation that doesn't exist?
+    ASSERT(entry != state_w->m_entries.end());
+  }
+  entry->second.m_last_use_frame = frame;
+  return true;
+}
+
+void ResidencyManager::set_oldest_frame_in_flight(task::SynchronousWindow const* window, uint64_t oldest_frame_in_flight)
+{
+  state_type::wat state_w(m_state);
+  auto iter = std::find_if(state_w->m_windows.begin(), state_w->m_windows.end(), [window](WindowFrames const& window_frames){ return window_frames.m_window == window; });
+  if (iter == state_w->m_windows.end())
+    state_w->m_windows.push_back({ window, oldest_frame_in_flight });
+  else
+    iter->m_oldest_frame_in_flight = oldest_frame_in_flight;
+  update_oldest_frame_in_flight(*state_w);
+}
+
+void ResidencyManager::remove_window(task::SynchronousWindow const* window)
+{
+  state_type::wat state_w(m_state);
+  std::erase_if(state_w->m_windows, [window](WindowFrames const& window_frames){ return window_frames.m_window == window; });
+  update_oldest_frame_in_flight(*state_w);
+}
+
+void ResidencyManager::update_oldest_frame_in_flight(State const& state)
+{
+  uint64_t oldest_frame_in_flight = std::numeric_limits<uint64_t>::max();
+  for (WindowFrames const& window_frames : state.m_windows)
+    oldest_frame_in_flight = std::min(oldest_frame_in_flight, window_frames.m_oldest_frame_in_flight);
+  m_oldest_frame_in_flight.store(oldest_frame_in_flight, std::memory_order::release);
+}
+
+bool ResidencyManager::under_pressure(vk::DeviceSize size) const
+{
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+  m_allocator->get_heap_budgets(budgets.data());
+  uint32_t const memory_heap_count = m_allocator->get_memory_properties()->memoryHeapCount;
+  for (uint32_t heap = 0; heap < memory_heap_count; ++heap)
+    if (budgets[heap].usage + size > s_high_water_mark * budgets[heap].budget)
+      return true;
+  return false;
+}
+
+void ResidencyManager::make_room(uint32_t memory_type_index, vk::DeviceSize size)
+{
+  DoutEntering(dc::vulkan, "ResidencyManager::make_room(" << memory_type_index << ", " << size << ") [" << this << "]");
+  if (memory_type_index == UINT32_MAX)
+    return;
+  uint32_t const heap = heap_index(memory_type_index);
+
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+  m_allocator->get_heap_budgets(budgets.data());
+  vk::DeviceSize const allowed = s_high_water_mark * budgets[heap].budget;
+  if (budgets[heap].usage + size <= allowed)
+    return;
+  vk::DeviceSize const bytes_needed = budgets[heap].usage + size - allowed;
+
+  // Collect the eviction candidates of this heap, least recently used first.
+  struct Candidate
+  {
+    VmaAllocation m_vh_allocation;
+    Evictable* m_evictable;
+    uint64_t m_last_use_frame;
+  };
+  std::vector<Candidate> candidates;
+  // Stop Evictable objects from being unregistered (destructed) while we are using them.
+  std::lock_guard<std::mutex> lock(m_evict_mutex);
+  {
+    state_type::crat state_r(m_state);
+    for (auto const& [vh_allocation, entry] : state_r->m_entries)
+      if (entry.m_heap_index == heap && entry.m_evictable && !entry.m_evicted && is_completed(entry.m_last_use_frame))
+        candidates.push_back({ vh_allocation, entry.m_evictable, entry.m_last_use_frame });
+  }
+  std::sort(candidates.begin(), candidates.end(), [](Candidate const& lhs, Candidate const& rhs){ return lhs.m_last_use_frame < rhs.m_last_use_frame; });
+
+  // Evict without holding the lock on m_state: evicting normally destroys the allocation, which calls untrack.
+  vk::DeviceSize freed = 0;
+  for (Candidate const& candidate : candidates)
+  {
+    if (freed >= bytes_needed)
+      break;
+    {
+      state_type::wat state_w(m_state);
+      // The owner might have used the allocation again since we collected the candidates.
+      auto entry = state_w->m_entries.find(candidate.m_vh_allocation);
+      if (entry == state_w->m_entries.end() || entry->second.m_evictable != candidate.m_evictable || !is_completed(entry->second.m_last_use_frame))
+        continue;
+      // From now on touch() returns false.
+      entry->second.m_evicted = true;
+    }
+    Dout(dc::vulkan, "Evicting " << candidate.m_vh_allocation << " (last used in frame " << candidate.m_last_use_frame << ").");
+    freed += candidate.m_evictable->evict(candidate.m_vh_allocation);
+  }
+  if (freed < bytes_needed)
+    Dout(dc::warning, "ResidencyManager::make_room: could only free " << freed << " of the " << bytes_needed << " bytes needed in heap " << heap << ".");
+}
+
+std::vector<ResidencyManager::HeapBudget> ResidencyManager::heap_budgets() const
+{
+  VkPhysicalDeviceMemoryProperties const* memory_properties = m_allocator->get_memory_properties();
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+  m_allocator->get_heap_budgets(budgets.data());
+  std::vector<HeapBudget> result(memory_properties->memoryHeapCount);
+  state_type::crat state_r(m_state);
+  for (uint32_t heap = 0; heap < memory_properties->memoryHeapCount; ++heap)
+  {
+    result[heap].m_flags = vk::MemoryHeapFlags{memory_properties->memoryHeaps[heap].flags};
+    result[heap].m_usage = budgets[heap].usage;
+    result[heap].m_budget = budgets[heap].budget;
+    result[heap].m_tracked_bytes = state_r->m_tracked_bytes.empty() ? 0 : state_r->m_tracked_bytes[heap];
+    result[heap].m_evictable_bytes = state_r->m_evictable_bytes.empty() ? 0 : state_r->m_evictable_bytes[heap];
+    result[heap].m_block_count = budgets[heap].statistics.blockCount;
+    result[heap].m_allocation_count = budgets[heap].statistics.allocationCount;
+    result[heap].m_block_bytes = budgets[heap].statistics.blockBytes;
+    result[heap].m_allocation_bytes = budgets[heap].statistics.allocationBytes;
+  }
+  return result;
+}
+
+ResidencyManager::Statistics ResidencyManager::statistics() const
+{
+  Statistics result;
+  result.m_heaps = heap_budgets();
+  state_type::crat state_r(m_state);
+  result.m_categories = state_r->m_categories;
+  return result;
+}
+
+#ifdef TRACY_ENABLE
+void ResidencyManager::plot_statistics() const
+{
+  // Tracy requires the plot names to stay valid.
+  static std::array<std::string, number_of_allocation_categories> const category_plot_names = []{
+    std::array<std::string, number_of_allocation_categories> names;
+    for (size_t category = 0; category < number_of_allocation_categories; ++category)
+      names[category] = std::string("GPU memory: ") + to_string(static_cast<AllocationCategory>(category));
+    return names;
+  }();
+  static std::array<std::string, VK_MAX_MEMORY_HEAPS> const heap_plot_names = []{
+    std::array<std::string, VK_MAX_MEMORY_HEAPS> names;
+    for (uint32_t heap = 0; heap < VK_MAX_MEMORY_HEAPS; ++heap)
+      names[heap] = "GPU heap " + std::to_string(heap) + ": allocated";
+    return names;
+  }();
+
+  Statistics const stats = statistics();
+  for (size_t category = 0; category < number_of_allocation_categories; ++category)
+    TracyPlot(category_plot_names[category].c_str(), static_cast<int64_t>(stats.m_categories[category].m_bytes));
+  for (uint32_t heap = 0; heap < stats.m_heaps.size(); ++heap)
+    TracyPlot(heap_plot_names[heap].c_str(), static_cast<int64_t>(stats.m_heaps[heap].m_allocation_bytes));
+}
+#endif
+
+#ifdef CWDEBUG
+void ResidencyManager::HeapBudget::print_on(std::ostream& os) const
+{
+  os << "{flags:" << m_flags <<
+      ", usage:" << m_usage <<
+      ", budget:" << m_budget <<
+      ", tracked_bytes:" << m_tracked_bytes <<
+      ", evictable_bytes:" << m_evictable_bytes <<
+      ", block_count:" << m_block_count <<
+      ", allocation_count:" << m_allocation_count <<
+      ", block_bytes:" << m_block_bytes <<
+      ", allocation_bytes:" << m_allocation_bytes << '}';
+}
+#endif
+
+} // namespace vulkan::memory
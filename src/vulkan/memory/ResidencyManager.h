@@ -0,0 +1,229 @@
+#pragma once
+
+#include "Allocator.h"
+#include "AllocationCategory.h"
+#include "threadsafe/aithreadsafe.h"
+#include <unordered_map>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include "debug.h"
+
+namespace task {
+class SynchronousWindow;
+} // namespace task
+
+namespace vulkan::memory {
+
+// Interface of objects whose memory may be (partially) given back when the heap that they were allocated from runs out of budget.
+class Evictable
+{
+ public:
+  // Free (some of) the memory of vh_allocation, for example by destroying a texture that can be recreated later,
+  // or by replacing it with a version with fewer mip levels. Return the number of bytes that were freed.
+  //
+  // This is called by whatever thread is about to allocate memory. It is only called for allocations that are
+  // idle: no frame that is still in flight used it, and touch() will return false from now on (so the owner
+  // won't start using it again). Calls to evict and to ResidencyManager::remove_evictable are serialized.
+  virtual vk::DeviceSize evict(VmaAllocation vh_allocation) = 0;
+
+ protected:
+  ~Evictable() = default;
+};
+
+// Interface of objects whose resource can be moved to a different allocation (by task::Defragment).
+//
+// The resource must only be used by the render loop of owning_window(), which also runs the Defragment task.
+// The calls are made in this order:
+//   create_relocated    - create a new resource that is bound to vh_dst_allocation (see LogicalDevice::create_aliasing_buffer).
+//   switch_to_relocated - replace the old resource with the new one (updating everything that refers to it), but keep the old
+//                         resource: frames that are still in flight might be using it. Called between two frames.
+//   record_relocation   - record the commands that copy the contents of the old resource to the new resource, including the
+//                         barriers around it. These are executed on the graphics queue at the start of the next frame.
+//   destroy_old         - destroy the old resource (but not its allocation); called once that frame completed.
+// After destroy_old the original VmaAllocation handle refers to the new memory.
+class Relocatable
+{
+ private:
+  task::SynchronousWindow const* m_owning_window;       // The window whose frames use the resource.
+
+ public:
+  Relocatable(task::SynchronousWindow const* owning_window) : m_owning_window(owning_window) { }
+
+  // Return false (without creating anything) if the resource can't be moved at this moment.
+  virtual bool create_relocated(VmaAllocation vh_allocation, VmaAllocation vh_dst_allocation) = 0;
+  virtual void switch_to_relocated() = 0;
+  virtual void record_relocation(vk::CommandBuffer vh_command_buffer) = 0;
+  virtual void destroy_old() = 0;
+
+  // Accessor.
+  task::SynchronousWindow const* owning_window() const { return m_owning_window; }
+
+ protected:
+  ~Relocatable() = default;
+};
+
+// Keeps track of every buffer and image allocation of a LogicalDevice: per heap, per category and last-use frame.
+//
+// Every allocation is tracked automatically (by LogicalDevice::create_buffer and create_image).
+// In order to participate in eviction, the owner of an allocation must call touch()
+// every frame that it uses the resource; an evictable resource may only be used when touch() returned true.
+//
+// Frames are numbered in the order in which they are started, by any window. Every window reports
+// the oldest of its frames that might still be in flight (see SynchronousWindow::start_frame);
+// an allocation is idle when all frames, of all windows, up till the last one that touched it completed.
+//
+// Before a new allocation is made that would bring the usage of its heap over s_high_water_mark
+// of the budget (as reported by vmaGetHeapBudgets), the least recently used idle evictable allocations
+// of that heap are evicted.
+//
+class ResidencyManager
+{
+ public:
+  static constexpr double s_high_water_mark = 0.9;      // Start evicting when usage would exceed this fraction of the budget.
+
+  struct HeapBudget
+  {
+    vk::MemoryHeapFlags m_flags;                        // The flags of this heap.
+    vk::DeviceSize m_usage;                             // Estimated current memory usage of the whole process (or of this program if VK_EXT_memory_budget is not enabled).
+    vk::DeviceSize m_budget;                            // Estimated amount of memory available to this program.
+    vk::DeviceSize m_tracked_bytes;                     // The number of bytes of tracked allocations in this heap.
+    vk::DeviceSize m_evictable_bytes;                   // The number of bytes of tracked allocations in this heap that have an Evictable.
+    uint32_t m_block_count;                             // The number of VkDeviceMemory objects allocated from this heap (by VMA).
+    uint32_t m_allocation_count;                        // The number of VMA allocations in this heap.
+    vk::DeviceSize m_block_bytes;                       // The total size of all blocks.
+    vk::DeviceSize m_allocation_bytes;                  // The total size of all allocations (m_block_bytes minus unused space).
+
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const;
+#endif
+  };
+
+  // Blocks are shared between categories, so only bytes and allocations are counted per category.
+  struct CategoryStatistics
+  {
+    uint32_t m_allocation_count;                        // The number of tracked allocations of this category.
+    vk::DeviceSize m_bytes;                             // Their total size.
+  };
+
+  struct Statistics
+  {
+    std::array<CategoryStatistics, number_of_allocation_categories> m_categories;       // Indexed by AllocationCategory.
+    std::vector<HeapBudget> m_heaps;                                                    // Indexed by heap index.
+  };
+
+ private:
+  struct Entry
+  {
+    uint32_t m_heap_index;                              // The heap that the allocation was made from.
+    AllocationCategory m_category;                      // What the allocation is used for.
+    vk::DeviceSize m_size;                              // The size of the allocation.
+    uint64_t m_last_use_frame;                          // The value of m_frame at the last call to touch (or track).
+    Evictable* m_evictable;                             // The object to call when this allocation must be evicted, or nullptr.
+    Relocatable* m_relocatable;                         // The object that can move this allocation, or nullptr.
+    bool m_evicted;                                     // Set when m_evictable was chosen to evict this allocation.
+  };
+
+  struct WindowFrames
+  {
+    task::SynchronousWindow const* m_window;
+    uint64_t m_oldest_frame_in_flight;                  // The oldest frame of m_window that might still be in use by the GPU.
+  };
+
+  struct State
+  {
+    std::unordered_map<VmaAllocation, Entry> m_entries;
+    std::vector<vk::DeviceSize> m_tracked_bytes;        // Indexed by heap index.
+    std::vector<vk::DeviceSize> m_evictable_bytes;      // Indexed by heap index.
+    std::array<CategoryStatistics, number_of_allocation_categories> m_categories{};     // Indexed by AllocationCategory.
+    std::vector<WindowFrames> m_windows;                // The windows that have frames in flight.
+  };
+
+  using state_type = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  Allocator const* m_allocator;                         // The allocator of the logical device.
+  state_type m_state;
+  std::mutex m_evict_mutex;                             // Held while calling Evictable::evict.
+  std::atomic<uint64_t> m_frame{};                      // Incremented at the start of every frame (of any window).
+  std::atomic<uint64_t> m_oldest_frame_in_flight{std::numeric_limits<uint64_t>::max()};   // The minimum of m_oldest_frame_in_flight of all windows.
+  std::atomic<int> m_evictable_count{};                 // The number of tracked allocations that have an Evictable.
+
+ public:
+  ResidencyManager(Allocator const* allocator) : m_allocator(allocator) { }
+
+  // Called by LogicalDevice after creating and before destroying a buffer or image.
+  void track(VmaAllocation vh_allocation, AllocationCategory category);
+  void untrack(VmaAllocation vh_allocation);
+
+  // Change the category of vh_allocation (for allocations that are made by code that doesn't know what they are used for).
+  void set_category(VmaAllocation vh_allocation, AllocationCategory category);
+
+  // Register the object that can evict vh_allocation.
+  void set_evictable(VmaAllocation vh_allocation, Evictable* evictable);
+
+  // Unregister evictable for vh_allocation, if it is still registered (it isn't if vh_allocation was evicted).
+  // If evictable is being evicted by another thread then this blocks until that finished.
+  void remove_evictable(VmaAllocation vh_allocation, Evictable* evictable);
+
+  // Register (or with nullptr, unregister) the object that can move vh_allocation during defragmentation.
+  // Unregistering an allocation that was already destroyed is allowed.
+  void set_relocatable(VmaAllocation vh_allocation, Relocatable* relocatable);
+
+  // Called by task::Defragment: return the Relocatable of vh_allocation, or nullptr if it can't be moved.
+  // Evictable allocations are never moved (they might be evicted while being relocated).
+  Relocatable* relocatable(VmaAllocation vh_allocation) const;
+
+  // Called by task::Defragment after vh_allocation was moved (possibly to a different heap).
+  void moved(VmaAllocation vh_allocation);
+
+  // Mark vh_allocation as used during the current frame.
+  // Returns false if evictable is non-null and vh_allocation was evicted (or is no longer the allocation of evictable);
+  // the resource may not be used then.
+  bool touch(VmaAllocation vh_allocation, Evictable const* evictable = nullptr);
+
+  // Called by SynchronousWindow::start_frame. Returns the number of the new frame.
+  uint64_t new_frame() { return m_frame.fetch_add(1, std::memory_order::relaxed) + 1; }
+
+  // The number of the last frame that was started (by any window).
+  uint64_t frame() const { return m_frame.load(std::memory_order::relaxed); }
+
+  // Called by SynchronousWindow::start_frame: all frames of window before oldest_frame_in_flight completed.
+  void set_oldest_frame_in_flight(task::SynchronousWindow const* window, uint64_t oldest_frame_in_flight);
+
+  // Called when window no longer has frames in flight (it is closing).
+  void remove_window(task::SynchronousWindow const* window);
+
+  // Return true if every frame up till and including frame completed (for all windows).
+  bool is_completed(uint64_t frame) const { return frame < m_oldest_frame_in_flight.load(std::memory_order::acquire); }
+
+  // Return true if there are any evictable allocations at all (if not, make_room can't free anything).
+  bool has_evictables() const { return m_evictable_count.load(std::memory_order::relaxed) > 0; }
+
+  // Return true if an allocation of size bytes might not fit within the budget of some heap.
+  // This is cheap and is called before every allocation.
+  bool under_pressure(vk::DeviceSize size) const;
+
+  // Evict allocations from the heap of memory_type_index until an allocation of size bytes fits within its budget (if possible).
+  void make_room(uint32_t memory_type_index, vk::DeviceSize size);
+
+  // Return the current budget and usage of every heap.
+  std::vector<HeapBudget> heap_budgets() const;
+
+  // Return the usage per category and per heap. This is cheap enough to be called every frame.
+  Statistics statistics() const;
+
+#ifdef TRACY_ENABLE
+  // Emit the statistics as tracy plots (called once per frame).
+  void plot_statistics() const;
+#endif
+
+ private:
+  // Recalculate m_oldest_frame_in_flight. Must be called with m_state locked.
+  void update_oldest_frame_in_flight(State const& state);
+
+  uint32_t heap_index(uint32_t memory_type_index) const { return m_allocator->get_memory_properties()->memoryTypes[memory_type_index].heapIndex; }
+};
+
+} // namespace vulkan::memory
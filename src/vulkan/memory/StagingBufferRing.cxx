@@ -0,0 +1,113 @@
+#include "sys.h"
+#include "StagingBufferRing.h"
+#include "LogicalDevice.h"
+#include <algorithm>
+
+namespace vulkan::memory {
+
+StagingBufferRing::StagingBufferRing(LogicalDevice const* logical_device, vk::DeviceSize size
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+  m_staging_buffer(logical_device, size COMMA_CWDEBUG_ONLY(ambifix(".m_staging_buffer"))),
+  m_alignment(std::max(s_min_alignment, logical_device->non_coherent_atom_size()))
+{
+  DoutEntering(dc::vulkan, "StagingBufferRing::StagingBufferRing(" << logical_device << ", " << size << ") [" << this << "]");
+  // The ring must be persistently mapped.
+  ASSERT(m_staging_buffer.m_pointer);
+}
+
+bool StagingBufferRing::allocate(vk::DeviceSize size, StagingBufferRange& range_out, AIStatefulTask* task, AIStatefulTask::condition_type condition)
+{
+  DoutEntering(dc::vulkan|continued_cf, "StagingBufferRing::allocate(" << size << ", ...) = ");
+  // Call fits(size) first, and use a dedicated StagingBuffer when it returns false.
+  ASSERT(fits(size));
+
+  vk::DeviceSize const capacity = m_staging_buffer.m_size;
+  vk::DeviceSize begin;
+  {
+    ring_state_type::wat ring_state_w(m_ring_state);
+    std::deque<Block>& blocks = ring_state_w->m_blocks;
+    // A task that retries after it was woken up by something else (e.g. submit_finished) is still subscribed.
+    // Remove that subscription: it is either renewed below, or no longer needed.
+    std::erase_if(ring_state_w->m_waiters, [task](Waiter const& waiter){ return waiter.m_task.get() == task; });
+    bool found = true;
+    if (blocks.empty())
+      begin = 0;
+    else
+    {
+      vk::DeviceSize const tail = blocks.front().m_begin;       // The first byte that is still in use.
+      vk::DeviceSize const head = blocks.back().m_end;          // One past the last byte that is in use.
+      begin = (head + m_alignment - 1) / m_alignment * m_alignment;
+      if (head > tail)
+      {
+        // The used space is [tail, head>; the free space is [head, capacity> + [0, tail>.
+        if (begin + size > capacity)
+        {
+          // Wrap around.
+          begin = 0;
+          found = size <= tail;
+        }
+      }
+      else
+      {
+        // We wrapped around; the free space is [head, tail>.
+        found = begin + size <= tail;
+      }
+    }
+    if (!found)
+    {
+      // Wake up task when more space becomes available.
+      ring_state_w->m_waiters.push_back({task, condition});
+      Dout(dc::finish, "false (" << blocks.size() << " ranges in use)");
+      return false;
+    }
+    blocks.emplace_back(begin, begin + size, false);
+  }
+  range_out = StagingBufferRange(this, m_staging_buffer.m_vh_buffer, m_staging_buffer.m_vh_allocation,
+      begin, size, static_cast<unsigned char*>(m_staging_buffer.m_pointer) + begin);
+  Dout(dc::finish, "true (offset " << begin << ")");
+  return true;
+}
+
+void StagingBufferRing::release(StagingBufferRange& range)
+{
+  DoutEntering(dc::vulkan, "StagingBufferRing::release(" << range << ")");
+  // Only release ranges that were allocated from this ring.
+  ASSERT(range.ring() == this);
+
+  std::vector<Waiter> waiters;
+  {
+    ring_state_type::wat ring_state_w(m_ring_state);
+    std::deque<Block>& blocks = ring_state_w->m_blocks;
+    // Ranges are normally released in the order that they were allocated, so this is fast.
+    auto block = std::find_if(blocks.begin(), blocks.end(), [&range](Block const& block){ return block.m_begin == range.offset() && !block.m_released; });
+    // Releasing a range that wasn't allocated (or releasing it twice)?
+    ASSERT(block != blocks.end());
+    block->m_released = true;
+    // Recycle all released blocks at the front.
+    while (!blocks.empty() && blocks.front().m_released)
+      blocks.pop_front();
+    waiters.swap(ring_state_w->m_waiters);
+  }
+  // Signal the waiting tasks without holding the lock; each of them will retry the allocation.
+  for (Waiter const& waiter : waiters)
+    waiter.m_task->signal(waiter.m_condition);
+  range.reset();
+}
+
+void StagingBufferRing::remove_waiter(AIStatefulTask* task)
+{
+  ring_state_type::wat ring_state_w(m_ring_state);
+  std::erase_if(ring_state_w->m_waiters, [task](Waiter const& waiter){ return waiter.m_task.get() == task; });
+}
+
+#ifdef CWDEBUG
+void StagingBufferRange::print_on(std::ostream& os) const
+{
+  os << "{ring:" << m_ring <<
+      ", vh_buffer:" << m_vh_buffer <<
+      ", offset:" << m_offset <<
+      ", size:" << m_size << '}';
+}
+#endif
+
+} // namespace vulkan::memory
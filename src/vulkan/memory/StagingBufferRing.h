@@ -0,0 +1,121 @@
+#pragma once
+
+#include "StagingBuffer.h"
+#include "statefultask/AIStatefulTask.h"
+#include "threadsafe/aithreadsafe.h"
+#include <boost/intrusive_ptr.hpp>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+class StagingBufferRing;
+
+// A sub-range of a staging buffer: either of a StagingBufferRing, or of a dedicated StagingBuffer.
+class StagingBufferRange
+{
+ private:
+  StagingBufferRing* m_ring{};                  // The ring that this range was allocated from, or nullptr if this range is not (or no longer) part of a ring.
+  vk::Buffer m_vh_buffer;                       // The staging buffer that this range is part of.
+  VmaAllocation m_vh_allocation{};              // The allocation of m_vh_buffer.
+  vk::DeviceSize m_offset{};                    // The offset of the range into m_vh_buffer.
+  vk::DeviceSize m_size{};                      // The size of the range in bytes.
+  unsigned char* m_pointer{};                   // Pointer to the mapped memory at m_offset.
+
+ public:
+  StagingBufferRange() = default;
+
+  // Construct a range that spans the whole of a dedicated staging buffer.
+  StagingBufferRange(StagingBuffer const& staging_buffer) :
+    m_vh_buffer(staging_buffer.m_vh_buffer), m_vh_allocation(staging_buffer.m_vh_allocation),
+    m_offset(0), m_size(staging_buffer.m_size), m_pointer(static_cast<unsigned char*>(staging_buffer.m_pointer)) { }
+
+  // Construct a range that is part of ring.
+  StagingBufferRange(StagingBufferRing* ring, vk::Buffer vh_buffer, VmaAllocation vh_allocation,
+      vk::DeviceSize offset, vk::DeviceSize size, unsigned char* pointer) :
+    m_ring(ring), m_vh_buffer(vh_buffer), m_vh_allocation(vh_allocation), m_offset(offset), m_size(size), m_pointer(pointer) { }
+
+  // Accessors.
+  StagingBufferRing* ring() const { return m_ring; }
+  vk::Buffer vh_buffer() const { return m_vh_buffer; }
+  VmaAllocation vh_allocation() const { return m_vh_allocation; }
+  vk::DeviceSize offset() const { return m_offset; }
+  vk::DeviceSize size() const { return m_size; }
+  unsigned char* pointer() const { return m_pointer; }
+
+  // Called by StagingBufferRing::release.
+  void reset() { *this = StagingBufferRange{}; }
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+};
+
+// A persistently mapped staging buffer, shared by all uploads to one logical device.
+//
+// Sub-ranges are handed out in a FIFO manner: a range is allocated directly after the
+// last allocated range, wrapping around to the start of the buffer when the end is reached.
+// Ranges are released (by CopyDataToGPU) once the timeline semaphore of the ImmediateSubmitQueue
+// that the copy was submitted to reached the signal value of that submit. Since ranges can be
+// released out of order (there can be more than one ImmediateSubmitQueue), released ranges
+// are only recycled once all ranges before them were released too.
+//
+// If an allocation does not fit in the currently free space, then the calling task is subscribed
+// and will be signaled as soon as a range is released; it should then retry the allocation.
+//
+class StagingBufferRing
+{
+ public:
+  static constexpr vk::DeviceSize s_min_alignment = 16;         // The minimum alignment of the offset of each range (a multiple of every texel block size we use).
+
+ private:
+  struct Block
+  {
+    vk::DeviceSize m_begin;                     // Offset of the first byte of this block.
+    vk::DeviceSize m_end;                       // Offset one past the last byte of this block.
+    bool m_released;                            // Set when the block was released, but could not be recycled yet.
+  };
+
+  struct Waiter
+  {
+    boost::intrusive_ptr<AIStatefulTask> m_task;        // The task to signal when space was released (kept alive until signaled).
+    AIStatefulTask::condition_type m_condition;         // The condition to signal it with.
+  };
+
+  struct RingState
+  {
+    std::deque<Block> m_blocks;                 // All allocated blocks, in allocation order.
+    std::vector<Waiter> m_waiters;              // Tasks that failed to allocate a range.
+  };
+
+  using ring_state_type = aithreadsafe::Wrapper<RingState, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  StagingBuffer m_staging_buffer;               // The underlaying, persistently mapped, buffer.
+  vk::DeviceSize m_alignment;                   // The alignment used for the offset of each range.
+  ring_state_type m_ring_state;
+
+ public:
+  StagingBufferRing(LogicalDevice const* logical_device, vk::DeviceSize size
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Returns true if a range of size bytes could ever be allocated from this ring.
+  bool fits(vk::DeviceSize size) const { return size <= m_staging_buffer.m_size; }
+
+  // Attempt to allocate size bytes. Returns true upon success, in which case range_out is filled in.
+  // Otherwise task is subscribed to be signaled with condition as soon as a range was released.
+  // A task is subscribed at most once; every call replaces a previous subscription of the same task.
+  bool allocate(vk::DeviceSize size, StagingBufferRange& range_out, AIStatefulTask* task, AIStatefulTask::condition_type condition);
+
+  // Release a range that was returned by allocate. Afterwards range is reset.
+  void release(StagingBufferRange& range);
+
+  // Unsubscribe task, when it is no longer interested in a signal after a failed allocate.
+  void remove_waiter(AIStatefulTask* task);
+
+  // Accessor.
+  vk::DeviceSize capacity() const { return m_staging_buffer.m_size; }
+};
+
+} // namespace vulkan::memory
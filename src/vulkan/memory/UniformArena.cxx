@@ -0,0 +1,39 @@
+#include "sys.h"
+#include "UniformArena.h"
+#include "LogicalDevice.h"
+#include "utils/AIAlert.h"
+
+namespace vulkan::memory {
+
+UniformArena::UniformArena(LogicalDevice const* logical_device, vk::DeviceSize size
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+  // Don't allow VMA to pick memory that isn't host visible: we need m_pointer.
+  m_buffer(logical_device, size
+      COMMA_CWDEBUG_ONLY(ambifix(".m_buffer")),
+      { .vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT }),
+  m_alignment(logical_device->min_uniform_buffer_offset_alignment())
+{
+  DoutEntering(dc::vulkan, "UniformArena::UniformArena(" << logical_device << ", " << size << ") [" << this << "]");
+  // The arena must be persistently mapped.
+  ASSERT(m_buffer.m_pointer);
+}
+
+void* UniformArena::allocate(vk::DeviceSize size, uint32_t& dynamic_offset_out)
+{
+  // m_alignment is a power of two.
+  vk::DeviceSize const offset = (m_used + m_alignment - 1) & ~(m_alignment - 1);
+  if (AI_UNLIKELY(offset + size > m_buffer.m_size))
+    THROW_ALERT("UniformArena of [CAPACITY] bytes is full (trying to allocate [SIZE] bytes at offset [OFFSET])",
+        AIArgs("[CAPACITY]", m_buffer.m_size)("[SIZE]", size)("[OFFSET]", offset));
+  m_used = offset + size;
+  dynamic_offset_out = static_cast<uint32_t>(offset);
+  return static_cast<unsigned char*>(m_buffer.m_pointer) + offset;
+}
+
+void UniformArena::flush() const
+{
+  if (m_used > 0)
+    m_buffer.m_logical_device->flush_mapped_allocation(m_buffer.m_vh_allocation, 0, m_used);
+}
+
+} // namespace vulkan::memory
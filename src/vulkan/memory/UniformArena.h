@@ -0,0 +1,69 @@
+#pragma once
+
+#include "UniformBuffer.h"
+#include "debug.h"
+
+namespace vulkan::memory {
+
+// A linear (bump) allocator for per-frame uniform data.
+//
+// Each FrameResourcesData has one UniformArena: a single, persistently mapped uniform buffer
+// that is bound through eUniformBufferDynamic descriptors. Instead of creating a UniformBuffer
+// (and descriptor set) per object per frame, allocate the uniform data of every object from
+// the arena of the current frame and pass the returned offset as dynamic offset to bindDescriptorSets.
+//
+// The arena is reset by SynchronousWindow::start_frame and flushed by SynchronousWindow::submit.
+// Because the previous use of the same frame resources might still be executing, only allocate
+// (write) after calling wait_command_buffer_completed().
+//
+// Usage:
+//
+//   // Once, point a descriptor of type eUniformBufferDynamic at the arena:
+//   logical_device()->update_descriptor_set(vh_descriptor_set, vk::DescriptorType::eUniformBufferDynamic, binding, 0, {},
+//       { frame_resources->m_uniform_arena.descriptor_buffer_info(sizeof(MyUniform)) });
+//
+//   // Every frame, for every object:
+//   uint32_t dynamic_offset;
+//   MyUniform* uniform = frame_resources->m_uniform_arena.allocate<MyUniform>(dynamic_offset);
+//   uniform->x = ...;
+//   command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, { vh_descriptor_set }, { dynamic_offset });
+//
+class UniformArena
+{
+ private:
+  UniformBuffer m_buffer;                       // The underlying, persistently mapped, buffer.
+  vk::DeviceSize m_alignment{};                 // The alignment of each allocation (minUniformBufferOffsetAlignment).
+  vk::DeviceSize m_used{};                      // The number of bytes allocated since the last reset.
+
+ public:
+  UniformArena() = default;
+  UniformArena(LogicalDevice const* logical_device, vk::DeviceSize size
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Allocate size bytes and return a pointer to them. Set dynamic_offset_out to the offset of the allocation into the buffer.
+  // Throws if the arena is full.
+  void* allocate(vk::DeviceSize size, uint32_t& dynamic_offset_out);
+
+  template<typename T>
+  T* allocate(uint32_t& dynamic_offset_out) { return static_cast<T*>(allocate(sizeof(T), dynamic_offset_out)); }
+
+  // Make the data written since the last reset available to the device (a no-op for host coherent memory).
+  void flush() const;
+
+  // Start a new frame.
+  void reset() { m_used = 0; }
+
+  // Return the buffer info for a dynamic uniform buffer descriptor that covers range bytes.
+  vk::DescriptorBufferInfo descriptor_buffer_info(vk::DeviceSize range) const
+  {
+    return { .buffer = m_buffer.m_vh_buffer, .offset = 0, .range = range };
+  }
+
+  // Accessors.
+  vk::Buffer vh_buffer() const { return m_buffer.m_vh_buffer; }
+  vk::DeviceSize capacity() const { return m_buffer.m_size; }
+  vk::DeviceSize used() const { return m_used; }
+  explicit operator bool() const { return m_buffer.m_vh_buffer; }
+};
+
+} // namespace vulkan::memory
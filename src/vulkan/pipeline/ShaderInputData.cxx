@@ -53,12 +53,21 @@ std::string_view ShaderInputData::preprocess(
   static constexpr char const* version_header = "#version 450\n\n";
   size_t final_source_code_size = std::strlen(version_header) + declarations.size() + source.length() + id_to_name_growth;
 
+  // #extension directives at the top of the template must precede the generated declarations.
+  size_t extensions_end = 0;
+  while (source.substr(extensions_end).starts_with("#extension"))
+  {
+    size_t const eol = source.find('\n', extensions_end);
+    extensions_end = eol == std::string_view::npos ? source.length() : eol + 1;
+  }
+
   glsl_source_code_buffer.reserve(utils::malloc_size(final_source_code_size + 1) - 1);
   glsl_source_code_buffer = version_header;
+  glsl_source_code_buffer += source.substr(0, extensions_end);
   glsl_source_code_buffer += declarations;
 
   // Next copy alternating, the characters in between the strings and the replacements of the substrings.
-  size_t start = 0;
+  size_t start = extensions_end;
   for (auto&& p : positions)
   {
     // Copy the characters leading up to the string at position p.
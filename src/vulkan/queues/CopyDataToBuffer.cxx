@@ -1,43 +1,125 @@
 #include "sys.h"
 #include "CopyDataToBuffer.h"
+#include "SynchronousWindow.h"
 
 namespace task {
 
-void CopyDataToBuffer::record_command_buffer(vulkan::handle::CommandBuffer command_buffer)
+bool CopyDataToBuffer::record_transfer(vulkan::TransferBatch& batch, Slice const& slice)
 {
-  DoutEntering(dc::vulkan, "CopyDataToBuffer::record_command_buffer(" << command_buffer << ") [" << this << "]");
+  DoutEntering(dc::vulkan, "CopyDataToBuffer::record_transfer(" << &batch << ", {" << slice.m_staging_offset << ", " <<
+      slice.m_data_offset << ", " << slice.m_size << "}) [" << this << "]");
 
-  command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+  vk::DeviceSize const dst_offset = m_buffer_offset + slice.m_data_offset;
 
+  // Writing the same part of the buffer twice in one batch requires a barrier in between.
+  if (batch.touches(m_vh_target_buffer, dst_offset, slice.m_size))
+    return false;
+
+  // If the batch is submitted to a different queue family than the one that uses the buffer, then ownership must be transferred.
+  uint32_t const dst_queue_family = ownership_transfer_queue_family(batch);
+  bool const transfer_ownership = dst_queue_family != VK_QUEUE_FAMILY_IGNORED;
+
+  // When transferring ownership the old contents are overwritten, so there is nothing to acquire: the previous
+  // accesses happened on a different queue (and must have been synchronized with a semaphore by the caller).
   vk::BufferMemoryBarrier pre_transfer_buffer_memory_barrier{
-    .srcAccessMask = m_current_buffer_access,
+    .srcAccessMask = transfer_ownership ? vk::AccessFlags(0) : m_current_buffer_access,
     .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
     .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
     .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
     .buffer = m_vh_target_buffer,
-    .offset = m_buffer_offset,
-    .size = m_data_size
+    .offset = dst_offset,
+    .size = slice.m_size
   };
-  command_buffer->pipelineBarrier(m_generating_stages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0), {}, { pre_transfer_buffer_memory_barrier }, {});
+  batch.add_pre_transfer_barrier(transfer_ownership ? vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe) : m_generating_stages,
+      pre_transfer_buffer_memory_barrier);
 
   vk::BufferCopy buffer_copy_region{
-    .srcOffset = 0,
-    .dstOffset = m_buffer_offset,
-    .size = m_data_size
+    .srcOffset = slice.m_staging_offset,
+    .dstOffset = dst_offset,
+    .size = slice.m_size
   };
-  command_buffer->copyBuffer(m_staging_buffer.m_vh_buffer, m_vh_target_buffer, { buffer_copy_region });
+  batch.copy_buffer(slice.m_vh_staging_buffer, m_vh_target_buffer, buffer_copy_region);
 
-  vk::BufferMemoryBarrier post_transfer_buffer_memory_barrier{
+  if (!transfer_ownership)
+  {
+    vk::BufferMemoryBarrier post_transfer_buffer_memory_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = m_new_buffer_access,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = m_vh_target_buffer,
+      .offset = dst_offset,
+      .size = slice.m_size
+    };
+    batch.add_post_transfer_barrier(m_consuming_stages, post_transfer_buffer_memory_barrier);
+    return true;
+  }
+
+  // Release ownership to the graphics queue family of the resource owner.
+  uint32_t const src_queue_family = static_cast<uint32_t>(batch.queue_family().get_value());
+  vk::BufferMemoryBarrier release_buffer_memory_barrier{
     .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlags(0),                // Ignored for a release.
+    .srcQueueFamilyIndex = src_queue_family,
+    .dstQueueFamilyIndex = dst_queue_family,
+    .buffer = m_vh_target_buffer,
+    .offset = dst_offset,
+    .size = slice.m_size
+  };
+  batch.add_release_barrier(release_buffer_memory_barrier);
+
+  // And let the resource owner acquire it again, once this batch finished executing.
+  vk::BufferMemoryBarrier acquire_buffer_memory_barrier{
+    .srcAccessMask = vk::AccessFlags(0),                // Ignored for an acquire.
     .dstAccessMask = m_new_buffer_access,
-    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .srcQueueFamilyIndex = src_queue_family,
+    .dstQueueFamilyIndex = dst_queue_family,
     .buffer = m_vh_target_buffer,
-    .offset = m_buffer_offset,
-    .size = m_data_size
+    .offset = dst_offset,
+    .size = slice.m_size
   };
-  command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, m_consuming_stages, vk::DependencyFlags(0), {}, { post_transfer_buffer_memory_barrier }, {});
-  command_buffer->end();
+  // Only publish the acquire after the batch was submitted, so that no frame waits for a signal value that isn't queued yet.
+  batch.after_submit([resource_owner = m_resource_owner, consuming_stages = m_consuming_stages, acquire_buffer_memory_barrier,
+      vh_timeline_semaphore = batch.vh_timeline_semaphore(), signal_value = batch.signal_value()](){
+    resource_owner->add_acquire_barrier(consuming_stages, acquire_buffer_memory_barrier, vh_timeline_semaphore, signal_value);
+  });
+  return true;
+}
+
+unsigned char* CopyDataToBuffer::map_target()
+{
+  DoutEntering(dc::vulkan|continued_cf, "CopyDataToBuffer::map_target() = ");
+  if (!m_vh_target_allocation)
+  {
+    Dout(dc::finish, "nullptr (unknown allocation)");
+    return nullptr;
+  }
+  // The host can't wait for previous accesses by the device; only write directly to buffers that weren't used yet.
+  if (m_current_buffer_access)
+  {
+    Dout(dc::finish, "nullptr (buffer in use)");
+    return nullptr;
+  }
+  vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
+  vk::MemoryPropertyFlags memory_property_flags;
+  logical_device->get_allocation_memory_properties(m_vh_target_allocation, memory_property_flags);
+  if (!(memory_property_flags & vk::MemoryPropertyFlagBits::eHostVisible))
+  {
+    Dout(dc::finish, "nullptr (not host visible)");
+    return nullptr;
+  }
+  unsigned char* mapped_target = static_cast<unsigned char*>(logical_device->map_memory(m_vh_target_allocation)) + m_buffer_offset;
+  Dout(dc::finish, (void*)mapped_target);
+  return mapped_target;
+}
+
+void CopyDataToBuffer::unmap_target()
+{
+  DoutEntering(dc::vulkan, "CopyDataToBuffer::unmap_target() [" << this << "]");
+  vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
+  // This is a no-op for host coherent memory.
+  logical_device->flush_mapped_allocation(m_vh_target_allocation, m_buffer_offset, m_data_size);
+  logical_device->unmap_memory(m_vh_target_allocation);
 }
 
 } // namespace task
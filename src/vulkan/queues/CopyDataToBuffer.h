@@ -14,6 +14,7 @@ class CopyDataToBuffer final : public CopyDataToGPU
   vk::PipelineStageFlags m_generating_stages;
   vk::AccessFlags m_new_buffer_access;
   vk::PipelineStageFlags m_consuming_stages;
+  VmaAllocation m_vh_target_allocation{};       // The allocation of m_vh_target_buffer, if known; used to decide whether or not to use a staging buffer.
 
  public:
   // Construct a CopyDataToBuffer object.
@@ -37,8 +38,18 @@ class CopyDataToBuffer final : public CopyDataToGPU
     DoutEntering(dc::vulkan, "~CopyDataToBuffer() [" << this << "]");
   }
 
+  // Optionally pass the allocation of the target buffer. If that memory turns out to be host visible
+  // then the data is written directly into the buffer, instead of copying it from a staging buffer.
+  void set_target_allocation(VmaAllocation vh_target_allocation)
+  {
+    m_vh_target_allocation = vh_target_allocation;
+  }
+
  private:
-  void record_command_buffer(vulkan::handle::CommandBuffer command_buffer) override;
+  bool record_transfer(vulkan::TransferBatch& batch, Slice const& slice) override;
+  bool supports_streaming() const override { return true; }
+  unsigned char* map_target() override;
+  void unmap_target() override;
 };
 
 } // namespace task
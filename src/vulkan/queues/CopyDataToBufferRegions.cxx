@@ -0,0 +1,146 @@
+#include "sys.h"
+#include "CopyDataToBufferRegions.h"
+#include "SynchronousWindow.h"
+#include <algorithm>
+#include <limits>
+
+namespace task {
+
+//static
+uint32_t CopyDataToBufferRegions::packed_size(std::vector<vulkan::DirtyRanges::Range> const& regions)
+{
+  vk::DeviceSize size = 0;
+  for (vulkan::DirtyRanges::Range const& region : regions)
+    size += region.m_size;
+  // The size of all data must fit in an uint32_t.
+  ASSERT(size <= std::numeric_limits<uint32_t>::max());
+  return static_cast<uint32_t>(size);
+}
+
+CopyDataToBufferRegions::CopyDataToBufferRegions(vulkan::LogicalDevice const* logical_device,
+    vk::Buffer vh_target_buffer, std::vector<vulkan::DirtyRanges::Range> regions,
+    vk::AccessFlags current_buffer_access, vk::PipelineStageFlags generating_stages,
+    vk::AccessFlags new_buffer_access, vk::PipelineStageFlags consuming_stages
+    COMMA_CWDEBUG_ONLY(bool debug)) :
+  CopyDataToGPU(logical_device, packed_size(regions) COMMA_CWDEBUG_ONLY(debug)),
+  m_vh_target_buffer(vh_target_buffer), m_regions(std::move(regions)),
+  m_current_buffer_access(current_buffer_access), m_generating_stages(generating_stages),
+  m_new_buffer_access(new_buffer_access), m_consuming_stages(consuming_stages)
+{
+  DoutEntering(dc::vulkan, "CopyDataToBufferRegions(" << logical_device << ", " << vh_target_buffer <<
+      ", <" << m_regions.size() << " regions>, " << current_buffer_access << ", " << generating_stages <<
+      ", " << new_buffer_access << ", " << consuming_stages << ") [" << this << "]");
+  // There must be something to copy.
+  ASSERT(!m_regions.empty());
+  m_packed_offsets.reserve(m_regions.size());
+  vk::DeviceSize packed_offset = 0;
+  for (size_t i = 0; i < m_regions.size(); ++i)
+  {
+    // The regions must be sorted, disjoint and non-empty (as produced by DirtyRanges).
+    ASSERT(m_regions[i].m_size > 0 && (i == 0 || m_regions[i - 1].end() <= m_regions[i].m_offset));
+    m_packed_offsets.push_back(packed_offset);
+    packed_offset += m_regions[i].m_size;
+  }
+}
+
+bool CopyDataToBufferRegions::record_transfer(vulkan::TransferBatch& batch, Slice const& slice)
+{
+  DoutEntering(dc::vulkan, "CopyDataToBufferRegions::record_transfer(" << &batch << ", {" << slice.m_staging_offset << ", " <<
+      slice.m_data_offset << ", " << slice.m_size << "}) [" << this << "]");
+
+  // Collect the (parts of the) regions that are covered by this slice.
+  vk::DeviceSize const slice_end = slice.m_data_offset + slice.m_size;
+  size_t const first = std::upper_bound(m_packed_offsets.begin(), m_packed_offsets.end(), slice.m_data_offset) - m_packed_offsets.begin() - 1;
+  std::vector<vk::BufferCopy> buffer_copy_regions;
+  for (size_t i = first; i < m_regions.size() && m_packed_offsets[i] < slice_end; ++i)
+  {
+    vk::DeviceSize const packed_begin = std::max(slice.m_data_offset, m_packed_offsets[i]);
+    vk::DeviceSize const packed_end = std::min(slice_end, m_packed_offsets[i] + m_regions[i].m_size);
+    buffer_copy_regions.push_back({
+      .srcOffset = slice.m_staging_offset + (packed_begin - slice.m_data_offset),
+      .dstOffset = m_regions[i].m_offset + (packed_begin - m_packed_offsets[i]),
+      .size = packed_end - packed_begin
+    });
+  }
+  // The part of the buffer that is written to.
+  vk::DeviceSize const span_offset = buffer_copy_regions.front().dstOffset;
+  vk::DeviceSize const span_size = buffer_copy_regions.back().dstOffset + buffer_copy_regions.back().size - span_offset;
+
+  // Writing the same part of the buffer twice in one batch requires a barrier in between.
+  if (batch.touches(m_vh_target_buffer, span_offset, span_size))
+    return false;
+
+  // If the batch is submitted to a different queue family than the one that uses the buffer, then ownership must be transferred.
+  uint32_t const dst_queue_family = ownership_transfer_queue_family(batch);
+  bool const transfer_ownership = dst_queue_family != VK_QUEUE_FAMILY_IGNORED;
+
+  // One barrier for the whole span; the bytes in between the regions aren't accessed by the transfer.
+  vk::BufferMemoryBarrier pre_transfer_buffer_memory_barrier{
+    .srcAccessMask = transfer_ownership ? vk::AccessFlags(0) : m_current_buffer_access,
+    .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = m_vh_target_buffer,
+    .offset = span_offset,
+    .size = span_size
+  };
+  batch.add_pre_transfer_barrier(transfer_ownership ? vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe) : m_generating_stages,
+      pre_transfer_buffer_memory_barrier);
+
+  // All regions have the same source and destination buffer, so TransferBatch records them with a single vkCmdCopyBuffer.
+  for (vk::BufferCopy const& buffer_copy_region : buffer_copy_regions)
+    batch.copy_buffer(slice.m_vh_staging_buffer, m_vh_target_buffer, buffer_copy_region);
+
+  if (!transfer_ownership)
+  {
+    vk::BufferMemoryBarrier post_transfer_buffer_memory_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = m_new_buffer_access,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = m_vh_target_buffer,
+      .offset = span_offset,
+      .size = span_size
+    };
+    batch.add_post_transfer_barrier(m_consuming_stages, post_transfer_buffer_memory_barrier);
+    return true;
+  }
+
+  // Ownership is transferred per region: releasing the bytes in between would make their contents undefined.
+  uint32_t const src_queue_family = static_cast<uint32_t>(batch.queue_family().get_value());
+  std::vector<vk::BufferMemoryBarrier> acquire_buffer_memory_barriers;
+  for (vk::BufferCopy const& buffer_copy_region : buffer_copy_regions)
+  {
+    vk::BufferMemoryBarrier release_buffer_memory_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlags(0),              // Ignored for a release.
+      .srcQueueFamilyIndex = src_queue_family,
+      .dstQueueFamilyIndex = dst_queue_family,
+      .buffer = m_vh_target_buffer,
+      .offset = buffer_copy_region.dstOffset,
+      .size = buffer_copy_region.size
+    };
+    batch.add_release_barrier(release_buffer_memory_barrier);
+
+    vk::BufferMemoryBarrier acquire_buffer_memory_barrier{
+      .srcAccessMask = vk::AccessFlags(0),              // Ignored for an acquire.
+      .dstAccessMask = m_new_buffer_access,
+      .srcQueueFamilyIndex = src_queue_family,
+      .dstQueueFamilyIndex = dst_queue_family,
+      .buffer = m_vh_target_buffer,
+      .offset = buffer_copy_region.dstOffset,
+      .size = buffer_copy_region.size
+    };
+    acquire_buffer_memory_barriers.push_back(acquire_buffer_memory_barrier);
+  }
+  // Only publish the acquires after the batch was submitted, so that no frame waits for a signal value that isn't queued yet.
+  batch.after_submit([resource_owner = m_resource_owner, consuming_stages = m_consuming_stages,
+      acquire_buffer_memory_barriers = std::move(acquire_buffer_memory_barriers),
+      vh_timeline_semaphore = batch.vh_timeline_semaphore(), signal_value = batch.signal_value()](){
+    for (vk::BufferMemoryBarrier const& acquire_buffer_memory_barrier : acquire_buffer_memory_barriers)
+      resource_owner->add_acquire_barrier(consuming_stages, acquire_buffer_memory_barrier, vh_timeline_semaphore, signal_value);
+  });
+  return true;
+}
+
+} // namespace task
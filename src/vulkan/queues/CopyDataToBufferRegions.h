@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CopyDataToGPU.h"
+#include "memory/DirtyRanges.h"
+#include "vk_utils/print_flags.h"
+#include <vector>
+
+namespace task {
+
+// Scatter upload: copy packed data to a list of disjoint regions of a buffer.
+//
+// The data feeder must produce the data of all regions back to back, in the order of the regions
+// (see vulkan::GatherFeeder). The regions are copied with a single vkCmdCopyBuffer with one
+// BufferCopy per region, surrounded by a single merged pre- and post-transfer barrier.
+//
+// Usage:
+//
+//   std::vector<vulkan::DirtyRanges::Range> ranges = dirty_ranges.take();
+//   auto copy_data_to_buffer_regions = statefultask::create<task::CopyDataToBufferRegions>(logical_device, vh_instance_buffer, ranges,
+//       vk::AccessFlagBits::eVertexAttributeRead, vk::PipelineStageFlagBits::eVertexInput,
+//       vk::AccessFlagBits::eVertexAttributeRead, vk::PipelineStageFlagBits::eVertexInput
+//       COMMA_CWDEBUG_ONLY(true));
+//   copy_data_to_buffer_regions->set_data_feeder(std::make_unique<vulkan::GatherFeeder>(instance_data.data(), std::move(ranges)));
+//   copy_data_to_buffer_regions->run(...);
+//
+class CopyDataToBufferRegions final : public CopyDataToGPU
+{
+ private:
+  vk::Buffer m_vh_target_buffer;
+  std::vector<vulkan::DirtyRanges::Range> m_regions;    // The target regions, sorted by offset.
+  std::vector<vk::DeviceSize> m_packed_offsets;         // The offset of each region in the packed data.
+  vk::AccessFlags m_current_buffer_access;
+  vk::PipelineStageFlags m_generating_stages;
+  vk::AccessFlags m_new_buffer_access;
+  vk::PipelineStageFlags m_consuming_stages;
+
+ public:
+  // Construct a CopyDataToBufferRegions object.
+  CopyDataToBufferRegions(vulkan::LogicalDevice const* logical_device,
+      vk::Buffer vh_target_buffer, std::vector<vulkan::DirtyRanges::Range> regions,
+      vk::AccessFlags current_buffer_access, vk::PipelineStageFlags generating_stages,
+      vk::AccessFlags new_buffer_access, vk::PipelineStageFlags consuming_stages
+      COMMA_CWDEBUG_ONLY(bool debug));
+
+  ~CopyDataToBufferRegions()
+  {
+    DoutEntering(dc::vulkan, "~CopyDataToBufferRegions() [" << this << "]");
+  }
+
+ private:
+  static uint32_t packed_size(std::vector<vulkan::DirtyRanges::Range> const& regions);
+
+  bool record_transfer(vulkan::TransferBatch& batch, Slice const& slice) override;
+  bool supports_streaming() const override { return true; }
+};
+
+} // namespace task
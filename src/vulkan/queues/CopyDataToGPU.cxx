@@ -1,7 +1,10 @@
 #include "sys.h"
 #include "CopyDataToGPU.h"
 #include "SynchronousWindow.h"
+#include "QueuePool.h"
+#include "FillChunks.h"
 #include "memory/StagingBuffer.h"
+#include <algorithm>
 
 namespace task {
 
@@ -10,6 +13,17 @@ CopyDataToGPU::~CopyDataToGPU()
   DoutEntering(dc::vulkan, "CopyDataToGPU::~CopyDataToGPU() [" << this << "]");
 }
 
+char const* CopyDataToGPU::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(staging_space_available);
+    AI_CASE_RETURN(chunks_filled);
+    AI_CASE_RETURN(data_ready);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
 char const* CopyDataToGPU::state_str_impl(state_type run_state) const
 {
   switch(run_state)
@@ -17,6 +31,9 @@ char const* CopyDataToGPU::state_str_impl(state_type run_state) const
     AI_CASE_RETURN(CopyDataToGPU_start);
     AI_CASE_RETURN(CopyDataToGPU_write);
     AI_CASE_RETURN(CopyDataToGPU_flush);
+    AI_CASE_RETURN(CopyDataToGPU_stream_slice);
+    AI_CASE_RETURN(CopyDataToGPU_stream_submit);
+    AI_CASE_RETURN(CopyDataToGPU_stream_finish);
     AI_CASE_RETURN(CopyDataToGPU_done);
   }
   return direct_base_type::state_str_impl(run_state);
@@ -41,10 +58,101 @@ void CopyDataToGPU::initialize_impl()
 
 void CopyDataToGPU::finish_impl()
 {
+  // In case we were aborted while waiting for chunks_filled: FillChunks tasks might still be writing to
+  // the staging range (or the target). Don't block a thread on that; let the last of them release the resources.
+  // Both stores and loads are sequentially consistent, so that at least one of us sees the other finish.
+  m_finished.store(true);
+  if (m_running_fill_tasks.load() == 0)
+    release_resources();
+}
+
+void CopyDataToGPU::fill_task_finished()
+{
+  if (m_running_fill_tasks.fetch_sub(1) != 1)
+    return;
+  // This was the last FillChunks task.
+  if (m_finished.load())
+    release_resources();
+  else
+    signal(chunks_filled);
+}
+
+void CopyDataToGPU::release_resources()
+{
+  if (m_resources_released.exchange(true, std::memory_order::relaxed))
+    return;
+  // In case we were aborted while writing directly to the target.
+  if (m_mapped_target)
+    unmap_target();
+  // Recycle the staging buffer range(s). Normally we get here after submit_finished was signaled,
+  // meaning that the timeline semaphore passed the signal value of the submit that used it.
+  if (m_staging_range.ring())
+    m_staging_range.ring()->release(m_staging_range);
+  for (vulkan::memory::StagingBufferRange& range : m_slices_in_flight)
+    if (range.ring())
+      range.ring()->release(range);
+  // In case we were aborted while waiting for staging_space_available.
+  m_submit_request.logical_device()->staging_buffer_ring().remove_waiter(this);
+  // In case we were aborted while waiting for data_ready.
+  if (m_data_feeder)
+    m_data_feeder->remove_waiter(this);
   if (m_resource_owner)
     m_resource_owner->m_task_counter_gate.decrement();
 }
 
+uint32_t CopyDataToGPU::ownership_transfer_queue_family(vulkan::TransferBatch const& batch) const
+{
+  // Without a resource owner we don't know who will consume the resource; it must be on the same queue family then.
+  if (!m_resource_owner)
+    return VK_QUEUE_FAMILY_IGNORED;
+  vulkan::QueueFamilyPropertiesIndex const graphics_queue_family = m_resource_owner->presentation_surface().graphics_queue().queue_family();
+  if (graphics_queue_family == batch.queue_family())
+    return VK_QUEUE_FAMILY_IGNORED;
+  return static_cast<uint32_t>(graphics_queue_family.get_value());
+}
+
+void CopyDataToGPU::release_finished_slices()
+{
+  // All slices are submitted to the same ImmediateSubmitQueue, so they finish in order.
+  int const finished_slices = m_finished_submits.load(std::memory_order::acquire);
+  while (m_released_slices < finished_slices)
+  {
+    vulkan::memory::StagingBufferRange& range = m_slices_in_flight.front();
+    if (range.ring())
+      range.ring()->release(range);
+    m_slices_in_flight.pop_front();
+    ++m_released_slices;
+  }
+}
+
+void CopyDataToGPU::fill_chunks(unsigned char* chunk_ptr, int begin, int end)
+{
+  DoutEntering(dc::vulkan, "CopyDataToGPU::fill_chunks(" << (void*)chunk_ptr << ", " << begin << ", " << end << ") [" << this << "]");
+  uint32_t const chunk_size = m_data_feeder->chunk_size();
+  int const number_of_chunks = end - begin;
+  // Don't use more tasks than there are threads, and make sure each task has enough work to be worth the overhead.
+  int const number_of_parts = std::min(vulkan::Application::instance().number_of_worker_threads(), number_of_chunks / min_chunks_per_fill_task);
+  if (number_of_parts <= 1)
+  {
+    m_data_feeder->fill_chunks(chunk_ptr, begin, end);
+    return;
+  }
+  int const chunks_per_part = (number_of_chunks + number_of_parts - 1) / number_of_parts;
+  // This task fills the last part itself.
+  m_running_fill_tasks.store(number_of_parts - 1, std::memory_order::relaxed);
+  int part_begin = begin;
+  for (int part = 0; part < number_of_parts - 1; ++part)
+  {
+    int const part_end = part_begin + chunks_per_part;
+    auto fill_task = statefultask::create<FillChunks>(m_data_feeder.get(), chunk_ptr, part_begin, part_end,
+        boost::intrusive_ptr<CopyDataToGPU>(this) COMMA_CWDEBUG_ONLY(mSMDebug));
+    fill_task->run(vulkan::Application::instance().low_priority_queue());
+    chunk_ptr += static_cast<size_t>(chunks_per_part) * chunk_size;
+    part_begin = part_end;
+  }
+  m_data_feeder->fill_chunks(chunk_ptr, part_begin, end);
+}
+
 void CopyDataToGPU::multiplex_impl(state_type run_state)
 {
   switch (run_state)
@@ -52,26 +160,68 @@ void CopyDataToGPU::multiplex_impl(state_type run_state)
     case CopyDataToGPU_start:
     {
       ZoneScopedN("CopyDataToGPU_start");
+      // Don't claim any staging space before the data is available.
+      if (!m_data_feeder->is_ready(this, data_ready))
+      {
+        wait(data_ready);
+        break;
+      }
       vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
-      // Create staging buffer and map its memory to copy data from the CPU.
-      m_staging_buffer = vulkan::memory::StagingBuffer(logical_device, m_data_size
-          COMMA_CWDEBUG_ONLY(debug_name_prefix("m_staging_buffer")));
+      // If the target memory is mappable (ReBAR, UMA or a software renderer) then write the data directly, skipping the staging copy and the submit.
+      if ((m_mapped_target = map_target()))
+      {
+        set_state(CopyDataToGPU_write);
+        break;
+      }
+      vulkan::memory::StagingBufferRing& staging_buffer_ring = logical_device->staging_buffer_ring();
+      if (supports_streaming() && m_data_size > streaming_slice_size)
+      {
+        // Upload the data in slices, submitting each slice while the next one is being filled.
+        // Streamed uploads are always larger than background_lane_threshold, so this uses the background lane.
+        vulkan::QueuePool& queue_pool = vulkan::QueuePool::instance(m_submit_request);
+        // Use the same ImmediateSubmitQueue for all slices, so that they finish in the order that they are submitted.
+        m_immediate_submit_queue_task = queue_pool.get_immediate_submit_queue_task(m_submit_request.lane() COMMA_CWDEBUG_ONLY(mSMDebug));
+        // Let the feeder produce up to a whole slice per batch.
+        m_data_feeder->set_max_batch_size(static_cast<int>(std::max(streaming_slice_size / m_data_feeder->chunk_size(), vk::DeviceSize{1})));
+        set_state(CopyDataToGPU_stream_slice);
+        break;
+      }
+      if (AI_UNLIKELY(!staging_buffer_ring.fits(m_data_size)))
+      {
+        // This will never fit in the ring. Create a dedicated staging buffer and map its memory to copy data from the CPU.
+        m_staging_buffer = vulkan::memory::StagingBuffer(logical_device, m_data_size
+            COMMA_CWDEBUG_ONLY(debug_name_prefix("m_staging_buffer")));
+        m_staging_range = vulkan::memory::StagingBufferRange(m_staging_buffer);
+      }
+      else if (!staging_buffer_ring.allocate(m_data_size, m_staging_range, this, staging_space_available))
+      {
+        // Not enough free space in the ring at the moment; try again once another copy released its range.
+        wait(staging_space_available);
+        break;
+      }
       set_state(CopyDataToGPU_write);
     }
     [[fallthrough]];
     case CopyDataToGPU_write:
     {
       ZoneScopedN("CopyDataToGPU_write");
-      // Copy data to the staging buffer.
-      unsigned char* dst = static_cast<unsigned char*>(m_staging_buffer.m_pointer);
+      // Copy data to the staging buffer (or directly to the target).
+      unsigned char* dst = m_mapped_target ? m_mapped_target : m_staging_range.pointer();
       uint32_t const chunk_size = m_data_feeder->chunk_size();
       int const chunk_count = m_data_feeder->chunk_count();
-      int chunks;
-      for (int total_chunks = 0; total_chunks < chunk_count; total_chunks += chunks)
+      if (m_data_feeder->is_range_addressable())
+        fill_chunks(dst, 0, chunk_count);
+      else
       {
-        chunks = m_data_feeder->next_batch();
-        m_data_feeder->get_chunks(dst);
-        dst += chunks * chunk_size;
+        // Everything fits in the staging buffer, so the feeder may produce all chunks in a single batch.
+        m_data_feeder->set_max_batch_size(chunk_count);
+        int chunks;
+        for (int total_chunks = 0; total_chunks < chunk_count; total_chunks += chunks)
+        {
+          chunks = m_data_feeder->next_batch();
+          m_data_feeder->get_chunks(dst);
+          dst += chunks * chunk_size;
+        }
       }
       set_state(CopyDataToGPU_flush);
     }
@@ -79,18 +229,155 @@ void CopyDataToGPU::multiplex_impl(state_type run_state)
     case CopyDataToGPU_flush:
     {
       ZoneScopedN("CopyDataToGPU_flush");
+      // Wait until all FillChunks tasks finished, if any.
+      if (m_running_fill_tasks.load(std::memory_order::acquire) > 0)
+      {
+        wait(chunks_filled);
+        break;
+      }
+      if (m_mapped_target)
+      {
+        // Host writes are made available to the device by the next queue submission; there is nothing to submit ourselves.
+        unmap_target();
+        m_mapped_target = nullptr;
+        set_state(CopyDataToGPU_done);
+        break;
+      }
       vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
       // Once everything is written to the staging buffer and flush.
-      logical_device->flush_mapped_allocation(m_staging_buffer.m_vh_allocation, 0, VK_WHOLE_SIZE);
-      // Set callback to record command buffer to virtual function `record_command_buffer`,
+      logical_device->flush_mapped_allocation(m_staging_range.vh_allocation(), m_staging_range.offset(), m_staging_range.size());
+      // Set callback to add our barriers and copy commands to a batch, using virtual function `record_transfer`,
       // the derived class is responsible for appropriate commands to copy the staging buffer to the right destination.
-      m_submit_request.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){
-        record_command_buffer(command_buffer);
+      // This allows ImmediateSubmitQueue to record many small copies into a single command buffer.
+      m_submit_request.set_batch_record_function([this](vulkan::TransferBatch& batch){
+        return record_transfer(batch, { m_staging_range.vh_buffer(), m_staging_range.offset(), 0, m_data_size });
       });
       // Finish the rest of this "immediate submit" by passing control to the base class.
       set_state(ImmediateSubmit_start);
       break;
     }
+    case CopyDataToGPU_stream_slice:
+    {
+      ZoneScopedN("CopyDataToGPU_stream_slice");
+      release_finished_slices();
+      // Don't have more than max_slices_in_flight slices in flight.
+      if (m_slices_in_flight.size() == max_slices_in_flight)
+      {
+        wait(submit_finished);
+        break;
+      }
+      vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
+      vulkan::memory::StagingBufferRing& staging_buffer_ring = logical_device->staging_buffer_ring();
+      uint32_t const chunk_size = m_data_feeder->chunk_size();
+      bool const range_addressable = m_data_feeder->is_range_addressable();
+      vk::DeviceSize slice_size;
+      if (range_addressable)
+        slice_size = std::min(static_cast<vk::DeviceSize>(m_data_size) - m_data_offset, std::max(streaming_slice_size / chunk_size, vk::DeviceSize{1}) * chunk_size);
+      else
+      {
+        if (m_pending_batch == 0)
+          m_pending_batch = m_data_feeder->next_batch();
+        // A slice must be able to contain at least the next batch.
+        slice_size = std::min(static_cast<vk::DeviceSize>(m_data_size) - m_data_offset,
+            std::max(streaming_slice_size, static_cast<vk::DeviceSize>(m_pending_batch) * chunk_size));
+      }
+      if (AI_LIKELY(staging_buffer_ring.fits(slice_size)))
+      {
+        if (!staging_buffer_ring.allocate(slice_size, m_staging_range, this, staging_space_available))
+        {
+          // Our own slices that are in flight might be the ones using the space, so also wake up when one of those finished.
+          wait(staging_space_available|submit_finished);
+          break;
+        }
+      }
+      else
+      {
+        // The feeder returns batches that are too large for the ring; fall back to a dedicated staging buffer,
+        // which can only be replaced once it is no longer in use.
+        if (!m_slices_in_flight.empty())
+        {
+          wait(submit_finished);
+          break;
+        }
+        m_staging_buffer = vulkan::memory::StagingBuffer(logical_device, slice_size
+            COMMA_CWDEBUG_ONLY(debug_name_prefix("m_staging_buffer")));
+        m_staging_range = vulkan::memory::StagingBufferRange(m_staging_buffer);
+      }
+      unsigned char* dst = m_staging_range.pointer();
+      if (range_addressable)
+      {
+        // Fill the whole slice, possibly in parallel.
+        int const chunks = slice_size / chunk_size;
+        fill_chunks(dst, m_chunks_done, m_chunks_done + chunks);
+        m_chunks_done += chunks;
+        m_slice_used = slice_size;
+      }
+      else
+      {
+        // Fill the slice with as many whole batches as fit.
+        int const chunk_count = m_data_feeder->chunk_count();
+        vk::DeviceSize used = 0;
+        for (;;)
+        {
+          vk::DeviceSize const batch_size = static_cast<vk::DeviceSize>(m_pending_batch) * chunk_size;
+          if (used + batch_size > slice_size)
+            break;
+          m_data_feeder->get_chunks(dst + used);
+          used += batch_size;
+          m_chunks_done += m_pending_batch;
+          m_pending_batch = 0;
+          if (m_chunks_done == chunk_count)
+            break;
+          m_pending_batch = m_data_feeder->next_batch();
+        }
+        m_slice_used = used;
+      }
+      set_state(CopyDataToGPU_stream_submit);
+      [[fallthrough]];
+    }
+    case CopyDataToGPU_stream_submit:
+    {
+      ZoneScopedN("CopyDataToGPU_stream_submit");
+      // Wait until all FillChunks tasks finished, if any.
+      if (m_running_fill_tasks.load(std::memory_order::acquire) > 0)
+      {
+        wait(chunks_filled);
+        break;
+      }
+      vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
+      logical_device->flush_mapped_allocation(m_staging_range.vh_allocation(), m_staging_range.offset(), m_slice_used);
+      // Submit the slice.
+      vulkan::ImmediateSubmitRequest slice_request(logical_device, this);
+      slice_request.set_queue_request_key(m_submit_request.queue_request_key());
+      slice_request.set_lane(m_submit_request.lane());
+      slice_request.set_byte_count(m_slice_used);
+      slice_request.set_batch_record_function([this, slice = Slice{m_staging_range.vh_buffer(), m_staging_range.offset(), m_data_offset, m_slice_used}](vulkan::TransferBatch& batch){
+        return record_transfer(batch, slice);
+      });
+      m_data_offset += m_slice_used;
+      m_slices_in_flight.push_back(m_staging_range);
+      m_staging_range.reset();
+      m_immediate_submit_queue_task->submit(std::move(slice_request));
+      // Continue with the next slice, if any.
+      if (m_chunks_done < m_data_feeder->chunk_count())
+      {
+        set_state(CopyDataToGPU_stream_slice);
+        break;
+      }
+      set_state(CopyDataToGPU_stream_finish);
+      [[fallthrough]];
+    }
+    case CopyDataToGPU_stream_finish:
+    {
+      release_finished_slices();
+      if (!m_slices_in_flight.empty())
+      {
+        wait(submit_finished);
+        break;
+      }
+      set_state(CopyDataToGPU_done);
+      [[fallthrough]];
+    }
     case CopyDataToGPU_done:
     {
       ZoneScopedN("CopyDataToGPU_done");
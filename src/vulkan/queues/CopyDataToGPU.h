@@ -1,22 +1,60 @@
 #pragma once
 
 #include "ImmediateSubmit.h"
+#include "TransferBatch.h"
 #include "memory/StagingBuffer.h"
+#include "memory/StagingBufferRing.h"
 #include "memory/DataFeeder.h"
 #include "statefultask/RunningTasksTracker.h"
 #include <vector>
+#include <deque>
+#include <atomic>
 
 namespace task {
 
 class CopyDataToGPU : public ImmediateSubmit
 {
+ public:
+  static constexpr condition_type staging_space_available = 2;
+  static constexpr condition_type chunks_filled = 4;
+  static constexpr condition_type data_ready = 8;
+
+  static constexpr vk::DeviceSize streaming_slice_size = 4 * 1024 * 1024;     // Uploads larger than this are streamed, if the derived class supports it.
+  static constexpr vk::DeviceSize background_lane_threshold = 256 * 1024;     // Uploads of at least this many bytes are bulk transfers and use the background lane.
+  static constexpr int max_slices_in_flight = 2;                              // Fill the next slice while the previous one is being transferred.
+  static constexpr int min_chunks_per_fill_task = 4096;                       // Only fill range-addressable data in parallel when each task gets at least this many chunks.
+
+  // Describes (part of) the data that is copied from a staging buffer.
+  struct Slice
+  {
+    vk::Buffer m_vh_staging_buffer;             // The staging buffer that contains the data.
+    vk::DeviceSize m_staging_offset;            // The offset of the data into m_vh_staging_buffer.
+    vk::DeviceSize m_data_offset;               // The offset of this slice relative to the start of all data.
+    vk::DeviceSize m_size;                      // The size of this slice in bytes.
+  };
+
  protected:
   std::unique_ptr<vulkan::DataFeeder> m_data_feeder;
-  vulkan::memory::StagingBuffer m_staging_buffer;
+  vulkan::memory::StagingBuffer m_staging_buffer;               // Only used when the data (or a batch of it) doesn't fit in the staging buffer ring of the logical device.
+  vulkan::memory::StagingBufferRange m_staging_range;           // The range of the staging buffer (ring) that is used for this copy (or the current slice).
+  unsigned char* m_mapped_target{};                             // Non-null if the data is written directly into the (host visible) target memory.
   uint32_t m_data_size;
   SynchronousWindow* m_resource_owner;                          // If any resources that this task uses are part of a window, then this should be set.
   statefultask::RunningTasksTracker::index_type m_index;        // Our index, if added to m_resource_owner.
 
+  // Streaming.
+  std::deque<vulkan::memory::StagingBufferRange> m_slices_in_flight;   // Ranges of slices that were submitted but not finished yet, in order of submission.
+  int m_released_slices{};                                      // The number of finished slices whose range was released.
+  int m_chunks_done{};                                          // The number of chunks that were written to a staging buffer so far.
+  int m_pending_batch{};                                        // The number of chunks returned by the last call to next_batch() that weren't written yet.
+  vk::DeviceSize m_data_offset{};                               // The number of bytes that were submitted so far.
+  vk::DeviceSize m_slice_used{};                                // The number of bytes written to the current slice.
+
+  // Parallel fill.
+  std::atomic<int> m_running_fill_tasks{};                      // The number of FillChunks tasks that didn't finish yet.
+  std::atomic<bool> m_finished{};                               // Set by finish_impl; from then on the last FillChunks task releases the resources.
+  std::atomic<bool> m_resources_released{};                     // Set by the first call to release_resources.
+
  protected:
   using direct_base_type = ImmediateSubmit;
 
@@ -25,6 +63,9 @@ class CopyDataToGPU : public ImmediateSubmit
     CopyDataToGPU_start = direct_base_type::state_end,
     CopyDataToGPU_write,
     CopyDataToGPU_flush,
+    CopyDataToGPU_stream_slice,
+    CopyDataToGPU_stream_submit,
+    CopyDataToGPU_stream_finish,
     CopyDataToGPU_done
   };
 
@@ -38,6 +79,10 @@ class CopyDataToGPU : public ImmediateSubmit
     m_data_size(data_size), m_resource_owner(nullptr), m_index(statefultask::RunningTasksTracker::s_aborted)
   {
     DoutEntering(dc::vulkan, "CopyDataToGPU(" << logical_device << ", " << data_size << ")");
+    m_submit_request.set_byte_count(data_size);
+    // Keep bulk transfers (like most texture uploads) out of the way of small, latency critical ones.
+    if (data_size >= background_lane_threshold)
+      m_submit_request.set_lane(vulkan::ImmediateSubmitRequest::Lane::background);
   }
 
   void set_resource_owner(SynchronousWindow* resource_owner)
@@ -51,13 +96,48 @@ class CopyDataToGPU : public ImmediateSubmit
   }
 
  private:
-  virtual void record_command_buffer(vulkan::handle::CommandBuffer command_buffer) = 0;
+  // Add the barriers and copy commands of slice to batch. Return false without adding anything if batch already touches the target.
+  // Unless supports_streaming() returns true, slice always covers all data.
+  virtual bool record_transfer(vulkan::TransferBatch& batch, Slice const& slice) = 0;
+
+  // Return true if record_transfer can handle slices that cover only part of the data.
+  virtual bool supports_streaming() const { return false; }
+
+  // Upload policy: return a host pointer to the start of the destination if the data can be written there directly
+  // (because the target memory is host visible), or nullptr if the data must go through a staging buffer.
+  virtual unsigned char* map_target() { return nullptr; }
+
+  // Called after all data was written to the pointer returned by map_target().
+  virtual void unmap_target() { }
+
+ protected:
+  // Returns the queue family index of the graphics queue of m_resource_owner if batch will be submitted to a
+  // different queue family, in which case the ownership of the target must be transferred; otherwise
+  // returns VK_QUEUE_FAMILY_IGNORED.
+  uint32_t ownership_transfer_queue_family(vulkan::TransferBatch const& batch) const;
+
+ private:
+
+  // Release the staging buffer ranges of slices that finished.
+  void release_finished_slices();
+
+  // Fill chunks [begin, end> of a range-addressable data feeder, spreading the work over the thread pool.
+  // If this returns with m_running_fill_tasks non-zero then wait for chunks_filled before using the data.
+  void fill_chunks(unsigned char* chunk_ptr, int begin, int end);
+
+  // Release the staging memory, the target mapping and our registrations. Only the first call does anything.
+  void release_resources();
+
+ public:
+  // Called by each FillChunks task when it finished writing its chunks.
+  void fill_task_finished();
 
  protected:
   ~CopyDataToGPU() override;
 
   void initialize_impl() override;
   void finish_impl() override;
+  char const* condition_str_impl(condition_type condition) const override;
   char const* state_str_impl(state_type run_state) const override;
   void multiplex_impl(state_type run_state) override;
 };
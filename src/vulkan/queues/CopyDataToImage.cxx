@@ -1,16 +1,29 @@
 #include "sys.h"
 #include "CopyDataToImage.h"
+#include "SynchronousWindow.h"
+#include <algorithm>
 
 namespace task {
 
-void CopyDataToImage::record_command_buffer(vulkan::handle::CommandBuffer command_buffer)
+bool CopyDataToImage::record_transfer(vulkan::TransferBatch& batch, Slice const& slice)
 {
-  DoutEntering(dc::vulkan, "CopyDataToImage::record_command_buffer(" << command_buffer << ")");
+  // Images are not streamed.
+  ASSERT(slice.m_data_offset == 0 && slice.m_size == m_data_size);
 
-  command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+  DoutEntering(dc::vulkan, "CopyDataToImage::record_transfer(" << &batch << ")");
 
+  // Each image can only be transitioned once per batch.
+  if (batch.touches(m_vh_target_image))
+    return false;
+
+  // If the batch is submitted to a different queue family than the one that uses the image, then ownership must be transferred.
+  uint32_t const dst_queue_family = ownership_transfer_queue_family(batch);
+  bool const transfer_ownership = dst_queue_family != VK_QUEUE_FAMILY_IGNORED;
+
+  // When transferring ownership the old contents are overwritten, so there is nothing to acquire: the previous
+  // accesses happened on a different queue (and must have been synchronized with a semaphore by the caller).
   vk::ImageMemoryBarrier pre_transfer_image_memory_barrier{
-    .srcAccessMask = m_current_image_access,
+    .srcAccessMask = transfer_ownership ? vk::AccessFlags(0) : m_current_image_access,
     .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
     .oldLayout = m_current_image_layout,
     .newLayout = vk::ImageLayout::eTransferDstOptimal,
@@ -19,44 +32,144 @@ void CopyDataToImage::record_command_buffer(vulkan::handle::CommandBuffer comman
     .image = m_vh_target_image,
     .subresourceRange = m_image_subresource_range
   };
-  command_buffer->pipelineBarrier(m_generating_stages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0), {}, {}, { pre_transfer_image_memory_barrier });
+  batch.add_pre_transfer_barrier(transfer_ownership ? vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe) : m_generating_stages,
+      pre_transfer_image_memory_barrier);
+
+  // Copy each level that is contained in the data from where it starts in the staging buffer.
+  uint32_t const level_count = m_generate_mipmaps ? 1 : m_image_subresource_range.levelCount;
+  auto level_blocks = [this](uint32_t level) -> uint64_t {
+    uint64_t const blocks_x = (std::max(m_extent.width >> level, 1u) + m_block_extent.width - 1) / m_block_extent.width;
+    uint64_t const blocks_y = (std::max(m_extent.height >> level, 1u) + m_block_extent.height - 1) / m_block_extent.height;
+    return blocks_x * blocks_y * m_image_subresource_range.layerCount;
+  };
+  vk::DeviceSize block_size = m_block_size;
+  if (block_size == 0)
+  {
+    uint64_t block_count = 0;
+    for (uint32_t level = 0; level < level_count; ++level)
+      block_count += level_blocks(level);
+    // The data must contain exactly level_count levels.
+    ASSERT(m_data_size % block_count == 0);
+    block_size = m_data_size / block_count;
+  }
 
   std::vector<vk::BufferImageCopy> buffer_image_copy;
-  buffer_image_copy.reserve(m_image_subresource_range.levelCount);
-  for (uint32_t i = m_image_subresource_range.baseMipLevel; i < m_image_subresource_range.baseMipLevel + m_image_subresource_range.levelCount; ++i)
+  buffer_image_copy.reserve(level_count);
+  vk::DeviceSize level_offset = 0;
+  for (uint32_t level = 0; level < level_count; ++level)
   {
+    vk::Extent3D const level_extent{
+      .width = std::max(m_extent.width >> level, 1u),
+      .height = std::max(m_extent.height >> level, 1u),
+      .depth = 1
+    };
     buffer_image_copy.emplace_back(vk::BufferImageCopy{
-      .bufferOffset = 0,
+      .bufferOffset = slice.m_staging_offset + level_offset,
       .bufferRowLength = 0,
       .bufferImageHeight = 0,
       .imageSubresource = vk::ImageSubresourceLayers{
         .aspectMask = m_image_subresource_range.aspectMask,
-        .mipLevel = i,
+        .mipLevel = m_image_subresource_range.baseMipLevel + level,
         .baseArrayLayer = m_image_subresource_range.baseArrayLayer,
         .layerCount = m_image_subresource_range.layerCount
       },
       .imageOffset = vk::Offset3D{},
-      .imageExtent = vk::Extent3D{
-        .width = m_extent.width,
-        .height = m_extent.height,
-        .depth = 1
-      }
+      .imageExtent = level_extent
     });
+    level_offset += level_blocks(level) * block_size;
   }
-  command_buffer->copyBufferToImage(m_staging_buffer.m_vh_buffer, m_vh_target_image, vk::ImageLayout::eTransferDstOptimal, buffer_image_copy);
+  batch.copy_buffer_to_image(slice.m_vh_staging_buffer, m_vh_target_image, vk::ImageLayout::eTransferDstOptimal, buffer_image_copy);
 
-  vk::ImageMemoryBarrier post_transfer_image_memory_barrier{
+  // The layouts of the levels after the transfer and the barriers that transition them to m_new_image_layout.
+  // Without mip generation all levels are still in eTransferDstOptimal.
+  vulkan::MipmapGeneration const mipmap_generation{m_vh_target_image, m_extent, m_image_subresource_range};
+  bool const generate_mipmaps = m_generate_mipmaps && m_image_subresource_range.levelCount > 1;
+  // Blitting requires a queue with graphics capability; if the batch is submitted to a dedicated transfer queue
+  // then the mip chain is generated by the resource owner, after acquiring the image.
+  bool const generate_on_batch_queue = generate_mipmaps &&
+    (m_submit_request.logical_device()->queue_family_flags(batch.queue_family()) & vulkan::QueueFlagBits::eGraphics);
+  if (generate_on_batch_queue)
+    batch.generate_mipmaps(mipmap_generation);
+
+  if (!transfer_ownership)
+  {
+    if (generate_on_batch_queue)
+    {
+      for (vk::ImageMemoryBarrier const& barrier : mipmap_generation.final_barriers(
+          vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite, m_new_image_access, m_new_image_layout))
+        batch.add_post_transfer_barrier(m_consuming_stages, barrier);
+      return true;
+    }
+    // A queue family without graphics capability can't be the family of the resource owner.
+    ASSERT(!generate_mipmaps);
+    vk::ImageMemoryBarrier post_transfer_image_memory_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = m_new_image_access,
+      .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+      .newLayout = m_new_image_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_vh_target_image,
+      .subresourceRange = m_image_subresource_range
+    };
+    batch.add_post_transfer_barrier(m_consuming_stages, post_transfer_image_memory_barrier);
+    return true;
+  }
+
+  // Release ownership to the graphics queue family of the resource owner.
+  // The layout transition is part of both the release and the acquire barrier (and executed once).
+  uint32_t const src_queue_family = static_cast<uint32_t>(batch.queue_family().get_value());
+  if (generate_on_batch_queue)
+  {
+    for (vk::ImageMemoryBarrier const& barrier : mipmap_generation.final_barriers(
+        vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite, vk::AccessFlags(0), m_new_image_layout, src_queue_family, dst_queue_family))
+      batch.add_release_barrier(barrier);
+    // Only publish the acquire after the batch was submitted, so that no frame waits for a signal value that isn't queued yet.
+    batch.after_submit([resource_owner = m_resource_owner, consuming_stages = m_consuming_stages,
+        acquire_barriers = mipmap_generation.final_barriers(vk::AccessFlags(0), m_new_image_access, m_new_image_layout, src_queue_family, dst_queue_family),
+        vh_timeline_semaphore = batch.vh_timeline_semaphore(), signal_value = batch.signal_value()](){
+      for (vk::ImageMemoryBarrier const& barrier : acquire_barriers)
+        resource_owner->add_acquire_barrier(consuming_stages, barrier, vh_timeline_semaphore, signal_value);
+    });
+    return true;
+  }
+
+  // If the mip chain still has to be generated, then ownership is transferred without changing the layout.
+  vk::ImageLayout const new_layout = generate_mipmaps ? vk::ImageLayout::eTransferDstOptimal : m_new_image_layout;
+  vk::ImageMemoryBarrier release_image_memory_barrier{
     .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
-    .dstAccessMask = m_new_image_access,
+    .dstAccessMask = vk::AccessFlags(0),                // Ignored for a release.
     .oldLayout = vk::ImageLayout::eTransferDstOptimal,
-    .newLayout = m_new_image_layout,
-    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .newLayout = new_layout,
+    .srcQueueFamilyIndex = src_queue_family,
+    .dstQueueFamilyIndex = dst_queue_family,
+    .image = m_vh_target_image,
+    .subresourceRange = m_image_subresource_range
+  };
+  batch.add_release_barrier(release_image_memory_barrier);
+
+  // And let the resource owner acquire it again, once this batch finished executing.
+  vk::ImageMemoryBarrier acquire_image_memory_barrier{
+    .srcAccessMask = vk::AccessFlags(0),                // Ignored for an acquire.
+    .dstAccessMask = generate_mipmaps ? vk::AccessFlags(vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite) : m_new_image_access,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = new_layout,
+    .srcQueueFamilyIndex = src_queue_family,
+    .dstQueueFamilyIndex = dst_queue_family,
     .image = m_vh_target_image,
     .subresourceRange = m_image_subresource_range
   };
-  command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, m_consuming_stages, vk::DependencyFlags(0), {}, {}, { post_transfer_image_memory_barrier });
-  command_buffer->end();
+  // Only publish the acquire after the batch was submitted, so that no frame waits for a signal value that isn't queued yet.
+  batch.after_submit([resource_owner = m_resource_owner, generate_mipmaps, acquire_image_memory_barrier, mipmap_generation,
+      consuming_stages = m_consuming_stages, new_image_access = m_new_image_access, new_image_layout = m_new_image_layout,
+      vh_timeline_semaphore = batch.vh_timeline_semaphore(), signal_value = batch.signal_value()](){
+    if (generate_mipmaps)
+      resource_owner->add_acquire_barrier_and_mipmap_generation(acquire_image_memory_barrier, vh_timeline_semaphore, signal_value,
+          mipmap_generation, consuming_stages, new_image_access, new_image_layout);
+    else
+      resource_owner->add_acquire_barrier(consuming_stages, acquire_image_memory_barrier, vh_timeline_semaphore, signal_value);
+  });
+  return true;
 }
 
 } // namespace task
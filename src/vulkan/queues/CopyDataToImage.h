@@ -17,6 +17,9 @@ class CopyDataToImage final : public CopyDataToGPU
   vk::ImageLayout m_new_image_layout;
   vk::AccessFlags m_new_image_access;
   vk::PipelineStageFlags m_consuming_stages;
+  bool m_generate_mipmaps{};                    // If true, the data only contains the first level; the other levels are generated with vkCmdBlitImage.
+  vk::Extent2D m_block_extent{1, 1};            // The extent of one texel block of the image format.
+  uint32_t m_block_size{};                      // The size of one texel block in bytes, or zero to derive it from the data size.
 
  public:
   // Construct a CopyDataToImage object.
@@ -35,8 +38,18 @@ class CopyDataToImage final : public CopyDataToGPU
         generating_stages << ", " << new_image_layout << ", " << new_image_access << ", " << consuming_stages << ")");
   }
 
+  // Generate all but the first level of the subresource range on the GPU. The image must have been created with
+  // usage eTransferSrc and its format must support linear blits (see LogicalDevice::supports_linear_blit).
+  //
+  // Without this, the data must contain all levels of the subresource range, one after another (level 0 first),
+  // each level containing all layers; see MipmapFeeder for a feeder that generates those on the CPU.
+  void set_generate_mipmaps(bool generate_mipmaps) { m_generate_mipmaps = generate_mipmaps; }
+
+  // Must be called for block compressed formats, for example with ({4, 4}, 16) for BC7.
+  void set_texel_block(vk::Extent2D block_extent, uint32_t block_size) { m_block_extent = block_extent; m_block_size = block_size; }
+
  private:
-  void record_command_buffer(vulkan::handle::CommandBuffer command_buffer) override;
+  bool record_transfer(vulkan::TransferBatch& batch, Slice const& slice) override;
 };
 
 } // namespace task
@@ -0,0 +1,211 @@
+#include "sys.h"
+#include "Defragment.h"
+#include "SynchronousWindow.h"
+#include "LogicalDevice.h"
+#include <boost/intrusive_ptr.hpp>
+#include <Tracy.hpp>
+
+namespace task {
+
+namespace {
+
+void add_to(VmaDefragmentationStats& sum, VmaDefragmentationStats const& stats)
+{
+  sum.bytesMoved += stats.bytesMoved;
+  sum.bytesFreed += stats.bytesFreed;
+  sum.allocationsMoved += stats.allocationsMoved;
+  sum.deviceMemoryBlocksFreed += stats.deviceMemoryBlocksFreed;
+}
+
+// The number of bytes that are allocated in blocks but not used by any allocation.
+vk::DeviceSize unused_bytes(VmaTotalStatistics const& total_statistics)
+{
+  return total_statistics.total.statistics.blockBytes - total_statistics.total.statistics.allocationBytes;
+}
+
+} // namespace
+
+Defragment::Defragment(SynchronousWindow* owner COMMA_CWDEBUG_ONLY(bool debug)) :
+  direct_base_type(owner COMMA_CWDEBUG_ONLY(debug)), m_logical_device(owner->logical_device())
+{
+  DoutEntering(dc::vulkan, "Defragment(" << owner << ") [" << this << "]");
+}
+
+Defragment::~Defragment()
+{
+  DoutEntering(dc::statefultask(mSMDebug), "Defragment::~Defragment() [" << this << "]");
+}
+
+char const* Defragment::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(Defragment_begin);
+    AI_CASE_RETURN(Defragment_pass);
+    AI_CASE_RETURN(Defragment_end_pass);
+    AI_CASE_RETURN(Defragment_end);
+  }
+  return direct_base_type::state_str_impl(run_state);
+}
+
+char const* Defragment::task_name_impl() const
+{
+  return "Defragment";
+}
+
+void Defragment::initialize_impl()
+{
+  direct_base_type::initialize_impl();
+  // Be aborted when the owning window closes (after it waited for all its frames to complete).
+  m_index = owning_window()->m_dependent_tasks.add(this);
+  // Defragment the default pools first, then the custom pools that small buffers are allocated from.
+  m_vh_pools.push_back(VK_NULL_HANDLE);
+  std::vector<VmaPool> const buffer_pools = m_logical_device->buffer_pools().pools();
+  m_vh_pools.insert(m_vh_pools.end(), buffer_pools.begin(), buffer_pools.end());
+}
+
+vk::Result Defragment::end_pass()
+{
+  for (Move const& move : m_moves)
+    move.m_relocatable->destroy_old();
+  vk::Result res = allocator().end_defragmentation_pass(m_context, &m_pass_info);
+  m_in_pass = false;
+  vulkan::memory::ResidencyManager& residency_manager = m_logical_device->residency_manager();
+  for (Move const& move : m_moves)
+    residency_manager.moved(move.m_vh_allocation);
+  m_moves.clear();
+  return res;
+}
+
+void Defragment::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case Defragment_begin:
+    {
+      ZoneScopedN("Defragment_begin");
+      if (m_pool_index == 0)
+        m_statistics_before = allocator().calculate_statistics();
+      VmaDefragmentationInfo const defragmentation_info{
+        .flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+        .pool = m_vh_pools[m_pool_index],
+        .maxBytesPerPass = max_bytes_per_pass,
+        .maxAllocationsPerPass = max_allocations_per_pass
+      };
+      vk::Result res = allocator().begin_defragmentation(defragmentation_info, &m_context);
+      if (res != vk::Result::eSuccess)
+      {
+        Dout(dc::warning, "vmaBeginDefragmentation returned " << res);
+        abort();
+        break;
+      }
+      set_state(Defragment_pass);
+      [[fallthrough]];
+    }
+    case Defragment_pass:
+    {
+      ZoneScopedN("Defragment_pass");
+      if (allocator().begin_defragmentation_pass(m_context, &m_pass_info) == vk::Result::eSuccess)
+      {
+        // Nothing (left) to move.
+        set_state(Defragment_end);
+        break;
+      }
+      m_in_pass = true;
+      vulkan::memory::ResidencyManager const& residency_manager = m_logical_device->residency_manager();
+      for (uint32_t i = 0; i < m_pass_info.moveCount; ++i)
+      {
+        VmaDefragmentationMove& move = m_pass_info.pMoves[i];
+        vulkan::memory::Relocatable* relocatable = residency_manager.relocatable(move.srcAllocation);
+        // Only resources that are used by this window can be switched over from here.
+        if (!relocatable || relocatable->owning_window() != owning_window() ||
+            !relocatable->create_relocated(move.srcAllocation, move.dstTmpAllocation))
+        {
+          // This allocation can't be moved (now); let VMA keep it where it is.
+          move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+          continue;
+        }
+        m_moves.push_back({relocatable, move.srcAllocation});
+      }
+      set_state(Defragment_end_pass);
+      if (m_moves.empty())
+        break;
+      // From the next frame on, use the new resources.
+      for (Move const& move : m_moves)
+        move.m_relocatable->switch_to_relocated();
+      // Copy the contents at the start of the next frame, on the graphics queue (that is used by all frames of this window).
+      m_copy_frame = 0;
+      owning_window()->add_relocations([self = boost::intrusive_ptr<Defragment>(this)](vk::CommandBuffer vh_command_buffer, uint64_t frame_serial){
+        for (Move const& move : self->m_moves)
+          move.m_relocatable->record_relocation(vh_command_buffer);
+        self->m_copy_frame = frame_serial;
+      });
+      yield_frame(1);
+      break;
+    }
+    case Defragment_end_pass:
+    {
+      ZoneScopedN("Defragment_end_pass");
+      // Wait until the frame that copied the resources, and therefore every frame that might use the old resources, completed.
+      if (!m_moves.empty() && (m_copy_frame == 0 || !m_logical_device->residency_manager().is_completed(m_copy_frame)))
+      {
+        yield_frame(1);
+        break;
+      }
+      if (end_pass() == vk::Result::eSuccess)
+      {
+        set_state(Defragment_end);
+        break;
+      }
+      // Do at most one pass per frame.
+      set_state(Defragment_pass);
+      yield_frame(1);
+      break;
+    }
+    case Defragment_end:
+    {
+      ZoneScopedN("Defragment_end");
+      VmaDefragmentationStats defragmentation_stats;
+      allocator().end_defragmentation(m_context, &defragmentation_stats);
+      m_context = nullptr;
+      add_to(m_defragmentation_stats, defragmentation_stats);
+      if (++m_pool_index < m_vh_pools.size())
+      {
+        // Continue with the next pool in the next frame.
+        set_state(Defragment_begin);
+        yield_frame(1);
+        break;
+      }
+      m_statistics_after = allocator().calculate_statistics();
+      Dout(dc::notice, "Defragmentation moved " << m_defragmentation_stats.allocationsMoved << " allocations (" <<
+          m_defragmentation_stats.bytesMoved << " bytes) and freed " << m_defragmentation_stats.deviceMemoryBlocksFreed <<
+          " blocks (" << m_defragmentation_stats.bytesFreed << " bytes). Unused bytes in blocks: " <<
+          unused_bytes(m_statistics_before) << " (" << m_statistics_before.total.statistics.blockCount << " blocks, " <<
+          m_statistics_before.total.statistics.allocationCount << " allocations) --> " <<
+          unused_bytes(m_statistics_after) << " (" << m_statistics_after.total.statistics.blockCount << " blocks, " <<
+          m_statistics_after.total.statistics.allocationCount << " allocations).");
+      finish();
+      break;
+    }
+    default:
+      direct_base_type::multiplex_impl(run_state);
+      break;
+  }
+}
+
+void Defragment::finish_impl()
+{
+  // In case we were aborted. That only happens when the owning window closes, after it waited for all of its frames
+  // to complete: the old resources of the current pass are no longer in use.
+  if (m_in_pass)
+    end_pass();
+  if (m_context)
+  {
+    VmaDefragmentationStats defragmentation_stats;
+    allocator().end_defragmentation(m_context, &defragmentation_stats);
+    add_to(m_defragmentation_stats, defragmentation_stats);
+  }
+  owning_window()->m_dependent_tasks.remove(m_index);
+}
+
+} // namespace task
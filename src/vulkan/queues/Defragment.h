@@ -0,0 +1,94 @@
+#pragma once
+
+#include "SynchronousTask.h"
+#include "memory/ResidencyManager.h"
+#include "statefultask/RunningTasksTracker.h"
+#include <vector>
+
+namespace vulkan {
+class LogicalDevice;
+} // namespace vulkan
+
+namespace task {
+
+// Incremental defragmentation of the device memory of the logical device of a window.
+//
+// Runs vmaBeginDefragmentation passes of at most max_bytes_per_pass bytes / max_allocations_per_pass allocations,
+// at most one pass per frame; first for the default pools and then for each of the custom memory::BufferPools
+// (VMA defragments one pool per defragmentation context). Only allocations that have a Relocatable registered with the ResidencyManager
+// that belongs to the owning window are moved; all other moves that VMA proposes are ignored.
+//
+// This is a SynchronousTask: it runs in the render loop of the owning window, between frames. The resources of a pass
+// are switched over to their new memory at once and the copies are recorded at the start of the next frame, on the
+// graphics queue of the window (see SynchronousWindow::add_relocations), so that no queue family ownership transfers
+// are needed. The old resources are destroyed (and VMA frees their memory) once that frame completed.
+//
+// Usage (from the render loop of the window that owns the Relocatables):
+//
+//   auto defragment = statefultask::create<task::Defragment>(this COMMA_CWDEBUG_ONLY(true));
+//   defragment->run();
+//
+class Defragment final : public SynchronousTask
+{
+ public:
+  static constexpr vk::DeviceSize max_bytes_per_pass = 8 * 1024 * 1024;
+  static constexpr uint32_t max_allocations_per_pass = 32;
+
+  struct Move
+  {
+    vulkan::memory::Relocatable* m_relocatable;         // The object that moves the resource.
+    VmaAllocation m_vh_allocation;                      // The allocation that is being moved.
+  };
+
+ private:
+  vulkan::LogicalDevice const* m_logical_device;        // The logical device of the owning window.
+  statefultask::RunningTasksTracker::index_type m_index;        // Our index in the m_dependent_tasks of the owning window.
+  std::vector<VmaPool> m_vh_pools;                      // The pools to defragment; VK_NULL_HANDLE stands for the default pools.
+  size_t m_pool_index{};                                // The index into m_vh_pools of the pool that is being defragmented.
+  VmaDefragmentationContext m_context{};                // The context of the current defragmentation, if any.
+  VmaDefragmentationPassMoveInfo m_pass_info{};         // The moves of the current pass.
+  std::vector<Move> m_moves;                            // The moves of the current pass that aren't ignored.
+  bool m_in_pass{};                                     // Set between begin_defragmentation_pass and end_defragmentation_pass.
+  uint64_t m_copy_frame{};                              // The frame that copies the resources of the current pass, or zero if not submitted yet.
+  VmaTotalStatistics m_statistics_before;               // Statistics of all allocations before defragmenting.
+  VmaTotalStatistics m_statistics_after;                // Statistics of all allocations after defragmenting.
+  VmaDefragmentationStats m_defragmentation_stats{};    // The sum of the results of vmaEndDefragmentation of all pools.
+
+ protected:
+  using direct_base_type = SynchronousTask;
+
+  // The different states of this task.
+  enum Defragment_state_type {
+    Defragment_begin = direct_base_type::state_end,
+    Defragment_pass,
+    Defragment_end_pass,
+    Defragment_end
+  };
+
+ public:
+  static constexpr state_type state_end = Defragment_end + 1;
+
+  Defragment(SynchronousWindow* owner COMMA_CWDEBUG_ONLY(bool debug));
+
+  // Accessors; only valid after the task finished successfully.
+  VmaTotalStatistics const& statistics_before() const { return m_statistics_before; }
+  VmaTotalStatistics const& statistics_after() const { return m_statistics_after; }
+  VmaDefragmentationStats const& defragmentation_stats() const { return m_defragmentation_stats; }
+
+ private:
+  vulkan::memory::Allocator const& allocator() const { return m_logical_device->allocator({}); }
+
+  // Destroy the old resources of the current pass and let VMA free their memory.
+  vk::Result end_pass();
+
+ protected:
+  ~Defragment() override;
+
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+  void finish_impl() override;
+};
+
+} // namespace task
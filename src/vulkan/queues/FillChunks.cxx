@@ -0,0 +1,56 @@
+#include "sys.h"
+#include "FillChunks.h"
+#include "CopyDataToGPU.h"
+#include <Tracy.hpp>
+
+namespace task {
+
+FillChunks::FillChunks(vulkan::DataFeeder* data_feeder, unsigned char* chunk_ptr, int begin, int end,
+    boost::intrusive_ptr<CopyDataToGPU> parent COMMA_CWDEBUG_ONLY(bool debug)) :
+  direct_base_type(CWDEBUG_ONLY(debug)),
+  m_data_feeder(data_feeder), m_chunk_ptr(chunk_ptr), m_begin(begin), m_end(end), m_parent(std::move(parent))
+{
+  DoutEntering(dc::statefultask(mSMDebug), "FillChunks(" << data_feeder << ", " << (void*)chunk_ptr << ", " << begin << ", " << end << ") [" << this << "]");
+}
+
+FillChunks::~FillChunks()
+{
+  DoutEntering(dc::statefultask(mSMDebug), "FillChunks::~FillChunks() [" << this << "]");
+}
+
+char const* FillChunks::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(FillChunks_fill);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* FillChunks::task_name_impl() const
+{
+  return "FillChunks";
+}
+
+void FillChunks::initialize_impl()
+{
+  set_state(FillChunks_fill);
+}
+
+void FillChunks::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case FillChunks_fill:
+    {
+      ZoneScopedN("FillChunks_fill");
+      m_data_feeder->fill_chunks(m_chunk_ptr, m_begin, m_end);
+      m_parent->fill_task_finished();
+      m_parent.reset();
+      finish();
+      break;
+    }
+  }
+}
+
+} // namespace task
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "memory/DataFeeder.h"
+#include <boost/intrusive_ptr.hpp>
+#include "debug.h"
+
+namespace task {
+
+class CopyDataToGPU;
+
+// Helper task of CopyDataToGPU: fills a range of chunks of a range-addressable DataFeeder.
+//
+// The parent keeps a count of running FillChunks tasks (see CopyDataToGPU::fill_task_finished);
+// the task that decrements that count to zero signals the parent with chunks_filled, or - if
+// the parent already finished (it was aborted) - releases the memory that was written to.
+//
+// m_parent keeps the parent (and therefore the feeder, which is a member of it) alive.
+class FillChunks final : public vulkan::AsyncTask
+{
+ private:
+  vulkan::DataFeeder* m_data_feeder;            // The feeder to use (owned by m_parent).
+  unsigned char* m_chunk_ptr;                   // Where to write chunk m_begin.
+  int m_begin;                                  // The first chunk to write.
+  int m_end;                                    // One past the last chunk to write.
+  boost::intrusive_ptr<CopyDataToGPU> m_parent; // The task to report to when done.
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of this task.
+  enum FillChunks_state_type {
+    FillChunks_fill = direct_base_type::state_end
+  };
+
+ public:
+  static constexpr state_type state_end = FillChunks_fill + 1;
+
+  FillChunks(vulkan::DataFeeder* data_feeder, unsigned char* chunk_ptr, int begin, int end,
+      boost::intrusive_ptr<CopyDataToGPU> parent COMMA_CWDEBUG_ONLY(bool debug = false));
+
+ protected:
+  ~FillChunks() override;
+
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+};
+
+} // namespace task
@@ -57,11 +57,11 @@ void ImmediateSubmit::multiplex_impl(state_type run_state)
     {
       // Obtain reference to associated QueuePool.
       vulkan::QueuePool& queue_pool = vulkan::QueuePool::instance(m_submit_request);
-      // Get a running ImmediateSubmitQueue task from the pool.
-      m_immediate_submit_queue_task = queue_pool.get_immediate_submit_queue_task(CWDEBUG_ONLY(mSMDebug));
+      // Get the least loaded running ImmediateSubmitQueue task of the lane of the request from the pool.
+      m_immediate_submit_queue_task = queue_pool.get_immediate_submit_queue_task(m_submit_request.lane() COMMA_CWDEBUG_ONLY(mSMDebug));
 
       // Pass on the submit request.
-      m_immediate_submit_queue_task->have_new_datum(std::move(m_submit_request));
+      m_immediate_submit_queue_task->submit(std::move(m_submit_request));
       set_state(m_continue_state);
       wait(submit_finished);
       break;
@@ -2,6 +2,7 @@
 
 #include "ImmediateSubmitRequest.h"
 #include "AsyncTask.h"
+#include <atomic>
 #include "debug.h"
 
 namespace task {
@@ -14,12 +15,14 @@ class ImmediateSubmit : public vulkan::AsyncTask
   static constexpr condition_type submit_finished = 1;
 
  protected:
-  // Constructor, set_queue_request_key, set_record_function.
+  // Constructor, set_queue_request_key, set_record_function or set_batch_record_function.
   vulkan::ImmediateSubmitRequest m_submit_request;
   // Constructor.
   state_type m_continue_state{ImmediateSubmit_done};
   // ImmediateSubmit_start.
   ImmediateSubmitQueue* m_immediate_submit_queue_task{};
+  // Incremented (by the ImmediateSubmitQueue task) every time a submit request of this task finished.
+  std::atomic<int> m_finished_submits{};
 
   // The different states of the task.
   enum ImmediateSubmit_state_type {
@@ -35,6 +38,15 @@ class ImmediateSubmit : public vulkan::AsyncTask
 
   void set_queue_request_key(vulkan::QueueRequestKey queue_request_key) { m_submit_request.set_queue_request_key(queue_request_key); }
   void set_record_function(vulkan::ImmediateSubmitRequest::record_function_type&& record_function) { m_submit_request.set_record_function(std::move(record_function)); }
+  void set_batch_record_function(vulkan::ImmediateSubmitRequest::batch_record_function_type&& batch_record_function) { m_submit_request.set_batch_record_function(std::move(batch_record_function)); }
+  void set_lane(vulkan::ImmediateSubmitRequest::Lane lane) { m_submit_request.set_lane(lane); }
+
+  // Called by ImmediateSubmitRequest::finished.
+  void submit_request_finished()
+  {
+    m_finished_submits.fetch_add(1, std::memory_order::release);
+    signal(submit_finished);
+  }
 
  protected:
   ~ImmediateSubmit() override;
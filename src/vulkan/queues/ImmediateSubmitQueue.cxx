@@ -2,21 +2,25 @@
 #include "ImmediateSubmitQueue.h"
 #include "CommandBufferFactory.h"
 #include "utils/AIAlert.h"
+#include <Tracy.hpp>
 
 namespace task {
 
 ImmediateSubmitQueue::ImmediateSubmitQueue(
     vulkan::LogicalDevice const* logical_device,
-    vulkan::Queue const& queue
+    vulkan::Queue const& queue,
+    vulkan::ImmediateSubmitRequest::Lane lane
     COMMA_CWDEBUG_ONLY(bool debug)) :
   direct_base_type(CWDEBUG_ONLY(debug)),
   m_command_buffer_pool(8, m_deque_allocator, logical_device, queue.queue_family()
       COMMA_CWDEBUG_ONLY(debug_name_prefix("m_command_buffer_pool.m_factory"))),
   m_queue(queue),
   m_semaphore(logical_device, 0
-      COMMA_CWDEBUG_ONLY(debug_name_prefix("m_timeline_semaphore")))
+      COMMA_CWDEBUG_ONLY(debug_name_prefix("m_timeline_semaphore"))),
+  m_lane(lane)
 {
-  DoutEntering(dc::statefultask(mSMDebug), "ImmediateSubmitQueue::ImmediateSubmitQueue(" << logical_device << ", " << queue << ") [" << this << "]");
+  DoutEntering(dc::statefultask(mSMDebug), "ImmediateSubmitQueue::ImmediateSubmitQueue(" << logical_device << ", " << queue << ", " <<
+      vulkan::ImmediateSubmitRequest::to_string(lane) << ") [" << this << "]");
 }
 
 ImmediateSubmitQueue::~ImmediateSubmitQueue()
@@ -45,11 +49,10 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
   {
     case ImmediateSubmitQueue_need_action:
     {
-      // The deque of the TaskToTaskDeque base class is appended to at the end by "producer tasks".
-      // We only obtain the lock on this deque while accessing it through base class member functions,
-      // so new elements can be appended at any moment, invalidating the `end()` iterator.
-      // Therefore we can't use the `end()` iterator and use instead a count of elements that are
-      // known to be in the deque (because it only grows; this task being the only consumer).
+      // The deque of the TaskToTaskDeque base class is appended to at the end by front_n, which moves
+      // all requests that were passed by "producer tasks" since the previous call into it.
+      // Iterators into the deque are therefore only valid until the next call to front_n, and
+      // we keep a count of the elements (m_pending_requests) instead of iterators between runs.
       //
       // Moreover, this deque is used for a dual purpose: to submit new immediate-submit requests,
       // all stored at the end, but also to keep track of already submitted requests, the command
@@ -61,15 +64,15 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
       //                             |          | ⎞ <-- begin() iff m_submitted > 0.
       //                             |          | ⎟- m_pending_requests = number of submitted, but not finished, command buffers.
       //                             |          | ⎟
-      //  m_last_submitted       --> |          | ⎠
-      //   (only valid if            +----------+
-      //    m_pending_requests > 0)  |          | ⎞⎞  <-- first_submit_request (= begin() iff m_submitted == 0) (only valid if n > 0).
+      //                             |          | ⎠
+      //                             +----------+
+      //                             |          | ⎞⎞  <-- first_submit_request (= begin() + m_pending_requests) (only valid if n > 0).
       //                             |          | ⎟⎟- n = number of existing new submit requests at the time of the call to front_n(n) (with a max. of 64).
       //                             |          | ⎟-- acquired = number of command buffers acquired (might be less than n).
       //                             |          | ⎠⎟
       //                             |          |  ⎠
       //                             .          .
-      //                             .          . <-- possibly already appended new submit requests (there is no `end()`).
+      //                             .          . <-- possibly more new submit requests (beyond the 64 that we read).
       //
       //
       // Reserve up to 64 elements for reading.
@@ -80,8 +83,8 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
       ASSERT(n >= m_pending_requests);
       // Set n to the number of existing new submit requests.
       n -= m_pending_requests;
-      // If there are pending requests then the first newly submitted request is at m_last_submitted + 1, otherwise it is at begin().
-      container_type::const_iterator const first_submit_request = (m_pending_requests > 0) ? m_last_submitted + 1 : first_pending_request;
+      // The first newly submitted request follows the pending requests.
+      container_type::const_iterator const first_submit_request = first_pending_request + m_pending_requests;
       if (m_pending_requests > 0)
       {
         Dout(dc::vulkan, "Considering " << m_pending_requests << " pending requests.");
@@ -89,6 +92,9 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
         container_type::const_iterator pending_request = first_pending_request;
         uint64_t counter_value = m_semaphore.get_counter_value();
         int processed = 0;
+        int released = 0;               // The number of command buffers to release (less than processed if requests were batched).
+        vk::DeviceSize finished_load = 0;
+        auto const now = std::chrono::steady_clock::now();
         for (;;)
         {
           if (counter_value < pending_request->signal_value())
@@ -98,8 +104,16 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
               --pending_request;        // Must be equal to the last processed request for the call to pop_front_n below.
             break;
           }
-          command_buffers[processed++] = pending_request->command_buffer();
+          ++processed;
+          // Only the last request of a batch owns the (shared) command buffer.
+          if (pending_request->has_command_buffer())
+            command_buffers[released++] = pending_request->command_buffer();
+          // Each request of a batch is signaled individually.
           pending_request->finished();
+          finished_load += pending_request->byte_count() + request_load;
+          // The time between submitting the command buffer and the task being signaled.
+          [[maybe_unused]] auto const latency = std::chrono::duration_cast<std::chrono::microseconds>(now - pending_request->submit_time());
+          TracyPlot("upload completion latency (us)", static_cast<int64_t>(latency.count()));
           // Do not increment pending_request past the last one processed.
           if (processed == m_pending_requests)
             break;
@@ -109,56 +123,113 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
         if (processed > 0)
         {
           // Release the command buffers of the pending requests that were signaled.
-          m_command_buffer_pool.release(command_buffers.data(), processed);
+          if (released > 0)
+            m_command_buffer_pool.release(command_buffers.data(), released);
           // Erase the pending requests that were just processed.
-          pop_front_n(pending_request);         // If this invalidates m_last_submitted
-          m_pending_requests -= processed;      // then this will become zero.
+          pop_front_n(pending_request);
+          m_pending_requests -= processed;
+          m_load.fetch_sub(finished_load, std::memory_order::relaxed);
         }
       }
       if (n > 0)
       {
         // Acquire n command buffers from the command buffer pool.
+        // If requests are batched then less will be needed; those will be released again below.
         std::vector<vulkan::handle::CommandBuffer> command_buffers(n);
         // Attempt to acquire n buffers - this might fail.
         size_t const acquired = m_command_buffer_pool.acquire(command_buffers);
+        int count = 0;                  // The number of submit requests that were handled.
         if (AI_LIKELY(acquired > 0))
         {
+          // Because this is the only thread/task that uses m_semaphore; it is safe to add 1 to the value
+          // returned by signal_value() and assume that will be the value used by the submit below.
+          uint64_t const signal_value = m_semaphore.signal_value() + 1;
+          m_transfer_batch.set_submit_info(m_queue.queue_family(), *m_semaphore.vh_semaphore_ptr(), signal_value);
+          size_t used = 0;              // The number of command buffers that were recorded.
           // As this task owns the deque and is essentially single threaded, we can
-          // now simply iterate over the elements, starting with first_submit_request
-          // without having the deque locked: producer threads can add new elements
-          // in the meantime without invalidating submit_request.
+          // now simply iterate over the elements, starting with first_submit_request:
+          // requests that producer threads add in the meantime are not appended to
+          // the deque before the next call to front_n.
           container_type::const_iterator submit_request = first_submit_request;
-          int count = 0;
+          container_type::const_iterator last_batched_request;
+          ASSERT(m_transfer_batch.empty());
           for (;;)
           {
             Dout(dc::vulkan, "ImmediateSubmitQueue_need_action: received submit_request: " << *submit_request << " [" << this << "]");
 
-            // Record the command buffer.
-            submit_request->record_commands(command_buffers[count]);
-            // Store pending request data. Because this is the only thread/task that uses m_semaphore; it is safe to
-            // add 1 to the value returned by signal_value() and assume that will be the value used by the submit below.
-            submit_request->set_command_buffer_and_signal_value(command_buffers[count], m_semaphore.signal_value() + 1);
-            // Prevent submit_request from being moved past the last recorded command buffer.
-            if (++count == acquired)
+            if (submit_request->is_batchable())
+            {
+              // Add the request to the current batch, unless that is full or already touches the same resources.
+              bool const added = m_transfer_batch.size() < max_batch_size && submit_request->add_to_batch(m_transfer_batch);
+              if (AI_LIKELY(added))
+              {
+                m_transfer_batch.added();
+                // Store pending request data. The command buffer is stored in the last request of the batch, by record_batch.
+                submit_request->set_command_buffer_and_signal_value({}, signal_value);
+                last_batched_request = submit_request;
+              }
+              else
+              {
+                // Adding a request to an empty batch should always succeed.
+                ASSERT(!m_transfer_batch.empty());
+                // Close the current batch and try again with a new one.
+                record_batch(command_buffers[used], last_batched_request, signal_value);
+                if (++used == acquired)
+                  break;
+                continue;
+              }
+            }
+            else
+            {
+              // Finish the current batch first, to keep the order of execution.
+              if (!m_transfer_batch.empty())
+              {
+                record_batch(command_buffers[used], last_batched_request, signal_value);
+                if (++used == acquired)
+                  break;
+              }
+              // Record the command buffer.
+              submit_request->record_commands(command_buffers[used]);
+              // Store pending request data.
+              submit_request->set_command_buffer_and_signal_value(command_buffers[used], signal_value);
+              ++used;
+            }
+            // Prevent submit_request from being moved past the last handled request.
+            if (++count == n || (used == acquired && m_transfer_batch.empty()))
               break;
             ++submit_request;
           }
-          m_last_submitted = submit_request;
-          m_pending_requests += acquired;
+          // Record the last batch, if any. If we get here with a non-empty batch then used < acquired.
+          if (!m_transfer_batch.empty())
+            record_batch(command_buffers[used++], last_batched_request, signal_value);
+          // Give back the command buffers that weren't needed.
+          if (used < acquired)
+            m_command_buffer_pool.release(command_buffers.data() + used, acquired - used);
 
-          // Submit recorded commands.
-          m_queue.submit(command_buffers.data()->get_array(), acquired, m_semaphore);
+          if (count > 0)
+          {
+            m_pending_requests += count;
+
+            // Submit recorded commands.
+            m_queue.submit(command_buffers.data()->get_array(), used, m_semaphore);
 
-          // Wake me up when you're done.
-          m_semaphore.add_poll(this, need_action);
+            // Only now it is safe to let others wait for signal_value.
+            for (auto const& action : m_after_submit)
+              action();
+            m_after_submit.clear();
+
+            // Wake me up when you're done.
+            m_semaphore.add_poll(this, need_action);
+          }
         }
-        // If less command buffers were returned than requested, then request for a callback once those command buffers are available again.
+        // If not all requests could be handled because we ran out of command buffers, then request for a callback once
+        // those command buffers are available again.
         // The re-use of `need_action` is kindof iffy, but because that is the ONLY signal that this task has and it is as general as
         // "do something" (action needs to be taken) it will work: this just assures this task will run again once more CAN be done.
         // It will also still run again when more submit requests are added; that then can result in multiple calls to the below 'subscribe'
         // function - so that must be able to deal with that.
-        if (acquired < n)
-          m_command_buffer_pool.subscribe(n - acquired, this, need_action);
+        if (count < n)
+          m_command_buffer_pool.subscribe(n - count, this, need_action);
       }
       if (producer_not_finished())
         break;
@@ -171,6 +242,17 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
   }
 }
 
+void ImmediateSubmitQueue::record_batch(vulkan::handle::CommandBuffer command_buffer, container_type::const_iterator last_request, uint64_t signal_value)
+{
+  DoutEntering(dc::vulkan, "ImmediateSubmitQueue::record_batch(" << command_buffer << ", ...) [" << this << "]");
+  Dout(dc::vulkan, "Recording " << m_transfer_batch.size() << " batched submit requests.");
+  m_transfer_batch.record(command_buffer);
+  m_transfer_batch.move_after_submit_actions(m_after_submit);
+  // The last request of the batch takes ownership of the command buffer; it will be released after all requests of the batch were finished.
+  last_request->set_command_buffer_and_signal_value(command_buffer, signal_value);
+  m_transfer_batch.clear();
+}
+
 void ImmediateSubmitQueue::abort_impl()
 {
   m_semaphore.remove_poll();
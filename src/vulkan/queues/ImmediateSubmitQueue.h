@@ -5,22 +5,33 @@
 #include "ImmediateSubmitRequest.h"
 #include "PersistentAsyncTask.h"
 #include "TimelineSemaphore.h"
+#include "TransferBatch.h"
 #include "vk_utils/TaskToTaskDeque.h"
 #include "statefultask/DefaultMemoryPagePool.h"
+#include <atomic>
 
 namespace task {
 
 class ImmediateSubmitQueue final : public vk_utils::TaskToTaskDeque<vulkan::PersistentAsyncTask, vulkan::ImmediateSubmitRequest>
 {
+ public:
+  static constexpr int max_batch_size = 64;                             // The maximum number of batchable requests that are recorded into a single command buffer.
+  static constexpr vk::DeviceSize request_load = 64 * 1024;             // The load of a request on top of its byte count (the cost of recording and submitting it, expressed in bytes).
+
  private:
   using CommandBuffer = vulkan::CommandBufferFactory::resource_type;    // vulkan::handle::CommandBuffer
   utils::DequeAllocator<CommandBuffer> m_deque_allocator{vulkan::Application::instance().deque512_nmr()};
   statefultask::ResourcePool<vulkan::CommandBufferFactory> m_command_buffer_pool;
   vulkan::Queue m_queue;                                                // Queue that is owned by this task.
   vulkan::TimelineSemaphore m_semaphore;                                // Timeline semaphore used for submitting to m_queue.
-  int m_pending_requests{};                                             // The number of command buffers that were submitted but were not signaled yet.
-  container_type::const_iterator m_last_submitted;                      // Pointer to the last ImmediateSubmitRequest associated with the pending requests.
-                                                                        // Only valid if m_pending_requests > 0.
+  int m_pending_requests{};                                             // The number of requests that were submitted but were not signaled yet.
+  vulkan::TransferBatch m_transfer_batch;                               // Scratch object used to combine batchable requests (kept to reuse its memory).
+  std::vector<std::function<void()>> m_after_submit;                    // Actions of the recorded batches that must be called after submitting them.
+  vulkan::ImmediateSubmitRequest::Lane const m_lane;                    // The lane that this task was created for (see QueuePool).
+  std::atomic<vk::DeviceSize> m_load{};                                 // The sum of the load of all requests passed to submit() that did not finish yet.
+
+  // Requests must be passed with submit(), so that their load is accounted for.
+  using direct_base_type::have_new_datum;
 
   // The different states of the task.
   enum ImmediateSubmitQueue_state_type {
@@ -39,13 +50,28 @@ class ImmediateSubmitQueue final : public vk_utils::TaskToTaskDeque<vulkan::Pers
   void multiplex_impl(state_type run_state) override;
   void abort_impl() override;
 
+ private:
+  // Record m_transfer_batch into command_buffer and store that in last_request.
+  void record_batch(vulkan::handle::CommandBuffer command_buffer, container_type::const_iterator last_request, uint64_t signal_value);
+
  public:
   ImmediateSubmitQueue(
     // Arguments for m_command_buffer_pool.
     vulkan::LogicalDevice const* logical_device,
-    vulkan::Queue const& queue
+    vulkan::Queue const& queue,
+    vulkan::ImmediateSubmitRequest::Lane lane
     COMMA_CWDEBUG_ONLY(bool debug = false));
 
+  // Pass a new request to this task.
+  void submit(vulkan::ImmediateSubmitRequest&& submit_request)
+  {
+    m_load.fetch_add(submit_request.byte_count() + request_load, std::memory_order::relaxed);
+    have_new_datum(std::move(submit_request));
+  }
+
+  vulkan::ImmediateSubmitRequest::Lane lane() const { return m_lane; }
+  vk::DeviceSize load() const { return m_load.load(std::memory_order::relaxed); }
+
   void wait_for(uint64_t signal_value) { m_semaphore.wait_for(signal_value); }
 
   void terminate();
@@ -6,7 +6,7 @@ namespace vulkan {
 
 void ImmediateSubmitRequest::finished() const
 {
-  m_immediate_submit->signal(task::ImmediateSubmit::submit_finished);
+  m_immediate_submit->submit_request_finished();
 }
 
 void ImmediateSubmitRequest::abort()
@@ -19,7 +19,21 @@ void ImmediateSubmitRequest::print_on(std::ostream& os) const
 {
   os << "{m_logical_device:" << m_logical_device <<
     ", m_queue_request_key:" << m_queue_request_key <<
-    ", m_record_function:" << (m_record_function ? "<set>" : "nullptr") << '}';
+    ", m_record_function:" << (m_record_function ? "<set>" : "nullptr") <<
+    ", m_batch_record_function:" << (m_batch_record_function ? "<set>" : "nullptr") <<
+    ", m_lane:" << to_string(m_lane) <<
+    ", m_byte_count:" << m_byte_count << '}';
+}
+
+//static
+char const* ImmediateSubmitRequest::to_string(Lane lane)
+{
+  switch (lane)
+  {
+    AI_CASE_RETURN(Lane::interactive);
+    AI_CASE_RETURN(Lane::background);
+  }
+  AI_NEVER_REACHED
 }
 #endif
 
@@ -4,6 +4,7 @@
 #include "CommandBuffer.h"
 #include "QueueRequestKey.h"
 #include <functional>
+#include <chrono>
 
 namespace task {
 class ImmediateSubmit;
@@ -11,12 +12,22 @@ class ImmediateSubmit;
 
 namespace vulkan {
 
+class TransferBatch;
+
 // This struct contains the data needed to start an ImmediateSubmit task.
 class ImmediateSubmitRequest
 {
  public:
   static constexpr vk::CommandPoolCreateFlags::MaskType pool_type = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   using record_function_type = std::function<void(handle::CommandBuffer)>;
+  using batch_record_function_type = std::function<bool(TransferBatch&)>;
+
+  // The priority lane of a request (see QueuePool::get_immediate_submit_queue_task).
+  enum class Lane
+  {
+    interactive,                // Small, latency critical transfers (the default).
+    background                  // Bulk transfers, like large (texture) uploads and defragmentation.
+  };
 
  private:
   // Filled by set_* functions before running the task.
@@ -24,9 +35,13 @@ class ImmediateSubmitRequest
   task::ImmediateSubmit* m_immediate_submit;            // The ImmediateSubmit task that issued this request.
   QueueRequestKey m_queue_request_key;                  // Key that uniquely maps to a queue (request/reply) to use.
   record_function_type m_record_function;               // Callback function that will record the command buffer.
+  batch_record_function_type m_batch_record_function;   // Alternatively, callback function that adds barriers and copy commands to a TransferBatch.
+  Lane m_lane{Lane::interactive};                       // The priority lane of this request.
+  vk::DeviceSize m_byte_count{};                        // The number of bytes that are transferred by this request (used to balance the load over the queues).
   // Filled in after submitting.
   mutable handle::CommandBuffer m_command_buffer{};     // Acquired command buffer that was recorded into (if any).
   mutable uint64_t m_signal_value;                      // Signal value used with the timeline semaphore when this command buffer was submitted.
+  mutable std::chrono::steady_clock::time_point m_submit_time;  // The time at which this request was submitted (used to measure the completion latency).
 
  public:
   ImmediateSubmitRequest() = default;
@@ -40,6 +55,9 @@ class ImmediateSubmitRequest
     m_logical_device = orig.m_logical_device;
     m_queue_request_key = orig.m_queue_request_key;
     m_record_function = std::move(orig.m_record_function);
+    m_batch_record_function = std::move(orig.m_batch_record_function);
+    m_lane = orig.m_lane;
+    m_byte_count = orig.m_byte_count;
     return *this;
   }
 
@@ -47,8 +65,14 @@ class ImmediateSubmitRequest
   void set_logical_device(vulkan::LogicalDevice const* logical_device) { m_logical_device = logical_device; }
   void set_queue_request_key(vulkan::QueueRequestKey queue_request_key) { m_queue_request_key = queue_request_key; }
   void set_record_function(record_function_type&& record_function) { m_record_function = std::move(record_function); }
+  // Use this instead of set_record_function to allow this request to share a command buffer with other requests.
+  // The function must return false, without adding anything, if the batch already touches the resources that it would use.
+  void set_batch_record_function(batch_record_function_type&& batch_record_function) { m_batch_record_function = std::move(batch_record_function); }
+  void set_lane(Lane lane) { m_lane = lane; }
+  void set_byte_count(vk::DeviceSize byte_count) { m_byte_count = byte_count; }
   // Called by ImmediateSubmitQueue_need_action.
-  void set_command_buffer_and_signal_value(handle::CommandBuffer command_buffer, uint64_t signal_value) const { m_command_buffer = command_buffer; m_signal_value = signal_value; }
+  // When requests are batched, command_buffer is only set for the last request of the batch (and null for the others).
+  void set_command_buffer_and_signal_value(handle::CommandBuffer command_buffer, uint64_t signal_value) const { m_command_buffer = command_buffer; m_signal_value = signal_value; m_submit_time = std::chrono::steady_clock::now(); }
 
   vulkan::LogicalDevice const* logical_device() const
   {
@@ -65,21 +89,52 @@ class ImmediateSubmitRequest
     m_record_function(command_buffer);
   }
 
+  Lane lane() const
+  {
+    return m_lane;
+  }
+
+  vk::DeviceSize byte_count() const
+  {
+    return m_byte_count;
+  }
+
+  bool is_batchable() const
+  {
+    return static_cast<bool>(m_batch_record_function);
+  }
+
+  bool add_to_batch(TransferBatch& batch) const
+  {
+    return m_batch_record_function(batch);
+  }
+
   handle::CommandBuffer command_buffer() const
   {
     return m_command_buffer;
   }
 
+  bool has_command_buffer() const
+  {
+    return static_cast<bool>(static_cast<vk::CommandBuffer>(m_command_buffer));
+  }
+
   uint64_t signal_value() const
   {
     return m_signal_value;
   }
 
+  std::chrono::steady_clock::time_point submit_time() const
+  {
+    return m_submit_time;
+  }
+
   void finished() const;
   void abort();
 
 #ifdef CWDEBUG
   void print_on(std::ostream& os) const;
+  static char const* to_string(Lane lane);
 #endif
 };
 
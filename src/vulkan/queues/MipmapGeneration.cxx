@@ -0,0 +1,105 @@
+#include "sys.h"
+#include "MipmapGeneration.h"
+#include <algorithm>
+
+namespace vulkan {
+
+void MipmapGeneration::record(vk::CommandBuffer vh_command_buffer) const
+{
+  DoutEntering(dc::vulkan, "MipmapGeneration::record(" << vh_command_buffer << ") [" << this << "]");
+  // There is nothing to generate with only one level.
+  ASSERT(m_subresource_range.levelCount > 1);
+
+  vk::ImageMemoryBarrier barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = m_vh_image,
+    .subresourceRange = vk::ImageSubresourceRange{
+      .aspectMask = m_subresource_range.aspectMask,
+      .levelCount = 1,
+      .baseArrayLayer = m_subresource_range.baseArrayLayer,
+      .layerCount = m_subresource_range.layerCount
+    }
+  };
+
+  int32_t width = m_extent.width;
+  int32_t height = m_extent.height;
+  uint32_t const end_level = m_subresource_range.baseMipLevel + m_subresource_range.levelCount;
+  for (uint32_t level = m_subresource_range.baseMipLevel + 1; level < end_level; ++level)
+  {
+    // Wait until the previous level is written and turn it into the source of the next blit.
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0),
+        {}, {}, { barrier });
+
+    int32_t const next_width = std::max(width / 2, 1);
+    int32_t const next_height = std::max(height / 2, 1);
+    vk::ImageBlit const blit{
+      .srcSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = m_subresource_range.aspectMask,
+        .mipLevel = level - 1,
+        .baseArrayLayer = m_subresource_range.baseArrayLayer,
+        .layerCount = m_subresource_range.layerCount
+      },
+      .srcOffsets = std::array<vk::Offset3D, 2>{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ width, height, 1 } },
+      .dstSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = m_subresource_range.aspectMask,
+        .mipLevel = level,
+        .baseArrayLayer = m_subresource_range.baseArrayLayer,
+        .layerCount = m_subresource_range.layerCount
+      },
+      .dstOffsets = std::array<vk::Offset3D, 2>{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ next_width, next_height, 1 } }
+    };
+    vh_command_buffer.blitImage(m_vh_image, vk::ImageLayout::eTransferSrcOptimal, m_vh_image, vk::ImageLayout::eTransferDstOptimal,
+        { blit }, vk::Filter::eLinear);
+
+    width = next_width;
+    height = next_height;
+  }
+}
+
+std::array<vk::ImageMemoryBarrier, 2> MipmapGeneration::final_barriers(vk::AccessFlags src_access, vk::AccessFlags dst_access,
+    vk::ImageLayout new_layout, uint32_t src_queue_family, uint32_t dst_queue_family) const
+{
+  // All levels but the last were read by a blit.
+  vk::ImageMemoryBarrier const source_levels_barrier{
+    .srcAccessMask = src_access & vk::AccessFlagBits::eTransferRead,
+    .dstAccessMask = dst_access,
+    .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+    .newLayout = new_layout,
+    .srcQueueFamilyIndex = src_queue_family,
+    .dstQueueFamilyIndex = dst_queue_family,
+    .image = m_vh_image,
+    .subresourceRange = vk::ImageSubresourceRange{
+      .aspectMask = m_subresource_range.aspectMask,
+      .baseMipLevel = m_subresource_range.baseMipLevel,
+      .levelCount = m_subresource_range.levelCount - 1,
+      .baseArrayLayer = m_subresource_range.baseArrayLayer,
+      .layerCount = m_subresource_range.layerCount
+    }
+  };
+  // The last level was only written.
+  vk::ImageMemoryBarrier const last_level_barrier{
+    .srcAccessMask = src_access & vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = dst_access,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = new_layout,
+    .srcQueueFamilyIndex = src_queue_family,
+    .dstQueueFamilyIndex = dst_queue_family,
+    .image = m_vh_image,
+    .subresourceRange = vk::ImageSubresourceRange{
+      .aspectMask = m_subresource_range.aspectMask,
+      .baseMipLevel = m_subresource_range.baseMipLevel + m_subresource_range.levelCount - 1,
+      .levelCount = 1,
+      .baseArrayLayer = m_subresource_range.baseArrayLayer,
+      .layerCount = m_subresource_range.layerCount
+    }
+  };
+  return { source_levels_barrier, last_level_barrier };
+}
+
+} // namespace vulkan
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include "debug.h"
+
+namespace vulkan {
+
+// Generates the mip chain of an image with vkCmdBlitImage: every level is downsampled (with a linear filter) from the previous one.
+//
+// This requires a queue with graphics capability and a format for which LogicalDevice::supports_linear_blit returns true.
+//
+// Before record: all levels of m_subresource_range are in layout eTransferDstOptimal and the first level was written
+//                (by a transfer command that is made visible to the transfer stage).
+// After record:  all levels except the last one are in layout eTransferSrcOptimal, the last one is still in eTransferDstOptimal.
+//                Use final_barriers to transition them to the layout that the image will be used with.
+//
+struct MipmapGeneration
+{
+  vk::Image m_vh_image;                                 // The image to generate the mip levels of.
+  vk::Extent2D m_extent;                                // The extent of the first level of m_subresource_range.
+  vk::ImageSubresourceRange m_subresource_range;        // The first level is the source; the other levels are generated.
+
+  // Record the blits and the barriers between them.
+  void record(vk::CommandBuffer vh_command_buffer) const;
+
+  // Return the barriers that transition all levels from the layouts that record leaves them in to new_layout.
+  // Per barrier, src_access is reduced to the access that record did to those levels (pass eTransferRead|eTransferWrite, or 0 for an acquire).
+  // The queue family indices can be used to turn these into the release or acquire half of a queue family ownership transfer.
+  std::array<vk::ImageMemoryBarrier, 2> final_barriers(vk::AccessFlags src_access, vk::AccessFlags dst_access, vk::ImageLayout new_layout,
+      uint32_t src_queue_family = VK_QUEUE_FAMILY_IGNORED, uint32_t dst_queue_family = VK_QUEUE_FAMILY_IGNORED) const;
+};
+
+} // namespace vulkan
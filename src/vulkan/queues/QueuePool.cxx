@@ -4,6 +4,7 @@
 #include "Exceptions.h"
 #include "Application.h"
 #include <algorithm>
+#include <limits>
 
 namespace vulkan {
 
@@ -67,40 +68,68 @@ void QueuePool::clean_up()
 #endif
 }
 
-task::ImmediateSubmitQueue* QueuePool::get_immediate_submit_queue_task(CWDEBUG_ONLY(bool debug))
+//static
+task::ImmediateSubmitQueue* QueuePool::least_loaded_task(QueuePoolTasks const& tasks, ImmediateSubmitRequest::Lane lane, bool idle_only)
+{
+  // Only use tasks of lane; unless there are none and we can't acquire a new queue for it anymore.
+  bool const any_task = !idle_only &&
+    std::none_of(tasks.tasks.begin(), tasks.tasks.end(), [lane](auto const& task){ return task->lane() == lane; });
+  task::ImmediateSubmitQueue* best_task = nullptr;
+  vk::DeviceSize best_load = std::numeric_limits<vk::DeviceSize>::max();
+  for (auto const& task : tasks.tasks)
+  {
+    if (!any_task && task->lane() != lane)
+      continue;
+    vk::DeviceSize const load = task->load();
+    if (load < best_load && (!idle_only || load == 0))
+    {
+      best_task = task.get();
+      best_load = load;
+    }
+  }
+  return best_task;
+}
+
+task::ImmediateSubmitQueue* QueuePool::get_immediate_submit_queue_task(ImmediateSubmitRequest::Lane lane COMMA_CWDEBUG_ONLY(bool debug))
 {
   // The fast-path assumes we already acquired all queues - of course.
   if (AI_LIKELY(m_no_more_queues.load(std::memory_order::relaxed)))
   {
     // Obtain read lock on m_tasks.
     tasks_type::rat tasks_r(m_tasks);
-    // For now just rotate over all tasks.
-    return tasks_r->tasks[++m_next_task % tasks_r->tasks.size()].get();
+    // There is at least one task, and it may be used by any lane if it is the only one.
+    return least_loaded_task(*tasks_r, lane, false);
   }
 
-  // For now just get a new queue, regardless of whether or not already running tasks are busy or not.
-
   // We can't allow multiple threads in this area, because for each queue that is successfully
   // acquired, it has to be emplaced on the tasks list before another thread may set m_no_more_queues.
-  // An alternative solution to avoid the above modulo to be executed while tasks_r->tasks.size() is
-  // zero would be to spin just before setting m_no_more_queues until that size is at least 1.
+  // An alternative solution to avoid least_loaded_task to be called while tasks_r->tasks is empty
+  // would be to spin just before setting m_no_more_queues until that size is at least 1.
   // However then it is possible that only one task was push to tasks yet resulting in
   // many threads using that one task; while there could be more. So, this is cleaner.
   std::lock_guard<std::mutex> lock(m_acquiring_queue);
 
+  // Only acquire a new queue when all tasks of this lane are busy.
+  {
+    tasks_type::rat tasks_r(m_tasks);
+    task::ImmediateSubmitQueue* idle_task = least_loaded_task(*tasks_r, lane, true);
+    if (idle_task)
+      return idle_task;
+  }
+
   // Get a pointer to the task::ImmediateSubmitQueue associated with the vulkan::QueueRequestKey that we have.
   vulkan::Queue queue;
   try
   {
     queue = m_logical_device->acquire_queue(m_key_as_uint64);
-    Dout(dc::vulkan, "Obtained queue: " << queue);
+    Dout(dc::vulkan, "Obtained queue: " << queue << " for lane " << ImmediateSubmitRequest::to_string(lane) << ".");
   }
   catch (vulkan::OutOfQueues_Exception const& error)
   {
     m_no_more_queues.store(true, std::memory_order::relaxed);
-    return get_immediate_submit_queue_task(CWDEBUG_ONLY(debug));
+    return get_immediate_submit_queue_task(lane COMMA_CWDEBUG_ONLY(debug));
   }
-  auto immediate_submit_queue_task = statefultask::create<task::ImmediateSubmitQueue>(m_logical_device, queue COMMA_CWDEBUG_ONLY(debug));
+  auto immediate_submit_queue_task = statefultask::create<task::ImmediateSubmitQueue>(m_logical_device, queue, lane COMMA_CWDEBUG_ONLY(debug));
   immediate_submit_queue_task->run(vulkan::Application::instance().medium_priority_queue());
 
   // Keep a copy of the task pointer.
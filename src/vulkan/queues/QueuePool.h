@@ -52,7 +52,6 @@ class QueuePool
   LogicalDevice const* m_logical_device;        // The corresponding logical device.
   uint64_t const m_key_as_uint64;               // The key that uniquely identifies this pool.
   std::atomic<bool> m_no_more_queues;           // Set when all available queues have been acquired. Once set we'll return the least busy task from m_tasks.
-  std::atomic<int> m_next_task;                 // Rotates over the existing tasks. FIXME: we should use the task with an empty queue first and/or the smallest queue.
   tasks_type m_tasks;                           // A list with running task::ImmediateSubmitQueue pointers.
   std::mutex m_acquiring_queue;                 // Used in get_immediate_submit_queue_task.
 
@@ -72,7 +71,7 @@ class QueuePool
   }
 
  public:
-  QueuePool(LogicalDevice const* logical_device, uint64_t key_as_uint64) : m_logical_device(logical_device), m_key_as_uint64(key_as_uint64), m_no_more_queues(false), m_next_task(0)
+  QueuePool(LogicalDevice const* logical_device, uint64_t key_as_uint64) : m_logical_device(logical_device), m_key_as_uint64(key_as_uint64), m_no_more_queues(false)
   {
     DoutEntering(dc::vulkan, "QueuePool::QueuePool(" << logical_device << ", 0x" << std::hex << key_as_uint64 << ") [" << this << "]");
   }
@@ -109,8 +108,19 @@ class QueuePool
 
   static void clean_up();
 
-  // Returns a pointer to a running ImmediateSubmitQueue from this pool.
-  task::ImmediateSubmitQueue* get_immediate_submit_queue_task(CWDEBUG_ONLY(bool debug));
+  // Returns a pointer to a running ImmediateSubmitQueue from this pool, for a request in lane.
+  //
+  // Each ImmediateSubmitQueue belongs to the lane of the request that caused its queue to be acquired.
+  // As long as not all queues were acquired, an idle task of the lane is returned, or a new queue is acquired.
+  // Afterwards the least loaded task of the lane is returned (see ImmediateSubmitQueue::load()); only when there
+  // are no tasks of the lane at all a task of the other lane is used. This way bulk transfers never end up in
+  // front of interactive requests, nor the other way around, when there is more than one queue.
+  task::ImmediateSubmitQueue* get_immediate_submit_queue_task(ImmediateSubmitRequest::Lane lane COMMA_CWDEBUG_ONLY(bool debug));
+
+ private:
+  // Returns the least loaded task in tasks that may be used for lane, or nullptr if there is none.
+  // If idle_only is set, only tasks of lane with a load of zero are considered.
+  static task::ImmediateSubmitQueue* least_loaded_task(QueuePoolTasks const& tasks, ImmediateSubmitRequest::Lane lane, bool idle_only);
 };
 
 } // namespace vulkan
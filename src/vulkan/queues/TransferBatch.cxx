@@ -0,0 +1,105 @@
+#include "sys.h"
+#include "TransferBatch.h"
+#include <algorithm>
+
+namespace vulkan {
+
+bool TransferBatch::touches(vk::Buffer vh_buffer, vk::DeviceSize offset, vk::DeviceSize size) const
+{
+  vk::DeviceSize const end = (size == VK_WHOLE_SIZE) ? VK_WHOLE_SIZE : offset + size;
+  return std::any_of(m_pre_transfer_buffer_barriers.begin(), m_pre_transfer_buffer_barriers.end(),
+      [=](vk::BufferMemoryBarrier const& barrier){
+        vk::DeviceSize const barrier_end = (barrier.size == VK_WHOLE_SIZE) ? VK_WHOLE_SIZE : barrier.offset + barrier.size;
+        return barrier.buffer == vh_buffer && barrier.offset < end && offset < barrier_end;
+      });
+}
+
+bool TransferBatch::touches(vk::Image vh_image) const
+{
+  // Don't bother with comparing subresource ranges: two uploads to the same image end up in different batches.
+  return std::any_of(m_pre_transfer_image_barriers.begin(), m_pre_transfer_image_barriers.end(),
+      [=](vk::ImageMemoryBarrier const& barrier){ return barrier.image == vh_image; });
+}
+
+void TransferBatch::add_pre_transfer_barrier(vk::PipelineStageFlags generating_stages, vk::BufferMemoryBarrier const& barrier)
+{
+  m_generating_stages |= generating_stages;
+  m_pre_transfer_buffer_barriers.push_back(barrier);
+}
+
+void TransferBatch::add_pre_transfer_barrier(vk::PipelineStageFlags generating_stages, vk::ImageMemoryBarrier const& barrier)
+{
+  m_generating_stages |= generating_stages;
+  m_pre_transfer_image_barriers.push_back(barrier);
+}
+
+void TransferBatch::copy_buffer(vk::Buffer vh_src_buffer, vk::Buffer vh_dst_buffer, vk::BufferCopy const& region)
+{
+  // Most of the time all uploads use the same staging buffer; if they also have the same target then use a single vkCmdCopyBuffer.
+  if (m_buffer_copies.empty() || m_buffer_copies.back().m_vh_src_buffer != vh_src_buffer || m_buffer_copies.back().m_vh_dst_buffer != vh_dst_buffer)
+    m_buffer_copies.push_back({ vh_src_buffer, vh_dst_buffer, {} });
+  m_buffer_copies.back().m_regions.push_back(region);
+}
+
+void TransferBatch::copy_buffer_to_image(vk::Buffer vh_src_buffer, vk::Image vh_dst_image, vk::ImageLayout dst_image_layout, std::vector<vk::BufferImageCopy> const& regions)
+{
+  m_buffer_image_copies.push_back({ vh_src_buffer, vh_dst_image, dst_image_layout, regions });
+}
+
+void TransferBatch::add_post_transfer_barrier(vk::PipelineStageFlags consuming_stages, vk::BufferMemoryBarrier const& barrier)
+{
+  m_consuming_stages |= consuming_stages;
+  m_post_transfer_buffer_barriers.push_back(barrier);
+}
+
+void TransferBatch::add_post_transfer_barrier(vk::PipelineStageFlags consuming_stages, vk::ImageMemoryBarrier const& barrier)
+{
+  m_consuming_stages |= consuming_stages;
+  m_post_transfer_image_barriers.push_back(barrier);
+}
+
+void TransferBatch::record(handle::CommandBuffer command_buffer) const
+{
+  DoutEntering(dc::vulkan, "TransferBatch::record(" << command_buffer << ") [" << this << "]");
+  // Don't record empty batches.
+  ASSERT(!empty());
+
+  command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+  if (!m_pre_transfer_buffer_barriers.empty() || !m_pre_transfer_image_barriers.empty())
+    command_buffer->pipelineBarrier(m_generating_stages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0),
+        {}, m_pre_transfer_buffer_barriers, m_pre_transfer_image_barriers);
+
+  for (BufferCopies const& buffer_copies : m_buffer_copies)
+    command_buffer->copyBuffer(buffer_copies.m_vh_src_buffer, buffer_copies.m_vh_dst_buffer, buffer_copies.m_regions);
+  for (BufferImageCopies const& buffer_image_copies : m_buffer_image_copies)
+    command_buffer->copyBufferToImage(buffer_image_copies.m_vh_src_buffer, buffer_image_copies.m_vh_dst_image,
+        buffer_image_copies.m_dst_image_layout, buffer_image_copies.m_regions);
+
+  // This starts with a barrier that makes the copy to the first level visible to the first blit.
+  for (MipmapGeneration const& mipmap_generation : m_mipmap_generations)
+    mipmap_generation.record(*command_buffer.operator->());
+
+  if (!m_post_transfer_buffer_barriers.empty() || !m_post_transfer_image_barriers.empty())
+    command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, m_consuming_stages, vk::DependencyFlags(0),
+        {}, m_post_transfer_buffer_barriers, m_post_transfer_image_barriers);
+
+  command_buffer->end();
+}
+
+void TransferBatch::clear()
+{
+  m_size = 0;
+  m_generating_stages = {};
+  m_pre_transfer_buffer_barriers.clear();
+  m_pre_transfer_image_barriers.clear();
+  m_buffer_copies.clear();
+  m_buffer_image_copies.clear();
+  m_mipmap_generations.clear();
+  m_consuming_stages = {};
+  m_post_transfer_buffer_barriers.clear();
+  m_post_transfer_image_barriers.clear();
+  m_after_submit.clear();
+}
+
+} // namespace vulkan
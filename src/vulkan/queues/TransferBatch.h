@@ -0,0 +1,122 @@
+#pragma once
+
+#include "CommandBuffer.h"
+#include "QueueFamilyProperties.h"
+#include "MipmapGeneration.h"
+#include <vulkan/vulkan.hpp>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "debug.h"
+
+namespace vulkan {
+
+// Collects the barriers and copy commands of several ImmediateSubmitRequest's
+// so that they can be recorded into a single command buffer.
+//
+// All pre-transfer barriers are combined into one pipelineBarrier that is recorded
+// before all copy commands, and all post-transfer barriers are combined into one
+// pipelineBarrier that is recorded after all copy commands. Mip chains that are
+// generated with generate_mipmaps are recorded in between.
+//
+// This is only correct when no two requests in the same batch touch the same
+// resource; a request must therefore test with `touches` before adding anything.
+//
+// Usage (from a batch record function):
+//
+//   if (batch.touches(m_vh_target_buffer, m_buffer_offset, m_data_size))
+//     return false;            // Let ImmediateSubmitQueue start a new batch.
+//   batch.add_pre_transfer_barrier(m_generating_stages, pre_transfer_buffer_memory_barrier);
+//   batch.copy_buffer(src, dst, buffer_copy_region);
+//   batch.add_post_transfer_barrier(m_consuming_stages, post_transfer_buffer_memory_barrier);
+//   return true;
+//
+class TransferBatch
+{
+ private:
+  struct BufferCopies
+  {
+    vk::Buffer m_vh_src_buffer;
+    vk::Buffer m_vh_dst_buffer;
+    std::vector<vk::BufferCopy> m_regions;
+  };
+
+  struct BufferImageCopies
+  {
+    vk::Buffer m_vh_src_buffer;
+    vk::Image m_vh_dst_image;
+    vk::ImageLayout m_dst_image_layout;
+    std::vector<vk::BufferImageCopy> m_regions;
+  };
+
+  // Set by ImmediateSubmitQueue.
+  QueueFamilyPropertiesIndex m_queue_family;                            // The queue family of the queue that this batch will be submitted to.
+  vk::Semaphore m_vh_timeline_semaphore;                                // The timeline semaphore that will be signaled when this batch finished executing.
+  uint64_t m_signal_value{};                                            // The value that m_vh_timeline_semaphore will be signaled with.
+
+  int m_size{};                                                         // The number of requests that were added to this batch.
+  vk::PipelineStageFlags m_generating_stages;                           // The union of the source stages of all pre-transfer barriers.
+  std::vector<vk::BufferMemoryBarrier> m_pre_transfer_buffer_barriers;
+  std::vector<vk::ImageMemoryBarrier> m_pre_transfer_image_barriers;
+  std::vector<BufferCopies> m_buffer_copies;                            // Copy commands; consecutive regions with the same buffers are merged.
+  std::vector<BufferImageCopies> m_buffer_image_copies;
+  std::vector<MipmapGeneration> m_mipmap_generations;                   // Recorded after all copy commands.
+  vk::PipelineStageFlags m_consuming_stages;                            // The union of the destination stages of all post-transfer barriers.
+  std::vector<vk::BufferMemoryBarrier> m_post_transfer_buffer_barriers;
+  std::vector<vk::ImageMemoryBarrier> m_post_transfer_image_barriers;
+  std::vector<std::function<void()>> m_after_submit;                    // Called by ImmediateSubmitQueue after the batch was submitted.
+
+ public:
+  // Returns true if a previously added request already uses (the given range of) this resource.
+  bool touches(vk::Buffer vh_buffer, vk::DeviceSize offset, vk::DeviceSize size) const;
+  bool touches(vk::Image vh_image) const;
+
+  void add_pre_transfer_barrier(vk::PipelineStageFlags generating_stages, vk::BufferMemoryBarrier const& barrier);
+  void add_pre_transfer_barrier(vk::PipelineStageFlags generating_stages, vk::ImageMemoryBarrier const& barrier);
+  void copy_buffer(vk::Buffer vh_src_buffer, vk::Buffer vh_dst_buffer, vk::BufferCopy const& region);
+  void copy_buffer_to_image(vk::Buffer vh_src_buffer, vk::Image vh_dst_image, vk::ImageLayout dst_image_layout, std::vector<vk::BufferImageCopy> const& regions);
+  // Generate the mip chain of an image after copying its first level; only allowed when queue_family() has graphics capability.
+  // The post-transfer barriers of the image must take the layouts into account that this leaves the levels in (see MipmapGeneration::final_barriers).
+  void generate_mipmaps(MipmapGeneration const& mipmap_generation) { m_mipmap_generations.push_back(mipmap_generation); }
+  void add_post_transfer_barrier(vk::PipelineStageFlags consuming_stages, vk::BufferMemoryBarrier const& barrier);
+  void add_post_transfer_barrier(vk::PipelineStageFlags consuming_stages, vk::ImageMemoryBarrier const& barrier);
+  // Add the release half of a queue family ownership transfer (the destination stages are ignored).
+  void add_release_barrier(vk::BufferMemoryBarrier const& barrier) { add_post_transfer_barrier(vk::PipelineStageFlagBits::eBottomOfPipe, barrier); }
+  void add_release_barrier(vk::ImageMemoryBarrier const& barrier) { add_post_transfer_barrier(vk::PipelineStageFlagBits::eBottomOfPipe, barrier); }
+  // Call action once the command buffer of this batch was submitted; for example, to publish the acquire half of an ownership
+  // transfer, so that nobody waits for signal_value() before it is guaranteed that it will be signaled.
+  void after_submit(std::function<void()> action) { m_after_submit.push_back(std::move(action)); }
+
+  // Called by ImmediateSubmitQueue before adding requests.
+  void set_submit_info(QueueFamilyPropertiesIndex queue_family, vk::Semaphore vh_timeline_semaphore, uint64_t signal_value)
+  {
+    m_queue_family = queue_family;
+    m_vh_timeline_semaphore = vh_timeline_semaphore;
+    m_signal_value = signal_value;
+  }
+
+  // Called by ImmediateSubmitQueue after a request was added successfully.
+  void added() { ++m_size; }
+
+  // Record everything that was added into command_buffer (including begin and end).
+  void record(handle::CommandBuffer command_buffer) const;
+
+  // Called by ImmediateSubmitQueue before clear(): append the actions that must be called after submitting to actions.
+  void move_after_submit_actions(std::vector<std::function<void()>>& actions)
+  {
+    std::move(m_after_submit.begin(), m_after_submit.end(), std::back_inserter(actions));
+    m_after_submit.clear();
+  }
+
+  // Start a new batch; this keeps the capacity of the vectors (and the submit info).
+  void clear();
+
+  // Accessors.
+  QueueFamilyPropertiesIndex queue_family() const { return m_queue_family; }
+  vk::Semaphore vh_timeline_semaphore() const { return m_vh_timeline_semaphore; }
+  uint64_t signal_value() const { return m_signal_value; }
+  int size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+};
+
+} // namespace vulkan
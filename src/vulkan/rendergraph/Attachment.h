@@ -37,6 +37,9 @@ class Attachment
 
   std::string const m_name;                             // Human readable name of the attachment; e.g. "depth" or "output".
   mutable vk::ImageLayout m_final_layout = {};
+  // Set by RenderGraph::compute_memory_aliasing.
+  mutable bool m_is_transient = false;                  // No render pass loads or stores this attachment: its contents never leave the render pass.
+  mutable int m_alias_group = -1;                       // Index into RenderGraph::alias_groups(), or -1 if this attachment has memory of its own.
 
  private:
   Attachment(task::SynchronousWindow* owning_window, std::string const& name, ImageViewKind const& image_view_kind, bool is_swapchain_image);
@@ -120,6 +123,14 @@ class Attachment
     return m_final_layout;
   }
 
+  // Called by rendergraph::RenderGraph::compute_memory_aliasing.
+  void set_is_transient() const { m_is_transient = true; }
+  void set_alias_group(int alias_group) const { m_alias_group = alias_group; }
+
+  // Transient attachments are created with vk::ImageUsageFlagBits::eTransientAttachment (and lazily allocated memory if available).
+  bool is_transient() const { return m_is_transient; }
+  int alias_group() const { return m_alias_group; }
+
   // These used to be part of vulkan::Attachment, when that was still derived from this class.
   // Its more of a usage interface - not a rendergraph generation interface.
 
@@ -5,6 +5,8 @@
 #include "LogicalDevice.h"
 #include "SynchronousWindow.h"
 #include "debug.h"
+#include <algorithm>
+#include <map>
 #ifdef CWDEBUG
 #include "debug_ostream_operators.h"
 #include "utils/AIAlert.h"
@@ -377,6 +379,10 @@ void RenderGraph::generate(task::SynchronousWindow* owning_window)
   boost::write_graphviz(file, g, boost::make_label_writer(get(&gv::VertexProperties::name, g)), gv::EdgeColorWriter(g));
 #endif
 
+  // Determine which attachments are transient and which can share memory. This must be done before
+  // creating the render passes, because it determines the subpass dependencies of those.
+  compute_memory_aliasing(all_attachments, presentation_attachment, owning_window->logical_device()->supports_lazily_allocated_memory());
+
   // Run over all render passes to create them.
   for_each_render_pass(search_forwards,
       [owning_window](RenderPass* render_pass, std::vector<RenderPass*>& UNUSED_ARG(path))
@@ -388,6 +394,128 @@ void RenderGraph::generate(task::SynchronousWindow* owning_window)
   owning_window->detect_if_imgui_is_used();
 }
 
+void RenderGraph::compute_memory_aliasing(std::set<Attachment const*, Attachment::CompareIDLessThan> const& all_attachments,
+    Attachment const& presentation_attachment, bool supports_lazily_allocated_memory)
+{
+  DoutEntering(dc::renderpass, "RenderGraph::compute_memory_aliasing(all_attachments, " << presentation_attachment << ", " << supports_lazily_allocated_memory << ")");
+
+  // Collect all render passes, and for each of them the set of render passes that precede it.
+  // This can not be done inside a for_each_render_pass because for_each_render_pass_from uses the same m_traversal_id.
+  std::vector<RenderPass*> render_passes;
+  for_each_render_pass(search_forwards,
+      [&](RenderPass* render_pass, std::vector<RenderPass*>& UNUSED_ARG(path))
+      {
+        render_passes.push_back(render_pass);
+        return false;
+      });
+  std::map<RenderPass const*, std::set<RenderPass const*>> preceding_render_passes;
+  for (RenderPass* render_pass : render_passes)
+  {
+    std::set<RenderPass const*>& preceding = preceding_render_passes[render_pass];
+    for_each_render_pass_from(render_pass, search_backwards,
+        [&](RenderPass* preceding_render_pass, std::vector<RenderPass*>& UNUSED_ARG(path))
+        {
+          preceding.insert(preceding_render_pass);
+          return false;
+        });
+  }
+
+  // The lifetime of an attachment is the set of render passes that know it. The lifetime of attachment1 ends
+  // before the lifetime of attachment2 begins if every render pass that knows attachment1 precedes every
+  // render pass that knows attachment2.
+  std::map<Attachment const*, std::vector<RenderPass*>> lifetimes;
+  auto ends_before = [&](Attachment const* attachment1, Attachment const* attachment2)
+  {
+    for (RenderPass const* render_pass2 : lifetimes[attachment2])
+    {
+      std::set<RenderPass const*> const& preceding = preceding_render_passes[render_pass2];
+      for (RenderPass const* render_pass1 : lifetimes[attachment1])
+        if (!preceding.contains(render_pass1))
+          return false;
+    }
+    return true;
+  };
+
+  // Only attachments that are used by render passes alone can share memory or be transient.
+  vk::ImageUsageFlags const attachment_only_usage =
+    vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment |
+    vk::ImageUsageFlagBits::eInputAttachment | vk::ImageUsageFlagBits::eTransientAttachment;
+
+  for (Attachment const* attachment : all_attachments)
+  {
+    // The swapchain images are not ours.
+    if (attachment->render_graph_attachment_index() == presentation_attachment.render_graph_attachment_index())
+      continue;
+    if ((attachment->image_kind()->usage & ~attachment_only_usage))
+      continue;
+
+    bool is_transient = true;
+    std::vector<RenderPass*>& lifetime = lifetimes[attachment];
+    for (RenderPass* render_pass : render_passes)
+      if (render_pass->is_known(attachment))
+      {
+        lifetime.push_back(render_pass);
+        if (render_pass->is_load(attachment) || render_pass->is_store(attachment))
+          is_transient = false;
+      }
+
+    if (is_transient)
+    {
+      Dout(dc::renderpass, "Attachment \"" << attachment << "\" is transient.");
+      attachment->set_is_transient();
+      // Lazily allocated memory is (nearly) free; don't let it share memory with other attachments.
+      if (supports_lazily_allocated_memory)
+        continue;
+    }
+
+    // Contents that must survive until the next frame can not be shared (the initial layout is only defined in that case).
+    if (attachment->image_kind()->initial_layout != vk::ImageLayout::eUndefined)
+      continue;
+
+    // Greedily add the attachment to the first group with which it has no overlapping lifetimes.
+    bool added = false;
+    for (std::vector<Attachment const*>& alias_group : m_alias_groups)
+    {
+      if (std::all_of(alias_group.begin(), alias_group.end(),
+            [&](Attachment const* member){ return ends_before(member, attachment) || ends_before(attachment, member); }))
+      {
+        alias_group.push_back(attachment);
+        added = true;
+        break;
+      }
+    }
+    if (!added)
+      m_alias_groups.push_back({ attachment });
+  }
+
+  // Only groups with more than one attachment actually share memory.
+  std::erase_if(m_alias_groups, [](std::vector<Attachment const*> const& alias_group){ return alias_group.size() < 2; });
+
+  for (int alias_group_index = 0; alias_group_index < static_cast<int>(m_alias_groups.size()); ++alias_group_index)
+  {
+    std::vector<Attachment const*>& alias_group = m_alias_groups[alias_group_index];
+    // All lifetimes in a group are disjoint, so this is a total order.
+    std::sort(alias_group.begin(), alias_group.end(), ends_before);
+#ifdef CWDEBUG
+    Dout(dc::renderpass|continued_cf, "Alias group " << alias_group_index << ": ");
+    char const* prefix = "";
+#endif
+    for (Attachment const* attachment : alias_group)
+    {
+      Dout(dc::continued, prefix << attachment);
+      Debug(prefix = ", ");
+      attachment->set_alias_group(alias_group_index);
+      // The render pass(es) that begin the lifetime of every attachment but the first must wait until the
+      // preceding attachments of the group are no longer accessed.
+      if (attachment != alias_group.front())
+        for (RenderPass* render_pass : lifetimes[attachment])
+          if (RenderPass::find_by_ID(render_pass->known_attachments(), attachment)->is_source())
+            render_pass->set_reuses_aliased_memory();
+    }
+    Dout(dc::finish, ".");
+  }
+}
+
 void RenderGraph::operator=(RenderPassStream& sink)
 {
   // Only assign to each RenderGraph once.
@@ -703,6 +831,61 @@ void RenderGraph::testsuite()
     TEST(lighting->stores(~specular) >> render_pass->stores(output) >> pass1[+specular]->stores(output));
     render_graph.has_with(in, specular, LOAD, STORE, &render_pass);
   }
+  // Memory aliasing: t1, t2 and t3 are only used inside lighting, pass1 and render_pass respectively.
+  // They are transient and, without lazily allocated memory, share one alias group in render pass order.
+  // specular and albedo are sampled too, so they never share memory.
+  vulkan::ImageKind const k2({
+    .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled
+  });
+  vulkan::ImageViewKind const v2{k2, {}};
+  for (bool supports_lazily_allocated_memory : { false, true })
+  {
+    TestWindow window;
+    Attachment const specular{&window, "specular", v2};
+    Attachment const albedo{&window, "albedo", v2};
+    Attachment const output{&window, "output", v1};
+    Attachment const t1{&window, "t1", v1};
+    Attachment const t2{&window, "t2", v1};
+    Attachment const t3{&window, "t3", v1};
+    RenderGraph& render_graph(window.render_graph());
+    RenderPass& lighting = window.lighting;
+    RenderPass& pass1 = window.pass1;
+    RenderPass& render_pass = window.render_pass;
+    window.run_test([&](){
+        Dout(dc::renderpass, "Running test: memory aliasing (supports_lazily_allocated_memory = " << supports_lazily_allocated_memory << ")");
+        render_graph = lighting[-t1]->stores(specular) >> pass1[-t2]->stores(albedo) >> render_pass[+specular][+albedo][-t3]->stores(output);
+        render_graph.generate(nullptr);
+    });
+    // generate(nullptr) stops before compute_memory_aliasing; output plays the role of the swapchain attachment.
+    std::set<Attachment const*, Attachment::CompareIDLessThan> all_attachments;
+    render_graph.for_each_render_pass(search_forwards,
+        [&](RenderPass* node, std::vector<RenderPass*>& UNUSED_ARG(path))
+        {
+          node->add_attachments_to(all_attachments);
+          return false;
+        });
+    render_graph.compute_memory_aliasing(all_attachments, output, supports_lazily_allocated_memory);
+
+    ASSERT(t1.is_transient() && t2.is_transient() && t3.is_transient());
+    ASSERT(!specular.is_transient() && !albedo.is_transient() && !output.is_transient());
+    ASSERT(specular.alias_group() == -1 && albedo.alias_group() == -1 && output.alias_group() == -1);
+    if (supports_lazily_allocated_memory)
+    {
+      ASSERT(render_graph.alias_groups().empty());
+      ASSERT(t1.alias_group() == -1 && t2.alias_group() == -1 && t3.alias_group() == -1);
+      ASSERT(!pass1.reuses_aliased_memory() && !render_pass.reuses_aliased_memory());
+    }
+    else
+    {
+      ASSERT(render_graph.alias_groups().size() == 1);
+      std::vector<Attachment const*> const& alias_group = render_graph.alias_groups()[0];
+      ASSERT(alias_group.size() == 3 && alias_group[0] == &t1 && alias_group[1] == &t2 && alias_group[2] == &t3);
+      ASSERT(t1.alias_group() == 0 && t2.alias_group() == 0 && t3.alias_group() == 0);
+      // Only the render passes that begin the lifetime of t2 and t3 must wait for the previous user of the memory.
+      ASSERT(pass1.reuses_aliased_memory() && render_pass.reuses_aliased_memory());
+    }
+    ASSERT(!lighting.reuses_aliased_memory());
+  }
 
   DoutFatal(dc::fatal, "RenderGraph::testuite successful!");
 }
@@ -3,6 +3,7 @@
 #include "RenderPass.h"
 #include "ClearValue.h"
 #include <map>
+#include <set>
 
 namespace vulkan::rendergraph {
 
@@ -20,6 +21,7 @@ class RenderGraph
   mutable int m_traversal_id = {};                      // Unique ID to identify which RenderPass nodes have already visited.
                                                         // Incremented every call to for_each_render_pass.
   bool m_have_incoming_outgoing = false;                // Set to true after m_sources was fixed to point to real sources and all RenderPass nodes have correct m_outgoing_vertices.
+  std::vector<std::vector<Attachment const*>> m_alias_groups;   // Groups of attachments with disjoint lifetimes that share the same memory, each in render pass order (set by generate()).
 
  public:
   // Filled by SynchronousWindow.
@@ -34,6 +36,15 @@ class RenderGraph
   void for_each_render_pass_from(RenderPass* start, Direction direction, std::function<bool(RenderPass*, std::vector<RenderPass*>&)> lambda) const;
   void generate(task::SynchronousWindow* owning_window);
 
+  // Accessor for the result of compute_memory_aliasing (only valid after generate()).
+  std::vector<std::vector<Attachment const*>> const& alias_groups() const { return m_alias_groups; }
+
+ private:
+  void compute_memory_aliasing(std::set<Attachment const*, Attachment::CompareIDLessThan> const& all_attachments,
+      Attachment const& presentation_attachment, bool supports_lazily_allocated_memory);
+
+ public:
+
 #ifdef CWDEBUG
   // Testsuite stuff.
   static void testsuite();
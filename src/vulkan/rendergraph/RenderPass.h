@@ -50,6 +50,7 @@ class RenderPass
   int m_traversal_id = {};                                              // Unique ID to identify which RenderPass nodes have already visited.
   std::set<RenderPass*> m_incoming_vertices;
   std::set<RenderPass*> m_outgoing_vertices;
+  bool m_reuses_aliased_memory = false;                                 // Set if this render pass is the first to use an attachment whose memory was used by a preceding render pass.
 
   // RenderPass::create:
   utils::Vector<vk_defaults::AttachmentDescription, pAttachmentsIndex> m_attachment_descriptions;
@@ -136,6 +137,8 @@ class RenderPass
       SearchType search_type, std::vector<RenderPass*>& path, bool skip_lambda = false);
   void add_attachments_to(std::set<Attachment const*, Attachment::CompareIDLessThan>& attachments);
   void set_is_present_on_attachment_sink_with_index(AttachmentIndex index);
+  void set_reuses_aliased_memory() { m_reuses_aliased_memory = true; }
+  bool reuses_aliased_memory() const { return m_reuses_aliased_memory; }
 
  private:
   void preceding_render_pass_stores(Attachment const* attachment);
@@ -7,6 +7,7 @@
 #include <boost/intrusive_ptr.hpp>
 #include <vector>
 #include <type_traits>
+#include <algorithm>
 #include "debug.h"
 
 // Forward declaration
@@ -39,8 +40,11 @@ class VertexShaderInputSetFeeder final : public DataFeeder
 
   uint32_t chunk_size() const override { return m_input_set->chunk_size(); }
   int chunk_count() const override { return m_input_set->chunk_count(); }
+  void set_max_batch_size(int max_chunks) override { m_input_set->set_max_batch_size(max_chunks); }
   int next_batch() override { return m_input_set->next_batch(); }
   void get_chunks(unsigned char* chunk_ptr) override { m_input_set->get_chunks(chunk_ptr); }
+  bool is_range_addressable() const override { return m_input_set->is_range_addressable(); }
+  void fill_chunks(unsigned char* chunk_ptr, int begin, int end) override { m_input_set->fill_chunks(chunk_ptr, begin, end); }
 };
 
 // ENTRY should be a struct existing solely of types specified in math/glsl.h,
@@ -75,6 +79,11 @@ class VertexShaderInputSetFeeder final : public DataFeeder
 template<typename ENTRY>
 class VertexShaderInputSet : public VertexShaderInputSetBase
 {
+ private:
+  int m_max_batch_size{1};              // The maximum number of entries per batch, as negotiated with the consumer (see set_max_batch_size).
+  int m_batch_size{};                   // The value returned by the last call to next_batch.
+  int m_next_entry{};                   // The index of the next entry that get_chunks will create.
+
  public:
   // Constructor. Pass the input rate to the base class, extracting that info from ENTRY.
   VertexShaderInputSet() : VertexShaderInputSetBase(shaderbuilder::ShaderVariableLayouts<ENTRY>::input_rate) { }
@@ -85,18 +94,61 @@ class VertexShaderInputSet : public VertexShaderInputSetBase
     return sizeof(ENTRY);
   }
 
-  int next_batch() override
+  void set_max_batch_size(int max_chunks) override final
+  {
+    m_max_batch_size = max_chunks;
+  }
+
+  int next_batch() override final
+  {
+    // Return as many entries as the consumer can accept, in multiples of entries_per_create_entry().
+    int const step = entries_per_create_entry();
+    int const remaining = chunk_count() - m_next_entry;
+    m_batch_size = std::min(remaining, std::max(step, m_max_batch_size / step * step));
+    return m_batch_size;
+  }
+
+  void get_chunks(unsigned char* chunk_ptr) override final
+  {
+    ASSERT(reinterpret_cast<size_t>(chunk_ptr) % alignof(ENTRY) == 0);
+    create_entries(reinterpret_cast<ENTRY*>(chunk_ptr), m_next_entry, m_next_entry + m_batch_size);
+    m_next_entry += m_batch_size;
+    // Allow the same input set to be used again.
+    if (m_next_entry == chunk_count())
+      m_next_entry = 0;
+  }
+
+  void fill_chunks(unsigned char* chunk_ptr, int begin, int end) override final
+  {
+    ASSERT(reinterpret_cast<size_t>(chunk_ptr) % alignof(ENTRY) == 0);
+    create_entries(reinterpret_cast<ENTRY*>(chunk_ptr), begin, end);
+  }
+
+ protected:
+  // The number of entries that a single call to create_entry produces.
+  virtual int entries_per_create_entry() const
   {
     // Default value.
     return 1;
   }
 
+  // Create entries_per_create_entry() entries.
   virtual void create_entry(ENTRY* input_entry_ptr) = 0;
 
-  void get_chunks(unsigned char* chunk_ptr) override final
+  // Create entries [begin, end>, where input_entry_ptr points to entry `begin`.
+  //
+  // The default calls create_entry once for every entries_per_create_entry() entries.
+  // Override this to produce many entries per call in a tight (vectorizable) loop.
+  //
+  // Normally this is called for consecutive ranges, each a multiple of entries_per_create_entry()
+  // in size (except possibly the last one). If is_range_addressable() is overridden to return true
+  // then this function must be thread-safe: it will then be called concurrently for disjoint
+  // ranges of arbitrary size.
+  virtual void create_entries(ENTRY* input_entry_ptr, int begin, int end)
   {
-    ASSERT(reinterpret_cast<size_t>(chunk_ptr) % alignof(ENTRY) == 0);
-    create_entry(reinterpret_cast<ENTRY*>(chunk_ptr));
+    int const step = entries_per_create_entry();
+    for (int entry = begin; entry < end; entry += step)
+      create_entry(input_entry_ptr + (entry - begin));
   }
 };
 
@@ -0,0 +1,131 @@
+#include "sys.h"
+#include "vk_utils/BCnDecoder.h"
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "debug.h"
+
+// Decode a few hand made BC1, BC3 and BC7 blocks with vk_utils::bcn and compare the result
+// with reference texels that were calculated from the block layout in the specification.
+//
+// Returns a non-zero exit code if any of the blocks decodes to something else.
+
+namespace {
+
+using Texel = std::array<unsigned char, 4>;
+using Texels = std::array<Texel, 16>;
+
+// BC1, c0 = red (0xf800) > c1 = blue (0x001f): four color mode. Texel i uses index i % 4.
+constexpr unsigned char bc1_four_color_block[8] = { 0x00, 0xf8, 0x1f, 0x00, 0xe4, 0xe4, 0xe4, 0xe4 };
+constexpr Texel bc1_four_color_palette[4] = { { 255, 0, 0, 255 }, { 0, 0, 255, 255 }, { 170, 0, 85, 255 }, { 85, 0, 170, 255 } };
+
+// BC1, c0 = blue < c1 = red: three color mode. All texels use index 3 (transparent black).
+constexpr unsigned char bc1_three_color_block[8] = { 0x1f, 0x00, 0x00, 0xf8, 0xff, 0xff, 0xff, 0xff };
+
+// BC3, a0 = 255 > a1 = 0: eight alpha mode. Texel i uses alpha index i % 8.
+// The color block has c0 = blue < c1 = red, but BC3 always uses four color mode. Texel i uses color index i % 4.
+constexpr unsigned char bc3_block[16] = {
+  0xff, 0x00, 0x88, 0xc6, 0xfa, 0x88, 0xc6, 0xfa,
+  0x1f, 0x00, 0x00, 0xf8, 0xe4, 0xe4, 0xe4, 0xe4
+};
+constexpr unsigned char bc3_alphas[8] = { 255, 0, 219, 182, 146, 109, 73, 36 };
+constexpr Texel bc3_palette[4] = { { 0, 0, 255 }, { 255, 0, 0 }, { 85, 0, 170 }, { 170, 0, 85 } };
+
+// BC7 mode 6: endpoints (127, 0, 0, 127) and (0, 127, 0, 127) with both p-bits set. Texel i uses index i.
+constexpr unsigned char bc7_mode6_block[16] = {
+  0xc0, 0x3f, 0x00, 0xf0, 0x07, 0x00, 0xfe, 0xff, 0x11, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe
+};
+constexpr Texels bc7_mode6_texels = {{
+  { 255, 1, 1, 255 }, { 239, 17, 1, 255 }, { 219, 37, 1, 255 }, { 203, 53, 1, 255 },
+  { 188, 68, 1, 255 }, { 172, 84, 1, 255 }, { 152, 104, 1, 255 }, { 136, 120, 1, 255 },
+  { 120, 136, 1, 255 }, { 104, 152, 1, 255 }, { 84, 172, 1, 255 }, { 68, 188, 1, 255 },
+  { 53, 203, 1, 255 }, { 37, 219, 1, 255 }, { 17, 239, 1, 255 }, { 1, 255, 1, 255 }
+}};
+
+// BC7 with all mode bits zero is invalid and decodes to transparent black.
+constexpr unsigned char bc7_invalid_block[16] = {};
+
+int s_failures = 0;
+
+void compare(std::string const& name, unsigned char const* rgba, Texel const* expected, int number_of_texels)
+{
+  for (int i = 0; i < number_of_texels; ++i)
+  {
+    if (std::memcmp(rgba + 4 * i, expected[i].data(), 4) == 0)
+      continue;
+    std::cout << name << ": texel " << i << " is (" <<
+      (int)rgba[4 * i] << ", " << (int)rgba[4 * i + 1] << ", " << (int)rgba[4 * i + 2] << ", " << (int)rgba[4 * i + 3] << "), expected (" <<
+      (int)expected[i][0] << ", " << (int)expected[i][1] << ", " << (int)expected[i][2] << ", " << (int)expected[i][3] << ")." << std::endl;
+    ++s_failures;
+    return;
+  }
+  std::cout << name << ": OK" << std::endl;
+}
+
+void compare(std::string const& name, unsigned char const* rgba, Texels const& expected)
+{
+  compare(name, rgba, expected.data(), 16);
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  using namespace vk_utils::bcn;
+  std::array<unsigned char, 16 * 4> rgba;
+
+  Texels bc1_four_color_texels;
+  for (int i = 0; i < 16; ++i)
+    bc1_four_color_texels[i] = bc1_four_color_palette[i % 4];
+  decode_bc1_block(bc1_four_color_block, rgba.data(), true);
+  compare("BC1 four color mode", rgba.data(), bc1_four_color_texels);
+
+  Texels bc1_three_color_texels;
+  bc1_three_color_texels.fill({ 0, 0, 0, 0 });
+  decode_bc1_block(bc1_three_color_block, rgba.data(), true);
+  compare("BC1 three color mode (RGBA)", rgba.data(), bc1_three_color_texels);
+
+  bc1_three_color_texels.fill({ 0, 0, 0, 255 });
+  decode_bc1_block(bc1_three_color_block, rgba.data(), false);
+  compare("BC1 three color mode (RGB)", rgba.data(), bc1_three_color_texels);
+
+  Texels bc3_texels;
+  for (int i = 0; i < 16; ++i)
+  {
+    bc3_texels[i] = bc3_palette[i % 4];
+    bc3_texels[i][3] = bc3_alphas[i % 8];
+  }
+  decode_bc3_block(bc3_block, rgba.data());
+  compare("BC3", rgba.data(), bc3_texels);
+
+  decode_bc7_block(bc7_mode6_block, rgba.data());
+  compare("BC7 mode 6", rgba.data(), bc7_mode6_texels);
+
+  Texels bc7_invalid_texels;
+  bc7_invalid_texels.fill({ 0, 0, 0, 0 });
+  decode_bc7_block(bc7_invalid_block, rgba.data());
+  compare("BC7 invalid block", rgba.data(), bc7_invalid_texels);
+
+  // A 5x2 level consists of two blocks, of which only the left column of the top half of the second one is used.
+  std::array<unsigned char, 16> bc1_level;
+  std::memcpy(bc1_level.data(), bc1_four_color_block, 8);
+  std::memcpy(bc1_level.data() + 8, bc1_three_color_block, 8);
+  std::vector<unsigned char> level(5 * 2 * 4);
+  decode_level(vk::Format::eBc1RgbUnormBlock, bc1_level.data(), { 5, 2 }, level.data());
+  std::array<Texel, 10> level_texels;
+  for (int y = 0; y < 2; ++y)
+  {
+    for (int x = 0; x < 4; ++x)
+      level_texels[5 * y + x] = bc1_four_color_palette[x];
+    level_texels[5 * y + 4] = { 0, 0, 0, 255 };
+  }
+  compare("BC1 5x2 level", level.data(), level_texels.data(), level_texels.size());
+
+  Dout(dc::notice, "Leaving main()");
+  return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+#include "sys.h"
+#include "DispatchLoader.h"
+#include "memory/Allocator.h"
+#include "memory/BufferPools.h"
+#include "memory/BufferSlice.h"
+#include "debug/DebugSetName.h"
+#include <vk_mem_alloc.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <array>
+#include <string>
+
+// Compare allocating many small vertex and uniform buffers
+//   1) each with its own VkBuffer from the default VMA pools (what memory::Buffer did before BufferPools existed),
+//   2) each with its own VkBuffer from the custom pools of memory::BufferPools,
+//   3) as slices of one VkBuffer per category, sub-allocated by memory::SlicedBuffer.
+//
+// Build in release mode: in debug mode every allocation is also given a name, which dominates the timing.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using namespace vulkan;
+
+constexpr int number_of_buffers = 4096;
+
+struct Request
+{
+  vk::DeviceSize m_size;
+  memory::AllocationCategory m_category;
+};
+
+std::vector<Request> make_requests()
+{
+  // A mix of per-object uniform blocks and small meshes.
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<vk::DeviceSize> vertex_size(1, 64);
+  std::vector<Request> requests;
+  for (int i = 0; i < number_of_buffers; ++i)
+  {
+    if (i % 2 == 0)
+      requests.push_back({ 256, memory::AllocationCategory::uniform });
+    else
+      requests.push_back({ vertex_size(rng) * 1024, memory::AllocationCategory::vertex });
+  }
+  return requests;
+}
+
+vk::BufferUsageFlags usage_of(memory::AllocationCategory category)
+{
+  if (category == memory::AllocationCategory::uniform)
+    return vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst;
+  return vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst;
+}
+
+double milliseconds_since(clock_type::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+void print_result(char const* name, double create_ms, double destroy_ms, int buffer_count, VmaStatistics const& statistics)
+{
+  vk::DeviceSize const unused_bytes = statistics.blockBytes - statistics.allocationBytes;
+  std::cout << std::left << std::setw(14) << name << std::right <<
+    std::fixed << std::setprecision(3) <<
+    std::setw(10) << create_ms << " ms" <<
+    std::setw(10) << destroy_ms << " ms" <<
+    std::setw(10) << buffer_count <<
+    std::setw(8) << statistics.blockCount <<
+    std::setw(12) << statistics.blockBytes / 1024 << " KiB" <<
+    std::setw(12) << unused_bytes / 1024 << " KiB" << std::endl;
+}
+
+// Create (and then destroy) one buffer per request; the pool of each buffer is returned by get_pool.
+void run_per_buffer(char const* name, memory::Allocator const& allocator, std::vector<Request> const& requests,
+    std::function<VmaPool(vk::BufferCreateInfo const&, VmaAllocationCreateInfo const&, memory::AllocationCategory)> get_pool)
+{
+  std::vector<std::pair<vk::Buffer, VmaAllocation>> buffers(requests.size());
+  VmaStatistics statistics{};
+
+  auto start = clock_type::now();
+  for (size_t i = 0; i < requests.size(); ++i)
+  {
+    vk::BufferCreateInfo buffer_create_info{
+      .size = requests[i].m_size,
+      .usage = usage_of(requests[i].m_category)
+    };
+    VmaAllocationCreateInfo vma_allocation_create_info{
+      .usage = VMA_MEMORY_USAGE_AUTO
+    };
+    vma_allocation_create_info.pool = get_pool(buffer_create_info, vma_allocation_create_info, requests[i].m_category);
+    buffers[i].first = allocator.create_buffer(buffer_create_info, vma_allocation_create_info, &buffers[i].second, nullptr
+        COMMA_CWDEBUG_ONLY(Ambifix{"buffers[" + std::to_string(i) + "]"}));
+  }
+  double const create_ms = milliseconds_since(start);
+
+  statistics = allocator.calculate_statistics().total.statistics;
+
+  start = clock_type::now();
+  for (auto const& buffer : buffers)
+    allocator.destroy_buffer(buffer.first, buffer.second);
+  double const destroy_ms = milliseconds_since(start);
+
+  print_result(name, create_ms, destroy_ms, static_cast<int>(buffers.size()), statistics);
+}
+
+// Create one buffer per category and slice all requests from them with a memory::SlicedBuffer.
+void run_sliced(memory::Allocator const& allocator, std::vector<Request> const& requests, vk::DeviceSize min_uniform_buffer_offset_alignment)
+{
+  constexpr vk::DeviceSize vertex_alignment = 16;
+  std::array<vk::DeviceSize, 2> const alignment = { vertex_alignment, std::max(min_uniform_buffer_offset_alignment, vertex_alignment) };
+  std::array<vk::DeviceSize, 2> total_size{};
+  for (Request const& request : requests)
+  {
+    bool const is_uniform = request.m_category == memory::AllocationCategory::uniform;
+    total_size[is_uniform] += (request.m_size + alignment[is_uniform] - 1) & ~(alignment[is_uniform] - 1);
+  }
+
+  auto start = clock_type::now();
+  std::array<std::pair<vk::Buffer, VmaAllocation>, 2> buffers;
+  std::array<std::unique_ptr<memory::SlicedBuffer>, 2> sliced_buffers;
+  for (int is_uniform = 0; is_uniform < 2; ++is_uniform)
+  {
+    vk::BufferCreateInfo buffer_create_info{
+      .size = total_size[is_uniform],
+      .usage = usage_of(is_uniform ? memory::AllocationCategory::uniform : memory::AllocationCategory::vertex)
+    };
+    VmaAllocationCreateInfo vma_allocation_create_info{
+      .usage = VMA_MEMORY_USAGE_AUTO
+    };
+    // Throws if vmaCreateBuffer fails.
+    buffers[is_uniform].first = allocator.create_buffer(buffer_create_info, vma_allocation_create_info, &buffers[is_uniform].second, nullptr
+        COMMA_CWDEBUG_ONLY(Ambifix{"sliced_buffer"}));
+    // Throws if vmaCreateVirtualBlock fails.
+    sliced_buffers[is_uniform] = std::make_unique<memory::SlicedBuffer>(buffers[is_uniform].first, total_size[is_uniform], alignment[is_uniform]);
+  }
+  std::vector<memory::BufferSlice> slices;
+  slices.reserve(requests.size());
+  for (Request const& request : requests)
+  {
+    bool const is_uniform = request.m_category == memory::AllocationCategory::uniform;
+    // Throws if vmaVirtualAllocate fails.
+    slices.push_back(sliced_buffers[is_uniform]->allocate(request.m_size));
+  }
+  double const create_ms = milliseconds_since(start);
+
+  VmaStatistics statistics = allocator.calculate_statistics().total.statistics;
+
+  start = clock_type::now();
+  slices.clear();
+  for (int is_uniform = 0; is_uniform < 2; ++is_uniform)
+  {
+    sliced_buffers[is_uniform].reset();
+    allocator.destroy_buffer(buffers[is_uniform].first, buffers[is_uniform].second);
+  }
+  double const destroy_ms = milliseconds_since(start);
+
+  print_result("SlicedBuffer", create_ms, destroy_ms, static_cast<int>(buffers.size()), statistics);
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  // Create a headless instance and a device without any extensions.
+  DispatchLoader dispatch_loader;
+  vk::ApplicationInfo application_info{
+    .pApplicationName = "buffer_pool_benchmark",
+    .apiVersion = VK_API_VERSION_1_3
+  };
+  vk::UniqueInstance instance = vk::createInstanceUnique({ .pApplicationInfo = &application_info });
+  dispatch_loader.load(*instance);
+
+  vk::PhysicalDevice vh_physical_device = instance->enumeratePhysicalDevices().at(0);
+  float const queue_priority = 1.0f;
+  vk::DeviceQueueCreateInfo device_queue_create_info{
+    .queueFamilyIndex = 0,
+    .queueCount = 1,
+    .pQueuePriorities = &queue_priority
+  };
+  vk::UniqueDevice device = vh_physical_device.createDeviceUnique({ .queueCreateInfoCount = 1, .pQueueCreateInfos = &device_queue_create_info });
+  dispatch_loader.load(*instance, *device);
+
+  vk::DeviceSize const min_uniform_buffer_offset_alignment = vh_physical_device.getProperties().limits.minUniformBufferOffsetAlignment;
+  std::cout << "Device: " << vh_physical_device.getProperties().deviceName << "; creating " << number_of_buffers <<
+    " small vertex and uniform buffers.\n" << std::endl;
+
+  {
+    VmaVulkanFunctions vma_vulkan_functions{
+      .vkGetInstanceProcAddr = vkGetInstanceProcAddr,
+      .vkGetDeviceProcAddr = vkGetDeviceProcAddr
+    };
+    VmaAllocatorCreateInfo vma_allocator_create_info{
+      .physicalDevice = vh_physical_device,
+      .device = *device,
+      .pVulkanFunctions = &vma_vulkan_functions,
+      .instance = *instance,
+      .vulkanApiVersion = VK_API_VERSION_1_3
+    };
+    memory::Allocator allocator;
+    allocator.create(vma_allocator_create_info);
+
+    std::vector<Request> const requests = make_requests();
+
+    std::cout << std::left << std::setw(14) << "method" << std::right <<
+      std::setw(13) << "create" << std::setw(13) << "destroy" << std::setw(10) << "VkBuffers" <<
+      std::setw(8) << "blocks" << std::setw(16) << "block bytes" << std::setw(16) << "unused bytes" << std::endl;
+
+    run_per_buffer("default pools", allocator, requests,
+        [](vk::BufferCreateInfo const&, VmaAllocationCreateInfo const&, memory::AllocationCategory) -> VmaPool { return VK_NULL_HANDLE; });
+
+    {
+      memory::BufferPools buffer_pools(&allocator);
+      run_per_buffer("BufferPools", allocator, requests,
+          [&](vk::BufferCreateInfo const& buffer_create_info, VmaAllocationCreateInfo const& vma_allocation_create_info, memory::AllocationCategory category){
+            return buffer_pools.pool_for(buffer_create_info, vma_allocation_create_info, category);
+          });
+    }
+
+    run_sliced(allocator, requests, min_uniform_buffer_offset_alignment);
+  }
+
+  Dout(dc::notice, "Leaving main()");
+}
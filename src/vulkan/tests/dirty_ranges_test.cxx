@@ -0,0 +1,124 @@
+#include "sys.h"
+#include "memory/DirtyRanges.h"
+#include "memory/GatherFeeder.h"
+#include <array>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "debug.h"
+
+// Add ranges to a vulkan::DirtyRanges and compare the resulting (coalesced) ranges with the expected ones.
+// Also check that vulkan::GatherFeeder packs the ranges of a host buffer back to back.
+//
+// Returns a non-zero exit code if any of the checks fails.
+
+namespace {
+
+using Range = vulkan::DirtyRanges::Range;
+
+int s_failures = 0;
+
+void compare(std::string const& name, vulkan::DirtyRanges const& dirty_ranges, std::vector<Range> const& expected)
+{
+  std::vector<Range> const& ranges = dirty_ranges.ranges();
+  bool equal = ranges.size() == expected.size();
+  for (size_t i = 0; equal && i < ranges.size(); ++i)
+    equal = ranges[i].m_offset == expected[i].m_offset && ranges[i].m_size == expected[i].m_size;
+  if (equal)
+  {
+    std::cout << name << ": OK" << std::endl;
+    return;
+  }
+  std::cout << name << ": ranges are";
+  for (Range const& range : ranges)
+    std::cout << " [" << range.m_offset << ", " << range.end() << ">";
+  std::cout << ", expected";
+  for (Range const& range : expected)
+    std::cout << " [" << range.m_offset << ", " << range.end() << ">";
+  std::cout << "." << std::endl;
+  ++s_failures;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  {
+    vulkan::DirtyRanges dirty_ranges;
+    dirty_ranges.add(8, 4);
+    dirty_ranges.add(0, 4);
+    dirty_ranges.add(0, 0);
+    compare("Disjoint ranges are sorted", dirty_ranges, { { 0, 4 }, { 8, 4 } });
+    dirty_ranges.add(4, 4);
+    compare("Adjacent ranges are merged", dirty_ranges, { { 0, 12 } });
+    dirty_ranges.add(10, 10);
+    compare("Overlapping ranges are merged", dirty_ranges, { { 0, 20 } });
+    dirty_ranges.add(2, 4);
+    compare("A contained range changes nothing", dirty_ranges, { { 0, 20 } });
+  }
+
+  {
+    vulkan::DirtyRanges dirty_ranges;
+    dirty_ranges.add(0, 4);
+    dirty_ranges.add(10, 4);
+    dirty_ranges.add(20, 4);
+    dirty_ranges.add(30, 4);
+    dirty_ranges.add(2, 20);
+    compare("A range covering several ranges", dirty_ranges, { { 0, 24 }, { 30, 4 } });
+  }
+
+  {
+    vulkan::DirtyRanges dirty_ranges(4);
+    dirty_ranges.add(0, 4);
+    dirty_ranges.add(8, 4);
+    compare("A gap of merge_gap bytes is merged", dirty_ranges, { { 0, 12 } });
+    dirty_ranges.add(17, 3);
+    compare("A gap larger than merge_gap is not", dirty_ranges, { { 0, 12 }, { 17, 3 } });
+    dirty_ranges.add(13, 1);
+    compare("Merge with both neighbours through merge_gap", dirty_ranges, { { 0, 20 } });
+    if (dirty_ranges.total_size() != 20)
+    {
+      std::cout << "total_size() is " << dirty_ranges.total_size() << ", expected 20." << std::endl;
+      ++s_failures;
+    }
+    std::vector<Range> ranges = dirty_ranges.take();
+    if (ranges.size() != 1 || !dirty_ranges.empty())
+    {
+      std::cout << "take() didn't return all ranges and start over." << std::endl;
+      ++s_failures;
+    }
+  }
+
+  {
+    std::array<unsigned char, 32> source;
+    for (size_t i = 0; i < source.size(); ++i)
+      source[i] = i;
+    vulkan::GatherFeeder gather_feeder(source.data(), { { 4, 4 }, { 12, 8 }, { 28, 4 } }, 4);
+    std::array<unsigned char, 16> packed{};
+    std::array<unsigned char, 16> const expected = { 4, 5, 6, 7, 12, 13, 14, 15, 16, 17, 18, 19, 28, 29, 30, 31 };
+    if (gather_feeder.chunk_count() != 4)
+    {
+      std::cout << "GatherFeeder: chunk_count() is " << gather_feeder.chunk_count() << ", expected 4." << std::endl;
+      ++s_failures;
+    }
+    // Fill the chunks in two (unaligned with the ranges) parts, like CopyDataToGPU does when filling in parallel.
+    gather_feeder.fill_chunks(packed.data() + 8, 2, 4);
+    gather_feeder.fill_chunks(packed.data(), 0, 2);
+    if (packed != expected)
+    {
+      std::cout << "GatherFeeder: packed data is";
+      for (unsigned char c : packed)
+        std::cout << ' ' << (int)c;
+      std::cout << "." << std::endl;
+      ++s_failures;
+    }
+    else
+      std::cout << "GatherFeeder: OK" << std::endl;
+  }
+
+  Dout(dc::notice, "Leaving main()");
+  return s_failures == 0 ? 0 : 1;
+}
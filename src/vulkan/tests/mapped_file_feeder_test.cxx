@@ -0,0 +1,107 @@
+#include "sys.h"
+#include "memory/MappedFileFeeder.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "debug.h"
+
+// Write a file of a few pages, read (parts of) it back through vulkan::MappedFileFeeder, both in batches
+// and with fill_chunks, and compare the result with what was written. Also check that ranges that are
+// out of bounds are rejected - including ones for which offset + size overflows.
+//
+// Returns a non-zero exit code if any of the checks fails.
+
+namespace {
+
+int s_failures = 0;
+
+void check(std::string const& name, bool ok)
+{
+  if (ok)
+    std::cout << name << ": OK" << std::endl;
+  else
+  {
+    std::cout << name << ": FAILED" << std::endl;
+    ++s_failures;
+  }
+}
+
+bool throws(std::filesystem::path const& filename, uint32_t chunk_size, size_t offset, size_t size)
+{
+  try
+  {
+    vulkan::MappedFileFeeder feeder(filename, chunk_size, offset, size);
+  }
+  catch (AIAlert::Error const&)
+  {
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  // A file of three and a half pages, filled with a pattern that differs per page.
+  size_t const page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t const file_size = 3 * page_size + page_size / 2;
+  std::vector<char> contents(file_size);
+  for (size_t i = 0; i < file_size; ++i)
+    contents[i] = static_cast<char>(i * 7 + i / page_size);
+  std::filesystem::path const filename = std::filesystem::temp_directory_path() / ("mapped_file_feeder_test." + std::to_string(::getpid()));
+  {
+    std::ofstream file(filename, std::ios::binary);
+    file.write(contents.data(), file_size);
+  }
+
+  {
+    // A range that doesn't start at a page boundary, read in batches of 100 chunks of 12 bytes.
+    uint32_t const chunk_size = 12;
+    size_t const offset = page_size / 3;
+    size_t const size = (file_size - offset) / chunk_size * chunk_size;
+    vulkan::MappedFileFeeder feeder(filename, chunk_size, offset, size);
+    feeder.set_max_batch_size(100);
+    std::vector<unsigned char> data(size);
+    unsigned char* dst = data.data();
+    for (int chunks = 0, total_chunks = 0; total_chunks < feeder.chunk_count(); total_chunks += chunks)
+    {
+      chunks = feeder.next_batch();
+      feeder.get_chunks(dst);
+      dst += chunks * chunk_size;
+    }
+    check("Batches", feeder.chunk_count() == static_cast<int>(size / chunk_size) &&
+        std::equal(data.begin(), data.end(), reinterpret_cast<unsigned char const*>(contents.data() + offset)));
+  }
+
+  {
+    // The whole file (size zero), filled in two parts in reverse order.
+    vulkan::MappedFileFeeder feeder(filename, 2);
+    int const chunk_count = feeder.chunk_count();
+    std::vector<unsigned char> data(file_size);
+    feeder.fill_chunks(data.data() + 2 * (chunk_count / 2), chunk_count / 2, chunk_count);
+    feeder.fill_chunks(data.data(), 0, chunk_count / 2);
+    check("fill_chunks", chunk_count == static_cast<int>(file_size / 2) &&
+        std::equal(data.begin(), data.end(), reinterpret_cast<unsigned char const*>(contents.data())));
+  }
+
+  check("Offset beyond the end", throws(filename, 1, file_size + 1, 1));
+  check("Range beyond the end", throws(filename, 1, page_size, file_size));
+  check("Overflowing range", throws(filename, 1, 16, std::numeric_limits<size_t>::max() - 8));
+  check("Partial chunk", throws(filename, 5, 0, 12));
+  check("Empty range", throws(filename, 1, file_size, 0));
+
+  std::filesystem::remove(filename);
+
+  Dout(dc::notice, "Leaving main()");
+  return s_failures == 0 ? 0 : 1;
+}
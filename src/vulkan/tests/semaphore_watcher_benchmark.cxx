@@ -0,0 +1,208 @@
+#include "sys.h"
+#include "SemaphoreWatchSet.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Compare registering timeline semaphore waits while another thread keeps polling them
+//   1) with a single mutex that add() and poll() both take, a linear search in add() and signaling
+//      while holding the mutex (what SemaphoreWatcher did before),
+//   2) with the lock-free registration list and the indexed SemaphoreWatchSet of task::SemaphoreWatcher,
+//      where only poll() takes the mutex and signaling happens after releasing it.
+//
+// A fake semaphore is used: the counter is incremented by the producer right after registering a wait for it.
+// Build in release mode.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr int number_of_producers = 4;
+constexpr int registrations_per_producer = 100000;
+
+struct FakeSemaphore
+{
+  std::atomic<uint64_t> m_counter{0};
+
+  uint64_t get_counter_value() const
+  {
+    return m_counter.load(std::memory_order::acquire);
+  }
+};
+
+// Signaling a task is replaced by incrementing a counter.
+std::atomic<int> s_signaled;
+
+// The old SemaphoreWatcher.
+class MutexWatcher
+{
+ private:
+  struct Entry
+  {
+    FakeSemaphore const* m_semaphore;
+    uint64_t m_signal_value;                    // The smallest value in m_values.
+    std::vector<uint64_t> m_values;
+  };
+
+  std::mutex m_mutex;
+  std::vector<Entry> m_entries;
+
+ public:
+  void add(FakeSemaphore const* semaphore, uint64_t signal_value)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Entry& entry : m_entries)
+      if (entry.m_semaphore == semaphore)
+      {
+        entry.m_values.push_back(signal_value);
+        entry.m_signal_value = std::min(entry.m_signal_value, signal_value);
+        return;
+      }
+    m_entries.push_back({semaphore, signal_value, {signal_value}});
+  }
+
+  void poll()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_entries.size();)
+    {
+      Entry& entry = m_entries[i];
+      uint64_t const counter_value = entry.m_semaphore->get_counter_value();
+      if (counter_value < entry.m_signal_value)
+      {
+        ++i;
+        continue;
+      }
+      uint64_t signal_value = std::numeric_limits<uint64_t>::max();
+      std::erase_if(entry.m_values, [&](uint64_t value){
+        if (value <= counter_value)
+        {
+          s_signaled.fetch_add(1, std::memory_order::relaxed);
+          return true;
+        }
+        signal_value = std::min(signal_value, value);
+        return false;
+      });
+      entry.m_signal_value = signal_value;
+      if (!entry.m_values.empty())
+      {
+        ++i;
+        continue;
+      }
+      if (i != m_entries.size() - 1)
+        entry = std::move(m_entries.back());
+      m_entries.pop_back();
+    }
+  }
+};
+
+// What task::SemaphoreWatcher does now.
+class LockFreeWatcher
+{
+ private:
+  task::SemaphoreWatcherRegistrationList<FakeSemaphore> m_registrations;
+  std::mutex m_mutex;
+  task::SemaphoreWatchSet<FakeSemaphore> m_watch_set;
+  std::vector<task::SemaphoreWatcherValueTaskConditionTriplet> m_ready;
+
+ public:
+  void add(FakeSemaphore const* semaphore, uint64_t signal_value)
+  {
+    m_registrations.push(new task::SemaphoreWatcherRegistration<FakeSemaphore>(semaphore, signal_value, nullptr, 1));
+  }
+
+  void poll()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_watch_set.insert(m_registrations.take_all());
+      m_watch_set.collect(m_ready);
+    }
+    s_signaled.fetch_add(m_ready.size(), std::memory_order::relaxed);
+    m_ready.clear();
+  }
+};
+
+template<typename WATCHER>
+void run(char const* name, int number_of_semaphores)
+{
+  std::deque<FakeSemaphore> semaphores(number_of_semaphores);
+  WATCHER watcher;
+  s_signaled = 0;
+  int const total = number_of_producers * registrations_per_producer;
+
+  std::atomic<bool> go{false};
+  std::vector<double> add_ns(number_of_producers);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < number_of_producers; ++p)
+    producers.emplace_back([&, p](){
+      Debug(NAMESPACE_DEBUG::init_thread("Producer"));
+      std::mt19937 rng(p);
+      std::uniform_int_distribution<int> pick(0, number_of_semaphores - 1);
+      while (!go.load(std::memory_order::acquire))
+        ;
+      clock_type::duration in_add{};
+      for (int i = 0; i < registrations_per_producer; ++i)
+      {
+        FakeSemaphore& semaphore = semaphores[pick(rng)];
+        uint64_t const signal_value = semaphore.get_counter_value() + 1;
+        auto start = clock_type::now();
+        watcher.add(&semaphore, signal_value);
+        in_add += clock_type::now() - start;
+        // The "GPU" finishes the work.
+        semaphore.m_counter.fetch_add(1, std::memory_order::release);
+      }
+      add_ns[p] = std::chrono::duration<double, std::nano>(in_add).count() / registrations_per_producer;
+    });
+
+  int polls = 0;
+  auto start = clock_type::now();
+  go.store(true, std::memory_order::release);
+  while (s_signaled.load(std::memory_order::relaxed) < total)
+  {
+    watcher.poll();
+    ++polls;
+  }
+  double const total_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+  for (std::thread& producer : producers)
+    producer.join();
+
+  double average_add_ns = 0;
+  for (double ns : add_ns)
+    average_add_ns += ns / number_of_producers;
+
+  std::cout << std::left << std::setw(12) << name << std::right <<
+    std::setw(12) << number_of_semaphores <<
+    std::fixed << std::setprecision(1) <<
+    std::setw(12) << average_add_ns << " ns" <<
+    std::setw(12) << total_ms << " ms" <<
+    std::setw(12) << polls << std::endl;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  std::cout << number_of_producers << " threads each register " << registrations_per_producer << " waits.\n" << std::endl;
+  std::cout << std::left << std::setw(12) << "method" << std::right <<
+    std::setw(12) << "semaphores" << std::setw(15) << "add" << std::setw(15) << "total" << std::setw(12) << "polls" << std::endl;
+
+  for (int number_of_semaphores : { 1, 16, 256 })
+  {
+    run<MutexWatcher>("mutex", number_of_semaphores);
+    run<LockFreeWatcher>("lock-free", number_of_semaphores);
+  }
+
+  Dout(dc::notice, "Leaving main()");
+}
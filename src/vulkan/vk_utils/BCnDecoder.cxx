@@ -0,0 +1,398 @@
+#include "sys.h"
+#include "BCnDecoder.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include "debug.h"
+
+namespace vk_utils {
+namespace bcn {
+
+namespace {
+
+uint16_t read_uint16(unsigned char const* ptr)
+{
+  return ptr[0] | (ptr[1] << 8);
+}
+
+uint32_t read_uint32(unsigned char const* ptr)
+{
+  return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (uint32_t{ptr[3]} << 24);
+}
+
+// Expand an R5G6B5 color to 8 bits per channel.
+void unpack_565(uint16_t color, unsigned char* rgb)
+{
+  uint32_t const r = (color >> 11) & 0x1f;
+  uint32_t const g = (color >> 5) & 0x3f;
+  uint32_t const b = color & 0x1f;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Decode the color part of a BC1/BC2/BC3 block, writing only the alpha channel when writes_alpha is set.
+void decode_color_block(unsigned char const* block, unsigned char* rgba, bool four_color_mode_only, bool writes_alpha)
+{
+  uint16_t const c0 = read_uint16(block);
+  uint16_t const c1 = read_uint16(block + 2);
+  uint32_t const indices = read_uint32(block + 4);
+
+  std::array<std::array<unsigned char, 4>, 4> palette;
+  unpack_565(c0, palette[0].data());
+  unpack_565(c1, palette[1].data());
+  palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+  if (four_color_mode_only || c0 > c1)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+    }
+  }
+  else
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+    palette[3][3] = 0;
+  }
+
+  for (int i = 0; i < 16; ++i)
+  {
+    unsigned char const* color = palette[(indices >> (2 * i)) & 3].data();
+    std::memcpy(rgba + 4 * i, color, writes_alpha ? 4 : 3);
+  }
+}
+
+// Reads bits from a 128-bit block, least significant bit first.
+class BitReader
+{
+ private:
+  unsigned char const* m_block;
+  uint32_t m_position{};
+
+ public:
+  BitReader(unsigned char const* block) : m_block(block) { }
+
+  uint32_t read(uint32_t number_of_bits)
+  {
+    uint32_t value = 0;
+    for (uint32_t bit = 0; bit < number_of_bits; ++bit, ++m_position)
+      value |= ((m_block[m_position >> 3] >> (m_position & 7)) & 1) << bit;
+    return value;
+  }
+};
+
+struct BC7Mode
+{
+  uint8_t subsets;              // Number of subsets.
+  uint8_t partition_bits;
+  uint8_t rotation_bits;
+  uint8_t index_selection_bits;
+  uint8_t color_bits;           // Per endpoint per channel, without p-bit.
+  uint8_t alpha_bits;           // Zero if the alpha is always 255.
+  uint8_t endpoint_pbits;       // One p-bit per endpoint.
+  uint8_t shared_pbits;         // One p-bit per subset.
+  uint8_t index_bits;
+  uint8_t index2_bits;          // Zero if there is no secondary index.
+};
+
+constexpr std::array<BC7Mode, 8> bc7_modes = {{
+  { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+  { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+  { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+  { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+  { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+  { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+  { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+  { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+}};
+
+// Bit i is set if texel i belongs to the second subset.
+constexpr std::array<uint16_t, 64> bc7_partitions2 = {
+  0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+  0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+  0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+  0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+};
+
+// The subset of each texel, for the partitions with three subsets.
+constexpr uint8_t bc7_partitions3[64][16] = {
+  { 0,0,1,1,0,0,1,1,0,2,2,1,2,2,2,2 }, { 0,0,0,1,0,0,1,1,2,2,1,1,2,2,2,1 }, { 0,0,0,0,2,0,0,1,2,2,1,1,2,2,1,1 }, { 0,2,2,2,0,0,2,2,0,0,1,1,0,1,1,1 },
+  { 0,0,0,0,0,0,0,0,1,1,2,2,1,1,2,2 }, { 0,0,1,1,0,0,1,1,0,0,2,2,0,0,2,2 }, { 0,0,2,2,0,0,2,2,1,1,1,1,1,1,1,1 }, { 0,0,1,1,0,0,1,1,2,2,1,1,2,2,1,1 },
+  { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2 }, { 0,0,0,0,1,1,1,1,1,1,1,1,2,2,2,2 }, { 0,0,0,0,1,1,1,1,2,2,2,2,2,2,2,2 }, { 0,0,1,2,0,0,1,2,0,0,1,2,0,0,1,2 },
+  { 0,1,1,2,0,1,1,2,0,1,1,2,0,1,1,2 }, { 0,1,2,2,0,1,2,2,0,1,2,2,0,1,2,2 }, { 0,0,1,1,0,1,1,2,1,1,2,2,1,2,2,2 }, { 0,0,1,1,2,0,0,1,2,2,0,0,2,2,2,0 },
+  { 0,0,0,1,0,0,1,1,0,1,1,2,1,1,2,2 }, { 0,1,1,1,0,0,1,1,2,0,0,1,2,2,0,0 }, { 0,0,0,0,1,1,2,2,1,1,2,2,1,1,2,2 }, { 0,0,2,2,0,0,2,2,0,0,2,2,1,1,1,1 },
+  { 0,1,1,1,0,1,1,1,0,2,2,2,0,2,2,2 }, { 0,0,0,1,0,0,0,1,2,2,2,1,2,2,2,1 }, { 0,0,0,0,0,0,1,1,0,1,2,2,0,1,2,2 }, { 0,0,0,0,1,1,0,0,2,2,1,0,2,2,1,0 },
+  { 0,1,2,2,0,1,2,2,0,0,1,1,0,0,0,0 }, { 0,0,1,2,0,0,1,2,1,1,2,2,2,2,2,2 }, { 0,1,1,0,1,2,2,1,1,2,2,1,0,1,1,0 }, { 0,0,0,0,0,1,1,0,1,2,2,1,1,2,2,1 },
+  { 0,0,2,2,1,1,0,2,1,1,0,2,0,0,2,2 }, { 0,1,1,0,0,1,1,0,2,0,0,2,2,2,2,2 }, { 0,0,1,1,0,1,2,2,0,1,2,2,0,0,1,1 }, { 0,0,0,0,2,0,0,0,2,2,1,1,2,2,2,1 },
+  { 0,0,0,0,0,0,0,2,1,1,2,2,1,2,2,2 }, { 0,2,2,2,0,0,2,2,0,0,1,2,0,0,1,1 }, { 0,0,1,1,0,0,1,2,0,0,2,2,0,2,2,2 }, { 0,1,2,0,0,1,2,0,0,1,2,0,0,1,2,0 },
+  { 0,0,0,0,1,1,1,1,2,2,2,2,0,0,0,0 }, { 0,1,2,0,1,2,0,1,2,0,1,2,0,1,2,0 }, { 0,1,2,0,2,0,1,2,1,2,0,1,0,1,2,0 }, { 0,0,1,1,2,2,0,0,1,1,2,2,0,0,1,1 },
+  { 0,0,1,1,1,1,2,2,2,2,0,0,0,0,1,1 }, { 0,1,0,1,0,1,0,1,2,2,2,2,2,2,2,2 }, { 0,0,0,0,0,0,0,0,2,1,2,1,2,1,2,1 }, { 0,0,2,2,1,1,2,2,0,0,2,2,1,1,2,2 },
+  { 0,0,2,2,0,0,1,1,0,0,2,2,0,0,1,1 }, { 0,2,2,0,1,2,2,1,0,2,2,0,1,2,2,1 }, { 0,1,0,1,2,2,2,2,2,2,2,2,0,1,0,1 }, { 0,0,0,0,2,1,2,1,2,1,2,1,2,1,2,1 },
+  { 0,1,0,1,0,1,0,1,0,1,0,1,2,2,2,2 }, { 0,2,2,2,0,1,1,1,0,2,2,2,0,1,1,1 }, { 0,0,0,2,1,1,1,2,0,0,0,2,1,1,1,2 }, { 0,0,0,0,2,1,1,2,2,1,1,2,2,1,1,2 },
+  { 0,2,2,2,0,1,1,1,0,1,1,1,0,2,2,2 }, { 0,0,0,2,1,1,1,2,1,1,1,2,0,0,0,2 }, { 0,1,1,0,0,1,1,0,0,1,1,0,2,2,2,2 }, { 0,0,0,0,0,0,0,0,2,1,1,2,2,1,1,2 },
+  { 0,1,1,0,0,1,1,0,2,2,2,2,2,2,2,2 }, { 0,0,2,2,0,0,1,1,0,0,1,1,0,0,2,2 }, { 0,0,2,2,1,1,2,2,1,1,2,2,0,0,2,2 }, { 0,0,0,0,0,0,0,0,0,0,0,0,2,1,1,2 },
+  { 0,0,0,2,0,0,0,1,0,0,0,2,0,0,0,1 }, { 0,2,2,2,1,2,2,2,0,2,2,2,1,2,2,2 }, { 0,1,0,1,2,2,2,2,2,2,2,2,2,2,2,2 }, { 0,1,1,1,2,0,1,1,2,2,0,1,2,2,2,0 }
+};
+
+// The anchor (fix-up) texel of the second subset, for partitions with two subsets.
+constexpr std::array<uint8_t, 64> bc7_anchors2 = {
+  15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15, 15, 2, 8, 2, 2, 8, 8,15, 2, 8, 2, 2, 8, 8, 2, 2,
+  15,15, 6, 8, 2, 8,15,15,  2, 8, 2, 2, 2,15,15, 6,  6, 2, 6, 8,15,15, 2, 2, 15,15,15,15,15, 2, 2,15
+};
+
+// The anchor texels of the second and third subset, for partitions with three subsets.
+constexpr std::array<uint8_t, 64> bc7_anchors3a = {
+   3, 3,15,15, 8, 3,15,15,  8, 8, 6, 6, 6, 5, 3, 3,  3, 3, 8,15, 3, 3, 6,10,  5, 8, 8, 6, 8, 5,15,15,
+   8,15, 3, 5, 6,10, 8,15, 15, 3,15, 5,15,15,15,15,  3,15, 5, 5, 5, 8, 5,10,  5,10, 8,13,15,12, 3, 3
+};
+constexpr std::array<uint8_t, 64> bc7_anchors3b = {
+  15, 8, 8, 3,15,15, 3, 8, 15,15,15,15,15,15,15, 8, 15, 8,15, 3,15, 8,15, 8,  3,15, 6,10,15,15,10, 8,
+  15, 3,15,10,10, 8, 9,10,  6,15, 8,15, 3, 6, 6, 8, 15, 3,15,15,15,15,15,15, 15,15,15,15, 3,15,15, 8
+};
+
+constexpr uint8_t bc7_weights2[4] = { 0, 21, 43, 64 };
+constexpr uint8_t bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+constexpr uint8_t bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+unsigned char bc7_interpolate(unsigned char e0, unsigned char e1, uint32_t index, uint32_t index_bits)
+{
+  uint32_t const weight = index_bits == 2 ? bc7_weights2[index] : index_bits == 3 ? bc7_weights3[index] : bc7_weights4[index];
+  return static_cast<unsigned char>(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+}
+
+// Expand a value of `bits` bits to 8 bits by replicating its most significant bits.
+unsigned char bc7_unquantize(uint32_t value, uint32_t bits)
+{
+  value <<= 8 - bits;
+  return static_cast<unsigned char>(value | (value >> bits));
+}
+
+} // namespace
+
+void decode_bc1_block(unsigned char const* block, unsigned char* rgba, bool has_alpha)
+{
+  decode_color_block(block, rgba, false, true);
+  if (!has_alpha)
+    for (int i = 0; i < 16; ++i)
+      rgba[4 * i + 3] = 255;
+}
+
+void decode_bc3_block(unsigned char const* block, unsigned char* rgba)
+{
+  decode_color_block(block + 8, rgba, true, false);
+
+  uint32_t const a0 = block[0];
+  uint32_t const a1 = block[1];
+  std::array<unsigned char, 8> alphas;
+  alphas[0] = a0;
+  alphas[1] = a1;
+  if (a0 > a1)
+  {
+    for (uint32_t i = 1; i < 7; ++i)
+      alphas[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+  }
+  else
+  {
+    for (uint32_t i = 1; i < 5; ++i)
+      alphas[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+    alphas[6] = 0;
+    alphas[7] = 255;
+  }
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; ++i)
+    indices |= uint64_t{block[2 + i]} << (8 * i);
+  for (int i = 0; i < 16; ++i)
+    rgba[4 * i + 3] = alphas[(indices >> (3 * i)) & 7];
+}
+
+void decode_bc7_block(unsigned char const* block, unsigned char* rgba)
+{
+  // The mode is the number of trailing zeroes of the first byte.
+  if (block[0] == 0)
+  {
+    std::memset(rgba, 0, 16 * 4);
+    return;
+  }
+  uint32_t const mode_index = std::countr_zero(block[0]);
+  BC7Mode const& mode = bc7_modes[mode_index];
+
+  BitReader bits(block);
+  bits.read(mode_index + 1);
+  uint32_t const partition = bits.read(mode.partition_bits);
+  uint32_t const rotation = bits.read(mode.rotation_bits);
+  uint32_t const index_selection = bits.read(mode.index_selection_bits);
+
+  // endpoints[subset * 2 + e][channel].
+  uint32_t const number_of_endpoints = 2 * mode.subsets;
+  std::array<std::array<uint32_t, 4>, 6> endpoints;
+  for (uint32_t channel = 0; channel < 3; ++channel)
+    for (uint32_t e = 0; e < number_of_endpoints; ++e)
+      endpoints[e][channel] = bits.read(mode.color_bits);
+  for (uint32_t e = 0; e < number_of_endpoints; ++e)
+    endpoints[e][3] = mode.alpha_bits ? bits.read(mode.alpha_bits) : 255;
+
+  // Apply the p-bits and expand everything to 8 bits.
+  uint32_t const pbit_count = mode.endpoint_pbits ? number_of_endpoints : mode.shared_pbits ? mode.subsets : 0;
+  std::array<uint32_t, 6> pbits{};
+  for (uint32_t i = 0; i < pbit_count; ++i)
+    pbits[i] = bits.read(1);
+  std::array<std::array<unsigned char, 4>, 6> colors;
+  for (uint32_t e = 0; e < number_of_endpoints; ++e)
+  {
+    uint32_t const pbit = mode.endpoint_pbits ? pbits[e] : pbits[e / 2];
+    bool const has_pbit = pbit_count > 0;
+    for (uint32_t channel = 0; channel < 4; ++channel)
+    {
+      if (channel == 3 && !mode.alpha_bits)
+      {
+        colors[e][3] = 255;
+        continue;
+      }
+      uint32_t const channel_bits = channel == 3 ? mode.alpha_bits : mode.color_bits;
+      uint32_t value = endpoints[e][channel];
+      if (has_pbit)
+        value = (value << 1) | pbit;
+      colors[e][channel] = bc7_unquantize(value, channel_bits + (has_pbit ? 1 : 0));
+    }
+  }
+
+  // Determine the subset of each texel, and which texels are anchors (whose index has one bit less).
+  std::array<uint8_t, 16> subset_of{};
+  std::array<bool, 16> is_anchor{};
+  is_anchor[0] = true;
+  if (mode.subsets == 2)
+  {
+    for (int i = 0; i < 16; ++i)
+      subset_of[i] = (bc7_partitions2[partition] >> i) & 1;
+    is_anchor[bc7_anchors2[partition]] = true;
+  }
+  else if (mode.subsets == 3)
+  {
+    for (int i = 0; i < 16; ++i)
+      subset_of[i] = bc7_partitions3[partition][i];
+    is_anchor[bc7_anchors3a[partition]] = true;
+    is_anchor[bc7_anchors3b[partition]] = true;
+  }
+
+  std::array<uint32_t, 16> indices;
+  for (int i = 0; i < 16; ++i)
+    indices[i] = bits.read(mode.index_bits - (is_anchor[i] ? 1 : 0));
+  std::array<uint32_t, 16> indices2{};
+  if (mode.index2_bits)
+    for (int i = 0; i < 16; ++i)
+      indices2[i] = bits.read(mode.index2_bits - (i == 0 ? 1 : 0));
+
+  for (int i = 0; i < 16; ++i)
+  {
+    uint32_t const e = 2 * subset_of[i];
+    unsigned char* texel = rgba + 4 * i;
+    if (mode.index2_bits)
+    {
+      // Separate indices for color and alpha; the index selection bit swaps them.
+      uint32_t const color_index = index_selection ? indices2[i] : indices[i];
+      uint32_t const color_index_bits = index_selection ? mode.index2_bits : mode.index_bits;
+      uint32_t const alpha_index = index_selection ? indices[i] : indices2[i];
+      uint32_t const alpha_index_bits = index_selection ? mode.index_bits : mode.index2_bits;
+      for (int channel = 0; channel < 3; ++channel)
+        texel[channel] = bc7_interpolate(colors[e][channel], colors[e + 1][channel], color_index, color_index_bits);
+      texel[3] = bc7_interpolate(colors[e][3], colors[e + 1][3], alpha_index, alpha_index_bits);
+    }
+    else
+    {
+      for (int channel = 0; channel < 4; ++channel)
+        texel[channel] = bc7_interpolate(colors[e][channel], colors[e + 1][channel], indices[i], mode.index_bits);
+    }
+    // Rotation swaps alpha with one of the color channels.
+    if (rotation)
+      std::swap(texel[3], texel[rotation - 1]);
+  }
+}
+
+bool is_supported(vk::Format format)
+{
+  switch (format)
+  {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+      return true;
+    default:
+      return false;
+  }
+}
+
+vk::Format decoded_format(vk::Format format)
+{
+  switch (format)
+  {
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc7SrgbBlock:
+      return vk::Format::eR8G8B8A8Srgb;
+    default:
+      return vk::Format::eR8G8B8A8Unorm;
+  }
+}
+
+uint32_t block_size(vk::Format format)
+{
+  switch (format)
+  {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+      return 8;
+    default:
+      return 16;
+  }
+}
+
+void decode_level(vk::Format format, unsigned char const* src, vk::Extent2D extent, unsigned char* dst)
+{
+  // Only call decode_level for supported formats.
+  ASSERT(is_supported(format));
+  bool const has_alpha = format != vk::Format::eBc1RgbUnormBlock && format != vk::Format::eBc1RgbSrgbBlock;
+  uint32_t const size = block_size(format);
+  uint32_t const blocks_x = (extent.width + 3) / 4;
+  uint32_t const blocks_y = (extent.height + 3) / 4;
+  std::array<unsigned char, 16 * 4> texels;
+  for (uint32_t by = 0; by < blocks_y; ++by)
+    for (uint32_t bx = 0; bx < blocks_x; ++bx, src += size)
+    {
+      switch (format)
+      {
+        case vk::Format::eBc3UnormBlock:
+        case vk::Format::eBc3SrgbBlock:
+          decode_bc3_block(src, texels.data());
+          break;
+        case vk::Format::eBc7UnormBlock:
+        case vk::Format::eBc7SrgbBlock:
+          decode_bc7_block(src, texels.data());
+          break;
+        default:
+          decode_bc1_block(src, texels.data(), has_alpha);
+          break;
+      }
+      // Copy the texels that are inside the image (blocks at the right and bottom edge may be partial).
+      uint32_t const width = std::min(4u, extent.width - 4 * bx);
+      uint32_t const height = std::min(4u, extent.height - 4 * by);
+      for (uint32_t y = 0; y < height; ++y)
+        std::memcpy(dst + ((4 * by + y) * extent.width + 4 * bx) * 4, texels.data() + y * 16, width * 4);
+    }
+}
+
+} // namespace bcn
+} // namespace vk_utils
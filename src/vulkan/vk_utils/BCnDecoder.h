@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+
+namespace vk_utils {
+namespace bcn {
+
+// Software decoder for block compressed textures, used when the device doesn't support sampling a BCn format.
+//
+// Each block decoder writes the 4x4 texels of one block as RGBA8 (16 * 4 bytes, row by row).
+
+// 8 byte block. If has_alpha is false then the "transparent" color of the three color mode is opaque black.
+void decode_bc1_block(unsigned char const* block, unsigned char* rgba, bool has_alpha);
+// 16 byte block: a BC4-like alpha block followed by a BC1 color block (always in four color mode).
+void decode_bc3_block(unsigned char const* block, unsigned char* rgba);
+// 16 byte block. Invalid blocks (mode bits all zero) decode to transparent black.
+void decode_bc7_block(unsigned char const* block, unsigned char* rgba);
+
+// Return true if format is one of the formats that decode_level supports.
+bool is_supported(vk::Format format);
+
+// Return the format that decode_level produces for format: eR8G8B8A8Unorm or eR8G8B8A8Srgb.
+vk::Format decoded_format(vk::Format format);
+
+// Return the size in bytes of one block of format (8 or 16).
+uint32_t block_size(vk::Format format);
+
+// Decode a whole mip level with extent extent from src to dst (which must be extent.width * extent.height * 4 bytes).
+void decode_level(vk::Format format, unsigned char const* src, vk::Extent2D extent, unsigned char* dst);
+
+} // namespace bcn
+} // namespace vk_utils
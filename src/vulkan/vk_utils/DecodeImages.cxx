@@ -0,0 +1,53 @@
+#include "sys.h"
+#include "DecodeImages.h"
+#include <Tracy.hpp>
+
+namespace task {
+
+DecodeImages::~DecodeImages()
+{
+  DoutEntering(dc::statefultask(mSMDebug), "DecodeImages::~DecodeImages() [" << this << "]");
+}
+
+char const* DecodeImages::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(DecodeImages_decode);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* DecodeImages::task_name_impl() const
+{
+  return "DecodeImages";
+}
+
+void DecodeImages::initialize_impl()
+{
+  set_state(DecodeImages_decode);
+}
+
+void DecodeImages::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case DecodeImages_decode:
+    {
+      std::shared_ptr<vk_utils::stbi::DecodedImage> decoded_image = m_image_decoder->next_job({});
+      if (!decoded_image)
+      {
+        finish();
+        break;
+      }
+      {
+        ZoneScopedN("DecodeImages_decode");
+        decoded_image->decode({});
+      }
+      yield();
+      break;
+    }
+  }
+}
+
+} // namespace task
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "ImageDecoder.h"
+#include "debug.h"
+
+namespace task {
+
+// Helper task of ImageDecoder: decodes images from the queue of an ImageDecoder until it is empty.
+//
+// Yields after every image, so that other tasks on the same thread pool queue aren't starved.
+class DecodeImages final : public vulkan::AsyncTask
+{
+ private:
+  vk_utils::stbi::ImageDecoder* m_image_decoder;        // The decoder to get jobs from.
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of this task.
+  enum DecodeImages_state_type {
+    DecodeImages_decode = direct_base_type::state_end
+  };
+
+ public:
+  static constexpr state_type state_end = DecodeImages_decode + 1;
+
+  DecodeImages(vk_utils::stbi::ImageDecoder* image_decoder COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    direct_base_type(CWDEBUG_ONLY(debug)), m_image_decoder(image_decoder)
+  {
+    DoutEntering(dc::statefultask(mSMDebug), "DecodeImages(" << image_decoder << ") [" << this << "]");
+  }
+
+ protected:
+  ~DecodeImages() override;
+
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+};
+
+} // namespace task
@@ -5,6 +5,7 @@
 #include "utils/AIAlert.h"
 #include <cstring>
 #include <stdexcept>
+#include <Tracy.hpp>
 #include "debug.h"
 
 namespace vk_utils {
@@ -15,18 +16,18 @@ ImageData::ImageData(std::filesystem::path const& filename, int requested_compon
 {
   DoutEntering(dc::vulkan, "ImageData::ImageData(" << filename << ", " << requested_components << ")");
 
-  auto const file_data = get_binary_file_contents(filename);
+  m_file_data = get_binary_file_contents(filename);
 
+  // Only parse the header here; the image is decoded by decode().
   int width = 0, height = 0;
-  m_image_data = reinterpret_cast<std::byte*>(stbi_load_from_memory(
-      reinterpret_cast<stbi_uc const*>(file_data.data()), static_cast<int>(file_data.size()), &width, &height, &m_components, requested_components));
-  // These casts are OK because of the test below.
-  m_extent = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
-
-  if (m_image_data == nullptr || width <= 0 || height <= 0 || m_components <= 0)
+  if (!stbi_info_from_memory(reinterpret_cast<stbi_uc const*>(m_file_data.data()), static_cast<int>(m_file_data.size()), &width, &height, &m_components) ||
+      width <= 0 || height <= 0 || m_components <= 0)
     THROW_ALERT("Could not get image data for file \"[FILENAME]\"", AIArgs("[FILENAME]", filename));
 
-  m_size = width * height * (requested_components > 0 ? requested_components : m_components);
+  // These casts are OK because of the test above.
+  m_extent = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+  m_texel_components = requested_components > 0 ? requested_components : m_components;
+  m_size = width * height * m_texel_components;
 }
 
 ImageData::~ImageData()
@@ -35,5 +36,38 @@ ImageData::~ImageData()
     stbi_image_free(m_image_data);
 }
 
+void ImageData::decode()
+{
+  ZoneScopedN("ImageData::decode");
+  // Let stb_image do the conversion to m_texel_components: it knows about things like a tRNS chunk,
+  // which turns an RGB (or grey) PNG into one with an alpha channel.
+  int width = 0, height = 0, components = 0;
+  m_image_data = reinterpret_cast<std::byte*>(stbi_load_from_memory(
+      reinterpret_cast<stbi_uc const*>(m_file_data.data()), static_cast<int>(m_file_data.size()), &width, &height, &components, m_texel_components));
+  if (AI_UNLIKELY(m_image_data && (static_cast<uint32_t>(width) != m_extent.width || static_cast<uint32_t>(height) != m_extent.height)))
+  {
+    stbi_image_free(m_image_data);
+    m_image_data = nullptr;
+    Dout(dc::warning, "Failed to decode image: header mismatch");
+  }
+  else if (AI_UNLIKELY(!m_image_data))
+    Dout(dc::warning, "Failed to decode image: " << stbi_failure_reason());
+  m_decoded = true;
+  // Free the encoded data.
+  std::vector<std::byte>{}.swap(m_file_data);
+}
+
+void ImageDataFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  std::byte const* image_data = m_image_data.image_data();
+  if (AI_UNLIKELY(!image_data))
+  {
+    // The image could not be decoded; upload black rather than garbage.
+    std::memset(chunk_ptr, 0, m_image_data.size());
+    return;
+  }
+  std::memcpy(chunk_ptr, image_data, m_image_data.size());
+}
+
 } // namespace stbi
 } // namespace vk_utils
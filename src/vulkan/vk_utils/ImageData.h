@@ -1,3 +1,5 @@
+#pragma once
+
 #include "stb_image.h"
 #include "memory/DataFeeder.h"
 #include "utils/Badge.h"
@@ -12,55 +14,64 @@ namespace stbi {
 
 class ImageDataFeeder;
 
+// The contents of an image file.
+//
+// The constructor only reads the file and parses the image header, so that the extent is known immediately.
+// The pixel data is decoded by ImageDataFeeder::is_ready, which the copy task calls before it reserves any
+// staging memory. stb_image can only decode into a buffer that it allocates itself, hence the decoded image
+// is copied to the staging buffer by ImageDataFeeder::get_chunks.
 class ImageData
 {
  private:
-  std::byte* m_image_data;
+  std::vector<std::byte> m_file_data;   // The encoded image; released after decoding.
   vk::Extent2D m_extent;
-  int m_components{};
-  uint32_t m_size;              // Size in bytes (int is large enough to store an image with 4 components and extent 32768x32768).
+  int m_components{};                   // The number of components in the file.
+  int m_texel_components{};             // The number of components per texel of the decoded data.
+  uint32_t m_size;                      // Size in bytes (int is large enough to store an image with 4 components and extent 32768x32768).
+  std::byte* m_image_data{};            // The decoded data, or nullptr if not decoded (yet), or if decoding failed.
+  bool m_decoded{};                     // Set when decode() was called.
 
  public:
   ImageData(std::filesystem::path const& filename, int requested_components);
+  ImageData(ImageData&& orig) : m_file_data(std::move(orig.m_file_data)), m_extent(orig.m_extent), m_components(orig.m_components),
+    m_texel_components(orig.m_texel_components), m_size(orig.m_size), m_image_data(orig.m_image_data), m_decoded(orig.m_decoded)
+  {
+    orig.m_image_data = nullptr;
+  }
   ~ImageData();
 
   // Accessors.
   vk::Extent2D extent() const { return m_extent; }
   int components() const { return m_components; }
+  int texel_components() const { return m_texel_components; }
   uint32_t size() const { return m_size; }
-  std::byte* image_data() const { return m_image_data; }
+  bool is_decoded() const { return m_decoded; }
+  // Only call this after decode(). Returns nullptr if decoding failed.
+  std::byte const* image_data() const { ASSERT(m_decoded); return m_image_data; }
 
-  // Transfer data ownership.
-  std::byte* move_image_data(utils::Badge<ImageDataFeeder>) &&
-  {
-    std::byte* image_data = m_image_data;
-    m_image_data = nullptr;
-    return image_data;
-  }
+  // Decode the image (with texel_components() components per texel) and free the file data.
+  void decode();
 };
 
 class ImageDataFeeder final : public vulkan::DataFeeder
 {
  private:
-  std::byte* m_image_data;
-  uint32_t m_size;
+  ImageData m_image_data;
 
  public:
-  ImageDataFeeder(ImageData&& image_data) : m_image_data(std::move(image_data).move_image_data({})), m_size(image_data.size())
-  {
-    // Don't create an ImageDataFeeder from a ImageData that doesn't have data.
-    ASSERT(m_image_data);
-  }
+  ImageDataFeeder(ImageData&& image_data) : m_image_data(std::move(image_data)) { }
 
-  ~ImageDataFeeder() override
+  uint32_t chunk_size() const override { return m_image_data.size(); }
+  int chunk_count() const override { return 1; }
+  // Decode the image here: this is called before any staging memory is reserved.
+  bool is_ready(AIStatefulTask* UNUSED_ARG(task), AIStatefulTask::condition_type UNUSED_ARG(condition)) override
   {
-    stbi_image_free(m_image_data);
+    if (!m_image_data.is_decoded())
+      m_image_data.decode();
+    return true;
   }
-
-  uint32_t chunk_size() const override { return m_size; }
-  int chunk_count() const override { return 1; }
   int next_batch() override { return 1; }
-  void get_chunks(unsigned char* chunk_ptr) override { std::memcpy(chunk_ptr, m_image_data, m_size); }
+  void get_chunks(unsigned char* chunk_ptr) override;
 };
 
 } // namespace stbi
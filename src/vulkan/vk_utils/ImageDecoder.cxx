@@ -0,0 +1,142 @@
+#include "sys.h"
+#include "ImageDecoder.h"
+#include "DecodeImages.h"
+#include "ImageData.h"
+#include "get_binary_file_contents.h"
+#include "Application.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+#include <cstring>
+#include "debug.h"
+
+namespace vk_utils {
+namespace stbi {
+
+DecodedImage::DecodedImage(std::filesystem::path const& filename, int requested_components, priority_type priority) :
+  m_filename(filename), m_priority(priority)
+{
+  DoutEntering(dc::vulkan, "DecodedImage::DecodedImage(" << filename << ", " << requested_components << ", " << priority << ") [" << this << "]");
+
+  m_file_data = get_binary_file_contents(filename);
+
+  // Only parse the header here; the actual decoding is done by DecodeImages.
+  int width = 0, height = 0;
+  if (!stbi_info_from_memory(reinterpret_cast<stbi_uc const*>(m_file_data.data()), static_cast<int>(m_file_data.size()), &width, &height, &m_components) ||
+      width <= 0 || height <= 0 || m_components <= 0)
+    THROW_ALERT("Could not get image data for file \"[FILENAME]\"", AIArgs("[FILENAME]", filename));
+
+  // These casts are OK because of the test above.
+  m_extent = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+  m_texel_components = requested_components > 0 ? requested_components : m_components;
+  m_size = width * height * m_texel_components;
+}
+
+DecodedImage::~DecodedImage()
+{
+  if (m_image_data)
+    stbi_image_free(m_image_data);
+}
+
+void DecodedImage::decode(utils::Badge<task::DecodeImages>)
+{
+  DoutEntering(dc::vulkan, "DecodedImage::decode() [" << this << "] (" << m_filename << ")");
+
+  // Decode with m_texel_components components per texel (stb_image does the conversion, taking a tRNS chunk into account).
+  int width = 0, height = 0, components = 0;
+  m_image_data = reinterpret_cast<std::byte*>(stbi_load_from_memory(
+      reinterpret_cast<stbi_uc const*>(m_file_data.data()), static_cast<int>(m_file_data.size()), &width, &height, &components, m_texel_components));
+  if (m_image_data && (static_cast<uint32_t>(width) != m_extent.width || static_cast<uint32_t>(height) != m_extent.height))
+  {
+    stbi_image_free(m_image_data);
+    m_image_data = nullptr;
+  }
+  if (!m_image_data)
+    Dout(dc::warning, "Failed to decode \"" << m_filename << "\": " << stbi_failure_reason());
+  // Free the encoded data.
+  std::vector<std::byte>{}.swap(m_file_data);
+
+  std::vector<Waiter> waiters;
+  {
+    state_type::wat state_w(m_state);
+    state_w->m_decoded = true;
+    m_decoded.store(true, std::memory_order::release);
+    waiters.swap(state_w->m_waiters);
+  }
+  // Signal the waiting tasks without holding the lock.
+  for (Waiter const& waiter : waiters)
+    waiter.m_task->signal(waiter.m_condition);
+}
+
+bool DecodedImage::is_ready(AIStatefulTask* task, AIStatefulTask::condition_type condition)
+{
+  if (is_decoded())
+    return true;
+  state_type::wat state_w(m_state);
+  if (state_w->m_decoded)
+    return true;
+  state_w->m_waiters.push_back({task, condition});
+  return false;
+}
+
+void DecodedImage::remove_waiter(AIStatefulTask* task)
+{
+  state_type::wat state_w(m_state);
+  std::vector<Waiter>& waiters = state_w->m_waiters;
+  waiters.erase(std::remove_if(waiters.begin(), waiters.end(), [task](Waiter const& waiter){ return waiter.m_task.get() == task; }), waiters.end());
+}
+
+void DecodedImageFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  std::byte const* image_data = m_decoded_image->image_data();
+  if (AI_UNLIKELY(!image_data))
+  {
+    // The image could not be decoded; upload black rather than garbage.
+    std::memset(chunk_ptr, 0, m_decoded_image->size());
+    return;
+  }
+  std::memcpy(chunk_ptr, image_data, m_decoded_image->size());
+}
+
+std::shared_ptr<DecodedImage> ImageDecoder::decode(std::filesystem::path const& filename, int requested_components, priority_type priority)
+{
+  DoutEntering(dc::vulkan, "ImageDecoder::decode(" << filename << ", " << requested_components << ", " << priority << ") [" << this << "]");
+
+  auto decoded_image = std::make_shared<DecodedImage>(filename, requested_components, priority);
+
+  vulkan::Application const& application = vulkan::Application::instance();
+  int const max_workers = m_max_workers > 0 ? m_max_workers : std::max(1, application.number_of_worker_threads() / 2);
+  bool start_worker;
+  {
+    jobs_type::wat jobs_w(m_jobs);
+    jobs_w->m_queue.push({ priority, jobs_w->m_next_sequence_number++, decoded_image });
+    start_worker = jobs_w->m_running_workers < max_workers;
+    if (start_worker)
+      ++jobs_w->m_running_workers;
+  }
+  if (start_worker)
+  {
+    auto decode_images_task = statefultask::create<task::DecodeImages>(this COMMA_CWDEBUG_ONLY(false));
+    decode_images_task->run(application.low_priority_queue());
+  }
+
+  return decoded_image;
+}
+
+std::shared_ptr<DecodedImage> ImageDecoder::next_job(utils::Badge<task::DecodeImages>)
+{
+  jobs_type::wat jobs_w(m_jobs);
+  while (!jobs_w->m_queue.empty())
+  {
+    std::shared_ptr<DecodedImage> decoded_image = jobs_w->m_queue.top().m_decoded_image.lock();
+    jobs_w->m_queue.pop();
+    // Skip images that nobody is interested in anymore.
+    if (decoded_image)
+      return decoded_image;
+  }
+  // Decrement the number of running workers while holding the lock, so that decode starts a new worker if needed.
+  --jobs_w->m_running_workers;
+  return {};
+}
+
+} // namespace stbi
+} // namespace vk_utils
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "memory/DataFeeder.h"
+#include "statefultask/AIStatefulTask.h"
+#include "threadsafe/aithreadsafe.h"
+#include "utils/Badge.h"
+#include <boost/intrusive_ptr.hpp>
+#include <vulkan/vulkan.hpp>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include "debug.h"
+
+namespace task {
+class DecodeImages;
+} // namespace task
+
+namespace vk_utils {
+namespace stbi {
+
+class ImageDecoder;
+
+// The handle returned by ImageDecoder::decode.
+//
+// The file is read and its header is parsed by the constructor, so that the extent
+// is known immediately (and the vulkan image can be created); the pixel data
+// becomes available once a DecodeImages task decoded it. Use is_ready to be
+// notified of that (or pass the handle to a DecodedImageFeeder).
+class DecodedImage
+{
+ public:
+  using priority_type = int;
+
+ private:
+  struct Waiter
+  {
+    boost::intrusive_ptr<AIStatefulTask> m_task;        // The task to signal once the image is decoded.
+    AIStatefulTask::condition_type m_condition;         // The condition to signal it with.
+  };
+
+  struct State
+  {
+    bool m_decoded = false;                             // Set when decoding finished (successful or not).
+    std::vector<Waiter> m_waiters;                      // Tasks waiting for m_decoded to become true.
+  };
+  using state_type = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  std::filesystem::path m_filename;                     // For diagnostics only.
+  priority_type m_priority;
+  std::vector<std::byte> m_file_data;                   // The encoded data; released after decoding.
+  vk::Extent2D m_extent;
+  int m_components{};                                   // The number of components in the file.
+  int m_texel_components{};                             // The number of components per texel of m_image_data (and that are uploaded).
+  uint32_t m_size;                                      // Size in bytes of the uploaded data.
+  std::byte* m_image_data{};                            // The decoded data, or nullptr if decoding failed.
+  std::atomic<bool> m_decoded{false};                   // A lock-free copy of State::m_decoded.
+  state_type m_state;
+
+ public:
+  DecodedImage(std::filesystem::path const& filename, int requested_components, priority_type priority);
+  ~DecodedImage();
+
+  // Called by DecodeImages.
+  void decode(utils::Badge<task::DecodeImages>);
+
+  // Return true if the image was decoded. Otherwise return false and signal task with condition once it is.
+  bool is_ready(AIStatefulTask* task, AIStatefulTask::condition_type condition);
+  void remove_waiter(AIStatefulTask* task);
+
+  // Accessors.
+  vk::Extent2D extent() const { return m_extent; }
+  int components() const { return m_components; }
+  int texel_components() const { return m_texel_components; }
+  uint32_t size() const { return m_size; }
+  priority_type priority() const { return m_priority; }
+  bool is_decoded() const { return m_decoded.load(std::memory_order::acquire); }
+
+  // Only call this after is_decoded() returned true. Returns nullptr if decoding failed.
+  // The data has texel_components() components per texel.
+  std::byte const* image_data() const { ASSERT(is_decoded()); return m_image_data; }
+};
+
+// A DataFeeder that waits for a DecodedImage.
+class DecodedImageFeeder final : public vulkan::DataFeeder
+{
+ private:
+  std::shared_ptr<DecodedImage> m_decoded_image;
+
+ public:
+  DecodedImageFeeder(std::shared_ptr<DecodedImage> decoded_image) : m_decoded_image(std::move(decoded_image)) { }
+
+  uint32_t chunk_size() const override { return m_decoded_image->size(); }
+  int chunk_count() const override { return 1; }
+  bool is_ready(AIStatefulTask* task, AIStatefulTask::condition_type condition) override { return m_decoded_image->is_ready(task, condition); }
+  void remove_waiter(AIStatefulTask* task) override { m_decoded_image->remove_waiter(task); }
+  int next_batch() override { return 1; }
+  void get_chunks(unsigned char* chunk_ptr) override;
+};
+
+// Decodes images on the low priority queue of the thread pool, using up to max_workers threads in parallel.
+//
+// Usage:
+//
+//   std::shared_ptr<vk_utils::stbi::DecodedImage> decoded_image =
+//       application().image_decoder().decode(path, 4, priority);       // Returns immediately.
+//   auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(..., decoded_image->extent(), ...);
+//   copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::stbi::DecodedImageFeeder>(std::move(decoded_image)));
+//   copy_data_to_image->run(...);                                       // Waits until the image is decoded.
+//
+// Images with a higher priority are decoded first; images with the same priority in the order that decode was called.
+// Images whose handle is destroyed before they were decoded are skipped.
+class ImageDecoder
+{
+ public:
+  using priority_type = DecodedImage::priority_type;
+
+ private:
+  struct Job
+  {
+    priority_type m_priority;
+    uint64_t m_sequence_number;
+    std::weak_ptr<DecodedImage> m_decoded_image;
+
+    bool operator<(Job const& other) const
+    {
+      // std::priority_queue pops the largest element first.
+      return m_priority < other.m_priority || (m_priority == other.m_priority && m_sequence_number > other.m_sequence_number);
+    }
+  };
+
+  struct Jobs
+  {
+    std::priority_queue<Job> m_queue;
+    uint64_t m_next_sequence_number{};
+    int m_running_workers{};                            // The number of DecodeImages tasks that are running.
+  };
+  using jobs_type = aithreadsafe::Wrapper<Jobs, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  jobs_type m_jobs;
+  int m_max_workers{};                                  // Zero means: half the number of threads in the thread pool.
+
+ public:
+  // Set the maximum number of images that are decoded in parallel.
+  void set_max_workers(int max_workers) { m_max_workers = max_workers; }
+
+  // Read the file filename and schedule decoding of its contents. Throws if the file can't be read or isn't a supported image.
+  std::shared_ptr<DecodedImage> decode(std::filesystem::path const& filename, int requested_components, priority_type priority = 0);
+
+  // Called by DecodeImages. Returns the next image to decode, or nullptr (after which the worker must finish).
+  std::shared_ptr<DecodedImage> next_job(utils::Badge<task::DecodeImages>);
+};
+
+} // namespace stbi
+} // namespace vk_utils
@@ -0,0 +1,141 @@
+#include "sys.h"
+#include "KTX2Data.h"
+#include "BCnDecoder.h"
+#include "get_binary_file_contents.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <Tracy.hpp>
+
+namespace vk_utils {
+namespace ktx2 {
+
+namespace {
+
+constexpr std::array<unsigned char, 12> identifier = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+constexpr size_t header_size = 80;      // Identifier, 9 uint32_t's, four uint32_t's and two uint64_t's.
+constexpr size_t level_index_entry_size = 24;
+
+template<typename T>
+T read(std::vector<std::byte> const& data, size_t offset)
+{
+  T value;
+  std::memcpy(&value, data.data() + offset, sizeof(T));
+  return value;
+}
+
+} // namespace
+
+// Load a KTX2 texture from a specified file.
+KTX2Data::KTX2Data(std::filesystem::path const& filename)
+{
+  DoutEntering(dc::vulkan, "KTX2Data::KTX2Data(" << filename << ")");
+
+  m_file_data = get_binary_file_contents(filename);
+  if (m_file_data.size() < header_size || std::memcmp(m_file_data.data(), identifier.data(), identifier.size()) != 0)
+    THROW_ALERT("File \"[FILENAME]\" is not a KTX2 file", AIArgs("[FILENAME]", filename));
+
+  // KTX2 is little endian.
+  m_format = static_cast<vk::Format>(read<uint32_t>(m_file_data, 12));
+  uint32_t const pixel_width = read<uint32_t>(m_file_data, 20);
+  uint32_t const pixel_height = read<uint32_t>(m_file_data, 24);
+  uint32_t const pixel_depth = read<uint32_t>(m_file_data, 28);
+  uint32_t const layer_count = read<uint32_t>(m_file_data, 32);
+  uint32_t const face_count = read<uint32_t>(m_file_data, 36);
+  uint32_t const level_count = std::max(read<uint32_t>(m_file_data, 40), 1u);
+  uint32_t const supercompression_scheme = read<uint32_t>(m_file_data, 44);
+
+  if (!bcn::is_supported(m_format))
+    THROW_ALERT("KTX2 file \"[FILENAME]\" has unsupported format [FORMAT] (only BC1, BC3 and BC7 are supported)",
+        AIArgs("[FILENAME]", filename)("[FORMAT]", to_string(m_format)));
+  if (pixel_width == 0 || pixel_height == 0 || pixel_depth != 0 || layer_count != 0 || face_count != 1 || supercompression_scheme != 0)
+    THROW_ALERT("KTX2 file \"[FILENAME]\" is not a plain 2D texture", AIArgs("[FILENAME]", filename));
+  m_extent = vk::Extent2D{ pixel_width, pixel_height };
+  if (level_count > 32 || ((m_extent.width >> (level_count - 1)) == 0 && (m_extent.height >> (level_count - 1)) == 0))
+    THROW_ALERT("KTX2 file \"[FILENAME]\" has too many levels ([LEVELS])", AIArgs("[FILENAME]", filename)("[LEVELS]", level_count));
+
+  if (m_file_data.size() < header_size + level_count * level_index_entry_size)
+    THROW_ALERT("KTX2 file \"[FILENAME]\" is truncated", AIArgs("[FILENAME]", filename));
+  uint32_t const block_size = bcn::block_size(m_format);
+  for (uint32_t level = 0; level < level_count; ++level)
+  {
+    size_t const entry = header_size + level * level_index_entry_size;
+    uint64_t const byte_offset = read<uint64_t>(m_file_data, entry);
+    uint64_t const byte_length = read<uint64_t>(m_file_data, entry + 8);
+    vk::Extent2D const extent = level_extent(level);
+    uint64_t const expected_length = uint64_t{(extent.width + 3) / 4} * ((extent.height + 3) / 4) * block_size;
+    if (byte_length != expected_length || byte_offset > m_file_data.size() || byte_length > m_file_data.size() - byte_offset)
+      THROW_ALERT("KTX2 file \"[FILENAME]\" has invalid level [LEVEL]", AIArgs("[FILENAME]", filename)("[LEVEL]", level));
+    m_levels.push_back({ static_cast<size_t>(byte_offset), static_cast<size_t>(byte_length) });
+  }
+}
+
+size_t KTX2Data::size(bool decoded) const
+{
+  size_t size = 0;
+  for (uint32_t level = 0; level < mip_levels(); ++level)
+  {
+    vk::Extent2D const extent = level_extent(level);
+    size += decoded ? size_t{extent.width} * extent.height * 4 : m_levels[level].m_size;
+  }
+  return size;
+}
+
+KTX2DataFeeder::KTX2DataFeeder(KTX2Data&& data, bool decode) :
+  m_data(std::move(data)), m_decode(decode), m_max_batch_size(std::numeric_limits<int>::max())
+{
+  // chunk_count() must fit in an int.
+  ASSERT(m_data.size(m_decode) / chunk_size() <= static_cast<size_t>(std::numeric_limits<int>::max()));
+}
+
+uint32_t KTX2DataFeeder::chunk_size() const
+{
+  return m_decode ? 4 : bcn::block_size(m_data.format());
+}
+
+int KTX2DataFeeder::level_chunks(uint32_t level) const
+{
+  vk::Extent2D const extent = m_data.level_extent(level);
+  if (m_decode)
+    return extent.width * extent.height;
+  return ((extent.width + 3) / 4) * ((extent.height + 3) / 4);
+}
+
+int KTX2DataFeeder::chunk_count() const
+{
+  int chunks = 0;
+  for (uint32_t level = 0; level < m_data.mip_levels(); ++level)
+    chunks += level_chunks(level);
+  return chunks;
+}
+
+int KTX2DataFeeder::next_batch()
+{
+  // Batches don't cross level boundaries.
+  if (m_level_chunk == level_chunks(m_level))
+  {
+    ++m_level;
+    m_level_chunk = 0;
+  }
+  if (m_decode && m_level_chunk == 0)
+  {
+    ZoneScopedN("KTX2DataFeeder decode");
+    vk::Extent2D const extent = m_data.level_extent(m_level);
+    m_decoded_level.resize(size_t{extent.width} * extent.height * 4);
+    bcn::decode_level(m_data.format(), m_data.level_data(m_level), extent, m_decoded_level.data());
+  }
+  m_batch_size = std::min(m_max_batch_size, level_chunks(m_level) - m_level_chunk);
+  return m_batch_size;
+}
+
+void KTX2DataFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  unsigned char const* level_data = m_decode ? m_decoded_level.data() : m_data.level_data(m_level);
+  std::memcpy(chunk_ptr, level_data + static_cast<size_t>(m_level_chunk) * chunk_size(), static_cast<size_t>(m_batch_size) * chunk_size());
+  m_level_chunk += m_batch_size;
+}
+
+} // namespace ktx2
+} // namespace vk_utils
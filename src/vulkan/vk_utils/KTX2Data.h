@@ -0,0 +1,77 @@
+#pragma once
+
+#include "memory/DataFeeder.h"
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <filesystem>
+#include <cstddef>
+#include <algorithm>
+#include "debug.h"
+
+namespace vk_utils {
+namespace ktx2 {
+
+// A KTX2 texture with pre-compressed BC1, BC3 or BC7 data (and any number of mip levels).
+//
+// Only 2D textures without array layers, cube faces or supercompression are supported.
+//
+class KTX2Data
+{
+ public:
+  struct Level
+  {
+    size_t m_offset;                    // The offset of the data of this level into the file.
+    size_t m_size;                      // The size of the data of this level in bytes.
+  };
+
+ private:
+  std::vector<std::byte> m_file_data;
+  vk::Format m_format;
+  vk::Extent2D m_extent;
+  std::vector<Level> m_levels;          // Level 0 first.
+
+ public:
+  KTX2Data(std::filesystem::path const& filename);
+
+  // Accessors.
+  vk::Format format() const { return m_format; }
+  vk::Extent2D extent() const { return m_extent; }
+  uint32_t mip_levels() const { return m_levels.size(); }
+  unsigned char const* level_data(uint32_t level) const { return reinterpret_cast<unsigned char const*>(m_file_data.data()) + m_levels[level].m_offset; }
+  vk::Extent2D level_extent(uint32_t level) const { return { std::max(m_extent.width >> level, 1u), std::max(m_extent.height >> level, 1u) }; }
+
+  // The size of the data of all levels, with or without decoding them to RGBA8.
+  size_t size(bool decoded) const;
+};
+
+// Feeds all mip levels of a KTX2Data, level 0 first; either as-is, or decoded to RGBA8 (see bcn::decoded_format) for
+// devices that can't sample the block compressed format (see LogicalDevice::supports_sampled_image_format).
+//
+// The chunk size is the size of one block, or one texel when decoding. Decoding is done one level at a time.
+//
+class KTX2DataFeeder final : public vulkan::DataFeeder
+{
+ private:
+  KTX2Data m_data;
+  bool m_decode;                        // Set if the blocks must be decoded.
+  std::vector<unsigned char> m_decoded_level;   // The decoded data of m_level (only used when m_decode is set).
+  int m_max_batch_size;                 // The maximum number of chunks per batch.
+  uint32_t m_level{};                   // The level that the next batch starts in.
+  int m_level_chunk{};                  // The first chunk of the next batch, relative to the start of m_level.
+  int m_batch_size{};                   // The number of chunks of the current batch.
+
+ public:
+  KTX2DataFeeder(KTX2Data&& data, bool decode);
+
+  uint32_t chunk_size() const override;
+  int chunk_count() const override;
+  void set_max_batch_size(int max_chunks) override { m_max_batch_size = max_chunks; }
+  int next_batch() override;
+  void get_chunks(unsigned char* chunk_ptr) override;
+
+ private:
+  int level_chunks(uint32_t level) const;
+};
+
+} // namespace ktx2
+} // namespace vk_utils
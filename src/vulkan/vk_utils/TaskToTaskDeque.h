@@ -7,6 +7,8 @@
 #include "utils/DequeAllocator.h"
 #include <deque>
 #include <algorithm>
+#include <atomic>
+#include <new>
 
 namespace vk_utils {
 
@@ -22,12 +24,18 @@ namespace vk_utils {
 // See MoveNewPipelines for an example implementation.
 //
 // This class uses AIMemoryPagePool and therefore uses Application::m_mpp.
-// It also uses utils::DequeAllocator which relies on Application::m_dmri.
+// It also uses utils::DequeAllocator which relies on Application::m_dmri,
+// and allocates the nodes passed to have_new_datum from Application::m_deque512_nmr.
 //
 // The producer task can add more `Datum` objects by passing rvalue-references to `have_new_datum`.
 // After the last call to `have_new_datum` it should call `set_producer_finished` (this can be
 // done immediately after that last call).
 //
+// No mutex is used: `have_new_datum` pushes onto a lock-free singly linked list (multiple producers),
+// and the consumer takes the whole list at once with a single atomic exchange, after which it
+// processes the batch without any locking. The deque (used by front_n/pop_front_n) is only
+// accessed by the consumer.
+//
 // Each time one of these functions is called, the signal `need_action`
 // is emitted. The consumer task therefore must already have been running,
 // or not wait for that signal before entering the `*_need_action` state
@@ -52,30 +60,78 @@ class TaskToTaskDeque : public BASE
   using direct_base_type = TaskToTaskDeque<BASE, DATUM>;                // Not ours, but that of the derived class.
   using deque_allocator_type = utils::DequeAllocator<DATUM>;
   using container_type = std::deque<DATUM, deque_allocator_type>;
-  using new_data_type = aithreadsafe::Wrapper<container_type, aithreadsafe::policy::Primitive<std::mutex>>;
 
  private:
+  struct NewDatum
+  {
+    NewDatum* m_next;                           // The datum that was added before this one.
+    DATUM m_datum;
+  };
+  // Nodes are allocated from Application::m_deque512_nmr (see have_new_datum).
+  static void destroy(NewDatum* new_datum)
+  {
+    new_datum->~NewDatum();
+    vulkan::Application::instance().deque512_nmr().deallocate(new_datum);
+  }
+
   utils::DequeAllocator<DATUM> m_datum_allocator{vulkan::Application::instance().deque512_nmr()};
-  new_data_type m_new_data{m_datum_allocator};
+  std::atomic<NewDatum*> m_new_data{nullptr};   // Data passed to have_new_datum, most recent first.
+  container_type m_data{m_datum_allocator};     // Data taken from m_new_data by front_n (only accessed by the consumer).
   std::atomic_bool m_producer_finished = false;
 
+  // Take all data from m_new_data, in the order in which they were added (oldest first).
+  NewDatum* take_new_data()
+  {
+    if (m_new_data.load(std::memory_order::relaxed) == nullptr)
+      return nullptr;
+    NewDatum* new_datum = m_new_data.exchange(nullptr, std::memory_order::acquire);
+    // Reverse the list.
+    NewDatum* oldest_first = nullptr;
+    while (new_datum)
+    {
+      NewDatum* next = new_datum->m_next;
+      new_datum->m_next = oldest_first;
+      oldest_first = new_datum;
+      new_datum = next;
+    }
+    return oldest_first;
+  }
+
  protected:
   using BASE::BASE;
 
+  ~TaskToTaskDeque() override
+  {
+    NewDatum* new_datum = m_new_data.load(std::memory_order::relaxed);
+    while (new_datum)
+    {
+      NewDatum* next = new_datum->m_next;
+      destroy(new_datum);
+      new_datum = next;
+    }
+  }
+
   // Called by consumer (derived task).
   void flush_new_data(std::function<void(Datum&&)> lambda)
   {
-    for (;;)
+    // First the data that was already moved to the deque by front_n, if any.
+    while (!m_data.empty())
+    {
+      Datum datum = std::move(m_data.front());
+      m_data.pop_front();
+      lambda(std::move(datum));
+    }
+    // Then everything that was added, including what is added while we're processing.
+    while (NewDatum* new_datum = take_new_data())
     {
-      Datum datum;
+      do
       {
-        typename new_data_type::wat new_data_w(m_new_data);
-        if (new_data_w->empty())
-          break;
-        datum = std::move(new_data_w->front());
-        new_data_w->pop_front();
+        NewDatum* next = new_datum->m_next;
+        lambda(std::move(new_datum->m_datum));
+        destroy(new_datum);
+        new_datum = next;
       }
-      lambda(std::move(datum));
+      while (new_datum);
     }
   }
 
@@ -88,36 +144,37 @@ class TaskToTaskDeque : public BASE
     return !producer_finished;
   }
 
-  // Return begin() and decrease n to the number of elements that are in the deque,
-  // if that is less than the requested n.
-  typename container_type::const_iterator front_n(int& n) const
+  // Append all new data to the deque, then return begin() and decrease n to the number of
+  // elements that are in the deque, if that is less than the requested n.
+  //
+  // Only front_n adds elements to the deque, so iterators into it remain valid until the next
+  // call to front_n.
+  typename container_type::const_iterator front_n(int& n)
   {
-    typename new_data_type::crat new_data_r(m_new_data);
-    n = std::min((size_t)n, new_data_r->size());
-    return new_data_r->begin();
+    for (NewDatum* new_datum = take_new_data(); new_datum;)
+    {
+      NewDatum* next = new_datum->m_next;
+      m_data.push_back(std::move(new_datum->m_datum));
+      destroy(new_datum);
+      new_datum = next;
+    }
+    n = std::min((size_t)n, m_data.size());
+    return m_data.begin();
   }
 
   // Erase all elements up till and including last, which must be the iterator
   // returned by front_n incremented n - 1 times.
   //
-  // No other threads may have called pop_front_n in the meantime; in other
-  // words the pair front_n/pop_front_n is single-threaded.
-  //
-  // Note that it is not possible to have the caller pass last + 1, because
-  // the deque is not locked at the moment of the call and other threads
-  // are allowed to call have_new_datum that will call push_back which
-  // invalidates the end iterator; and last + 1 CAN be one past the end.
+  // The pair front_n/pop_front_n must be called by the consumer only.
   void pop_front_n(typename container_type::const_iterator last)
   {
-    typename new_data_type::wat new_data_w(m_new_data);
-    new_data_w->erase(new_data_w->begin(), ++last);
+    m_data.erase(m_data.begin(), ++last);
   }
 
   // Erase the first element.
   void pop_front()
   {
-    typename new_data_type::wat new_data_w(m_new_data);
-    new_data_w->pop_front();
+    m_data.pop_front();
   }
 
  public:
@@ -139,7 +196,13 @@ class TaskToTaskDeque : public BASE
 template<task::TaskType BASE, typename DATUM>
 void TaskToTaskDeque<BASE, DATUM>::have_new_datum(DATUM&& datum)
 {
-  typename new_data_type::wat(m_new_data)->push_back(std::move(datum));
+  static_assert(sizeof(NewDatum) <= 512, "NewDatum does not fit in a block of deque512_nmr.");
+  void* block = vulkan::Application::instance().deque512_nmr().allocate(sizeof(NewDatum));
+  NewDatum* new_datum = new (block) NewDatum{nullptr, std::move(datum)};
+  NewDatum* head = m_new_data.load(std::memory_order::relaxed);
+  do
+    new_datum->m_next = head;
+  while (!m_new_data.compare_exchange_weak(head, new_datum, std::memory_order::release, std::memory_order::relaxed));
   BASE::signal(need_action);
 }
 